@@ -35,6 +35,7 @@ Anchor::Anchor(const string& name, int x, int y)
       move_animation_in_progress_(false),
       move_animation_timeout_id_(0) {
   CHECK(titlebar_);
+  titlebar_->SetTitlebarRole(this);
   SetName(name);
   DrawTitlebar();
   Move(x, y);
@@ -46,6 +47,8 @@ Anchor::~Anchor() {
   if (move_animation_in_progress_) {
     XServer::Get()->CancelTimeout(move_animation_timeout_id_);
   }
+  DrawingEngine::Get()->ForgetTitlebar(titlebar_);
+  titlebar_->ClearRole();
   titlebar_->Destroy();
   desktop_ = NULL;
   active_window_ = NULL;
@@ -132,6 +135,17 @@ void Anchor::Move(int x, int y) {
 
 
 void Anchor::AnimateMove(int x, int y) {
+  // Each step of the animation would reach the screen a round trip late,
+  // so just jump there when the server is far away.
+  if (XServer::Get()->high_latency()) {
+    if (move_animation_in_progress_) {
+      XServer::Get()->CancelTimeout(move_animation_timeout_id_);
+      move_animation_in_progress_ = false;
+    }
+    Move(x, y);
+    return;
+  }
+
   ConstrainCoordinates(&x, &y);
   target_x_ = x;
   target_y_ = y;
@@ -208,7 +222,7 @@ bool Anchor::SetActiveWindow(uint index) {
     UpdateWindowPosition(active_window_);
     active_window_->MakeSibling(*titlebar_);
     active_window_->Map();
-    active_window_->TakeFocus();
+    if (active_) active_window_->TakeFocus();
   }
 
   DrawTitlebar();
@@ -241,6 +255,11 @@ void Anchor::DrawTitlebar() {
 }
 
 
+void Anchor::HandleTitlebarResized() {
+  MoveInternal(x_, y_);
+}
+
+
 int Anchor::GetWindowIndexAtTitlebarPoint(int abs_x) {
   if (windows_.empty()) return -1;
   if (abs_x < titlebar_->x()) {
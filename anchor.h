@@ -73,6 +73,7 @@ class Anchor {
 
   // Animate the anchor smoothly moving to a new position.
   // The anchor will be constrained within the root window's dimensions.
+  // In high-latency mode, it's just moved there.
   void AnimateMove(int x, int y);
 
   // Move the anchor in the specified direction.
@@ -101,6 +102,11 @@ class Anchor {
   // Instruct the drawing engine to draw the titlebar.
   void DrawTitlebar();
 
+  // Reposition the titlebar and active window after the drawing engine
+  // changes the titlebar's size.  Only needed when titlebars are drawn
+  // asynchronously; see DrawingEngine::DrawAnchor().
+  void HandleTitlebarResized();
+
   // Get the index number of the window represented in the titlebar at the
   // given absolute (that is, not relative to the titlebar's position) X
   // value.  Constrains too-small or -large values, and returns -1 if no
@@ -210,7 +216,7 @@ class Anchor {
 
   MoveTimeoutFunction move_animation_;
   bool move_animation_in_progress_;
-  int move_animation_timeout_id_;
+  TimeoutId move_animation_timeout_id_;
 
   DISALLOW_EVIL_CONSTRUCTORS(Anchor);
 };
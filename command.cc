@@ -16,6 +16,7 @@ const Command::Info Command::info_[] = {
   { "cycle_desktop",             CYCLE_DESKTOP,             BOOL_ARG },
   { "cycle_window",              CYCLE_WINDOW,              BOOL_ARG },
   { "cycle_window_config",       CYCLE_WINDOW_CONFIG,       BOOL_ARG },
+  { "display_stats",             DISPLAY_STATS,             NO_ARG },
   { "display_window_props",      DISPLAY_WINDOW_PROPS,      NO_ARG },
   { "exec",                      EXEC,                      STRING_ARG },
   { "set_attach_anchor",         SET_ATTACH_ANCHOR,         NO_ARG },
@@ -27,6 +27,7 @@ class Command {
     CYCLE_DESKTOP,
     CYCLE_WINDOW,
     CYCLE_WINDOW_CONFIG,
+    DISPLAY_STATS,
     DISPLAY_WINDOW_PROPS,
     EXEC,
     SET_ATTACH_ANCHOR,
@@ -20,7 +20,20 @@ Config::Config()
       window_border(2),
       mouse_primary_button(1),
       mouse_secondary_button(3),
-      keybinding_abort_key("Escape") {}
+      keybinding_abort_key("Escape"),
+      timer_slack_ms(1),
+      event_budget_ms(4),
+      deferred_event_slice_ms(2),
+      idle_task_slice_ms(2),
+      use_event_ingestion_thread(false),
+      use_property_worker(true),
+      num_pool_threads(0),
+      use_render_thread(false),
+      latency_ping_interval_ms(1000),
+      high_latency_threshold_ms(25),
+      low_latency_threshold_ms(10),
+      high_latency_deferred_event_slice_ms(10),
+      high_latency_timer_slack_ms(10) {}
 
 
 Config::~Config() {}
@@ -47,6 +47,55 @@ struct Config {
 
   string keybinding_abort_key;
 
+  // How long timeouts may be delayed so that ones with nearby deadlines
+  // can be run in the same wakeup.
+  uint timer_slack_ms;
+
+  // How long handling a single X event may take before we log about it.
+  uint event_budget_ms;
+
+  // How long we spend handling deferrable events (redraws and property
+  // changes) before checking whether any input has arrived.
+  uint deferred_event_slice_ms;
+
+  // How long idle tasks may run before we check for events again.
+  uint idle_task_slice_ms;
+
+  // Read X events on a separate thread, so that the connection keeps
+  // being drained while we're handling them.
+  bool use_event_ingestion_thread;
+
+  // Fetch changed properties and classify windows on a separate thread
+  // with its own X connection.  If the thread can't be started, this is
+  // done on the main thread instead.
+  bool use_property_worker;
+
+  // Number of threads used for CPU-heavy work (see ThreadPool).  If 0
+  // (the default, since nothing submits work to the pool yet), the pool
+  // isn't started.
+  uint num_pool_threads;
+
+  // Draw titlebars on a separate thread with its own X connection.
+  bool use_render_thread;
+
+  // How often we ping the X server to measure the round-trip time.  If
+  // 0, the RTT isn't measured and we never switch to high-latency mode.
+  uint latency_ping_interval_ms;
+
+  // Smoothed RTTs at which we switch to and from high-latency mode, in
+  // which we avoid round trips and redundant drawing at the cost of some
+  // polish: anchors jump instead of sliding, titlebars are drawn into
+  // pixmaps that the server repaints on its own, events are handled in
+  // longer slices, and properties that we don't display are fetched when
+  // we're idle.
+  uint high_latency_threshold_ms;
+  uint low_latency_threshold_ms;
+
+  // Replacements for 'deferred_event_slice_ms' and 'timer_slack_ms' in
+  // high-latency mode.
+  uint high_latency_deferred_event_slice_ms;
+  uint high_latency_timer_slack_ms;
+
   DISALLOW_EVIL_CONSTRUCTORS(Config);
 
  private:
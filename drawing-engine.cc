@@ -3,8 +3,6 @@
 
 #include "drawing-engine.h"
 
-#include <cmath>
-
 #include "anchor.h"
 #include "config.h"
 #include "window.h"
@@ -91,16 +89,12 @@ const DrawingEngine::Style::ColorsDef
 
 bool DrawingEngine::Style::initialized_ = false;
 
-// A string that hopefully measures the full ascent and descent for a given
-// font.
-static const string kFullHeightString = "X[yj|";
-
-
 DrawingEngine::DrawingEngine()
     : initialized_(false),
       gc_(0),
       gc_font_(NULL),
-      style_(new Style) {
+      style_(new Style),
+      render_results_func_(this) {
 }
 
 
@@ -111,129 +105,89 @@ void DrawingEngine::DrawAnchor(const Anchor& anchor, XWindow* titlebar) {
   }
 
   InitIfNeeded();
-  ::Window win = titlebar->id();
-
-  uint width = 0, height = 0;
+  titlebar->SetBorder(0);
+  TitlebarRender render;
+  DescribeAnchor(anchor, titlebar, &render);
+
+  // Drawing into a pixmap lets the server handle exposures without
+  // waiting on us, so when round trips are slow we only draw titlebars
+  // that have actually changed.
+  bool use_pixmap = XServer::Get()->high_latency();
+  bool had_pixmap = false;
+  if (use_pixmap) {
+    map< ::Window, TitlebarRender>::iterator it =
+        pixmap_titlebars_.find(titlebar->id());
+    if (it != pixmap_titlebars_.end() && it->second == render) return;
+    pixmap_titlebars_[titlebar->id()] = render;
+  } else {
+    had_pixmap = pixmap_titlebars_.erase(titlebar->id()) > 0;
+  }
 
-  const Config* conf = Config::Get();
+  // The renderer always draws into pixmaps.
+  if (renderer_.get()) {
+    renderer_->Enqueue(new TitlebarRender(render));
+    return;
+  }
 
-  string anchor_name = anchor.attach() ? "[a] " : "";
-  anchor_name += "[" + anchor.name() + "]";
+  TitlebarLayout layout;
+  LayOutTitlebar(render, this, &layout);
+  titlebar->Resize(layout.width, layout.height);
 
-  // TODO: This is ugly.  It might be better to create some type of
-  // "variations" system, so that there aren't so many duplicated lines of
-  // code for active/inactive anchors and windows.
-  uint border = 0;
-  uint padding = 0;
-  uint spacing = 0;
-  uint awindow_border = 0;
-  uint awindow_padding = 0;
-  uint iwindow_border = 0;
-  uint iwindow_padding = 0;
-  const string* font = NULL;
-  const Style::Colors* anchor_colors = NULL;
-  const Style::Colors* awindow_colors = NULL;
-  const Style::Colors* iwindow_colors = NULL;
+  // FIXME: set all window's backgrounds on init
 
-  if (anchor.active()) {
-    border = u(Style::ACTIVE_ANCHOR__BORDER_WIDTH);
-    padding = u(Style::ACTIVE_ANCHOR__PADDING);
-    spacing = u(Style::ACTIVE_ANCHOR__WINDOW_SPACING);
-    awindow_border = u(Style::ACTIVE_ANCHOR__ACTIVE_WINDOW__BORDER_WIDTH);
-    awindow_padding = u(Style::ACTIVE_ANCHOR__ACTIVE_WINDOW__PADDING);
-    iwindow_border = u(Style::ACTIVE_ANCHOR__INACTIVE_WINDOW__BORDER_WIDTH);
-    iwindow_padding = u(Style::ACTIVE_ANCHOR__INACTIVE_WINDOW__PADDING);
-    font = &(s(Style::ACTIVE_ANCHOR__FONT));
-    anchor_colors = &(c(Style::ACTIVE_ANCHOR__COLOR));
-    awindow_colors = &(c(Style::ACTIVE_ANCHOR__ACTIVE_WINDOW__COLOR));
-    iwindow_colors = &(c(Style::ACTIVE_ANCHOR__INACTIVE_WINDOW__COLOR));
-  } else {
-    border = u(Style::INACTIVE_ANCHOR__BORDER_WIDTH);
-    padding = u(Style::INACTIVE_ANCHOR__PADDING);
-    spacing = u(Style::INACTIVE_ANCHOR__WINDOW_SPACING);
-    awindow_border = u(Style::INACTIVE_ANCHOR__ACTIVE_WINDOW__BORDER_WIDTH);
-    awindow_padding = u(Style::INACTIVE_ANCHOR__ACTIVE_WINDOW__PADDING);
-    iwindow_border = u(Style::INACTIVE_ANCHOR__INACTIVE_WINDOW__BORDER_WIDTH);
-    iwindow_padding = u(Style::INACTIVE_ANCHOR__INACTIVE_WINDOW__PADDING);
-    font = &(s(Style::INACTIVE_ANCHOR__FONT));
-    anchor_colors = &(c(Style::INACTIVE_ANCHOR__COLOR));
-    awindow_colors = &(c(Style::INACTIVE_ANCHOR__ACTIVE_WINDOW__COLOR));
-    iwindow_colors = &(c(Style::INACTIVE_ANCHOR__INACTIVE_WINDOW__COLOR));
+  ::Window win = titlebar->id();
+  if (had_pixmap) {
+    // Otherwise, the server would keep repainting the titlebar's old
+    // contents after exposures.
+    XSetWindowBackground(dpy(), win, GetPixel(render.colors.bg));
+    XClearWindow(dpy(), win);
+  }
+  Drawable drawable = win;
+  if (use_pixmap)
+    drawable = XCreatePixmap(dpy(), win, layout.width, layout.height,
+                             DefaultDepth(dpy(), scr()));
+  for (vector<TitlebarLayout::Box>::const_iterator box =
+         layout.boxes.begin(); box != layout.boxes.end(); ++box) {
+    DrawBorders(drawable, box->x, box->y, box->width, box->height,
+                *(box->colors), box->border_width);
+  }
+  for (vector<TitlebarLayout::Text>::const_iterator text =
+         layout.texts.begin(); text != layout.texts.end(); ++text) {
+    DrawText(drawable, text->x, text->y, text->text, render.font,
+             text->colors->fg);
   }
+  if (use_pixmap) {
+    XSetWindowBackgroundPixmap(dpy(), win, drawable);
+    XClearWindow(dpy(), win);
+    XFreePixmap(dpy(), drawable);
+  }
+}
 
-  int ascent = 0, descent = 0;
-  GetTextSize(*font, kFullHeightString, NULL, &ascent, &descent);
-  height = ascent + descent + 2 * padding + 2 * border +
-      2 * max(awindow_border, iwindow_border) +
-      2 * max(awindow_padding, iwindow_padding);
 
-  // Include the outer border and padding in the total width.
-  width = 2 * (border + padding);
-  const vector<Window*>& windows = anchor.windows();
-  if (windows.empty()) {
-    int name_width = 0;
-    GetTextSize(*font, anchor_name, &name_width, NULL, NULL);
-    width += name_width + 2 * (iwindow_padding + iwindow_border);
-  } else {
-    int max_title_width = 0;
-    for (vector<Window*>::const_iterator window = windows.begin();
-         window != windows.end(); ++window) {
-      int title_width = 0;
-      GetTextSize(*font, (*window)->title(), &title_width, NULL, NULL);
-      max_title_width = max(max_title_width, title_width);
-    }
-    width += max_title_width + 2 * (awindow_padding + awindow_border) +
-        (windows.size() - 1) *
-        (max_title_width + iwindow_border + iwindow_padding + spacing);
-  }
-  width = min(max(width, conf->anchor_min_width), conf->anchor_max_width);
+void DrawingEngine::ForgetTitlebar(XWindow* titlebar) {
+  CHECK(titlebar);
+  pixmap_titlebars_.erase(titlebar->id());
+  if (renderer_.get()) renderer_->Cancel(titlebar->id());
+}
 
-  titlebar->SetBorder(0);
-  titlebar->Resize(width, height);
-  DrawBorders(win, 0, 0, width, height, *anchor_colors, border);
 
-  // FIXME: set all window's backgrounds on init
+void DrawingEngine::HandleLatencyModeChange() {
+  if (XServer::Get()->high_latency() || renderer_.get()) return;
 
-  if (windows.empty()) {
-    DrawBorders(win, border + padding, border + padding,
-                width - 2 * (border + padding),
-                height - 2 * (border + padding),
-                *iwindow_colors, iwindow_border);
-    DrawText(win,
-             border + padding + iwindow_border + iwindow_padding,
-             border + padding + iwindow_border + iwindow_padding + ascent,
-             anchor_name, *font, iwindow_colors->fg);
-  } else {
-    uint width_for_titles =
-        width - 2 * (border + padding) - (windows.size() - 1) * spacing;
-    float title_width = static_cast<float>(width_for_titles) / windows.size();
-
-    int i = 0;
-    for (vector<Window*>::const_iterator window = windows.begin();
-         window != windows.end(); ++window, ++i) {
-      bool active = (anchor.active_window() == *window);
-      int x = border + padding +
-          static_cast<int>(roundf(i * (title_width + spacing)));
-      int y = border + padding;
-      int this_width = border + padding +
-          static_cast<int>(roundf(i * (title_width + spacing) + title_width)) -
-          x;
-      int this_height = height - 2 * (border + padding);
-
-      DrawBorders(win, x, y, this_width, this_height,
-                  active ? *awindow_colors : *iwindow_colors,
-                  active ? awindow_border : iwindow_border);
-
-      uint gap = active ?
-          awindow_border + awindow_padding :
-          iwindow_border + iwindow_padding;
-      string tags = (anchor.attach() && active) ? "a" : "";
-      tags += (*window)->tagged() ? "t" : "";
-      string title = tags.empty() ? "" : "[" + tags + "] ";
-      title += (*window)->title();
-      DrawText(win, x + gap, y + gap + ascent, title, *font,
-               active ? awindow_colors->fg : iwindow_colors->fg);
-    }
+  // Copy the IDs first, since DrawAnchor() removes them from the map.
+  vector< ::Window> ids;
+  for (map< ::Window, TitlebarRender>::const_iterator it =
+         pixmap_titlebars_.begin(); it != pixmap_titlebars_.end(); ++it) {
+    ids.push_back(it->first);
+  }
+  for (vector< ::Window>::const_iterator id = ids.begin();
+       id != ids.end(); ++id) {
+    XWindow* titlebar = XServer::Get()->GetWindow(*id, false);
+    Anchor* anchor = titlebar ? titlebar->titlebar_anchor() : NULL;
+    if (anchor)
+      DrawAnchor(*anchor, titlebar);
+    else
+      pixmap_titlebars_.erase(*id);
   }
 }
 
@@ -313,11 +267,113 @@ void DrawingEngine::InitIfNeeded() {
   if (!XServer::Testing()) {
     CHECK(XServer::Get()->Initialized());
     gc_ = XCreateGC(dpy(), root(), 0, NULL);
+
+    if (Config::Get()->use_render_thread) {
+      renderer_.reset(new TitlebarRenderer);
+      if (renderer_->Start(DisplayString(dpy()))) {
+        LOG << "Drawing titlebars on a separate thread";
+        XServer::Get()->WatchFd(renderer_->fd(), &render_results_func_);
+      } else {
+        renderer_.reset();
+      }
+    }
   }
   initialized_ = true;
 }
 
 
+void DrawingEngine::DescribeAnchor(const Anchor& anchor,
+                                   XWindow* titlebar,
+                                   TitlebarRender* render) {
+  CHECK(titlebar);
+  CHECK(render);
+  render->titlebar = titlebar->id();
+
+  // TODO: This is ugly.  It might be better to create some type of
+  // "variations" system, so that there aren't so many duplicated lines of
+  // code for active/inactive anchors and windows.
+  if (anchor.active()) {
+    render->border = u(Style::ACTIVE_ANCHOR__BORDER_WIDTH);
+    render->padding = u(Style::ACTIVE_ANCHOR__PADDING);
+    render->spacing = u(Style::ACTIVE_ANCHOR__WINDOW_SPACING);
+    render->active_title_border =
+        u(Style::ACTIVE_ANCHOR__ACTIVE_WINDOW__BORDER_WIDTH);
+    render->active_title_padding =
+        u(Style::ACTIVE_ANCHOR__ACTIVE_WINDOW__PADDING);
+    render->inactive_title_border =
+        u(Style::ACTIVE_ANCHOR__INACTIVE_WINDOW__BORDER_WIDTH);
+    render->inactive_title_padding =
+        u(Style::ACTIVE_ANCHOR__INACTIVE_WINDOW__PADDING);
+    render->font = s(Style::ACTIVE_ANCHOR__FONT);
+    render->colors = c(Style::ACTIVE_ANCHOR__COLOR);
+    render->active_title_colors = c(Style::ACTIVE_ANCHOR__ACTIVE_WINDOW__COLOR);
+    render->inactive_title_colors =
+        c(Style::ACTIVE_ANCHOR__INACTIVE_WINDOW__COLOR);
+  } else {
+    render->border = u(Style::INACTIVE_ANCHOR__BORDER_WIDTH);
+    render->padding = u(Style::INACTIVE_ANCHOR__PADDING);
+    render->spacing = u(Style::INACTIVE_ANCHOR__WINDOW_SPACING);
+    render->active_title_border =
+        u(Style::INACTIVE_ANCHOR__ACTIVE_WINDOW__BORDER_WIDTH);
+    render->active_title_padding =
+        u(Style::INACTIVE_ANCHOR__ACTIVE_WINDOW__PADDING);
+    render->inactive_title_border =
+        u(Style::INACTIVE_ANCHOR__INACTIVE_WINDOW__BORDER_WIDTH);
+    render->inactive_title_padding =
+        u(Style::INACTIVE_ANCHOR__INACTIVE_WINDOW__PADDING);
+    render->font = s(Style::INACTIVE_ANCHOR__FONT);
+    render->colors = c(Style::INACTIVE_ANCHOR__COLOR);
+    render->active_title_colors =
+        c(Style::INACTIVE_ANCHOR__ACTIVE_WINDOW__COLOR);
+    render->inactive_title_colors =
+        c(Style::INACTIVE_ANCHOR__INACTIVE_WINDOW__COLOR);
+  }
+
+  const Config* conf = Config::Get();
+  render->min_width = conf->anchor_min_width;
+  render->max_width = conf->anchor_max_width;
+
+  render->anchor_name = anchor.attach() ? "[a] " : "";
+  render->anchor_name += "[" + anchor.name() + "]";
+
+  const vector<Window*>& windows = anchor.windows();
+  for (vector<Window*>::const_iterator window = windows.begin();
+       window != windows.end(); ++window) {
+    bool active = (anchor.active_window() == *window);
+    string tags = (anchor.attach() && active) ? "a" : "";
+    tags += (*window)->tagged() ? "t" : "";
+    render->titles.push_back(
+        TitlebarRender::Title((*window)->title(), tags, active));
+  }
+}
+
+
+void DrawingEngine::HandleRenderResults() {
+  CHECK(renderer_.get());
+  renderer_->ClearWakeup();
+
+  XServer::RequestBatch request_batch(XServer::Get());
+  TitlebarRenderer::Result result;
+  while (renderer_->PopResult(&result)) {
+    // The anchor may have been destroyed in the meantime.
+    XWindow* titlebar = XServer::Get()->GetWindow(result.titlebar, false);
+    Anchor* anchor = titlebar ? titlebar->titlebar_anchor() : NULL;
+    if (!anchor) continue;
+    if (titlebar->width() == result.width &&
+        titlebar->height() == result.height) {
+      continue;
+    }
+    titlebar->Resize(result.width, result.height);
+    anchor->HandleTitlebarResized();
+  }
+}
+
+
+void DrawingEngine::RenderResultsFunction::operator()(int fd) {
+  engine_->HandleRenderResults();
+}
+
+
 void DrawingEngine::Clear(::Window win) {
   XClearWindow(dpy(), win);
 }
@@ -377,7 +433,7 @@ void DrawingEngine::DrawBorders(::Window win,
 }
 
 
-void DrawingEngine::ChangeColor(const string& name) {
+uint DrawingEngine::GetPixel(const string& name) {
   // FIXME: Is it safe to leave this at 0 if we fail to load the color?
   uint pixel = 0;
   map<string, uint>::const_iterator it = colors_.find(name);
@@ -398,9 +454,13 @@ void DrawingEngine::ChangeColor(const string& name) {
       pixel = color.pixel;
     }
   }
+  return pixel;
+}
+
 
+void DrawingEngine::ChangeColor(const string& name) {
   XGCValues gc_val;
-  gc_val.foreground = pixel;
+  gc_val.foreground = GetPixel(name);
   XChangeGC(XServer::Get()->display(), gc_, GCForeground, &gc_val);
 }
 
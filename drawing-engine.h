@@ -8,6 +8,8 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
+#include "event-loop.h"
+#include "titlebar-renderer.h"
 #include "util.h"
 
 using namespace std;
@@ -19,7 +21,7 @@ class Window;   // from window.h
 class XWindow;  // from x-window.h
 class XServer;  // from x-server.h
 
-class DrawingEngine {
+class DrawingEngine : public TextMeasurer {
  public:
   DrawingEngine();
 
@@ -34,9 +36,22 @@ class DrawingEngine {
     singleton_.swap(new_drawing_engine);
   }
 
-  // Draw an anchor's titlebar.
+  // Draw an anchor's titlebar.  If Config::use_render_thread is set,
+  // this just queues a description of the titlebar for a
+  // TitlebarRenderer, and the titlebar is resized once it's been drawn.
+  // In high-latency mode, titlebars are drawn into background pixmaps
+  // and aren't redrawn unless they've changed.
   void DrawAnchor(const Anchor& anchor, XWindow* titlebar);
 
+  // Drop any queued drawing for 'titlebar', which is about to be
+  // destroyed.
+  void ForgetTitlebar(XWindow* titlebar);
+
+  // Handle XServer switching into or out of high-latency mode.  When
+  // leaving it, titlebars that were drawn into background pixmaps are
+  // drawn directly again.
+  void HandleLatencyModeChange();
+
   void DrawWindowFrame(XWindow* frame);
 
   // TODO: For operations that could potentially redraw the same objects
@@ -48,7 +63,26 @@ class DrawingEngine {
   void StartBuffering();
   void Finalize();
 
+  // Get the size of the text 'text' when written in the font described by
+  // 'font'.  The text's width, ascent, and descent are stored at the
+  // passed-in pointers if non-NULL.
+  void GetTextSize(const string& font, const string& text,
+                   int* width, int* ascent, int* descent);
+
  private:
+  // Resizes titlebars once 'renderer_' has drawn them.
+  class RenderResultsFunction : public EventLoop::FdFunction {
+   public:
+    explicit RenderResultsFunction(DrawingEngine* engine) : engine_(engine) {
+      CHECK(engine_);
+    }
+
+    void operator()(int fd);
+
+   private:
+    DrawingEngine* engine_;
+  };
+
   class Style {
    public:
     Style();
@@ -87,26 +121,7 @@ class DrawingEngine {
       INACTIVE_WINDOW__FRAME_COLOR,
     };
 
-    struct Colors {
-      Colors(const string& bg,
-             const string& fg,
-             const string& top,
-             const string& left,
-             const string& bottom,
-             const string& right)
-          : bg(bg),
-            fg(fg),
-            top(top),
-            left(left),
-            bottom(bottom),
-            right(right) {}
-      string bg;
-      string fg;
-      string top;
-      string left;
-      string bottom;
-      string right;
-    };
+    typedef DrawingColors Colors;
 
     const string& GetString(Type type) const;
     uint GetUint(Type type) const;
@@ -159,6 +174,14 @@ class DrawingEngine {
   // after the XServer singleton has been initialized.
   void InitIfNeeded();
 
+  // Copy everything needed to draw 'anchor''s titlebar into 'render'.
+  void DescribeAnchor(const Anchor& anchor,
+                      XWindow* titlebar,
+                      TitlebarRender* render);
+
+  // Resize the titlebars that 'renderer_' has finished drawing.
+  void HandleRenderResults();
+
   void Clear(::Window win);
 
   // Draw text into a window.
@@ -194,18 +217,16 @@ class DrawingEngine {
                    const Style::Colors& colors,
                    uint border_width);
 
+  // Get the pixel value for the color named 'name', allocating it if
+  // necessary.
+  uint GetPixel(const string& name);
+
   // Change the color used by 'gc_'.
   void ChangeColor(const string& name);
 
   // Change the font used by 'gc_'.
   void ChangeFont(const string& name);
 
-  // Get the size of the text 'text' when written in the font described by
-  // 'font'.  The text's width, ascent, and descent are stored at the
-  // passed-in pointers if non-NULL.
-  void GetTextSize(const string& font, const string& text,
-                   int* width, int* ascent, int* descent);
-
   // Get the font described by the passed-in string, loading it if
   // necessary.
   XFontStruct* GetFontInfo(const string& name);
@@ -231,6 +252,16 @@ class DrawingEngine {
 
   ref_ptr<Style> style_;
 
+  // Draws titlebars on another thread if Config::use_render_thread is
+  // set.
+  ref_ptr<TitlebarRenderer> renderer_;
+  RenderResultsFunction render_results_func_;
+
+  // What was last drawn into each titlebar's background pixmap in
+  // high-latency mode, keyed by titlebar ID.  The server repaints these
+  // titlebars itself after they're exposed.
+  map< ::Window, TitlebarRender> pixmap_titlebars_;
+
   // Singleton object.
   static ref_ptr<DrawingEngine> singleton_;
 
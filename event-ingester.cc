@@ -0,0 +1,146 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "event-ingester.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace wham {
+
+EventIngester::EventIngester(xcb_connection_t* conn)
+    : conn_(conn),
+      ring_(kRingSize),
+      event_fd_(-1),
+      kick_fd_(-1) {
+  CHECK(conn_);
+  event_fd_ = eventfd(0, EFD_NONBLOCK);
+  CHECK(event_fd_ != -1);
+  kick_fd_ = eventfd(0, EFD_NONBLOCK);
+  CHECK(kick_fd_ != -1);
+}
+
+
+bool EventIngester::Start() {
+  int error = pthread_create(&thread_, NULL, RunThread, this);
+  if (error) {
+    ERROR << "Unable to start event ingestion thread: " << strerror(error);
+    return false;
+  }
+  pthread_detach(thread_);
+  return true;
+}
+
+
+void EventIngester::ClearWakeup() {
+  DrainEventFd(event_fd_);
+}
+
+
+void EventIngester::Kick() {
+  uint64_t count = 1;
+  if (write(kick_fd_, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    ERROR << "Unable to write to eventfd: " << strerror(errno);
+}
+
+
+void* EventIngester::RunThread(void* arg) {
+  static_cast<EventIngester*>(arg)->Run();
+  return NULL;
+}
+
+
+void EventIngester::Run() {
+  struct pollfd pfds[2];
+  pfds[0].fd = xcb_get_file_descriptor(conn_);
+  pfds[0].events = POLLIN;
+  pfds[1].fd = kick_fd_;
+  pfds[1].events = POLLIN;
+
+  vector<xcb_generic_event_t> burst;
+  bool got_data = false;
+  while (!xcb_connection_has_error(conn_)) {
+    // xcb_poll_for_event() reads everything that's available from the
+    // connection (replies included) before returning the first queued
+    // event, so the rest can be taken from the queue.  Grab all of them
+    // so that the main thread only gets woken once.
+    burst.clear();
+    xcb_generic_event_t* event = xcb_poll_for_event(conn_);
+    while (event) {
+      burst.push_back(*event);
+      free(event);
+      event = xcb_poll_for_queued_event(conn_);
+    }
+    CoalesceMotion(&burst);
+    for (size_t i = 0; i < burst.size(); ++i) Push(burst[i]);
+
+    // The main thread needs to hear about replies too, since it may be
+    // waiting to run functions that were passed to XServer::AwaitReply().
+    if (!burst.empty() || got_data) Wake();
+
+    pfds[0].revents = pfds[1].revents = 0;
+    if (poll(pfds, 2, -1) == -1) {
+      if (errno == EINTR) continue;
+      ERROR << "poll() failed: " << strerror(errno);
+      break;
+    }
+    got_data = pfds[0].revents != 0;
+    if (pfds[1].revents) DrainEventFd(kick_fd_);
+  }
+
+  // The main thread will notice the connection error when it wakes up.
+  Wake();
+}
+
+
+void EventIngester::CoalesceMotion(vector<xcb_generic_event_t>* burst) {
+  CHECK(burst);
+  size_t num_kept = 0;
+  for (size_t i = 0; i < burst->size(); ++i) {
+    const xcb_generic_event_t& event = (*burst)[i];
+    if (i + 1 < burst->size() &&
+        (event.response_type & ~0x80) == XCB_MOTION_NOTIFY &&
+        ((*burst)[i + 1].response_type & ~0x80) == XCB_MOTION_NOTIFY &&
+        reinterpret_cast<const xcb_motion_notify_event_t&>(event).event ==
+        reinterpret_cast<const xcb_motion_notify_event_t&>(
+            (*burst)[i + 1]).event) {
+      continue;
+    }
+    if (num_kept != i) (*burst)[num_kept] = event;
+    num_kept++;
+  }
+  burst->resize(num_kept);
+}
+
+
+void EventIngester::Push(const xcb_generic_event_t& event) {
+  while (!ring_.Push(event)) {
+    // Make sure that the main thread knows that there's something to read
+    // and give it a chance to catch up.
+    Wake();
+    usleep(100);
+  }
+}
+
+
+void EventIngester::Wake() {
+  uint64_t count = 1;
+  if (write(event_fd_, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    ERROR << "Unable to write to eventfd: " << strerror(errno);
+}
+
+
+void EventIngester::DrainEventFd(int fd) {
+  uint64_t count = 0;
+  if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    ERROR << "Unable to read from eventfd: " << strerror(errno);
+}
+
+}  // namespace wham
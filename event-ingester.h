@@ -0,0 +1,105 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __EVENT_INGESTER_H__
+#define __EVENT_INGESTER_H__
+
+#include <vector>
+
+#include <pthread.h>
+
+extern "C" {
+#include <xcb/xcb.h>
+}
+
+#include "ring-buffer.h"
+#include "util.h"
+
+using namespace std;
+
+namespace wham {
+
+// Reads events from the X connection on a separate thread and hands them
+// to the main thread through a RingBuffer, so that the connection keeps
+// getting drained while a slow handler is running.  An eventfd becomes
+// readable whenever new events are available.
+//
+// The thread shares the main thread's XCB connection (XCB is thread-safe),
+// since events need to carry our requests' sequence numbers and the
+// redirects and grabs that we've set up only apply to our connection.  It
+// only copies raw events; decoding them needs Xlib's keyboard mapping,
+// which isn't thread-safe, so that's left to the main thread.  The only
+// coalescing done here is dropping runs of MotionNotify events for the
+// same window.
+//
+// The thread waits for the connection's fd to become readable itself
+// instead of blocking in xcb_wait_for_event(), so that the main thread
+// also gets woken when only replies arrive.  When the main thread blocks
+// waiting for a reply, XCB may read events into its queue without the fd
+// becoming readable for us, so the main thread should call Kick() before
+// it goes to sleep.
+//
+// Once started, the thread runs until the connection is closed and the
+// object must not be destroyed.
+class EventIngester {
+ public:
+  explicit EventIngester(xcb_connection_t* conn);
+
+  // Start the thread.  Returns false on failure.
+  bool Start();
+
+  // File descriptor that becomes readable when events are available.
+  int fd() const { return event_fd_; }
+
+  // Make fd() unreadable until more events are pushed.  Should be called
+  // by the main thread before it pops events.
+  void ClearWakeup();
+
+  // Make the thread check XCB's event queue even if nothing new has
+  // arrived on the connection.
+  void Kick();
+
+  // Copy the oldest event into 'event'.  Returns false if there aren't
+  // any.
+  bool Pop(xcb_generic_event_t* event) { return ring_.Pop(event); }
+
+ private:
+  // Number of events that fit in the ring.
+  static const size_t kRingSize = 4096;
+
+  static void* RunThread(void* arg);
+
+  // Read events until the connection is closed.
+  void Run();
+
+  // Drop MotionNotify events that are immediately followed by another
+  // MotionNotify for the same window from 'burst'.
+  static void CoalesceMotion(vector<xcb_generic_event_t>* burst);
+
+  // Push 'event' into the ring, waiting for the main thread to make room
+  // if it's full.
+  void Push(const xcb_generic_event_t& event);
+
+  // Make fd() readable.
+  void Wake();
+
+  // Read from 'fd' until it's drained.
+  static void DrainEventFd(int fd);
+
+  xcb_connection_t* conn_;  // not owned
+
+  RingBuffer<xcb_generic_event_t> ring_;
+
+  int event_fd_;
+
+  // Written by Kick() and watched by the thread alongside the connection.
+  int kick_fd_;
+
+  pthread_t thread_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(EventIngester);
+};
+
+}  // namespace wham
+
+#endif
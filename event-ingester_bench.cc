@@ -0,0 +1,208 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+//
+// Compares event latency with and without a separate ingestion thread
+// when the handler occasionally stalls (e.g. while redrawing a titlebar
+// with a font that needs to be loaded).  A "server" thread writes small
+// timestamped events to a socket with a small buffer at a fixed rate.
+// The events are either read and handled by a single thread, or read by
+// an ingestion thread that passes them to the handler through a
+// RingBuffer and an eventfd, as EventIngester does.  For each mode, we
+// report how long events waited before being handled and how long the
+// server spent unable to write because the socket had backed up.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ring-buffer.h"
+#include "util.h"
+
+using namespace std;
+using namespace wham;
+
+// Number of events to send in each run.
+static const int kNumEvents = 20000;
+
+// Time between events sent by the server, in seconds.
+static const double kEventInterval = 0.00005;
+
+// The handler stalls for 'kStallSec' after every 'kStallEvery' events.
+static const int kStallEvery = 1000;
+static const double kStallSec = 0.010;
+
+// Socket buffer size, in bytes.  X servers don't buffer much output for
+// a client before they stop writing to it.
+static const int kSocketBufferSize = 4096;
+
+static const size_t kRingSize = 4096;
+
+
+// Same size as an X event.
+struct FakeEvent {
+  double sent_time;
+  char padding[24];
+};
+
+
+struct Run {
+  Run() : server_fd(-1), client_fd(-1), blocked_sec(0) {}
+  int server_fd;
+  int client_fd;
+  double blocked_sec;
+  vector<double> latencies;
+};
+
+
+static void* RunServer(void* arg) {
+  Run* run = static_cast<Run*>(arg);
+  double next_time = GetMonotonicTime();
+  for (int i = 0; i < kNumEvents; ++i) {
+    // Latency is measured from when the event was supposed to be sent,
+    // so that time spent waiting for the socket to drain is included.
+    while (GetMonotonicTime() < next_time) {}
+    FakeEvent event;
+    memset(&event, 0, sizeof(event));
+    event.sent_time = next_time;
+    next_time += kEventInterval;
+    size_t num_written = 0;
+    while (num_written < sizeof(event)) {
+      ssize_t result = write(run->server_fd,
+                             reinterpret_cast<char*>(&event) + num_written,
+                             sizeof(event) - num_written);
+      if (result > 0) {
+        num_written += result;
+        continue;
+      }
+      CHECK(errno == EAGAIN);
+      double start = GetMonotonicTime();
+      struct pollfd pfd = { run->server_fd, POLLOUT, 0 };
+      poll(&pfd, 1, -1);
+      run->blocked_sec += GetMonotonicTime() - start;
+    }
+  }
+  return NULL;
+}
+
+
+// Read a whole event from 'fd', which is blocking.
+static bool ReadEvent(int fd, FakeEvent* event) {
+  size_t num_read = 0;
+  while (num_read < sizeof(*event)) {
+    ssize_t result = read(fd, reinterpret_cast<char*>(event) + num_read,
+                          sizeof(*event) - num_read);
+    if (result <= 0) return false;
+    num_read += result;
+  }
+  return true;
+}
+
+
+static void HandleEvent(const FakeEvent& event, Run* run) {
+  run->latencies.push_back(GetMonotonicTime() - event.sent_time);
+  if (run->latencies.size() % kStallEvery == 0)
+    usleep(static_cast<useconds_t>(kStallSec * 1e6));
+}
+
+
+static void HandleInline(Run* run) {
+  FakeEvent event;
+  while (static_cast<int>(run->latencies.size()) < kNumEvents &&
+         ReadEvent(run->client_fd, &event)) {
+    HandleEvent(event, run);
+  }
+}
+
+
+struct IngestionState {
+  IngestionState(Run* run) : run(run), ring(kRingSize), event_fd(-1) {}
+  Run* run;
+  RingBuffer<FakeEvent> ring;
+  int event_fd;
+};
+
+
+static void* RunIngester(void* arg) {
+  IngestionState* state = static_cast<IngestionState*>(arg);
+  FakeEvent event;
+  while (ReadEvent(state->run->client_fd, &event)) {
+    while (!state->ring.Push(event)) usleep(100);
+    uint64_t count = 1;
+    CHECK(write(state->event_fd, &count, sizeof(count)) == sizeof(count));
+  }
+  return NULL;
+}
+
+
+static void HandleWithIngester(Run* run) {
+  IngestionState state(run);
+  state.event_fd = eventfd(0, 0);
+  CHECK(state.event_fd != -1);
+  pthread_t thread;
+  CHECK(pthread_create(&thread, NULL, RunIngester, &state) == 0);
+
+  while (static_cast<int>(run->latencies.size()) < kNumEvents) {
+    uint64_t count = 0;
+    CHECK(read(state.event_fd, &count, sizeof(count)) == sizeof(count));
+    FakeEvent event;
+    while (state.ring.Pop(&event)) HandleEvent(event, run);
+  }
+
+  // The ingester exits once the server's end of the socket is closed.
+  shutdown(run->client_fd, SHUT_RDWR);
+  CHECK(pthread_join(thread, NULL) == 0);
+  close(state.event_fd);
+}
+
+
+static void RunMode(const char* name, void (*handle)(Run*)) {
+  Run run;
+  int fds[2];
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  run.server_fd = fds[0];
+  run.client_fd = fds[1];
+  int size = kSocketBufferSize;
+  CHECK(setsockopt(run.server_fd, SOL_SOCKET, SO_SNDBUF,
+                   &size, sizeof(size)) == 0);
+  CHECK(setsockopt(run.client_fd, SOL_SOCKET, SO_RCVBUF,
+                   &size, sizeof(size)) == 0);
+  CHECK(fcntl(run.server_fd, F_SETFL, O_NONBLOCK) == 0);
+
+  pthread_t server_thread;
+  CHECK(pthread_create(&server_thread, NULL, RunServer, &run) == 0);
+  double start = GetMonotonicTime();
+  handle(&run);
+  double elapsed = GetMonotonicTime() - start;
+  CHECK(pthread_join(server_thread, NULL) == 0);
+  close(run.server_fd);
+  close(run.client_fd);
+
+  vector<double>& latencies = run.latencies;
+  sort(latencies.begin(), latencies.end());
+  double total = 0;
+  for (size_t i = 0; i < latencies.size(); ++i) total += latencies[i];
+  printf("%-8s events=%d elapsed=%.3fs latency: mean=%.1fus p50=%.1fus "
+         "p99=%.1fus max=%.1fus server blocked=%.1fms\n",
+         name, static_cast<int>(latencies.size()), elapsed,
+         1e6 * total / latencies.size(),
+         1e6 * latencies[latencies.size() / 2],
+         1e6 * latencies[latencies.size() * 99 / 100],
+         1e6 * latencies[latencies.size() - 1],
+         1e3 * run.blocked_sec);
+}
+
+
+int main(int argc, char** argv) {
+  RunMode("inline", HandleInline);
+  RunMode("ingester", HandleWithIngester);
+  return 0;
+}
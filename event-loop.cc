@@ -0,0 +1,200 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "event-loop.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace wham {
+
+// Maximum number of ready file descriptors that we'll handle in a single
+// call to epoll_wait().
+static const int kMaxEpollEvents = 32;
+
+
+EventLoop::EventLoop()
+    : epoll_fd_(-1),
+      timer_fd_(-1),
+      timer_time_(-1),
+      timer_slack_sec_(0),
+      quit_(false) {
+  epoll_fd_ = epoll_create(kMaxEpollEvents);
+  CHECK(epoll_fd_ != -1);
+
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  CHECK(timer_fd_ != -1);
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = timer_fd_;
+  CHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &event) == 0);
+}
+
+
+EventLoop::~EventLoop() {
+  close(timer_fd_);
+  close(epoll_fd_);
+  timer_fd_ = -1;
+  epoll_fd_ = -1;
+}
+
+
+void EventLoop::WatchFd(int fd, FdFunction* func) {
+  CHECK(fd >= 0);
+  CHECK(func);
+  CHECK(fd != timer_fd_);
+  CHECK(fd_funcs_.find(fd) == fd_funcs_.end());
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  CHECK(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0);
+  fd_funcs_.insert(make_pair(fd, func));
+  DEBUG << "Watching fd " << fd;
+}
+
+
+void EventLoop::UnwatchFd(int fd) {
+  FdFunctionMap::iterator it = fd_funcs_.find(fd);
+  if (it == fd_funcs_.end()) {
+    ERROR << "Got request to unwatch unwatched fd " << fd;
+    return;
+  }
+  fd_funcs_.erase(it);
+  // The kernel's epoll struct (the last argument) can be NULL for
+  // EPOLL_CTL_DEL in anything other than ancient kernels.
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, &event) != 0) {
+    ERROR << "Unable to remove fd " << fd << " from epoll set: "
+          << strerror(errno);
+  }
+  DEBUG << "Stopped watching fd " << fd;
+}
+
+
+TimeoutId EventLoop::RegisterTimeout(TimeoutFunction* func,
+                                     double timeout_sec) {
+  CHECK(func);
+  CHECK(timeout_sec >= 0);
+
+  double time = GetMonotonicTime() + timeout_sec;
+  DEBUG << "Registering timeout for " << fixed << time;
+  TimeoutId id = timeouts_.Add(func, time);
+  if (timeouts_.next_time() == time) UpdateTimer();
+  return id;
+}
+
+
+bool EventLoop::CancelTimeout(TimeoutId id) {
+  // We don't bother rearming the timer here; if it fires early, we'll just
+  // rearm it for the next timeout.
+  return timeouts_.Cancel(id);
+}
+
+
+int EventLoop::RunOnce(bool block) {
+  struct epoll_event events[kMaxEpollEvents];
+  int num_events =
+      epoll_wait(epoll_fd_, events, kMaxEpollEvents, block ? -1 : 0);
+  if (num_events == -1) {
+    if (errno == EINTR) return 0;
+    ERROR << "epoll_wait() failed: " << strerror(errno);
+    CHECK(false);
+  }
+
+  int num_callbacks = 0;
+  for (int i = 0; i < num_events; ++i) {
+    int fd = events[i].data.fd;
+    if (fd == timer_fd_) {
+      num_callbacks += RunExpiredTimeouts();
+      continue;
+    }
+    // Look the function up each time, since an earlier callback may have
+    // unwatched this fd.
+    FdFunctionMap::iterator it = fd_funcs_.find(fd);
+    if (it == fd_funcs_.end()) continue;
+    (*(it->second))(fd);
+    num_callbacks++;
+  }
+  return num_callbacks;
+}
+
+
+void EventLoop::Run() {
+  quit_ = false;
+  while (!quit_) RunOnce(true);
+}
+
+
+void EventLoop::UpdateTimer() {
+  double time = -1;
+  if (!timeouts_.empty()) {
+    double earliest = timeouts_.next_time();
+    // If the timer's already set to go off between the earliest deadline
+    // and the end of its slack, leave it alone so that the timeouts can
+    // share the wakeup.
+    if (timer_time_ >= earliest &&
+        timer_time_ <= earliest + timer_slack_sec_) {
+      return;
+    }
+    time = earliest + timer_slack_sec_;
+  }
+  if (time == timer_time_) return;
+
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  if (time >= 0) {
+    spec.it_value.tv_sec = static_cast<time_t>(time);
+    spec.it_value.tv_nsec =
+        static_cast<long>(1e9 * (time - static_cast<time_t>(time)));
+    // An all-zero value would disarm the timer instead.
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+      spec.it_value.tv_nsec = 1;
+    }
+  }
+  CHECK(timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, NULL) == 0);
+  timer_time_ = time;
+}
+
+
+int EventLoop::RunExpiredTimeouts() {
+  // Clear the timer's readable state.  This can fail with EAGAIN if the
+  // timer was rearmed after epoll reported it as readable; that's fine.
+  uint64_t expirations = 0;
+  if (read(timer_fd_, &expirations, sizeof(expirations)) == -1 &&
+      errno != EAGAIN) {
+    ERROR << "Unable to read from timerfd: " << strerror(errno);
+  }
+
+  // The timer is one-shot, so it's disarmed now if it fired.  Forget its
+  // deadline so that UpdateTimer() will rearm it.
+  timer_time_ = -1;
+
+  // Timeouts registered by the functions that we run here will have
+  // deadlines after 'now', so we won't loop forever.
+  double now = GetMonotonicTime();
+  int num_run = 0;
+  while (!timeouts_.empty() && timeouts_.next_time() <= now) {
+    // Remove the timeout from the queue before running it, in case the
+    // function registers or cancels other timeouts.
+    DEBUG << "Running timeout for " << fixed << timeouts_.next_time();
+    TimeoutFunction* func = timeouts_.Pop();
+    (*func)();
+    num_run++;
+  }
+  UpdateTimer();
+  return num_run;
+}
+
+}  // namespace wham
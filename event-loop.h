@@ -0,0 +1,111 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__
+
+#include <map>
+
+#include "timeout-queue.h"
+#include "util.h"
+
+using namespace std;
+
+class EventLoopTestSuite;  // from event-loop_test.h
+
+namespace wham {
+
+// Waits for file descriptors to become readable and for timeouts to
+// expire, and runs the callbacks that were registered for them.
+//
+// This is built on epoll.  All timeouts are multiplexed onto a single
+// timerfd that uses CLOCK_MONOTONIC and is armed for the earliest
+// deadline, so we wake up exactly when the next timeout is due rather
+// than recomputing a relative wait from the wall-clock time on each pass.
+//
+// The timer can be given some slack, in which case it's armed for a bit
+// after the earliest deadline and every timeout that's due by then is run
+// in the same wakeup.  Timeouts are never run early.
+class EventLoop {
+ public:
+  EventLoop();
+  ~EventLoop();
+
+  class FdFunction {
+   public:
+    virtual ~FdFunction() {}
+
+    // Called when 'fd' is readable.
+    virtual void operator()(int fd) = 0;
+  };
+
+  typedef wham::TimeoutFunction TimeoutFunction;
+
+  // Run 'func' whenever 'fd' is readable.  Ownership of 'func' remains
+  // with the caller.  Only one function can be registered per fd.
+  void WatchFd(int fd, FdFunction* func);
+
+  // Stop watching a file descriptor.  This is safe to call from within an
+  // FdFunction.
+  void UnwatchFd(int fd);
+
+  // Run 'func' in 'timeout_sec', returning an ID that can be used to
+  // cancel the timeout before it's executed.  Ownership of 'func' remains
+  // with the caller.
+  TimeoutId RegisterTimeout(TimeoutFunction* func, double timeout_sec);
+
+  // Cancel a timeout.  Returns false if it's already run or been
+  // cancelled.
+  bool CancelTimeout(TimeoutId id);
+
+  // Set how long (in seconds) a timeout may be delayed so that it can
+  // share a wakeup with later ones.
+  void set_timer_slack(double slack_sec) {
+    CHECK(slack_sec >= 0);
+    timer_slack_sec_ = slack_sec;
+  }
+
+  // Wait for activity (or don't, if 'block' is false) and run the
+  // callbacks for everything that's ready.  Returns the number of
+  // callbacks that were run.
+  int RunOnce(bool block);
+
+  // Repeatedly call RunOnce() until Quit() is called.
+  void Run();
+
+  // Make Run() return after the current iteration.
+  void Quit() { quit_ = true; }
+
+ private:
+  friend class ::EventLoopTestSuite;
+
+  // Arm 'timer_fd_' for the earliest timeout in 'timeouts_' (plus the
+  // slack), or disarm it if there aren't any timeouts.
+  void UpdateTimer();
+
+  // Run all timeouts whose deadlines have passed.  Returns the number of
+  // timeouts that were run.
+  int RunExpiredTimeouts();
+
+  int epoll_fd_;
+  int timer_fd_;
+
+  typedef map<int, FdFunction*> FdFunctionMap;
+  FdFunctionMap fd_funcs_;
+
+  TimeoutQueue timeouts_;
+
+  // Deadline that 'timer_fd_' is currently armed for, or -1 if it's
+  // disarmed.
+  double timer_time_;
+
+  double timer_slack_sec_;
+
+  bool quit_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(EventLoop);
+};
+
+}  // namespace wham
+
+#endif
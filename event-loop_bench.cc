@@ -0,0 +1,213 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+//
+// Compares the latency of timeouts run by EventLoop (epoll + timerfd)
+// against the select()-based loop that XServer used previously, under a
+// synthetic workload made up of many short, self-rescheduling timeouts
+// (similar to anchor animations).  Each timeout records how long after its
+// deadline it actually ran.
+//
+// Both loops log every timeout, so run this with stderr redirected:
+//
+//   ./event-loop_bench 2>/dev/null
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <sys/select.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "event-loop.h"
+#include "util.h"
+
+using namespace std;
+using namespace wham;
+
+// Number of concurrent chains of timeouts.
+static const int kNumChains = 100;
+
+// Total number of timeouts to run in each loop.
+static const int kNumTimeouts = 20000;
+
+// Range for the delay of each timeout, in seconds.
+static const double kMinDelay = 0.001;
+static const double kMaxDelay = 0.010;
+
+
+// Interface shared by both loops so that the workload can be written once.
+class Loop {
+ public:
+  virtual ~Loop() {}
+  virtual void Register(EventLoop::TimeoutFunction* func, double delay) = 0;
+  virtual void Run() = 0;
+  virtual void Quit() = 0;
+  virtual double Now() = 0;
+};
+
+
+// The old loop: a heap of timeouts using wall-clock times, with select()
+// on an otherwise-idle fd standing in for the X connection.
+class SelectLoop : public Loop {
+ public:
+  SelectLoop(int fd) : fd_(fd), quit_(false) {}
+
+  void Register(EventLoop::TimeoutFunction* func, double delay) {
+    heap_.push_back(Timeout(func, GetCurrentTime() + delay));
+    push_heap(heap_.begin(), heap_.end());
+  }
+
+  void Run() {
+    while (!quit_) {
+      double now = GetCurrentTime();
+      while (!heap_.empty() && heap_[0].time <= now) {
+        DEBUG << "Running timeout for " << fixed << heap_[0].time;
+        Timeout timeout = heap_[0];
+        pop_heap(heap_.begin(), heap_.end());
+        heap_.pop_back();
+        (*(timeout.func))();
+      }
+      if (quit_) break;
+
+      struct timeval tv;
+      struct timeval* timeout_tv = NULL;
+      if (!heap_.empty()) {
+        FillTimeval(heap_[0].time - now, &tv);
+        timeout_tv = &tv;
+      }
+      fd_set fds;
+      FD_ZERO(&fds);
+      FD_SET(fd_, &fds);
+      CHECK(select(fd_ + 1, &fds, NULL, NULL, timeout_tv) != -1);
+    }
+  }
+
+  void Quit() { quit_ = true; }
+  double Now() { return GetCurrentTime(); }
+
+ private:
+  struct Timeout {
+    Timeout(EventLoop::TimeoutFunction* func, double time)
+        : func(func), time(time) {}
+    bool operator<(const Timeout& o) const { return time > o.time; }
+    EventLoop::TimeoutFunction* func;
+    double time;
+  };
+
+  int fd_;
+  bool quit_;
+  vector<Timeout> heap_;
+};
+
+
+// The new loop.
+class EpollLoop : public Loop {
+ public:
+  class NullFdFunction : public EventLoop::FdFunction {
+   public:
+    void operator()(int fd) {}
+  };
+
+  EpollLoop(int fd) : fd_(fd) { loop_.WatchFd(fd_, &null_func_); }
+  ~EpollLoop() { loop_.UnwatchFd(fd_); }
+
+  void Register(EventLoop::TimeoutFunction* func, double delay) {
+    loop_.RegisterTimeout(func, delay);
+  }
+  void Run() { loop_.Run(); }
+  void Quit() { loop_.Quit(); }
+  double Now() { return GetMonotonicTime(); }
+
+ private:
+  int fd_;
+  NullFdFunction null_func_;
+  EventLoop loop_;
+};
+
+
+// Shared state for the workload.
+struct Workload {
+  Workload(Loop* loop) : loop(loop), num_run(0) {}
+  Loop* loop;
+  int num_run;
+  vector<double> lateness;
+};
+
+
+// A timeout that records how late it ran and then reschedules itself.
+class ChainFunction : public EventLoop::TimeoutFunction {
+ public:
+  ChainFunction() : workload_(NULL), deadline_(0) {}
+
+  void Start(Workload* workload) {
+    workload_ = workload;
+    Schedule();
+  }
+
+  void operator()() {
+    workload_->lateness.push_back(workload_->loop->Now() - deadline_);
+    workload_->num_run++;
+    if (workload_->num_run >= kNumTimeouts) {
+      workload_->loop->Quit();
+      return;
+    }
+    Schedule();
+  }
+
+ private:
+  void Schedule() {
+    double delay =
+        kMinDelay + (kMaxDelay - kMinDelay) * (rand() / (RAND_MAX + 1.0));
+    deadline_ = workload_->loop->Now() + delay;
+    workload_->loop->Register(this, delay);
+  }
+
+  Workload* workload_;
+  double deadline_;
+};
+
+
+static void RunWorkload(const char* name, Loop* loop) {
+  srand(1);
+  Workload workload(loop);
+  vector<ChainFunction> chains(kNumChains);
+  double start = GetMonotonicTime();
+  for (int i = 0; i < kNumChains; ++i) chains[i].Start(&workload);
+  loop->Run();
+  double elapsed = GetMonotonicTime() - start;
+
+  vector<double>& lateness = workload.lateness;
+  sort(lateness.begin(), lateness.end());
+  double total = 0;
+  int num_early = 0;
+  for (size_t i = 0; i < lateness.size(); ++i) {
+    total += lateness[i];
+    if (lateness[i] < 0) num_early++;
+  }
+  printf("%-6s timeouts=%d elapsed=%.3fs lateness: "
+         "mean=%.1fus p50=%.1fus p99=%.1fus max=%.1fus early=%d\n",
+         name, static_cast<int>(lateness.size()), elapsed,
+         1e6 * total / lateness.size(),
+         1e6 * lateness[lateness.size() / 2],
+         1e6 * lateness[lateness.size() * 99 / 100],
+         1e6 * lateness[lateness.size() - 1],
+         num_early);
+}
+
+
+int main(int argc, char** argv) {
+  int fds[2];
+  CHECK(pipe(fds) == 0);
+
+  SelectLoop select_loop(fds[0]);
+  RunWorkload("select", &select_loop);
+
+  EpollLoop epoll_loop(fds[0]);
+  RunWorkload("epoll", &epoll_loop);
+
+  close(fds[0]);
+  close(fds[1]);
+  return 0;
+}
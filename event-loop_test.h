@@ -0,0 +1,162 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include <unistd.h>
+
+#include "event-loop.h"
+#include "util.h"
+
+using namespace wham;
+
+class EventLoopTestSuite : public CxxTest::TestSuite {
+ public:
+  // Counts how many times it's been run, and optionally tells the loop to
+  // quit.
+  class CountingTimeoutFunction : public EventLoop::TimeoutFunction {
+   public:
+    CountingTimeoutFunction(EventLoop* loop, bool quit)
+        : loop_(loop),
+          quit_(quit),
+          num_runs(0),
+          last_run_time(0) {}
+
+    void operator()() {
+      num_runs++;
+      last_run_time = GetMonotonicTime();
+      if (quit_) loop_->Quit();
+    }
+
+   private:
+    EventLoop* loop_;
+    bool quit_;
+
+   public:
+    int num_runs;
+    double last_run_time;
+  };
+
+  // Reads a byte from the fd that it's called for.
+  class ReadingFdFunction : public EventLoop::FdFunction {
+   public:
+    ReadingFdFunction()
+        : num_runs(0),
+          last_fd(-1) {}
+
+    void operator()(int fd) {
+      char ch;
+      TS_ASSERT_EQUALS(read(fd, &ch, 1), 1);
+      num_runs++;
+      last_fd = fd;
+    }
+
+    int num_runs;
+    int last_fd;
+  };
+
+  void testWatchFd() {
+    EventLoop loop;
+    int fds[2];
+    TS_ASSERT_EQUALS(pipe(fds), 0);
+
+    ReadingFdFunction func;
+    loop.WatchFd(fds[0], &func);
+
+    // Nothing should happen until we write to the pipe.
+    TS_ASSERT_EQUALS(loop.RunOnce(false), 0);
+    TS_ASSERT_EQUALS(func.num_runs, 0);
+
+    TS_ASSERT_EQUALS(write(fds[1], "a", 1), 1);
+    TS_ASSERT_EQUALS(loop.RunOnce(true), 1);
+    TS_ASSERT_EQUALS(func.num_runs, 1);
+    TS_ASSERT_EQUALS(func.last_fd, fds[0]);
+
+    // After we stop watching the fd, we shouldn't get called anymore.
+    loop.UnwatchFd(fds[0]);
+    TS_ASSERT_EQUALS(write(fds[1], "b", 1), 1);
+    TS_ASSERT_EQUALS(loop.RunOnce(false), 0);
+    TS_ASSERT_EQUALS(func.num_runs, 1);
+
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  void testTimeouts() {
+    EventLoop loop;
+    CountingTimeoutFunction first(&loop, false);
+    CountingTimeoutFunction cancelled(&loop, false);
+    CountingTimeoutFunction last(&loop, true);
+
+    double start = GetMonotonicTime();
+    loop.RegisterTimeout(&last, 0.03);
+    loop.RegisterTimeout(&first, 0.01);
+    TimeoutId id = loop.RegisterTimeout(&cancelled, 0.02);
+    TS_ASSERT(loop.CancelTimeout(id));
+    TS_ASSERT(!loop.CancelTimeout(id));
+    loop.Run();
+
+    TS_ASSERT_EQUALS(first.num_runs, 1);
+    TS_ASSERT_EQUALS(cancelled.num_runs, 0);
+    TS_ASSERT_EQUALS(last.num_runs, 1);
+    TS_ASSERT(first.last_run_time >= start + 0.01);
+    TS_ASSERT(last.last_run_time >= start + 0.03);
+    TS_ASSERT(first.last_run_time <= last.last_run_time);
+    TS_ASSERT(loop.timeouts_.empty());
+  }
+
+  // Re-registers itself a fixed number of times, like the anchor
+  // animation code does.
+  class RepeatingTimeoutFunction : public EventLoop::TimeoutFunction {
+   public:
+    RepeatingTimeoutFunction(EventLoop* loop, int max_runs)
+        : loop_(loop),
+          max_runs_(max_runs),
+          num_runs(0) {}
+
+    void operator()() {
+      num_runs++;
+      if (num_runs < max_runs_) {
+        loop_->RegisterTimeout(this, 0);
+      } else {
+        loop_->Quit();
+      }
+    }
+
+   private:
+    EventLoop* loop_;
+    int max_runs_;
+
+   public:
+    int num_runs;
+  };
+
+  void testTimerSlack() {
+    // With enough slack, timeouts with nearby deadlines should all be run
+    // by the same wakeup, but none of them should be run early.
+    EventLoop loop;
+    loop.set_timer_slack(0.05);
+    CountingTimeoutFunction first(&loop, false);
+    CountingTimeoutFunction second(&loop, false);
+    CountingTimeoutFunction third(&loop, false);
+
+    double start = GetMonotonicTime();
+    loop.RegisterTimeout(&first, 0.01);
+    loop.RegisterTimeout(&second, 0.02);
+    loop.RegisterTimeout(&third, 0.03);
+    TS_ASSERT_EQUALS(loop.RunOnce(true), 3);
+    TS_ASSERT_EQUALS(first.num_runs, 1);
+    TS_ASSERT_EQUALS(second.num_runs, 1);
+    TS_ASSERT_EQUALS(third.num_runs, 1);
+    TS_ASSERT(first.last_run_time >= start + 0.03);
+    TS_ASSERT(loop.timeouts_.empty());
+  }
+
+  void testTimeoutRegisteredFromTimeout() {
+    EventLoop loop;
+    RepeatingTimeoutFunction func(&loop, 5);
+    loop.RegisterTimeout(&func, 0);
+    loop.Run();
+    TS_ASSERT_EQUALS(func.num_runs, 5);
+  }
+};
@@ -0,0 +1,132 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "event-stats.h"
+
+#include <cstring>
+
+using namespace std;
+
+namespace wham {
+
+LatencyHistogram::LatencyHistogram()
+    : count_(0),
+      total_sec_(0),
+      max_sec_(0) {
+  memset(buckets_, 0, sizeof(buckets_));
+}
+
+
+void LatencyHistogram::Add(double sec) {
+  if (sec < 0) sec = 0;
+  buckets_[GetBucket(static_cast<uint64_t>(sec * 1e6))]++;
+  count_++;
+  total_sec_ += sec;
+  if (sec > max_sec_) max_sec_ = sec;
+}
+
+
+double LatencyHistogram::GetPercentile(double percentile) const {
+  if (!count_) return 0;
+  uint64_t target = static_cast<uint64_t>(percentile / 100.0 * count_);
+  if (target >= count_) target = count_ - 1;
+
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += buckets_[i];
+    if (seen > target) {
+      // The last bucket is unbounded, so the max is the best we can do.
+      if (i == kNumBuckets - 1) return max_sec_;
+      double end_sec = GetBucketStart(i + 1) / 1e6;
+      return end_sec < max_sec_ ? end_sec : max_sec_;
+    }
+  }
+  return max_sec_;
+}
+
+
+int LatencyHistogram::GetBucket(uint64_t usec) {
+  // Durations under 4 us get a bucket apiece.  After that, a duration in
+  // [2^e, 2^(e+1)) goes in one of four buckets starting at 4 * (e - 1).
+  if (usec < 4) return static_cast<int>(usec);
+  int exponent = 0;
+  for (uint64_t v = usec; v > 1; v >>= 1) exponent++;
+  int sub_bucket = static_cast<int>((usec >> (exponent - 2)) & 3);
+  int bucket = 4 * (exponent - 1) + sub_bucket;
+  return bucket < kNumBuckets ? bucket : kNumBuckets - 1;
+}
+
+
+uint64_t LatencyHistogram::GetBucketStart(int bucket) {
+  if (bucket < 4) return bucket;
+  int exponent = bucket / 4 + 1;
+  return static_cast<uint64_t>(4 + bucket % 4) << (exponent - 2);
+}
+
+
+EventStats::EventStats()
+    : budget_sec_(0),
+      num_request_batches_(0),
+      num_batched_requests_(0),
+      max_requests_per_batch_(0) {
+}
+
+
+void EventStats::RecordHandled(const Event& event,
+                               const char* handler,
+                               double elapsed_sec) {
+  CHECK(event.type >= 0 && event.type < Event::NUM_TYPES);
+  TypeStats& stats = types_[event.type];
+  stats.handler = handler;
+  stats.latency.Add(elapsed_sec);
+
+  if (budget_sec_ > 0 && elapsed_sec > budget_sec_) {
+    stats.num_over_budget++;
+    LOG << StringPrintf("%s took %.3f ms (budget is %.3f ms) for %s",
+                        handler, 1000 * elapsed_sec, 1000 * budget_sec_,
+                        event.DebugString().c_str());
+  }
+}
+
+
+void EventStats::RecordRequestBatch(uint num_requests) {
+  num_request_batches_++;
+  num_batched_requests_ += num_requests;
+  if (num_requests > max_requests_per_batch_)
+    max_requests_per_batch_ = num_requests;
+}
+
+
+string EventStats::DebugString() const {
+  string out = StringPrintf(
+      "Event stats (times in ms, budget %.3f ms):\n"
+      "%-15s %9s %9s %6s %8s %8s %8s %8s  %s\n",
+      1000 * budget_sec_,
+      "type", "received", "handled", "slow",
+      "mean", "p50", "p99", "max", "handler");
+  for (int i = 0; i < Event::NUM_TYPES; ++i) {
+    const TypeStats& stats = types_[i];
+    if (!stats.num_received && !stats.latency.count()) continue;
+    out += StringPrintf(
+        "%-15s %9llu %9llu %6llu %8.3f %8.3f %8.3f %8.3f  %s\n",
+        Event::TypeToName(static_cast<Event::Type>(i)),
+        static_cast<unsigned long long>(stats.num_received),
+        static_cast<unsigned long long>(stats.latency.count()),
+        static_cast<unsigned long long>(stats.num_over_budget),
+        1000 * stats.latency.mean(),
+        1000 * stats.latency.GetPercentile(50),
+        1000 * stats.latency.GetPercentile(99),
+        1000 * stats.latency.max(),
+        stats.handler ? stats.handler : "-");
+  }
+  out += StringPrintf(
+      "Request batches: %llu, requests per batch: mean %.1f, max %u\n",
+      static_cast<unsigned long long>(num_request_batches_),
+      num_request_batches_ ?
+        static_cast<double>(num_batched_requests_) / num_request_batches_ :
+        0.0,
+      max_requests_per_batch_);
+  return out;
+}
+
+}  // namespace wham
@@ -0,0 +1,115 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __EVENT_STATS_H__
+#define __EVENT_STATS_H__
+
+#include <string>
+
+#include <stdint.h>
+
+#include "event.h"
+#include "util.h"
+
+using namespace std;
+
+class EventStatsTestSuite;  // from event-stats_test.h
+
+namespace wham {
+
+// Histogram of durations with log-linear buckets: each power of two (in
+// microseconds) is split into four equally-sized buckets, so the relative
+// error of a percentile is at most 25% while covering everything from a
+// microsecond to a couple of seconds in a small fixed-size array.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  // Record a duration, in seconds.
+  void Add(double sec);
+
+  uint64_t count() const { return count_; }
+
+  // Mean and maximum durations, in seconds.
+  double mean() const { return count_ ? total_sec_ / count_ : 0; }
+  double max() const { return max_sec_; }
+
+  // Get an upper bound for the 'percentile'th (0-100) duration, in
+  // seconds.
+  double GetPercentile(double percentile) const;
+
+ private:
+  friend class ::EventStatsTestSuite;
+
+  static const int kNumBuckets = 84;
+
+  // Get the bucket that a duration of 'usec' microseconds goes in.
+  static int GetBucket(uint64_t usec);
+
+  // Get the smallest duration (in microseconds) that goes in 'bucket'.
+  static uint64_t GetBucketStart(int bucket);
+
+  uint64_t buckets_[kNumBuckets];
+  uint64_t count_;
+  double total_sec_;
+  double max_sec_;
+};
+
+
+// Counts the events that we receive and keeps track of how long it takes
+// to handle each type.  Handling an event that takes longer than the
+// configured budget is logged.
+class EventStats {
+ public:
+  EventStats();
+
+  // Set how long handling a single event may take (in seconds) before we
+  // complain about it.  0 disables the check.
+  void set_budget(double budget_sec) { budget_sec_ = budget_sec; }
+
+  // Record that an event of type 'type' was read from the server.
+  void RecordReceived(Event::Type type) { types_[type].num_received++; }
+
+  // Record that 'handler' took 'elapsed_sec' to handle 'event'.
+  void RecordHandled(const Event& event,
+                     const char* handler,
+                     double elapsed_sec);
+
+  // Record that 'num_requests' requests were flushed at the end of a
+  // RequestBatch.
+  void RecordRequestBatch(uint num_requests);
+
+  // Get a table describing the stats collected so far.
+  string DebugString() const;
+
+ private:
+  friend class ::EventStatsTestSuite;
+
+  struct TypeStats {
+    TypeStats() : num_received(0), num_over_budget(0), handler(NULL) {}
+
+    uint64_t num_received;
+    uint64_t num_over_budget;
+
+    // Name of the handler that was last used for this type.
+    const char* handler;
+
+    LatencyHistogram latency;
+  };
+
+  TypeStats types_[Event::NUM_TYPES];
+
+  double budget_sec_;
+
+  // Number of non-empty request batches that have been flushed, the total
+  // number of requests in them, and the most requests in any one batch.
+  uint64_t num_request_batches_;
+  uint64_t num_batched_requests_;
+  uint max_requests_per_batch_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(EventStats);
+};
+
+}  // namespace wham
+
+#endif
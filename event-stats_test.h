@@ -0,0 +1,105 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "event-stats.h"
+
+#include "event.h"
+#include "util.h"
+
+using namespace wham;
+
+class EventStatsTestSuite : public CxxTest::TestSuite {
+ public:
+  void testBuckets() {
+    // Small durations get their own buckets.
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(0), 0);
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(3), 3);
+
+    // After that, each power of two is split into four buckets.
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(4), 4);
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(7), 7);
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(8), 8);
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(9), 8);
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(10), 9);
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(15), 11);
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(16), 12);
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(1000), 35);
+
+    // Huge durations end up in the last bucket.
+    TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(1ULL << 40),
+                     LatencyHistogram::kNumBuckets - 1);
+
+    // Each bucket's start should map back to it, and the buckets should
+    // be contiguous.
+    for (int i = 0; i < LatencyHistogram::kNumBuckets; ++i) {
+      uint64_t start = LatencyHistogram::GetBucketStart(i);
+      TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(start), i);
+      if (start > 0) {
+        TS_ASSERT_EQUALS(LatencyHistogram::GetBucket(start - 1), i - 1);
+      }
+    }
+  }
+
+  void testPercentiles() {
+    LatencyHistogram histogram;
+    TS_ASSERT_EQUALS(histogram.GetPercentile(50), 0);
+
+    // 90 fast durations and 10 slow ones.
+    for (int i = 0; i < 90; ++i) histogram.Add(0.000010);
+    for (int i = 0; i < 10; ++i) histogram.Add(0.005);
+    TS_ASSERT_EQUALS(histogram.count(), 100U);
+    TS_ASSERT_DELTA(histogram.mean(), 0.000509, 1e-9);
+    TS_ASSERT_DELTA(histogram.max(), 0.005, 1e-9);
+
+    // The percentiles are upper bounds for the durations in their buckets,
+    // so they should be within 25% of the real value.
+    TS_ASSERT(histogram.GetPercentile(50) >= 0.000010);
+    TS_ASSERT(histogram.GetPercentile(50) <= 0.0000125);
+    TS_ASSERT(histogram.GetPercentile(99) >= 0.004);
+    TS_ASSERT(histogram.GetPercentile(99) <= 0.005);
+    TS_ASSERT_EQUALS(histogram.GetPercentile(100), 0.005);
+  }
+
+  void testBudget() {
+    EventStats stats;
+    stats.set_budget(0.004);
+
+    Event motion(Event::MOTION_NOTIFY, 1);
+    Event expose(Event::EXPOSE, 2);
+    stats.RecordReceived(Event::MOTION_NOTIFY);
+    stats.RecordReceived(Event::MOTION_NOTIFY);
+    stats.RecordReceived(Event::EXPOSE);
+    stats.RecordHandled(motion, "HandleMotion", 0.001);
+    stats.RecordHandled(expose, "HandleExpose", 0.010);
+
+    const EventStats::TypeStats& motion_stats =
+        stats.types_[Event::MOTION_NOTIFY];
+    TS_ASSERT_EQUALS(motion_stats.num_received, 2U);
+    TS_ASSERT_EQUALS(motion_stats.latency.count(), 1U);
+    TS_ASSERT_EQUALS(motion_stats.num_over_budget, 0U);
+
+    const EventStats::TypeStats& expose_stats = stats.types_[Event::EXPOSE];
+    TS_ASSERT_EQUALS(expose_stats.num_received, 1U);
+    TS_ASSERT_EQUALS(expose_stats.latency.count(), 1U);
+    TS_ASSERT_EQUALS(expose_stats.num_over_budget, 1U);
+
+    // Only types that we've seen should be listed.
+    string str = stats.DebugString();
+    TS_ASSERT(str.find("MotionNotify") != string::npos);
+    TS_ASSERT(str.find("HandleExpose") != string::npos);
+    TS_ASSERT(str.find("KeyPress") == string::npos);
+  }
+
+  void testRequestBatches() {
+    EventStats stats;
+    stats.RecordRequestBatch(3);
+    stats.RecordRequestBatch(40);
+    stats.RecordRequestBatch(5);
+    TS_ASSERT_EQUALS(stats.num_request_batches_, 3U);
+    TS_ASSERT_EQUALS(stats.num_batched_requests_, 48U);
+    TS_ASSERT_EQUALS(stats.max_requests_per_batch_, 40U);
+    TS_ASSERT(stats.DebugString().find("mean 16.0, max 40") != string::npos);
+  }
+};
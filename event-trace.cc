@@ -0,0 +1,399 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "event-trace.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "mock-x-window.h"
+#include "x-server.h"
+
+using namespace std;
+
+namespace wham {
+
+// Written at the start of every trace.  Bump the version whenever the
+// record format changes.
+static const char kTraceMagic[] = "WHAMTRACE";
+static const uint32_t kTraceVersion = 5;
+
+// Upper bound on the length of strings in traces, so that a corrupt file
+// can't make us allocate huge buffers.
+static const uint32_t kMaxStringLength = 64 * 1024;
+
+
+EventTraceWriter::EventTraceWriter()
+    : file_(NULL) {
+}
+
+
+EventTraceWriter::~EventTraceWriter() {
+  if (file_) fclose(file_);
+  file_ = NULL;
+}
+
+
+bool EventTraceWriter::Open(const string& filename) {
+  CHECK(!file_);
+  file_ = fopen(filename.c_str(), "wb");
+  if (!file_) {
+    ERROR << "Unable to open " << filename << " for writing: "
+          << strerror(errno);
+    return false;
+  }
+  fwrite(kTraceMagic, sizeof(kTraceMagic), 1, file_);
+  WriteUint32(kTraceVersion);
+  return true;
+}
+
+
+void EventTraceWriter::WriteEvent(const Event& event, double time) {
+  WriteUint8(EventTraceRecord::EVENT);
+  WriteDouble(time);
+  WriteUint8(event.type);
+  WriteUint32(event.window);
+  WriteInt32(event.x);
+  WriteInt32(event.y);
+  WriteUint32(event.detail);
+  WriteUint32(event.state);
+}
+
+
+void EventTraceWriter::WriteCreateWindow(::Window id) {
+  WriteUint8(EventTraceRecord::CREATE_WINDOW);
+  WriteUint32(id);
+}
+
+
+void EventTraceWriter::WriteGeometry(
+    ::Window id, int x, int y, uint width, uint height) {
+  WriteUint8(EventTraceRecord::GEOMETRY);
+  WriteUint32(id);
+  WriteInt32(x);
+  WriteInt32(y);
+  WriteUint32(width);
+  WriteUint32(height);
+}
+
+
+void EventTraceWriter::WriteProperties(::Window id,
+                                       const WindowProperties& props,
+                                       bool success) {
+  WriteUint8(EventTraceRecord::PROPERTIES);
+  WriteUint32(id);
+  WriteUint8(success);
+  WriteString(props.window_name);
+  WriteString(props.icon_name);
+  WriteString(props.command);
+  WriteString(props.app_name);
+  WriteString(props.app_class);
+  WriteInt32(props.x);
+  WriteInt32(props.y);
+  WriteUint32(props.width);
+  WriteUint32(props.height);
+  WriteUint32(props.min_width);
+  WriteUint32(props.min_height);
+  WriteUint32(props.max_width);
+  WriteUint32(props.max_height);
+  WriteUint32(props.width_inc);
+  WriteUint32(props.height_inc);
+  WriteFloat(props.min_aspect);
+  WriteFloat(props.max_aspect);
+  WriteUint32(props.base_width);
+  WriteUint32(props.base_height);
+  WriteUint32(props.transient_for ? props.transient_for->id() : None);
+  WriteUint8(props.accepts_input);
+  WriteUint8(props.supports_take_focus);
+}
+
+
+void EventTraceWriter::Flush() {
+  fflush(file_);
+}
+
+
+void EventTraceWriter::WriteUint8(uint8_t value) {
+  fwrite(&value, sizeof(value), 1, file_);
+}
+
+
+void EventTraceWriter::WriteUint32(uint32_t value) {
+  fwrite(&value, sizeof(value), 1, file_);
+}
+
+
+void EventTraceWriter::WriteFloat(float value) {
+  fwrite(&value, sizeof(value), 1, file_);
+}
+
+
+void EventTraceWriter::WriteDouble(double value) {
+  fwrite(&value, sizeof(value), 1, file_);
+}
+
+
+void EventTraceWriter::WriteString(const string& value) {
+  WriteUint32(value.size());
+  fwrite(value.data(), 1, value.size(), file_);
+}
+
+
+EventTraceReader::EventTraceReader()
+    : file_(NULL) {
+}
+
+
+EventTraceReader::~EventTraceReader() {
+  if (file_) fclose(file_);
+  file_ = NULL;
+}
+
+
+bool EventTraceReader::Open(const string& filename) {
+  CHECK(!file_);
+  file_ = fopen(filename.c_str(), "rb");
+  if (!file_) {
+    ERROR << "Unable to open " << filename << " for reading: "
+          << strerror(errno);
+    return false;
+  }
+  char magic[sizeof(kTraceMagic)];
+  uint32_t version = 0;
+  if (fread(magic, sizeof(magic), 1, file_) != 1 ||
+      memcmp(magic, kTraceMagic, sizeof(magic)) != 0 ||
+      !ReadUint32(&version)) {
+    ERROR << filename << " isn't a trace file";
+    return false;
+  }
+  if (version != kTraceVersion) {
+    ERROR << filename << " has version " << version << "; expected "
+          << kTraceVersion;
+    return false;
+  }
+  return true;
+}
+
+
+bool EventTraceReader::Read(EventTraceRecord* record) {
+  CHECK(record);
+  CHECK(file_);
+
+  uint8_t type = 0;
+  if (!ReadUint8(&type)) return false;
+  record->type = static_cast<EventTraceRecord::Type>(type);
+
+  uint32_t id = 0;
+  bool ok = true;
+  switch (record->type) {
+    case EventTraceRecord::EVENT: {
+      uint8_t event_type = 0;
+      uint32_t window = 0;
+      ok = ReadDouble(&record->time) &&
+           ReadUint8(&event_type) &&
+           ReadUint32(&window) &&
+           ReadInt(&record->event.x) &&
+           ReadInt(&record->event.y) &&
+           ReadUint(&record->event.detail) &&
+           ReadUint(&record->event.state);
+      if (ok && event_type >= Event::NUM_TYPES) ok = false;
+      record->event.type = static_cast<Event::Type>(event_type);
+      record->event.window = window;
+      break;
+    }
+    case EventTraceRecord::CREATE_WINDOW:
+      ok = ReadUint32(&id);
+      record->window = id;
+      break;
+    case EventTraceRecord::GEOMETRY:
+      ok = ReadUint32(&id) &&
+           ReadInt(&record->x) &&
+           ReadInt(&record->y) &&
+           ReadUint(&record->width) &&
+           ReadUint(&record->height);
+      record->window = id;
+      break;
+    case EventTraceRecord::PROPERTIES: {
+      uint8_t success = 0;
+      uint32_t transient_for = 0;
+      uint8_t accepts_input = 0;
+      uint8_t supports_take_focus = 0;
+      WindowProperties* props = &record->props;
+      ok = ReadUint32(&id) &&
+           ReadUint8(&success) &&
+           ReadString(&props->window_name) &&
+           ReadString(&props->icon_name) &&
+           ReadString(&props->command) &&
+           ReadString(&props->app_name) &&
+           ReadString(&props->app_class) &&
+           ReadInt(&props->x) &&
+           ReadInt(&props->y) &&
+           ReadUint(&props->width) &&
+           ReadUint(&props->height) &&
+           ReadUint(&props->min_width) &&
+           ReadUint(&props->min_height) &&
+           ReadUint(&props->max_width) &&
+           ReadUint(&props->max_height) &&
+           ReadUint(&props->width_inc) &&
+           ReadUint(&props->height_inc) &&
+           ReadFloat(&props->min_aspect) &&
+           ReadFloat(&props->max_aspect) &&
+           ReadUint(&props->base_width) &&
+           ReadUint(&props->base_height) &&
+           ReadUint32(&transient_for) &&
+           ReadUint8(&accepts_input) &&
+           ReadUint8(&supports_take_focus);
+      record->window = id;
+      record->success = success;
+      record->transient_for = transient_for;
+      props->transient_for = NULL;
+      props->accepts_input = accepts_input;
+      props->supports_take_focus = supports_take_focus;
+      break;
+    }
+    default:
+      ERROR << "Got unknown trace record type " << static_cast<int>(type);
+      return false;
+  }
+
+  if (!ok) ERROR << "Trace is truncated or corrupt";
+  return ok;
+}
+
+
+bool EventTraceReader::ReadUint8(uint8_t* value) {
+  return fread(value, sizeof(*value), 1, file_) == 1;
+}
+
+
+bool EventTraceReader::ReadUint32(uint32_t* value) {
+  return fread(value, sizeof(*value), 1, file_) == 1;
+}
+
+
+bool EventTraceReader::ReadInt32(int32_t* value) {
+  return fread(value, sizeof(*value), 1, file_) == 1;
+}
+
+
+bool EventTraceReader::ReadInt(int* value) {
+  int32_t value32 = 0;
+  if (!ReadInt32(&value32)) return false;
+  *value = value32;
+  return true;
+}
+
+
+bool EventTraceReader::ReadUint(uint* value) {
+  uint32_t value32 = 0;
+  if (!ReadUint32(&value32)) return false;
+  *value = value32;
+  return true;
+}
+
+
+bool EventTraceReader::ReadFloat(float* value) {
+  return fread(value, sizeof(*value), 1, file_) == 1;
+}
+
+
+bool EventTraceReader::ReadDouble(double* value) {
+  return fread(value, sizeof(*value), 1, file_) == 1;
+}
+
+
+bool EventTraceReader::ReadString(string* value) {
+  uint32_t size = 0;
+  if (!ReadUint32(&size) || size > kMaxStringLength) return false;
+  value->resize(size);
+  if (size == 0) return true;
+  return fread(&(*value)[0], 1, size, file_) == size;
+}
+
+
+EventReplayer::EventReplayer(EventTraceReader* reader)
+    : reader_(reader),
+      next_event_(),
+      have_next_event_(false),
+      num_events_(0),
+      handler_time_(0) {
+  CHECK(reader_);
+}
+
+
+void EventReplayer::ApplyStartupRecords() {
+  CHECK(XServer::Testing());
+  CHECK(!have_next_event_);
+  have_next_event_ = ReadToNextEvent(&next_event_);
+}
+
+
+void EventReplayer::Replay(WindowManager* window_manager, bool paced) {
+  CHECK(window_manager);
+  XServer* x_server = XServer::Get();
+
+  double start_time = GetMonotonicTime();
+  double first_event_time = next_event_.time;
+
+  while (have_next_event_) {
+    EventTraceRecord record = next_event_;
+
+    // The records after this event describe what the server told us while
+    // it was being handled, so they need to be applied first.
+    have_next_event_ = ReadToNextEvent(&next_event_);
+
+    if (paced) {
+      double delay = (record.time - first_event_time) -
+                     (GetMonotonicTime() - start_time);
+      if (delay > 0) usleep(static_cast<useconds_t>(delay * 1e6));
+    }
+
+    // Treat each event as its own batch.
+    XServer::RequestBatch request_batch(x_server);
+    x_server->event_stats_.RecordReceived(record.event.type);
+    double handler_start = GetMonotonicTime();
+    x_server->HandleEvent(record.event, window_manager);
+    handler_time_ += GetMonotonicTime() - handler_start;
+    num_events_++;
+
+    x_server->focus_manager_.Commit();
+    x_server->event_loop_->RunOnce(false);
+  }
+}
+
+
+bool EventReplayer::ReadToNextEvent(EventTraceRecord* event_record) {
+  CHECK(event_record);
+  EventTraceRecord record;
+  while (reader_->Read(&record)) {
+    if (record.type == EventTraceRecord::EVENT) {
+      *event_record = record;
+      return true;
+    }
+    ApplyRecord(record);
+  }
+  return false;
+}
+
+
+void EventReplayer::ApplyRecord(const EventTraceRecord& record) {
+  switch (record.type) {
+    case EventTraceRecord::CREATE_WINDOW:
+      MockXWindow::AddCannedId(record.window);
+      break;
+    case EventTraceRecord::GEOMETRY:
+      MockXWindow::AddCannedGeometry(record.window, record.x, record.y,
+                                     record.width, record.height);
+      break;
+    case EventTraceRecord::PROPERTIES:
+      MockXWindow::AddCannedProperties(record.window, record.props,
+                                       record.transient_for, record.success);
+      break;
+    default:
+      CHECK(false);
+  }
+}
+
+}  // namespace wham
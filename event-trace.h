@@ -0,0 +1,196 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __EVENT_TRACE_H__
+#define __EVENT_TRACE_H__
+
+#include <cstdio>
+#include <string>
+
+#include <stdint.h>
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+#include "event.h"
+#include "util.h"
+#include "window-properties.h"
+
+using namespace std;
+
+class EventTraceTestSuite;  // from event-trace_test.h
+
+namespace wham {
+
+class WindowManager;
+
+// A single record from a trace file.  Each EVENT record is followed by
+// records describing what the X server told us while the event was being
+// handled (and records before the first event describe what happened
+// during startup).
+struct EventTraceRecord {
+  enum Type {
+    // An event that was passed to XServer::ProcessEvent().
+    EVENT = 1,
+
+    // XWindow::Create() created a window with ID 'window'.
+    CREATE_WINDOW,
+
+    // The initial geometry of 'window'.
+    GEOMETRY,
+
+    // The properties of 'window' after a call to
+    // XWindow::UpdateAllProperties() or after the reply to
+    // XWindow::RequestPropertyUpdate() arrived, and whether the
+    // properties could be read.
+    PROPERTIES,
+  };
+
+  EventTraceRecord()
+      : type(EVENT),
+        time(0),
+        event(),
+        window(None),
+        x(0),
+        y(0),
+        width(0),
+        height(0),
+        props(),
+        transient_for(None),
+        success(false) {}
+
+  Type type;
+
+  // EVENT: Monotonic time at which the event was handled.
+  double time;
+  Event event;
+
+  ::Window window;
+
+  // GEOMETRY
+  int x;
+  int y;
+  uint width;
+  uint height;
+
+  // PROPERTIES.  'props.transient_for' is always NULL; the ID of the
+  // window is stored in 'transient_for' instead.
+  WindowProperties props;
+  ::Window transient_for;
+  bool success;
+};
+
+
+// Writes a trace file.  The format is a header followed by a sequence of
+// records in the machine's native byte order; traces are meant to be
+// replayed on the machine where they were recorded.
+class EventTraceWriter {
+ public:
+  EventTraceWriter();
+  ~EventTraceWriter();
+
+  // Create 'filename' and write the header.  Returns false on failure.
+  bool Open(const string& filename);
+
+  void WriteEvent(const Event& event, double time);
+  void WriteCreateWindow(::Window id);
+  void WriteGeometry(::Window id, int x, int y, uint width, uint height);
+  void WriteProperties(::Window id,
+                       const WindowProperties& props,
+                       bool success);
+
+  // Write buffered records to the file.
+  void Flush();
+
+ private:
+  void WriteUint8(uint8_t value);
+  void WriteUint32(uint32_t value);
+  void WriteInt32(int32_t value) { WriteUint32(value); }
+  void WriteFloat(float value);
+  void WriteDouble(double value);
+  void WriteString(const string& value);
+
+  FILE* file_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(EventTraceWriter);
+};
+
+
+// Reads a trace file written by EventTraceWriter.
+class EventTraceReader {
+ public:
+  EventTraceReader();
+  ~EventTraceReader();
+
+  // Open 'filename' and check its header.  Returns false on failure.
+  bool Open(const string& filename);
+
+  // Read the next record into 'record'.  Returns false at the end of the
+  // file or if the trace is corrupt.
+  bool Read(EventTraceRecord* record);
+
+ private:
+  bool ReadUint8(uint8_t* value);
+  bool ReadUint32(uint32_t* value);
+  bool ReadInt32(int32_t* value);
+  bool ReadInt(int* value);
+  bool ReadUint(uint* value);
+  bool ReadFloat(float* value);
+  bool ReadDouble(double* value);
+  bool ReadString(string* value);
+
+  FILE* file_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(EventTraceReader);
+};
+
+
+// Feeds a recorded trace into a WindowManager without an X server.  The
+// XServer must be in testing mode, so windows are MockXWindows; the
+// geometry, properties and window IDs that the real server handed out
+// while the trace was recorded are given to them as canned data.
+class EventReplayer {
+ public:
+  EventReplayer(EventTraceReader* reader);
+
+  // Apply the records that precede the first event.  This should be
+  // called before the WindowManager is created and initialized.
+  void ApplyStartupRecords();
+
+  // Replay all of the trace's events against 'window_manager'.  If
+  // 'paced' is true, the events are handled with the same spacing as when
+  // they were recorded; otherwise, they're handled as fast as possible.
+  // Expired timeouts are run between events either way.
+  void Replay(WindowManager* window_manager, bool paced);
+
+  int num_events() const { return num_events_; }
+
+  // Time spent handling events, in seconds.
+  double handler_time() const { return handler_time_; }
+
+ private:
+  friend class ::EventTraceTestSuite;
+
+  // Read records up to and including the next EVENT record, applying any
+  // other records along the way.  Returns false at the end of the trace.
+  bool ReadToNextEvent(EventTraceRecord* event_record);
+
+  // Hand the data from a non-EVENT record to MockXWindow.
+  void ApplyRecord(const EventTraceRecord& record);
+
+  EventTraceReader* reader_;  // not owned
+
+  // The next EVENT record, if we've already read it.
+  EventTraceRecord next_event_;
+  bool have_next_event_;
+
+  int num_events_;
+  double handler_time_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(EventReplayer);
+};
+
+}  // namespace wham
+
+#endif
@@ -0,0 +1,159 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "event-trace.h"
+
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "event.h"
+#include "mock-x-window.h"
+#include "window-manager.h"
+#include "window-properties.h"
+#include "window.h"
+#include "x-server.h"
+#include "x-window.h"
+
+using namespace wham;
+
+class EventTraceTestSuite : public CxxTest::TestSuite {
+ public:
+  void setUp() {
+    XServer::SetupTesting();
+    MockXWindow::ClearCannedData();
+    char filename[] = "/tmp/wham_trace_test.XXXXXX";
+    int fd = mkstemp(filename);
+    TS_ASSERT(fd != -1);
+    close(fd);
+    filename_ = filename;
+  }
+
+  void tearDown() {
+    unlink(filename_.c_str());
+    MockXWindow::ClearCannedData();
+  }
+
+  void testRoundTrip() {
+    XWindow* transient_for = XWindow::Create(0, 0, 10, 10);
+
+    Event event(Event::BUTTON_PRESS, 0x123);
+    event.x = -5;
+    event.y = 40;
+    event.detail = 3;
+    event.state = 0x4;
+
+    WindowProperties props;
+    props.window_name = "window name";
+    props.app_class = "Class";
+    props.min_width = 20;
+    props.max_aspect = 1.5;
+    props.transient_for = transient_for;
+
+    {
+      EventTraceWriter writer;
+      TS_ASSERT(writer.Open(filename_));
+      writer.WriteCreateWindow(0x200);
+      writer.WriteEvent(event, 12.5);
+      writer.WriteGeometry(0x200, 1, -2, 300, 400);
+      writer.WriteProperties(0x200, props, false);
+    }
+
+    EventTraceReader reader;
+    TS_ASSERT(reader.Open(filename_));
+    EventTraceRecord record;
+
+    TS_ASSERT(reader.Read(&record));
+    TS_ASSERT_EQUALS(record.type, EventTraceRecord::CREATE_WINDOW);
+    TS_ASSERT_EQUALS(record.window, 0x200U);
+
+    TS_ASSERT(reader.Read(&record));
+    TS_ASSERT_EQUALS(record.type, EventTraceRecord::EVENT);
+    TS_ASSERT_EQUALS(record.time, 12.5);
+    TS_ASSERT_EQUALS(record.event.type, Event::BUTTON_PRESS);
+    TS_ASSERT_EQUALS(record.event.window, 0x123U);
+    TS_ASSERT_EQUALS(record.event.x, -5);
+    TS_ASSERT_EQUALS(record.event.y, 40);
+    TS_ASSERT_EQUALS(record.event.detail, 3U);
+    TS_ASSERT_EQUALS(record.event.state, 0x4U);
+
+    TS_ASSERT(reader.Read(&record));
+    TS_ASSERT_EQUALS(record.type, EventTraceRecord::GEOMETRY);
+    TS_ASSERT_EQUALS(record.window, 0x200U);
+    TS_ASSERT_EQUALS(record.x, 1);
+    TS_ASSERT_EQUALS(record.y, -2);
+    TS_ASSERT_EQUALS(record.width, 300U);
+    TS_ASSERT_EQUALS(record.height, 400U);
+
+    TS_ASSERT(reader.Read(&record));
+    TS_ASSERT_EQUALS(record.type, EventTraceRecord::PROPERTIES);
+    TS_ASSERT_EQUALS(record.window, 0x200U);
+    TS_ASSERT_EQUALS(record.success, false);
+    TS_ASSERT_EQUALS(record.transient_for, transient_for->id());
+    TS_ASSERT_EQUALS(record.props.window_name, "window name");
+    TS_ASSERT_EQUALS(record.props.app_class, "Class");
+    TS_ASSERT_EQUALS(record.props.min_width, 20U);
+    TS_ASSERT_EQUALS(record.props.max_aspect, 1.5);
+    TS_ASSERT(record.props.transient_for == NULL);
+
+    // We should hit the end of the file.
+    TS_ASSERT(!reader.Read(&record));
+  }
+
+  void testRejectBadFile() {
+    FILE* file = fopen(filename_.c_str(), "w");
+    fputs("not a trace", file);
+    fclose(file);
+
+    EventTraceReader reader;
+    TS_ASSERT(!reader.Open(filename_));
+  }
+
+  void testReplay() {
+    const ::Window kClientId = 0x100000;
+    const ::Window kFrameId = 0x100001;
+
+    // Write the trace that we'd get if a client window asked to be mapped:
+    // the MapRequest, followed by the client's geometry and properties and
+    // the creation of its frame while the event was handled.
+    {
+      EventTraceWriter writer;
+      TS_ASSERT(writer.Open(filename_));
+      writer.WriteEvent(Event(Event::MAP_REQUEST, kClientId), 1.0);
+      writer.WriteGeometry(kClientId, 20, 30, 400, 300);
+      WindowProperties props;
+      props.window_name = "replayed";
+      writer.WriteProperties(kClientId, props, true);
+      writer.WriteCreateWindow(kFrameId);
+      writer.WriteGeometry(kFrameId, 0, 0, 410, 310);
+    }
+
+    EventTraceReader reader;
+    TS_ASSERT(reader.Open(filename_));
+    EventReplayer replayer(&reader);
+    replayer.ApplyStartupRecords();
+    TS_ASSERT(replayer.have_next_event_);
+
+    WindowManager wm;
+    wm.SetupDefaultCrap();
+    replayer.Replay(&wm, false);
+    TS_ASSERT_EQUALS(replayer.num_events(), 1);
+    TS_ASSERT(!replayer.have_next_event_);
+
+    // The client should've been created with the recorded geometry and
+    // properties, and its frame should've gotten the recorded ID.
+    XWindow* xwin = XServer::Get()->GetWindow(kClientId, false);
+    TS_ASSERT(xwin != NULL);
+    TS_ASSERT_EQUALS(xwin->initial_width(), 400U);
+    TS_ASSERT_EQUALS(xwin->initial_height(), 300U);
+    wham::Window* win = xwin->client_window();
+    TS_ASSERT(win != NULL);
+    TS_ASSERT_EQUALS(win->title(), "replayed");
+    TS_ASSERT_EQUALS(win->frame()->id(), kFrameId);
+  }
+
+ private:
+  string filename_;
+};
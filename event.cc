@@ -0,0 +1,141 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "event.h"
+
+#include <set>
+
+using namespace std;
+
+namespace wham {
+
+const char* Event::TypeToName(Type type) {
+  switch (type) {
+    case BUTTON_PRESS: return "ButtonPress";
+    case BUTTON_RELEASE: return "ButtonRelease";
+    case CONFIGURE_NOTIFY: return "ConfigureNotify";
+    case CREATE_NOTIFY: return "CreateNotify";
+    case DAMAGE_NOTIFY: return "DamageNotify";
+    case DESTROY_NOTIFY: return "DestroyNotify";
+    case ENTER_NOTIFY: return "EnterNotify";
+    case EXPOSE: return "Expose";
+    case FOCUS_IN: return "FocusIn";
+    case FOCUS_OUT: return "FocusOut";
+    case KEY_PRESS: return "KeyPress";
+    case KEY_RELEASE: return "KeyRelease";
+    case MAP_REQUEST: return "MapRequest";
+    case MOTION_NOTIFY: return "MotionNotify";
+    case PROPERTY_NOTIFY: return "PropertyNotify";
+    case UNMAP_NOTIFY: return "UnmapNotify";
+    default: return "Unknown event";
+  }
+}
+
+
+string Event::DebugString() const {
+  return StringPrintf("%s: xwin=0x%lx x=%d y=%d detail=%u state=%u",
+                      TypeToName(type), window, x, y, detail, state);
+}
+
+
+void CoalesceEvents(vector<Event>* events) {
+  CHECK(events);
+
+  // Walk backwards through the batch, remembering which events we've
+  // already seen later on.
+  set< ::Window> motion_windows;
+  set< ::Window> configured_windows;
+  set<pair< ::Window, uint> > property_atoms;
+  set< ::Window> destroyed_windows;
+  set< ::Window> damaged_windows;
+  set< ::Window> exposed_windows;
+  vector<bool> drop(events->size(), false);
+
+  for (int i = static_cast<int>(events->size()) - 1; i >= 0; --i) {
+    const Event& event = (*events)[i];
+    switch (event.type) {
+      case Event::BUTTON_PRESS:
+      case Event::BUTTON_RELEASE:
+        // Motion before a button event needs to be handled before it
+        // (e.g. to start a drag from the right place).
+        motion_windows.clear();
+        break;
+      case Event::MOTION_NOTIFY:
+        drop[i] = !motion_windows.insert(event.window).second;
+        break;
+      case Event::PROPERTY_NOTIFY:
+        drop[i] = !property_atoms.insert(
+            make_pair(event.window, event.detail)).second;
+        break;
+      case Event::DESTROY_NOTIFY:
+        destroyed_windows.insert(event.window);
+        break;
+      case Event::ENTER_NOTIFY:
+        drop[i] = destroyed_windows.count(event.window) > 0;
+        break;
+      case Event::CONFIGURE_NOTIFY:
+        drop[i] = !configured_windows.insert(event.window).second;
+        break;
+      case Event::DAMAGE_NOTIFY:
+        drop[i] = !damaged_windows.insert(event.window).second;
+        break;
+      case Event::EXPOSE:
+        drop[i] = !exposed_windows.insert(event.window).second;
+        break;
+      default:
+        break;
+    }
+  }
+
+  size_t num_kept = 0;
+  for (size_t i = 0; i < events->size(); ++i) {
+    if (drop[i]) continue;
+    if (num_kept != i) (*events)[num_kept] = (*events)[i];
+    num_kept++;
+  }
+  events->resize(num_kept);
+}
+
+
+bool IsDeferrableEventType(Event::Type type) {
+  return type == Event::DAMAGE_NOTIFY ||
+         type == Event::EXPOSE ||
+         type == Event::PROPERTY_NOTIFY;
+}
+
+
+void SplitDeferrableEvents(vector<Event>* events, vector<Event>* deferred) {
+  CHECK(events);
+  CHECK(deferred);
+
+  // Walk backwards to find out which deferrable events have urgent events
+  // for the same window after them; those need to stay where they are.
+  set< ::Window> urgent_windows;
+  vector<bool> defer(events->size(), false);
+  size_t num_deferred = 0;
+  for (int i = static_cast<int>(events->size()) - 1; i >= 0; --i) {
+    const Event& event = (*events)[i];
+    if (urgent_windows.count(event.window)) continue;
+    if (IsDeferrableEventType(event.type)) {
+      defer[i] = true;
+      num_deferred++;
+    } else {
+      urgent_windows.insert(event.window);
+    }
+  }
+  if (!num_deferred) return;
+
+  deferred->reserve(deferred->size() + num_deferred);
+  size_t num_kept = 0;
+  for (size_t i = 0; i < events->size(); ++i) {
+    if (defer[i]) {
+      deferred->push_back((*events)[i]);
+      continue;
+    }
+    if (num_kept != i) (*events)[num_kept] = (*events)[i];
+    num_kept++;
+  }
+  events->resize(num_kept);
+}
+
+}  // namespace wham
@@ -0,0 +1,135 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#include <vector>
+
+#include <stdint.h>
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+#include "util.h"
+
+using namespace std;
+
+namespace wham {
+
+// A decoded X event.  Only the fields that we actually use are copied out
+// of the original event, so that events are small and uniform enough to be
+// batched and coalesced cheaply.
+struct Event {
+  enum Type {
+    UNKNOWN = 0,
+    BUTTON_PRESS,
+    BUTTON_RELEASE,
+    CONFIGURE_NOTIFY,
+    CREATE_NOTIFY,
+    DAMAGE_NOTIFY,
+    DESTROY_NOTIFY,
+    ENTER_NOTIFY,
+    EXPOSE,
+    FOCUS_IN,
+    FOCUS_OUT,
+    KEY_PRESS,
+    KEY_RELEASE,
+    MAP_REQUEST,
+    MOTION_NOTIFY,
+    PROPERTY_NOTIFY,
+    UNMAP_NOTIFY,
+    NUM_TYPES,
+  };
+
+  Event()
+      : type(UNKNOWN),
+        window(None),
+        x(0),
+        y(0),
+        detail(0),
+        state(0),
+        time(CurrentTime),
+        sequence(0) {}
+
+  Event(Type type, ::Window window)
+      : type(type),
+        window(window),
+        x(0),
+        y(0),
+        detail(0),
+        state(0),
+        time(CurrentTime),
+        sequence(0) {}
+
+  static const char* TypeToName(Type type);
+
+  string DebugString() const;
+
+  Type type;
+
+  // The window that the event is about.  For DamageNotify, this is the
+  // damaged drawable; for UnmapNotify and DestroyNotify, it's the window
+  // that was unmapped or destroyed (rather than its parent).
+  ::Window window;
+
+  // Pointer position relative to the root window, for button and motion
+  // events, or the window's position relative to its parent for
+  // ConfigureNotify and CreateNotify.
+  int x;
+  int y;
+
+  // Type-specific detail: the button for button events, the (unshifted)
+  // keysym for key events, the atom for PropertyNotify, the damage
+  // object for DamageNotify, the detail field (NotifyAncestor, etc.)
+  // for focus events, and the width for ConfigureNotify and CreateNotify.
+  uint detail;
+
+  // Type-specific state: the modifier mask for key events,
+  // PropertyNewValue or PropertyDelete for PropertyNotify, the mode
+  // field (NotifyNormal, etc.) for focus events, and the height for
+  // ConfigureNotify and CreateNotify.
+  uint state;
+
+  // Server timestamp for button, key, motion and crossing events, or
+  // CurrentTime.  This isn't recorded in traces.
+  Time time;
+
+  // Sequence number of the last request that the server had processed
+  // when it generated the event.
+  uint32_t sequence;
+};
+
+
+// Reduce a batch of events in place, dropping events that would be made
+// redundant by later events in the same batch:
+//
+// - MotionNotify is dropped if there's a later MotionNotify for the same
+//   window, unless a button was pressed or released in between.
+// - PropertyNotify is dropped if there's a later PropertyNotify for the
+//   same window and atom.
+// - EnterNotify is dropped if the window is destroyed later in the batch.
+// - ConfigureNotify, DamageNotify and Expose are dropped if there's a
+//   later event of the same type for the same window.
+//
+// The relative order of the remaining events is preserved.
+void CoalesceEvents(vector<Event>* events);
+
+// Can 'type' wait until more urgent events have been handled?  Expose,
+// DamageNotify and PropertyNotify only lead to redrawing or to updating
+// our idea of a client's properties, while input and changes to the
+// window hierarchy affect what the user sees happen next.
+bool IsDeferrableEventType(Event::Type type);
+
+// Move the deferrable events in 'events' to the end of 'deferred',
+// leaving the rest in 'events'.  A deferrable event is only moved if
+// there are no later non-deferrable events for the same window in the
+// batch, so events for any single window are still handled in the order
+// in which they were received.  The relative order of the events within
+// each list is preserved.
+void SplitDeferrableEvents(vector<Event>* events, vector<Event>* deferred);
+
+}  // namespace wham
+
+#endif
@@ -0,0 +1,169 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "event.h"
+#include "util.h"
+
+using namespace wham;
+
+class EventTestSuite : public CxxTest::TestSuite {
+ public:
+  static Event MakeEvent(Event::Type type, ::Window window, uint detail) {
+    Event event(type, window);
+    event.detail = detail;
+    return event;
+  }
+
+  // Get a string listing the types and windows of 'events', e.g.
+  // "MotionNotify:1 Expose:2".
+  static string Describe(const vector<Event>& events) {
+    vector<string> parts;
+    for (vector<Event>::const_iterator it = events.begin();
+         it != events.end(); ++it) {
+      parts.push_back(StringPrintf("%s:%lu",
+                                   Event::TypeToName(it->type), it->window));
+    }
+    string out;
+    for (size_t i = 0; i < parts.size(); ++i) {
+      if (i > 0) out += " ";
+      out += parts[i];
+    }
+    return out;
+  }
+
+  void testMotion() {
+    vector<Event> events;
+    events.push_back(MakeEvent(Event::MOTION_NOTIFY, 1, 0));
+    events.push_back(MakeEvent(Event::MOTION_NOTIFY, 2, 0));
+    events.push_back(MakeEvent(Event::MOTION_NOTIFY, 1, 0));
+    events.back().x = 10;
+    CoalesceEvents(&events);
+    TS_ASSERT_EQUALS(Describe(events), "MotionNotify:2 MotionNotify:1");
+    TS_ASSERT_EQUALS(events[1].x, 10);
+
+    // Motion on either side of a button event should be preserved.
+    events.clear();
+    events.push_back(MakeEvent(Event::MOTION_NOTIFY, 1, 0));
+    events.push_back(MakeEvent(Event::MOTION_NOTIFY, 1, 0));
+    events.push_back(MakeEvent(Event::BUTTON_RELEASE, 1, 1));
+    events.push_back(MakeEvent(Event::MOTION_NOTIFY, 1, 0));
+    events.push_back(MakeEvent(Event::MOTION_NOTIFY, 1, 0));
+    CoalesceEvents(&events);
+    TS_ASSERT_EQUALS(Describe(events),
+                     "MotionNotify:1 ButtonRelease:1 MotionNotify:1");
+  }
+
+  void testProperty() {
+    vector<Event> events;
+    events.push_back(MakeEvent(Event::PROPERTY_NOTIFY, 1, 39));
+    events.push_back(MakeEvent(Event::PROPERTY_NOTIFY, 1, 67));
+    events.push_back(MakeEvent(Event::PROPERTY_NOTIFY, 2, 39));
+    events.push_back(MakeEvent(Event::PROPERTY_NOTIFY, 1, 39));
+    CoalesceEvents(&events);
+    TS_ASSERT_EQUALS(events.size(), 3U);
+    TS_ASSERT_EQUALS(events[0].window, 1U);
+    TS_ASSERT_EQUALS(events[0].detail, 67U);
+    TS_ASSERT_EQUALS(events[1].window, 2U);
+    TS_ASSERT_EQUALS(events[1].detail, 39U);
+    TS_ASSERT_EQUALS(events[2].window, 1U);
+    TS_ASSERT_EQUALS(events[2].detail, 39U);
+  }
+
+  void testEnterBeforeDestroy() {
+    vector<Event> events;
+    events.push_back(MakeEvent(Event::ENTER_NOTIFY, 1, 0));
+    events.push_back(MakeEvent(Event::ENTER_NOTIFY, 2, 0));
+    events.push_back(MakeEvent(Event::DESTROY_NOTIFY, 1, 0));
+    events.push_back(MakeEvent(Event::ENTER_NOTIFY, 3, 0));
+    CoalesceEvents(&events);
+    TS_ASSERT_EQUALS(Describe(events),
+                     "EnterNotify:2 DestroyNotify:1 EnterNotify:3");
+
+    // An EnterNotify after the window is destroyed isn't affected (not
+    // that we'd get one).
+    events.clear();
+    events.push_back(MakeEvent(Event::DESTROY_NOTIFY, 1, 0));
+    events.push_back(MakeEvent(Event::ENTER_NOTIFY, 1, 0));
+    CoalesceEvents(&events);
+    TS_ASSERT_EQUALS(Describe(events), "DestroyNotify:1 EnterNotify:1");
+  }
+
+  void testDamageAndExpose() {
+    vector<Event> events;
+    events.push_back(MakeEvent(Event::DAMAGE_NOTIFY, 1, 5));
+    events.push_back(MakeEvent(Event::EXPOSE, 2, 0));
+    events.push_back(MakeEvent(Event::DAMAGE_NOTIFY, 1, 5));
+    events.push_back(MakeEvent(Event::EXPOSE, 3, 0));
+    events.push_back(MakeEvent(Event::EXPOSE, 2, 0));
+    events.push_back(MakeEvent(Event::DAMAGE_NOTIFY, 4, 6));
+    CoalesceEvents(&events);
+    TS_ASSERT_EQUALS(Describe(events),
+                     "DamageNotify:1 Expose:3 Expose:2 DamageNotify:4");
+  }
+
+  void testConfigure() {
+    // Only the last ConfigureNotify for each window matters.
+    vector<Event> events;
+    events.push_back(MakeEvent(Event::CONFIGURE_NOTIFY, 1, 0));
+    events.push_back(MakeEvent(Event::CONFIGURE_NOTIFY, 2, 0));
+    events.push_back(MakeEvent(Event::CONFIGURE_NOTIFY, 1, 0));
+    CoalesceEvents(&events);
+    TS_ASSERT_EQUALS(Describe(events), "ConfigureNotify:2 ConfigureNotify:1");
+  }
+
+  void testOtherEventsUntouched() {
+    vector<Event> events;
+    events.push_back(MakeEvent(Event::KEY_PRESS, 1, 0));
+    events.push_back(MakeEvent(Event::KEY_PRESS, 1, 0));
+    events.push_back(MakeEvent(Event::MAP_REQUEST, 2, 0));
+    events.push_back(MakeEvent(Event::UNMAP_NOTIFY, 2, 0));
+    events.push_back(MakeEvent(Event::MAP_REQUEST, 2, 0));
+    CoalesceEvents(&events);
+    TS_ASSERT_EQUALS(events.size(), 5U);
+
+    events.clear();
+    CoalesceEvents(&events);
+    TS_ASSERT(events.empty());
+  }
+
+  void testSplitDeferrable() {
+    // Redrawing and property changes should be moved behind input and
+    // structural changes for other windows.
+    vector<Event> events;
+    events.push_back(MakeEvent(Event::EXPOSE, 1, 0));
+    events.push_back(MakeEvent(Event::PROPERTY_NOTIFY, 2, 0));
+    events.push_back(MakeEvent(Event::KEY_PRESS, 3, 0));
+    events.push_back(MakeEvent(Event::DAMAGE_NOTIFY, 4, 0));
+    events.push_back(MakeEvent(Event::MAP_REQUEST, 5, 0));
+    vector<Event> deferred;
+    SplitDeferrableEvents(&events, &deferred);
+    TS_ASSERT_EQUALS(Describe(events), "KeyPress:3 MapRequest:5");
+    TS_ASSERT_EQUALS(Describe(deferred),
+                     "Expose:1 PropertyNotify:2 DamageNotify:4");
+  }
+
+  void testSplitKeepsPerWindowOrder() {
+    // Deferrable events that come before urgent events for the same
+    // window should stay put, and ones after them can still be deferred.
+    vector<Event> events;
+    events.push_back(MakeEvent(Event::PROPERTY_NOTIFY, 1, 0));
+    events.push_back(MakeEvent(Event::EXPOSE, 2, 0));
+    events.push_back(MakeEvent(Event::MAP_REQUEST, 1, 0));
+    events.push_back(MakeEvent(Event::EXPOSE, 1, 0));
+    vector<Event> deferred;
+    deferred.push_back(MakeEvent(Event::EXPOSE, 3, 0));
+    SplitDeferrableEvents(&events, &deferred);
+    TS_ASSERT_EQUALS(Describe(events), "PropertyNotify:1 MapRequest:1");
+    TS_ASSERT_EQUALS(Describe(deferred), "Expose:3 Expose:2 Expose:1");
+
+    // A batch with nothing to defer should be left alone.
+    events.clear();
+    deferred.clear();
+    events.push_back(MakeEvent(Event::KEY_PRESS, 1, 0));
+    SplitDeferrableEvents(&events, &deferred);
+    TS_ASSERT_EQUALS(events.size(), 1U);
+    TS_ASSERT(deferred.empty());
+  }
+};
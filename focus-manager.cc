@@ -0,0 +1,103 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "focus-manager.h"
+
+#include "window.h"
+#include "x-server.h"
+#include "x-window.h"
+
+using namespace std;
+
+namespace wham {
+
+FocusManager::FocusManager()
+    : pending_window_(None),
+      requested_window_(None),
+      focused_window_(None),
+      last_event_time_(CurrentTime) {
+}
+
+
+void FocusManager::RequestFocus(XWindow* xwin) {
+  CHECK(xwin);
+  pending_window_ = xwin->id();
+}
+
+
+void FocusManager::Commit() {
+  if (pending_window_ == None) return;
+  ::Window id = pending_window_;
+  pending_window_ = None;
+
+  // If we're still waiting to hear about an earlier request, then that's
+  // what the focus is about to be; otherwise, it's whatever the server
+  // last told us.
+  ::Window expected_window =
+      (requested_window_ != None) ? requested_window_ : focused_window_;
+  if (id == expected_window) return;
+
+  // The window may have been destroyed since the request was made.
+  XWindow* xwin = XServer::Get()->GetWindow(id, false);
+  if (!xwin) return;
+
+  bool set_input_focus = true;
+  bool send_take_focus = false;
+  Window* window = xwin->client_window();
+  if (window) {
+    set_input_focus = window->props().accepts_input;
+    send_take_focus = window->props().supports_take_focus;
+  }
+  if (!set_input_focus && !send_take_focus) {
+    DEBUG << "Not focusing 0x" << hex << id << ", which doesn't want input";
+    return;
+  }
+
+  DEBUG << "Focusing 0x" << hex << id;
+  xwin->TakeFocus(set_input_focus, send_take_focus, last_event_time_);
+  // If the client ignores WM_TAKE_FOCUS, we'll never hear about the
+  // request again, so later ones for the window mustn't be dropped.
+  requested_window_ = set_input_focus ? id : None;
+}
+
+
+void FocusManager::HandleFocusIn(::Window id, uint detail, uint mode) {
+  if (!IsRelevant(detail, mode, true)) return;
+  focused_window_ = id;
+  if (requested_window_ == id) requested_window_ = None;
+}
+
+
+void FocusManager::HandleFocusOut(::Window id, uint detail, uint mode) {
+  if (!IsRelevant(detail, mode, false)) return;
+  if (focused_window_ == id) focused_window_ = None;
+  if (requested_window_ == id) requested_window_ = None;
+}
+
+
+void FocusManager::HandleFocusFailed(::Window id) {
+  if (requested_window_ == id) requested_window_ = None;
+}
+
+
+void FocusManager::HandleWindowDestroyed(::Window id) {
+  if (pending_window_ == id) pending_window_ = None;
+  if (requested_window_ == id) requested_window_ = None;
+  if (focused_window_ == id) focused_window_ = None;
+}
+
+
+bool FocusManager::IsRelevant(uint detail, uint mode, bool focus_in) {
+  // Keyboard grabs (e.g. for multi-key bindings) temporarily move the
+  // focus without really changing it.
+  if (mode == NotifyGrab || mode == NotifyUngrab) return false;
+
+  // NotifyInferior means that the focus moved between the window and one
+  // of its subwindows, so the window has it after a FocusIn but still
+  // contains it after a FocusOut.
+  return detail == NotifyAncestor ||
+         detail == NotifyNonlinear ||
+         (focus_in && detail == NotifyInferior);
+}
+
+}  // namespace wham
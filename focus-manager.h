@@ -0,0 +1,92 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __FOCUS_MANAGER_H__
+#define __FOCUS_MANAGER_H__
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+#include "util.h"
+
+using namespace std;
+
+class FocusManagerTestSuite;  // from focus-manager_test.h
+
+namespace wham {
+
+class XWindow;
+
+// Decides when we actually need to ask the X server to change the focus.
+// Focus requests made while an event batch is being handled are collapsed
+// into a single request that's sent at the end of the batch, and requests
+// for windows that already have the focus (or that we've already asked to
+// give it to) are dropped.  We never wait for the server to confirm a
+// focus change; FocusIn and FocusOut events tell us what it actually did.
+class FocusManager {
+ public:
+  FocusManager();
+
+  // Ask for 'xwin' to be focused.  Nothing is sent to the server until
+  // Commit() is called, and later requests replace earlier ones.
+  void RequestFocus(XWindow* xwin);
+
+  // Send the pending request, if there is one and it'd change anything.
+  // Client windows are focused as described by their WM_HINTS input field
+  // and WM_PROTOCOLS (see section 4.1.7 of the ICCCM); windows that want
+  // neither the input focus nor WM_TAKE_FOCUS are left alone.
+  void Commit();
+
+  // Record the timestamp of an event that we've received.  WM_TAKE_FOCUS
+  // messages carry the timestamp of the latest event, as the ICCCM
+  // requires.
+  void RecordEventTime(Time time) { last_event_time_ = time; }
+
+  // Handle FocusIn and FocusOut events for 'id'.  'detail' and 'mode' are
+  // the events' fields of the same names.
+  void HandleFocusIn(::Window id, uint detail, uint mode);
+  void HandleFocusOut(::Window id, uint detail, uint mode);
+
+  // Handle the server refusing to focus 'id' (usually because it was
+  // unmapped before our request got there), so that we won't think that
+  // a later request for it is redundant.
+  void HandleFocusFailed(::Window id);
+
+  // Forget about a window that's been destroyed, in case its ID is
+  // reused.
+  void HandleWindowDestroyed(::Window id);
+
+  // The window that the server last told us has the focus, or None.
+  ::Window focused_window() const { return focused_window_; }
+
+ private:
+  friend class ::FocusManagerTestSuite;
+
+  // Is a FocusIn (if 'focus_in' is true) or FocusOut event with the
+  // passed-in 'detail' and 'mode' about the window itself gaining or
+  // losing the focus (rather than about one of its ancestors or
+  // inferiors, or about a keyboard grab)?
+  static bool IsRelevant(uint detail, uint mode, bool focus_in);
+
+  // The window that we'll try to focus in Commit(), or None.
+  ::Window pending_window_;
+
+  // The window that we most recently asked the server to focus, until we
+  // hear that it's gotten or lost the focus.  Windows that were only sent
+  // WM_TAKE_FOCUS aren't recorded here, since the client may ignore the
+  // message.
+  ::Window requested_window_;
+
+  // The window that has the focus according to the server.
+  ::Window focused_window_;
+
+  // Timestamp passed to RecordEventTime(), or CurrentTime.
+  Time last_event_time_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(FocusManager);
+};
+
+}  // namespace wham
+
+#endif
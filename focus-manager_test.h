@@ -0,0 +1,212 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "focus-manager.h"
+
+#include "mock-x-window.h"
+#include "window-properties.h"
+#include "window.h"
+#include "x-server.h"
+#include "x-window.h"
+
+using namespace wham;
+
+class FocusManagerTestSuite : public CxxTest::TestSuite {
+ public:
+  void setUp() {
+    XServer::SetupTesting();
+    MockXWindow::ClearCannedData();
+  }
+
+  void testDeferAndCollapse() {
+    FocusManager focus_manager;
+    MockXWindow* xwin1 = CreateWindow();
+    MockXWindow* xwin2 = CreateWindow();
+
+    // Nothing should be sent until we commit, and then only the last
+    // request should be sent.
+    focus_manager.RequestFocus(xwin1);
+    focus_manager.RequestFocus(xwin2);
+    TS_ASSERT_EQUALS(xwin1->num_take_focus_calls(), 0);
+    TS_ASSERT_EQUALS(xwin2->num_take_focus_calls(), 0);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin1->num_take_focus_calls(), 0);
+    TS_ASSERT_EQUALS(xwin2->num_take_focus_calls(), 1);
+    TS_ASSERT(xwin2->last_set_input_focus());
+    TS_ASSERT(!xwin2->last_send_take_focus());
+
+    // Committing again without a new request shouldn't do anything.
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin2->num_take_focus_calls(), 1);
+  }
+
+  void testSkipRedundantRequests() {
+    FocusManager focus_manager;
+    MockXWindow* xwin1 = CreateWindow();
+    MockXWindow* xwin2 = CreateWindow();
+
+    // Asking for the same window again before the server has told us
+    // anything shouldn't send another request.
+    focus_manager.RequestFocus(xwin1);
+    focus_manager.Commit();
+    focus_manager.RequestFocus(xwin1);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin1->num_take_focus_calls(), 1);
+
+    // Neither should asking for it after the server confirms it.
+    focus_manager.HandleFocusIn(xwin1->id(), NotifyNonlinear, NotifyNormal);
+    TS_ASSERT_EQUALS(focus_manager.focused_window(), xwin1->id());
+    focus_manager.RequestFocus(xwin1);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin1->num_take_focus_calls(), 1);
+
+    // If we've asked for a different window in the meantime, we need to
+    // switch back.
+    focus_manager.RequestFocus(xwin2);
+    focus_manager.Commit();
+    focus_manager.RequestFocus(xwin1);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin2->num_take_focus_calls(), 1);
+    TS_ASSERT_EQUALS(xwin1->num_take_focus_calls(), 2);
+
+    // Focus changes caused by keyboard grabs should be ignored.
+    focus_manager.HandleFocusIn(xwin1->id(), NotifyNonlinear, NotifyNormal);
+    focus_manager.HandleFocusOut(xwin1->id(), NotifyNonlinear, NotifyGrab);
+    TS_ASSERT_EQUALS(focus_manager.focused_window(), xwin1->id());
+
+    // After the window loses the focus, we should ask for it again.
+    focus_manager.HandleFocusOut(xwin1->id(), NotifyNonlinear, NotifyNormal);
+    TS_ASSERT_EQUALS(focus_manager.focused_window(), None);
+    focus_manager.RequestFocus(xwin1);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin1->num_take_focus_calls(), 3);
+  }
+
+  void testFailedRequest() {
+    FocusManager focus_manager;
+    MockXWindow* xwin = CreateWindow();
+
+    // If the server refuses to focus the window, asking again should send
+    // another request.
+    focus_manager.RequestFocus(xwin);
+    focus_manager.Commit();
+    focus_manager.HandleFocusFailed(xwin->id());
+    focus_manager.RequestFocus(xwin);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin->num_take_focus_calls(), 2);
+  }
+
+  void testDestroyedWindow() {
+    FocusManager focus_manager;
+    MockXWindow* xwin = CreateWindow();
+    focus_manager.RequestFocus(xwin);
+    focus_manager.HandleWindowDestroyed(xwin->id());
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin->num_take_focus_calls(), 0);
+  }
+
+  void testFocusModels() {
+    FocusManager focus_manager;
+
+    // A client that wants WM_TAKE_FOCUS as well as the input focus
+    // should get both.
+    WindowProperties props;
+    props.supports_take_focus = true;
+    MockXWindow* xwin = CreateClientWindow(props);
+    focus_manager.RequestFocus(xwin);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin->num_take_focus_calls(), 1);
+    TS_ASSERT(xwin->last_set_input_focus());
+    TS_ASSERT(xwin->last_send_take_focus());
+
+    // A client that only wants WM_TAKE_FOCUS shouldn't be focused
+    // directly.
+    props.accepts_input = false;
+    xwin = CreateClientWindow(props);
+    focus_manager.RequestFocus(xwin);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin->num_take_focus_calls(), 1);
+    TS_ASSERT(!xwin->last_set_input_focus());
+    TS_ASSERT(xwin->last_send_take_focus());
+
+    // A client that wants neither should be left alone.
+    props.supports_take_focus = false;
+    xwin = CreateClientWindow(props);
+    focus_manager.RequestFocus(xwin);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin->num_take_focus_calls(), 0);
+  }
+
+  void testTakeFocusTime() {
+    FocusManager focus_manager;
+    WindowProperties props;
+    props.supports_take_focus = true;
+    MockXWindow* xwin = CreateClientWindow(props);
+
+    // The message should carry the timestamp of the latest event.
+    focus_manager.RecordEventTime(1234);
+    focus_manager.RecordEventTime(1240);
+    focus_manager.RequestFocus(xwin);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin->last_take_focus_time(), 1240U);
+  }
+
+  void testIgnoredTakeFocus() {
+    FocusManager focus_manager;
+    WindowProperties props;
+    props.accepts_input = false;
+    props.supports_take_focus = true;
+    MockXWindow* xwin1 = CreateClientWindow(props);
+    MockXWindow* xwin2 = CreateWindow();
+
+    // If the client ignores WM_TAKE_FOCUS, asking for it again should
+    // send another message, even if nothing else has gotten the focus.
+    focus_manager.RequestFocus(xwin1);
+    focus_manager.Commit();
+    focus_manager.RequestFocus(xwin1);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin1->num_take_focus_calls(), 2);
+
+    // The same goes for after the focus goes somewhere else.
+    focus_manager.HandleFocusIn(xwin2->id(), NotifyNonlinear, NotifyNormal);
+    focus_manager.RequestFocus(xwin1);
+    focus_manager.Commit();
+    TS_ASSERT_EQUALS(xwin1->num_take_focus_calls(), 3);
+  }
+
+  void testInferiorFocusOut() {
+    FocusManager focus_manager;
+    MockXWindow* xwin = CreateWindow();
+    focus_manager.HandleFocusIn(xwin->id(), NotifyNonlinear, NotifyNormal);
+
+    // The focus moving to one of the window's subwindows doesn't mean that
+    // the window lost it.
+    focus_manager.HandleFocusOut(xwin->id(), NotifyInferior, NotifyNormal);
+    TS_ASSERT_EQUALS(focus_manager.focused_window(), xwin->id());
+    focus_manager.HandleFocusOut(xwin->id(), NotifyPointer, NotifyNormal);
+    TS_ASSERT_EQUALS(focus_manager.focused_window(), xwin->id());
+
+    // Getting it back from the subwindow still counts as a FocusIn.
+    focus_manager.HandleFocusOut(xwin->id(), NotifyNonlinear, NotifyNormal);
+    focus_manager.HandleFocusIn(xwin->id(), NotifyInferior, NotifyNormal);
+    TS_ASSERT_EQUALS(focus_manager.focused_window(), xwin->id());
+  }
+
+ private:
+  MockXWindow* CreateWindow() {
+    return static_cast<MockXWindow*>(XWindow::Create(0, 0, 10, 10));
+  }
+
+  // Create a client window with the passed-in properties.  The Window
+  // object is leaked so that the XWindow keeps its client role.
+  MockXWindow* CreateClientWindow(const WindowProperties& props) {
+    ::Window id = MockXWindow::GetNextId();
+    MockXWindow::AddCannedProperties(id, props, None, true);
+    MockXWindow* xwin = static_cast<MockXWindow*>(
+        XServer::Get()->GetWindow(id, true));
+    new wham::Window(xwin);
+    return xwin;
+  }
+};
@@ -0,0 +1,66 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "idle-task-queue.h"
+
+using namespace std;
+
+namespace wham {
+
+IdleTaskQueue::IdleTaskQueue()
+    : next_task_(0),
+      next_id_(1) {
+}
+
+
+IdleTaskId IdleTaskQueue::Add(IdleTask* task) {
+  CHECK(task);
+  IdleTaskId id = next_id_++;
+  tasks_.push_back(Entry(id, task));
+  return id;
+}
+
+
+bool IdleTaskQueue::Cancel(IdleTaskId id) {
+  int index = FindTask(id);
+  if (index < 0) return false;
+  RemoveAt(index);
+  return true;
+}
+
+
+bool IdleTaskQueue::RunSlice(double budget_sec) {
+  double start = GetMonotonicTime();
+  while (!tasks_.empty()) {
+    if (next_task_ >= tasks_.size()) next_task_ = 0;
+    IdleTaskId id = tasks_[next_task_].id;
+    bool more_work = (*(tasks_[next_task_].task))();
+
+    // The task may have added or cancelled tasks (including itself), so
+    // look it up again.
+    int index = FindTask(id);
+    if (index >= 0) {
+      next_task_ = index + 1;
+      if (!more_work) RemoveAt(index);
+    }
+    if (GetMonotonicTime() - start >= budget_sec) break;
+  }
+  return !tasks_.empty();
+}
+
+
+int IdleTaskQueue::FindTask(IdleTaskId id) const {
+  for (size_t i = 0; i < tasks_.size(); ++i) {
+    if (tasks_[i].id == id) return i;
+  }
+  return -1;
+}
+
+
+void IdleTaskQueue::RemoveAt(size_t index) {
+  CHECK(index < tasks_.size());
+  tasks_.erase(tasks_.begin() + index);
+  if (index < next_task_) next_task_--;
+}
+
+}  // namespace wham
@@ -0,0 +1,87 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __IDLE_TASK_QUEUE_H__
+#define __IDLE_TASK_QUEUE_H__
+
+#include <vector>
+
+#include <stdint.h>
+
+#include "util.h"
+
+using namespace std;
+
+class IdleTaskQueueTestSuite;  // from idle-task-queue_test.h
+
+namespace wham {
+
+// Interface for low-priority work (pre-rendering, saving state, trimming
+// caches) that should only be done when there's nothing else to do.
+// Tasks should split their work into small pieces.
+class IdleTask {
+ public:
+  virtual ~IdleTask() {}
+
+  // Do a piece of work.  Returns true if there's more to do, in which case
+  // the task will be run again later.
+  virtual bool operator()() = 0;
+};
+
+
+// Handle for a task in an IdleTaskQueue.  0 is never a valid handle.
+typedef uint64_t IdleTaskId;
+
+
+// Runs idle tasks round-robin in time-limited slices.
+class IdleTaskQueue {
+ public:
+  IdleTaskQueue();
+
+  bool empty() const { return tasks_.empty(); }
+  size_t size() const { return tasks_.size(); }
+
+  // Add a task.  Ownership of 'task' remains with the caller.
+  IdleTaskId Add(IdleTask* task);
+
+  // Remove a task.  Returns false if it already finished or was
+  // cancelled.  This is safe to call from within a task.
+  bool Cancel(IdleTaskId id);
+
+  // Run tasks until 'budget_sec' has passed or there are no tasks left.
+  // At least one task is run if the queue is non-empty, and a task that
+  // has more work to do goes to the back of the line, so every task makes
+  // progress.  Returns true if any tasks remain.
+  bool RunSlice(double budget_sec);
+
+ private:
+  friend class ::IdleTaskQueueTestSuite;
+
+  struct Entry {
+    Entry(IdleTaskId id, IdleTask* task) : id(id), task(task) {}
+    IdleTaskId id;
+    IdleTask* task;
+  };
+
+  // Get the index of the task with ID 'id', or -1 if there isn't one.
+  int FindTask(IdleTaskId id) const;
+
+  // Remove the task at 'index', keeping 'next_task_' pointing at the same
+  // task.
+  void RemoveAt(size_t index);
+
+  // Tasks in the order in which they were added.  There are only ever a
+  // few of these.
+  vector<Entry> tasks_;
+
+  // Index in 'tasks_' of the next task to run.
+  size_t next_task_;
+
+  IdleTaskId next_id_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(IdleTaskQueue);
+};
+
+}  // namespace wham
+
+#endif
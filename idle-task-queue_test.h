@@ -0,0 +1,104 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "idle-task-queue.h"
+#include "util.h"
+
+using namespace wham;
+
+class IdleTaskQueueTestSuite : public CxxTest::TestSuite {
+ public:
+  // Records its number each time that it's run, and finishes after it's
+  // been run 'num_runs' times.
+  class RecordingIdleTask : public IdleTask {
+   public:
+    RecordingIdleTask(int num, int num_runs, vector<int>* order)
+        : num_(num),
+          runs_left_(num_runs),
+          order_(order) {}
+
+    bool operator()() {
+      order_->push_back(num_);
+      return --runs_left_ > 0;
+    }
+
+   private:
+    int num_;
+    int runs_left_;
+    vector<int>* order_;
+  };
+
+  // Cancels another task (or itself) when it's run.
+  class CancellingIdleTask : public IdleTask {
+   public:
+    CancellingIdleTask(IdleTaskQueue* queue) : queue_(queue), id_(0) {}
+    void set_id(IdleTaskId id) { id_ = id; }
+    bool operator()() {
+      queue_->Cancel(id_);
+      return true;
+    }
+
+   private:
+    IdleTaskQueue* queue_;
+    IdleTaskId id_;
+  };
+
+  void testRoundRobin() {
+    IdleTaskQueue queue;
+    vector<int> order;
+    RecordingIdleTask task1(1, 1, &order), task2(2, 3, &order);
+    queue.Add(&task1);
+    queue.Add(&task2);
+
+    // With no time budget, only one task should be run per slice.
+    TS_ASSERT(queue.RunSlice(0));
+    TS_ASSERT(queue.RunSlice(0));
+    TS_ASSERT_EQUALS(Join(order), "1 2");
+    TS_ASSERT_EQUALS(queue.size(), 1U);
+
+    // A big budget should run everything to completion.
+    TS_ASSERT(!queue.RunSlice(60));
+    TS_ASSERT_EQUALS(Join(order), "1 2 2 2");
+    TS_ASSERT(queue.empty());
+  }
+
+  void testCancel() {
+    IdleTaskQueue queue;
+    vector<int> order;
+    RecordingIdleTask task1(1, 2, &order), task2(2, 2, &order);
+    IdleTaskId id1 = queue.Add(&task1);
+    queue.Add(&task2);
+    TS_ASSERT(queue.Cancel(id1));
+    TS_ASSERT(!queue.Cancel(id1));
+    TS_ASSERT(!queue.RunSlice(60));
+    TS_ASSERT_EQUALS(Join(order), "2 2");
+  }
+
+  void testCancelFromTask() {
+    IdleTaskQueue queue;
+    vector<int> order;
+
+    // A task that cancels a later one should keep it from running.
+    CancellingIdleTask canceller(&queue);
+    RecordingIdleTask task(1, 1, &order);
+    IdleTaskId canceller_id = queue.Add(&canceller);
+    canceller.set_id(queue.Add(&task));
+    TS_ASSERT(queue.RunSlice(0));
+    TS_ASSERT_EQUALS(queue.size(), 1U);
+
+    // A task that cancels itself should just go away.
+    canceller.set_id(canceller_id);
+    TS_ASSERT(!queue.RunSlice(0));
+    TS_ASSERT(order.empty());
+  }
+
+ private:
+  static string Join(const vector<int>& nums) {
+    string out;
+    for (size_t i = 0; i < nums.size(); ++i)
+      out += StringPrintf(i ? " %d" : "%d", nums[i]);
+    return out;
+  }
+};
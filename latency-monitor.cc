@@ -0,0 +1,93 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "latency-monitor.h"
+
+using namespace std;
+
+namespace wham {
+
+// Weight given to each new RTT sample.  This is the value that TCP uses
+// for its smoothed RTT.
+static const double kSmoothingFactor = 0.125;
+
+
+LatencyMonitor::LatencyMonitor()
+    : high_threshold_sec_(0.025),
+      low_threshold_sec_(0.010),
+      high_latency_(false),
+      ping_in_flight_(false),
+      ping_sent_time_(0),
+      smoothed_rtt_(0),
+      num_mode_changes_(0) {
+}
+
+
+void LatencyMonitor::SetThresholds(double high_sec, double low_sec) {
+  CHECK(low_sec >= 0);
+  CHECK(low_sec <= high_sec);
+  high_threshold_sec_ = high_sec;
+  low_threshold_sec_ = low_sec;
+}
+
+
+void LatencyMonitor::RecordPingSent(double now) {
+  CHECK(!ping_in_flight_);
+  ping_in_flight_ = true;
+  ping_sent_time_ = now;
+}
+
+
+bool LatencyMonitor::RecordPingReply(double now) {
+  CHECK(ping_in_flight_);
+  ping_in_flight_ = false;
+
+  double rtt = now - ping_sent_time_;
+  if (rtt < 0) rtt = 0;
+  rtts_.Add(rtt);
+  if (rtts_.count() == 1)
+    smoothed_rtt_ = rtt;
+  else
+    smoothed_rtt_ += kSmoothingFactor * (rtt - smoothed_rtt_);
+  return UpdateMode();
+}
+
+
+bool LatencyMonitor::CheckPingInFlight(double now) {
+  if (!ping_in_flight_) return false;
+
+  // The reply will take at least this long, so there's no need to wait
+  // for it to raise the smoothed RTT.
+  double elapsed = now - ping_sent_time_;
+  if (elapsed <= smoothed_rtt_) return false;
+  smoothed_rtt_ = elapsed;
+  return UpdateMode();
+}
+
+
+string LatencyMonitor::DebugString() const {
+  return StringPrintf(
+      "X server RTT (ms): smoothed %.3f, mean %.3f, p50 %.3f, p99 %.3f, "
+      "max %.3f over %llu pings; %s latency, %llu mode changes\n",
+      1000 * smoothed_rtt_,
+      1000 * rtts_.mean(),
+      1000 * rtts_.GetPercentile(50),
+      1000 * rtts_.GetPercentile(99),
+      1000 * rtts_.max(),
+      static_cast<unsigned long long>(rtts_.count()),
+      high_latency_ ? "high" : "normal",
+      static_cast<unsigned long long>(num_mode_changes_));
+}
+
+
+bool LatencyMonitor::UpdateMode() {
+  bool high_latency = high_latency_ ?
+      smoothed_rtt_ >= low_threshold_sec_ :
+      smoothed_rtt_ >= high_threshold_sec_;
+  if (high_latency == high_latency_) return false;
+  high_latency_ = high_latency;
+  num_mode_changes_++;
+  return true;
+}
+
+}  // namespace wham
@@ -0,0 +1,90 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __LATENCY_MONITOR_H__
+#define __LATENCY_MONITOR_H__
+
+#include <string>
+
+#include <stdint.h>
+
+#include "event-stats.h"
+#include "util.h"
+
+using namespace std;
+
+class LatencyMonitorTestSuite;  // from latency-monitor_test.h
+
+namespace wham {
+
+// Tracks the round-trip time to the X server and decides whether we're
+// talking to it over a slow link (ssh -X, a nested server on another
+// machine, etc.).
+//
+// The caller periodically sends a cheap request with a reply and reports
+// when it was sent and when the reply arrived; only one ping is in flight
+// at a time.  The RTT is smoothed with an exponentially-weighted moving
+// average, as TCP does.  We switch to high-latency mode when the smoothed
+// RTT reaches the high threshold and back when it drops below the low
+// one, so that a link that hovers around a single threshold doesn't make
+// us flap between modes.
+class LatencyMonitor {
+ public:
+  LatencyMonitor();
+
+  // Set the smoothed RTTs (in seconds) at which we enter and leave
+  // high-latency mode.  'low_sec' must not be greater than 'high_sec'.
+  void SetThresholds(double high_sec, double low_sec);
+
+  bool high_latency() const { return high_latency_; }
+  bool ping_in_flight() const { return ping_in_flight_; }
+
+  // Smoothed RTT, in seconds, or 0 if no replies have arrived yet.
+  double smoothed_rtt() const { return smoothed_rtt_; }
+
+  // Every RTT that's been measured.
+  const LatencyHistogram& rtts() const { return rtts_; }
+
+  // Record that a ping was sent at 'now' (a monotonic time, in seconds).
+  void RecordPingSent(double now);
+
+  // Record that the reply to the in-flight ping arrived at 'now'.
+  // Returns true if we switched modes.
+  bool RecordPingReply(double now);
+
+  // Check how long the in-flight ping has been waiting as of 'now'.  If
+  // it's already taken longer than the smoothed RTT, the smoothed RTT is
+  // raised to match, so that a stalled link is noticed without waiting
+  // for the reply.  Returns true if we switched modes.
+  bool CheckPingInFlight(double now);
+
+  // Get a description of the RTTs measured so far.
+  string DebugString() const;
+
+ private:
+  friend class ::LatencyMonitorTestSuite;
+
+  // Update 'high_latency_' using the current smoothed RTT.  Returns true
+  // if it changed.
+  bool UpdateMode();
+
+  double high_threshold_sec_;
+  double low_threshold_sec_;
+
+  bool high_latency_;
+
+  bool ping_in_flight_;
+  double ping_sent_time_;
+
+  double smoothed_rtt_;
+  LatencyHistogram rtts_;
+
+  // Number of times that we've switched modes.
+  uint64_t num_mode_changes_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(LatencyMonitor);
+};
+
+}  // namespace wham
+
+#endif
@@ -0,0 +1,95 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "latency-monitor.h"
+
+#include "util.h"
+
+using namespace wham;
+
+class LatencyMonitorTestSuite : public CxxTest::TestSuite {
+ public:
+  void testSmoothing() {
+    LatencyMonitor monitor;
+    monitor.SetThresholds(0.025, 0.010);
+    TS_ASSERT(!monitor.ping_in_flight());
+
+    // The first RTT is used as-is.
+    TS_ASSERT(!Ping(&monitor, 10.0, 0.004));
+    TS_ASSERT_DELTA(monitor.smoothed_rtt(), 0.004, 1e-9);
+
+    // Later ones are only given an eighth of the weight.
+    TS_ASSERT(!Ping(&monitor, 11.0, 0.012));
+    TS_ASSERT_DELTA(monitor.smoothed_rtt(), 0.005, 1e-9);
+    TS_ASSERT_EQUALS(monitor.rtts().count(), 2U);
+    TS_ASSERT(!monitor.high_latency());
+  }
+
+  void testHysteresis() {
+    LatencyMonitor monitor;
+    monitor.SetThresholds(0.025, 0.010);
+    TS_ASSERT(!Ping(&monitor, 0, 0.010));
+
+    // A single slow ping shouldn't be enough to switch modes...
+    TS_ASSERT(!Ping(&monitor, 1, 0.060));
+    TS_ASSERT(!monitor.high_latency());
+
+    // ...but a few more should.
+    bool changed = false;
+    double now = 2;
+    while (!changed && now < 10) changed = Ping(&monitor, now++, 0.060);
+    TS_ASSERT(changed);
+    TS_ASSERT(monitor.high_latency());
+    TS_ASSERT(monitor.smoothed_rtt() >= 0.025);
+
+    // Dropping below the high threshold isn't enough to switch back; we
+    // need to get below the low one.
+    monitor.smoothed_rtt_ = 0.020;
+    TS_ASSERT(!Ping(&monitor, now++, 0.020));
+    TS_ASSERT(monitor.high_latency());
+    monitor.smoothed_rtt_ = 0.011;
+    TS_ASSERT(Ping(&monitor, now++, 0.001));
+    TS_ASSERT(!monitor.high_latency());
+    TS_ASSERT_EQUALS(monitor.num_mode_changes_, 2U);
+  }
+
+  void testStalledPing() {
+    LatencyMonitor monitor;
+    monitor.SetThresholds(0.025, 0.010);
+    TS_ASSERT(!Ping(&monitor, 0, 0.005));
+
+    // Nothing changes while the ping is taking less time than usual.
+    monitor.RecordPingSent(1.0);
+    TS_ASSERT(!monitor.CheckPingInFlight(1.004));
+    TS_ASSERT_DELTA(monitor.smoothed_rtt(), 0.005, 1e-9);
+
+    // Once it's been waiting for longer than the high threshold, we should
+    // switch modes without waiting for the reply.
+    TS_ASSERT(!monitor.CheckPingInFlight(1.020));
+    TS_ASSERT_DELTA(monitor.smoothed_rtt(), 0.020, 1e-9);
+    TS_ASSERT(monitor.CheckPingInFlight(1.500));
+    TS_ASSERT(monitor.high_latency());
+    TS_ASSERT(!monitor.CheckPingInFlight(1.600));
+
+    // The reply is even slower, so we should stay in high-latency mode.
+    TS_ASSERT(!monitor.RecordPingReply(1.700));
+    TS_ASSERT(monitor.high_latency());
+    TS_ASSERT_DELTA(monitor.smoothed_rtt(), 0.6125, 1e-9);
+
+    // Nothing should happen without a ping in flight.
+    TS_ASSERT(!monitor.CheckPingInFlight(5.0));
+  }
+
+ private:
+  // Record a ping sent at 'now' that took 'rtt' seconds.  Returns true if
+  // the monitor switched modes.
+  static bool Ping(LatencyMonitor* monitor, double now, double rtt) {
+    monitor->RecordPingSent(now);
+    TS_ASSERT(monitor->ping_in_flight());
+    bool changed = monitor->RecordPingReply(now + rtt);
+    TS_ASSERT(!monitor->ping_in_flight());
+    return changed;
+  }
+};
@@ -0,0 +1,362 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+// Forwards X connections from one local display to another, holding on
+// to everything that passes through it for a while.  Running wham against
+// the proxy's display makes a local X server (e.g. Xvfb) look like one
+// that's on the other end of a slow link; see run_with_latency.sh.
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "util.h"
+
+using namespace std;
+using namespace wham;
+
+static const char* kUsage =
+    "Usage: wham-latency-proxy [options] LISTEN_DISPLAY SERVER_DISPLAY\n"
+    "\n"
+    "Accepts X connections for LISTEN_DISPLAY (e.g. \":2\") and forwards\n"
+    "them to the server for SERVER_DISPLAY, delaying the data that's sent in\n"
+    "each direction by half of the round-trip time.\n"
+    "\n"
+    "Options:\n"
+    "  -h, --help               Display this message and exit\n"
+    "  -r MS, --rtt=MS          Round-trip time to add, in milliseconds\n"
+    "                           (default 40)\n";
+
+static const char* kSocketDir = "/tmp/.X11-unix";
+
+// Most data that we'll read from a socket at once.
+static const size_t kReadSize = 65536;
+
+// Set by the SIGINT and SIGTERM handler.
+static volatile sig_atomic_t quit = 0;
+
+
+// Data read from one end of a connection that's waiting to be written to
+// the other end.
+struct Stream {
+  Stream() : from_fd(-1), to_fd(-1), offset(0), eof(false) {}
+
+  struct Chunk {
+    double release_time;
+    string data;
+  };
+
+  int from_fd;
+  int to_fd;
+
+  // Chunks in the order in which they were read.  Their release times
+  // never decrease.
+  deque<Chunk> chunks;
+
+  // Number of bytes of the first chunk that have already been written.
+  size_t offset;
+
+  // Has 'from_fd' been closed?
+  bool eof;
+};
+
+
+// A client's connection to us and our connection to the server on its
+// behalf.
+struct Connection {
+  Connection(int client_fd, int server_fd) {
+    up.from_fd = client_fd;
+    up.to_fd = server_fd;
+    down.from_fd = server_fd;
+    down.to_fd = client_fd;
+  }
+
+  Stream up;    // client to server
+  Stream down;  // server to client
+};
+
+
+static void HandleSignal(int signal) {
+  quit = 1;
+}
+
+// Get the number of the display described by 'display' (e.g. ":1.0"), or
+// -1 if it isn't a local display.
+static int GetDisplayNumber(const string& display) {
+  if (display.empty() || display[0] != ':') return -1;
+  char* end = NULL;
+  long num = strtol(display.c_str() + 1, &end, 10);
+  if (end == display.c_str() + 1 || (*end != '\0' && *end != '.'))
+    return -1;
+  return static_cast<int>(num);
+}
+
+static string GetSocketPath(int display_num) {
+  return StringPrintf("%s/X%d", kSocketDir, display_num);
+}
+
+static bool SetNonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static bool FillAddress(const string& path, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr->sun_path)) return false;
+  strcpy(addr->sun_path, path.c_str());
+  return true;
+}
+
+// Connect to the Unix socket at 'path'.  Returns the socket's fd, or -1
+// on failure.
+static int ConnectToSocket(const string& path) {
+  struct sockaddr_un addr;
+  if (!FillAddress(path, &addr)) return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) return -1;
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+              sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Start listening at 'path', replacing a stale socket that nobody's
+// listening on.  Returns the socket's fd, or -1 on failure.
+static int ListenOnSocket(const string& path) {
+  int existing_fd = ConnectToSocket(path);
+  if (existing_fd != -1) {
+    close(existing_fd);
+    ERROR << "Something is already listening at " << path;
+    return -1;
+  }
+  unlink(path.c_str());
+
+  struct sockaddr_un addr;
+  if (!FillAddress(path, &addr)) return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    ERROR << "Unable to create socket: " << strerror(errno);
+    return -1;
+  }
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr),
+           sizeof(addr)) == -1 ||
+      listen(fd, 16) == -1 ||
+      !SetNonblocking(fd)) {
+    ERROR << "Unable to listen at " << path << ": " << strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Read everything that's available from 'stream''s source and queue it
+// to be released after 'delay_sec'.
+static void ReadStream(Stream* stream, double delay_sec) {
+  char buf[kReadSize];
+  while (true) {
+    ssize_t bytes = read(stream->from_fd, buf, sizeof(buf));
+    if (bytes > 0) {
+      Stream::Chunk chunk;
+      chunk.release_time = GetMonotonicTime() + delay_sec;
+      chunk.data.assign(buf, bytes);
+      stream->chunks.push_back(chunk);
+      continue;
+    }
+    if (bytes == -1 && (errno == EAGAIN || errno == EINTR)) return;
+    stream->eof = true;
+    return;
+  }
+}
+
+// Write 'stream''s released data to its destination.  Returns false if
+// the destination has gone away.
+static bool WriteStream(Stream* stream, double now) {
+  while (!stream->chunks.empty() &&
+         stream->chunks.front().release_time <= now) {
+    const string& data = stream->chunks.front().data;
+    ssize_t bytes = write(stream->to_fd, data.data() + stream->offset,
+                          data.size() - stream->offset);
+    if (bytes == -1) {
+      if (errno == EAGAIN || errno == EINTR) return true;
+      return false;
+    }
+    stream->offset += bytes;
+    if (stream->offset < data.size()) return true;
+    stream->chunks.pop_front();
+    stream->offset = 0;
+  }
+  return true;
+}
+
+// Is 'stream' waiting to write data that's already been released?
+static bool StreamNeedsWrite(const Stream& stream, double now) {
+  return !stream.chunks.empty() && stream.chunks.front().release_time <= now;
+}
+
+// Has 'stream''s source closed with nothing left to forward?
+static bool StreamFinished(const Stream& stream) {
+  return stream.eof && stream.chunks.empty();
+}
+
+// Update 'next_release' if 'stream' has data that'll be released before
+// then.
+static void UpdateNextRelease(const Stream& stream, double* next_release) {
+  if (stream.chunks.empty()) return;
+  double release_time = stream.chunks.front().release_time;
+  if (*next_release < 0 || release_time < *next_release)
+    *next_release = release_time;
+}
+
+
+int main(int argc, char** argv) {
+  double rtt_ms = 40;
+
+  struct option long_opts[] = {
+    { "help", false, NULL, 'h' },
+    { "rtt",  true,  NULL, 'r' },
+    { NULL,   false, NULL, 0 },
+  };
+  int opt = 0;
+  while ((opt = getopt_long(argc, argv, "hr:", long_opts, NULL)) != -1) {
+    switch (opt) {
+      case 'r':
+        rtt_ms = atof(optarg);
+        break;
+      case 'h':
+        // fallthrough
+      default:
+        std::cerr << kUsage;
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (optind != argc - 2 || rtt_ms < 0) {
+    std::cerr << kUsage;
+    exit(EXIT_FAILURE);
+  }
+  int listen_num = GetDisplayNumber(argv[optind]);
+  int server_num = GetDisplayNumber(argv[optind + 1]);
+  if (listen_num < 0 || server_num < 0 || listen_num == server_num) {
+    std::cerr << kUsage;
+    exit(EXIT_FAILURE);
+  }
+  const double delay_sec = rtt_ms / 2000.0;
+  const string listen_path = GetSocketPath(listen_num);
+  const string server_path = GetSocketPath(server_num);
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+
+  int listen_fd = ListenOnSocket(listen_path);
+  if (listen_fd == -1) exit(EXIT_FAILURE);
+  LOG << "Forwarding " << listen_path << " to " << server_path << " with "
+      << rtt_ms << " ms of added RTT";
+
+  list<Connection> connections;
+  vector<struct pollfd> pfds;
+  while (!quit) {
+    double now = GetMonotonicTime();
+
+    // Watch the listening socket first, then each connection's client and
+    // server sockets.
+    pfds.clear();
+    struct pollfd pfd;
+    pfd.fd = listen_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    pfds.push_back(pfd);
+    double next_release = -1;
+    for (list<Connection>::iterator conn = connections.begin();
+         conn != connections.end(); ++conn) {
+      pfd.fd = conn->up.from_fd;
+      pfd.events = (conn->up.eof ? 0 : POLLIN) |
+                   (StreamNeedsWrite(conn->down, now) ? POLLOUT : 0);
+      pfds.push_back(pfd);
+      pfd.fd = conn->down.from_fd;
+      pfd.events = (conn->down.eof ? 0 : POLLIN) |
+                   (StreamNeedsWrite(conn->up, now) ? POLLOUT : 0);
+      pfds.push_back(pfd);
+      UpdateNextRelease(conn->up, &next_release);
+      UpdateNextRelease(conn->down, &next_release);
+    }
+
+    int timeout_ms = -1;
+    if (next_release >= 0) {
+      double wait_sec = next_release - now;
+      // Round up so that we don't wake up just before the data's due.
+      timeout_ms = wait_sec > 0 ? static_cast<int>(wait_sec * 1000) + 1 : 0;
+    }
+    if (poll(&pfds[0], pfds.size(), timeout_ms) == -1) {
+      if (errno == EINTR) continue;
+      ERROR << "poll() failed: " << strerror(errno);
+      break;
+    }
+
+    if (pfds[0].revents & POLLIN) {
+      int client_fd = -1;
+      while ((client_fd = accept(listen_fd, NULL, NULL)) != -1) {
+        int server_fd = ConnectToSocket(server_path);
+        if (server_fd == -1 || !SetNonblocking(server_fd) ||
+            !SetNonblocking(client_fd)) {
+          ERROR << "Unable to connect to " << server_path << ": "
+                << strerror(errno);
+          if (server_fd != -1) close(server_fd);
+          close(client_fd);
+          continue;
+        }
+        connections.push_back(Connection(client_fd, server_fd));
+      }
+    }
+
+    // The connections are in the same order as their pollfds.
+    now = GetMonotonicTime();
+    size_t index = 1;
+    for (list<Connection>::iterator conn = connections.begin();
+         conn != connections.end(); index += 2) {
+      if (index + 1 < pfds.size()) {
+        const short kReadable = POLLIN | POLLHUP | POLLERR;
+        if (!conn->up.eof && (pfds[index].revents & kReadable))
+          ReadStream(&conn->up, delay_sec);
+        if (!conn->down.eof && (pfds[index + 1].revents & kReadable))
+          ReadStream(&conn->down, delay_sec);
+      }
+      bool ok = WriteStream(&conn->up, now) && WriteStream(&conn->down, now);
+
+      // X connections aren't half-closed, so once either side is gone and
+      // everything that it sent has been passed along, we're done.
+      if (!ok || StreamFinished(conn->up) || StreamFinished(conn->down)) {
+        close(conn->up.from_fd);
+        close(conn->down.from_fd);
+        conn = connections.erase(conn);
+      } else {
+        ++conn;
+      }
+    }
+  }
+
+  for (list<Connection>::iterator conn = connections.begin();
+       conn != connections.end(); ++conn) {
+    close(conn->up.from_fd);
+    close(conn->down.from_fd);
+  }
+  close(listen_fd);
+  unlink(listen_path.c_str());
+  return 0;
+}
@@ -15,21 +15,28 @@ static const char* kUsage =
     "\n"
     "Options:\n"
     "  -c FILE, --config=FILE   Config file to load\n"
-    "  -h, --help               Display this message and exit\n";
+    "  -h, --help               Display this message and exit\n"
+    "  -r FILE, --record=FILE   Record events to FILE for wham-replay\n";
 
 int main(int argc, char** argv) {
   string config_file = "config";
+  string record_file;
 
   struct option long_opts[] = {
     { "config", true,  NULL, 'c' },
     { "help",   false, NULL, 'h' },
+    { "record", true,  NULL, 'r' },
+    { NULL,     false, NULL, 0 },
   };
   int opt = 0;
-  while ((opt = getopt_long(argc, argv, "c:h", long_opts, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "c:hr:", long_opts, NULL)) != -1) {
     switch (opt) {
       case 'c':
         config_file = string(optarg);
         break;
+      case 'r':
+        record_file = string(optarg);
+        break;
       case 'h':
         // fallthrough
       default:
@@ -39,6 +46,9 @@ int main(int argc, char** argv) {
   }
 
   CHECK(XServer::Get()->Init());
+  // Start recording before the window manager is created so that the
+  // trace includes the windows that it creates at startup.
+  if (!record_file.empty()) CHECK(XServer::Get()->StartRecording(record_file));
   WindowManager window_manager;
   window_manager.SetupDefaultCrap();
   CHECK(window_manager.LoadConfig(config_file));
@@ -3,19 +3,78 @@
 
 #include "mock-x-window.h"
 
+#include "window.h"
+#include "x-server.h"
+
 using namespace std;
 
 namespace wham {
 
+deque< ::Window> MockXWindow::canned_ids_;
+::Window MockXWindow::next_id_ = 1;
+map< ::Window, MockXWindow::CannedGeometry> MockXWindow::canned_geometry_;
+map< ::Window, deque<MockXWindow::CannedProperties> >
+    MockXWindow::canned_properties_;
+map< ::Window, int> MockXWindow::pending_property_updates_;
+
+
 MockXWindow::MockXWindow(::Window id)
     : XWindow(id),
-      mapped_(false) {
+      mapped_(false),
+      num_take_focus_calls_(0),
+      last_set_input_focus_(false),
+      last_send_take_focus_(false),
+      last_take_focus_time_(CurrentTime) {
+  map< ::Window, CannedGeometry>::iterator it = canned_geometry_.find(id);
+  if (it != canned_geometry_.end()) {
+    InitGeometry(it->second.x, it->second.y,
+                 it->second.width, it->second.height);
+    canned_geometry_.erase(it);
+  }
+}
+
+
+MockXWindow::~MockXWindow() {
+  pending_property_updates_.erase(id());
+}
+
+
+void MockXWindow::RequestPropertyUpdate(WindowProperties::ChangeType type) {
+  if (canned_properties_.count(id()))
+    UseCannedPropertyUpdate();
+  else
+    pending_property_updates_[id()]++;
+}
+
+
+bool MockXWindow::UpdateAllProperties(WindowProperties* props) {
+  return UseCannedProperties(props);
 }
 
 
-bool MockXWindow::UpdateProperties(WindowProperties* props,
-                                   WindowProperties::ChangeType type) {
-  return true;
+void MockXWindow::UseCannedPropertyUpdate() {
+  Window* window = client_window();
+  WindowProperties props;
+  if (window) props = window->props();
+  bool success = UseCannedProperties(&props);
+  if (window) window->HandleUpdatedProperties(props, success);
+}
+
+
+bool MockXWindow::UseCannedProperties(WindowProperties* props) {
+  CHECK(props);
+  map< ::Window, deque<CannedProperties> >::iterator it =
+      canned_properties_.find(id());
+  if (it == canned_properties_.end()) return true;
+
+  const CannedProperties& canned = it->second.front();
+  *props = canned.props;
+  props->transient_for = (canned.transient_for != None) ?
+      XServer::Get()->GetWindow(canned.transient_for, false) : NULL;
+  bool success = canned.success;
+  it->second.pop_front();
+  if (it->second.empty()) canned_properties_.erase(it);
+  return success;
 }
 
 
@@ -41,11 +100,17 @@ void MockXWindow::Map() {
 }
 
 
-void MockXWindow::SelectEvents() {
+void MockXWindow::SelectClientEvents() {
 }
 
 
-void MockXWindow::TakeFocus() {
+void MockXWindow::TakeFocus(bool set_input_focus,
+                            bool send_take_focus,
+                            Time time) {
+  num_take_focus_calls_++;
+  last_set_input_focus_ = set_input_focus;
+  last_send_take_focus_ = send_take_focus;
+  last_take_focus_time_ = time;
 }
 
 
@@ -71,16 +136,62 @@ void MockXWindow::WarpPointer(int x, int y) {
 }
 
 
-void MockXWindow::GetGeometry(int* x,
-                              int* y,
-                              uint* width,
-                              uint* height,
-                              uint* border_width) {
+void MockXWindow::Destroy() {
+  // TODO: Maybe call XServer::DeleteWindow() here.
 }
 
 
-void MockXWindow::Destroy() {
-  // TODO: Maybe call XServer::DeleteWindow() here.
+::Window MockXWindow::GetNextId() {
+  if (canned_ids_.empty()) return next_id_++;
+  ::Window id = canned_ids_.front();
+  canned_ids_.pop_front();
+  return id;
+}
+
+
+void MockXWindow::AddCannedId(::Window id) {
+  canned_ids_.push_back(id);
+}
+
+
+void MockXWindow::AddCannedGeometry(
+    ::Window id, int x, int y, uint width, uint height) {
+  CannedGeometry geometry;
+  geometry.x = x;
+  geometry.y = y;
+  geometry.width = width;
+  geometry.height = height;
+  canned_geometry_[id] = geometry;
+}
+
+
+void MockXWindow::AddCannedProperties(::Window id,
+                                      const WindowProperties& props,
+                                      ::Window transient_for,
+                                      bool success) {
+  CannedProperties canned;
+  canned.props = props;
+  canned.transient_for = transient_for;
+  canned.success = success;
+  canned_properties_[id].push_back(canned);
+
+  // Treat the properties as the reply to an update that's waiting for
+  // one.
+  map< ::Window, int>::iterator it = pending_property_updates_.find(id);
+  if (it == pending_property_updates_.end()) return;
+  if (--(it->second) == 0) pending_property_updates_.erase(it);
+  MockXWindow* xwin =
+      static_cast<MockXWindow*>(XServer::Get()->GetWindow(id, false));
+  CHECK(xwin);
+  xwin->UseCannedPropertyUpdate();
+}
+
+
+void MockXWindow::ClearCannedData() {
+  canned_ids_.clear();
+  canned_geometry_.clear();
+  canned_properties_.clear();
+  pending_property_updates_.clear();
 }
 
 }  // namespace wham
@@ -4,6 +4,9 @@
 #ifndef __MOCK_X_WINDOW_H__
 #define __MOCK_X_WINDOW_H__
 
+#include <deque>
+#include <map>
+
 #include "x-window.h"
 
 using namespace std;
@@ -13,35 +16,91 @@ namespace wham {
 class MockXWindow : public XWindow {
  public:
   MockXWindow(::Window id);
-  ~MockXWindow() {}
+  ~MockXWindow();
 
-  bool UpdateProperties(WindowProperties* props,
-                        WindowProperties::ChangeType type);
+  void RequestPropertyUpdate(WindowProperties::ChangeType type);
+  bool UpdateAllProperties(WindowProperties* props);
 
   void Move(int x, int y);
   void Resize(uint width, uint height);
   void Unmap();
   void Map();
-  void SelectEvents();
-  void TakeFocus();
+  void SelectClientEvents();
+  void TakeFocus(bool set_input_focus, bool send_take_focus, Time time);
   void SetBorder(uint size);
   void Raise();
   void MakeSibling(const XWindow& leader);
   void Reparent(XWindow* parent, int x, int y);
   void WarpPointer(int x, int y);
-  void GetGeometry(int* x,
-                   int* y,
-                   uint* width,
-                   uint* height,
-                   uint* border_width);
   void Destroy();
 
   bool mapped() { return mapped_; }
 
+  // Number of times that TakeFocus() has been called, and the arguments
+  // that it was last called with.
+  int num_take_focus_calls() const { return num_take_focus_calls_; }
+  bool last_set_input_focus() const { return last_set_input_focus_; }
+  bool last_send_take_focus() const { return last_send_take_focus_; }
+  Time last_take_focus_time() const { return last_take_focus_time_; }
+
+  // Get the ID to use for the next window created by XWindow::Create().
+  // IDs passed to AddCannedId() are handed out first, in order.
+  static ::Window GetNextId();
+
+  // Canned data describing what the X server would have told us about a
+  // window.  This is used to replay recorded traces (see EventReplayer).
+  // Geometry is used when the window's object is created; each
+  // UpdateAllProperties() call for the window consumes the oldest set of
+  // properties and returns its 'success' value.  'transient_for' is
+  // looked up when the properties are consumed.  RequestPropertyUpdate()
+  // consumes a set of properties as its reply, waiting for one to be
+  // added if there aren't any.
+  static void AddCannedId(::Window id);
+  static void AddCannedGeometry(
+      ::Window id, int x, int y, uint width, uint height);
+  static void AddCannedProperties(::Window id,
+                                  const WindowProperties& props,
+                                  ::Window transient_for,
+                                  bool success);
+  static void ClearCannedData();
+
  private:
-  ::Window id_;
+  struct CannedGeometry {
+    int x;
+    int y;
+    uint width;
+    uint height;
+  };
+
+  struct CannedProperties {
+    WindowProperties props;
+    ::Window transient_for;
+    bool success;
+  };
+
+  // Copy the oldest canned properties for this window into 'props' and
+  // return their 'success' value, or return true if there aren't any.
+  bool UseCannedProperties(WindowProperties* props);
+
+  // Pass the oldest canned properties to our client window as the reply
+  // to a RequestPropertyUpdate() call.
+  void UseCannedPropertyUpdate();
 
   bool mapped_;
+
+  int num_take_focus_calls_;
+  bool last_set_input_focus_;
+  bool last_send_take_focus_;
+  Time last_take_focus_time_;
+
+  static deque< ::Window> canned_ids_;
+  static ::Window next_id_;
+  static map< ::Window, CannedGeometry> canned_geometry_;
+  static map< ::Window, deque<CannedProperties> > canned_properties_;
+
+  // Number of RequestPropertyUpdate() calls for each window that are
+  // waiting for canned properties.
+  static map< ::Window, int> pending_property_updates_;
 };
 
 }  // namespace wham
@@ -0,0 +1,128 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "property-prefetcher.h"
+
+#include "x-server.h"
+
+using namespace std;
+
+namespace wham {
+
+PropertyPrefetcher::PropertyPrefetcher() {
+}
+
+
+void PropertyPrefetcher::HandleCreate(::Window id,
+                                      int x,
+                                      int y,
+                                      uint width,
+                                      uint height) {
+  if (FindEntry(id) != -1) return;
+  if (entries_.size() >= kMaxEntries) RemoveEntry(0, true);
+
+  // Ask to hear about property changes before requesting the properties,
+  // so that we won't miss changes made after the requests are handled.
+  xcb_connection_t* conn = XServer::Get()->xcb_conn();
+  const uint32_t values[] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
+  XServer::Get()->TrackRequest(
+      xcb_change_window_attributes(conn, id, XCB_CW_EVENT_MASK, values),
+      "ChangeWindowAttributes", NULL);
+
+  Entry entry;
+  entry.id = id;
+  entry.x = x;
+  entry.y = y;
+  entry.width = width;
+  entry.height = height;
+  entry.have_geometry = true;
+  entry.have_properties = true;
+  XWindow::RequestAllProperties(id, &entry.cookies);
+  entries_.push_back(entry);
+}
+
+
+void PropertyPrefetcher::HandleConfigure(::Window id,
+                                         int x,
+                                         int y,
+                                         uint width,
+                                         uint height) {
+  int index = FindEntry(id);
+  if (index == -1) return;
+  Entry& entry = entries_[index];
+  entry.x = x;
+  entry.y = y;
+  entry.width = width;
+  entry.height = height;
+}
+
+
+void PropertyPrefetcher::HandlePropertyChange(::Window id,
+                                              xcb_atom_t atom,
+                                              uint32_t sequence) {
+  int index = FindEntry(id);
+  if (index == -1 || !entries_[index].have_properties) return;
+  XWindow::RefreshPropertyCookie(id, atom, sequence, &entries_[index].cookies);
+}
+
+
+void PropertyPrefetcher::HandleDestroy(::Window id) {
+  int index = FindEntry(id);
+  if (index != -1) RemoveEntry(index, false);
+}
+
+
+bool PropertyPrefetcher::TakeProperties(::Window id,
+                                        XWindow::PropertyCookies* cookies) {
+  CHECK(cookies);
+  int index = FindEntry(id);
+  if (index == -1 || !entries_[index].have_properties) return false;
+  *cookies = entries_[index].cookies;
+  entries_[index].have_properties = false;
+  if (!entries_[index].have_geometry) entries_.erase(entries_.begin() + index);
+  return true;
+}
+
+
+bool PropertyPrefetcher::TakeGeometry(::Window id,
+                                      int* x,
+                                      int* y,
+                                      uint* width,
+                                      uint* height) {
+  int index = FindEntry(id);
+  if (index == -1 || !entries_[index].have_geometry) return false;
+  const Entry& entry = entries_[index];
+  if (x) *x = entry.x;
+  if (y) *y = entry.y;
+  if (width) *width = entry.width;
+  if (height) *height = entry.height;
+  entries_[index].have_geometry = false;
+  if (!entries_[index].have_properties)
+    entries_.erase(entries_.begin() + index);
+  return true;
+}
+
+
+int PropertyPrefetcher::FindEntry(::Window id) const {
+  for (size_t i = 0; i < entries_.size(); ++i)
+    if (entries_[i].id == id) return static_cast<int>(i);
+  return -1;
+}
+
+
+void PropertyPrefetcher::RemoveEntry(int index, bool stop_watching) {
+  CHECK(index >= 0 && index < static_cast<int>(entries_.size()));
+  if (entries_[index].have_properties)
+    XWindow::DiscardPropertyCookies(entries_[index].cookies);
+  if (stop_watching) {
+    xcb_connection_t* conn = XServer::Get()->xcb_conn();
+    const uint32_t values[] = { 0 };
+    XServer::Get()->TrackRequest(
+        xcb_change_window_attributes(
+            conn, entries_[index].id, XCB_CW_EVENT_MASK, values),
+        "ChangeWindowAttributes", NULL);
+  }
+  entries_.erase(entries_.begin() + index);
+}
+
+}  // namespace wham
@@ -0,0 +1,95 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __PROPERTY_PREFETCHER_H__
+#define __PROPERTY_PREFETCHER_H__
+
+#include <vector>
+
+#include <stdint.h>
+
+extern "C" {
+#include <xcb/xcb.h>
+}
+
+#include "util.h"
+#include "x-window.h"
+
+using namespace std;
+
+namespace wham {
+
+// Starts fetching the properties of new top-level windows as soon as
+// they're created instead of waiting until they ask to be mapped.  By the
+// time that the MapRequest arrives, the replies (and the window's
+// geometry, which comes from the CreateNotify and ConfigureNotify events)
+// are usually already waiting for us, so the window can be classified
+// and framed without a round trip.
+//
+// Clients typically set their properties after creating their windows,
+// so we also listen for PropertyNotify on the windows and re-request
+// properties that change after we've asked for them.
+class PropertyPrefetcher {
+ public:
+  PropertyPrefetcher();
+
+  // Handle the creation of a top-level window.
+  void HandleCreate(::Window id, int x, int y, uint width, uint height);
+
+  // Handle a change to a window's geometry.
+  void HandleConfigure(::Window id, int x, int y, uint width, uint height);
+
+  // Handle a change to 'atom' on window 'id' in an event with sequence
+  // number 'sequence'.
+  void HandlePropertyChange(::Window id, xcb_atom_t atom, uint32_t sequence);
+
+  // Forget about a destroyed window.
+  void HandleDestroy(::Window id);
+
+  // Are we fetching the properties of window 'id'?
+  bool HasWindow(::Window id) const { return FindEntry(id) != -1; }
+
+  // If we're fetching the properties of window 'id', copy its cookies
+  // into 'cookies', stop tracking the properties, and return true.
+  bool TakeProperties(::Window id, XWindow::PropertyCookies* cookies);
+
+  // If we know window 'id''s geometry, copy it into the out-params and
+  // return true.  The geometry is forgotten once the properties have also
+  // been taken.
+  bool TakeGeometry(::Window id, int* x, int* y, uint* width, uint* height);
+
+ private:
+  // Most windows that are created but never mapped are destroyed soon
+  // afterwards, but this keeps us from hanging onto too many replies if
+  // they aren't.
+  static const size_t kMaxEntries = 64;
+
+  struct Entry {
+    ::Window id;
+    int x;
+    int y;
+    uint width;
+    uint height;
+    bool have_geometry;
+    bool have_properties;
+    XWindow::PropertyCookies cookies;
+  };
+
+  // Get the index of 'id' in 'entries_', or -1 if it isn't there.
+  int FindEntry(::Window id) const;
+
+  // Discard the replies for entry 'index' and remove it.  If
+  // 'stop_watching' is true, also stop listening for PropertyNotify on the
+  // window, which would otherwise keep sending them for as long as it
+  // exists.
+  void RemoveEntry(int index, bool stop_watching);
+
+  // Entries, oldest first.
+  vector<Entry> entries_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(PropertyPrefetcher);
+};
+
+}  // namespace wham
+
+#endif
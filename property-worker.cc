@@ -0,0 +1,252 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "property-worker.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "window.h"
+#include "x-window.h"
+
+using namespace std;
+
+namespace wham {
+
+PropertyWorker::PropertyWorker()
+    : conn_(NULL),
+      event_fd_(-1),
+      thread_started_(false),
+      quit_(false) {
+  event_fd_ = eventfd(0, EFD_NONBLOCK);
+  CHECK(event_fd_ != -1);
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&cond_, NULL);
+}
+
+
+PropertyWorker::~PropertyWorker() {
+  Stop();
+  for (deque<Job*>::iterator it = jobs_.begin(); it != jobs_.end(); ++it)
+    delete *it;
+  for (deque<Result*>::iterator it = results_.begin();
+       it != results_.end(); ++it) {
+    delete *it;
+  }
+  if (conn_) xcb_disconnect(conn_);
+  close(event_fd_);
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+
+bool PropertyWorker::Start(const char* display_name) {
+  CHECK(!thread_started_);
+  conn_ = xcb_connect(display_name, NULL);
+  if (xcb_connection_has_error(conn_)) {
+    ERROR << "Unable to open property worker's connection to "
+          << (display_name ? display_name : "default display");
+    xcb_disconnect(conn_);
+    conn_ = NULL;
+    return false;
+  }
+
+  int error = pthread_create(&thread_, NULL, RunThread, this);
+  if (error) {
+    ERROR << "Unable to start property worker thread: " << strerror(error);
+    return false;
+  }
+  thread_started_ = true;
+  return true;
+}
+
+
+void PropertyWorker::RequestUpdate(Window* window,
+                                   WindowProperties::ChangeType type) {
+  CHECK(window);
+  map< ::Window, Pending>::iterator it = pending_.find(window->id());
+  if (it != pending_.end()) {
+    it->second.queued_types.push_back(type);
+    return;
+  }
+  SendJob(window, vector<WindowProperties::ChangeType>(1, type));
+}
+
+
+void PropertyWorker::RequestClassification(Window* window) {
+  CHECK(window);
+  map< ::Window, Pending>::iterator it = pending_.find(window->id());
+  if (it != pending_.end()) {
+    it->second.classification_queued = true;
+    return;
+  }
+  SendJob(window, vector<WindowProperties::ChangeType>());
+}
+
+
+void PropertyWorker::ClassifyResult(const Result& result) {
+  CHECK(pending_.count(result.id));
+  PushJob(result.id, vector<WindowProperties::ChangeType>(), result.props);
+}
+
+
+void PropertyWorker::ClearWakeup() {
+  uint64_t count = 0;
+  if (read(event_fd_, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    ERROR << "Unable to read from eventfd: " << strerror(errno);
+}
+
+
+PropertyWorker::Result* PropertyWorker::PopResult() {
+  Result* result = NULL;
+  pthread_mutex_lock(&mutex_);
+  if (!results_.empty()) {
+    result = results_.front();
+    results_.pop_front();
+  }
+  pthread_mutex_unlock(&mutex_);
+
+  if (result) {
+    map< ::Window, Pending>::const_iterator it = pending_.find(result->id);
+    if (it != pending_.end() && it->second.classification_queued)
+      result->superseded = true;
+  }
+  return result;
+}
+
+
+void PropertyWorker::FinishUpdate(const Result& result, Window* window) {
+  map< ::Window, Pending>::iterator it = pending_.find(result.id);
+  CHECK(it != pending_.end());
+  vector<WindowProperties::ChangeType> types;
+  types.swap(it->second.queued_types);
+  bool classify = it->second.classification_queued;
+  pending_.erase(it);
+  if (window && (!types.empty() || classify)) SendJob(window, types);
+}
+
+
+void* PropertyWorker::RunThread(void* arg) {
+  static_cast<PropertyWorker*>(arg)->Run();
+  return NULL;
+}
+
+
+void PropertyWorker::Run() {
+  while (true) {
+    pthread_mutex_lock(&mutex_);
+    while (jobs_.empty() && !quit_) pthread_cond_wait(&cond_, &mutex_);
+    if (quit_) {
+      pthread_mutex_unlock(&mutex_);
+      break;
+    }
+    Job* job = jobs_.front();
+    jobs_.pop_front();
+    pthread_mutex_unlock(&mutex_);
+
+    Result* result = RunJob(*job);
+    delete job;
+
+    pthread_mutex_lock(&mutex_);
+    results_.push_back(result);
+    pthread_mutex_unlock(&mutex_);
+    Wake();
+  }
+}
+
+
+PropertyWorker::Result* PropertyWorker::RunJob(const Job& job) {
+  Result* result = new Result;
+  result->id = job.id;
+  result->num_changes = job.types.size();
+  result->props = job.props;
+  result->transient_for_id = job.transient_for_id;
+  result->got_transient_for = job.types.empty();
+
+  // Send all of the requests before waiting for any of the replies.
+  bool fetched_transient_for = false;
+  vector<xcb_get_property_cookie_t> cookies;
+  for (size_t i = 0; i < job.types.size(); ++i) {
+    cookies.push_back(
+        xcb_get_property(conn_,
+                         0,     // delete
+                         job.id,
+                         XWindow::GetPropertyAtom(job.types[i]),
+                         XCB_GET_PROPERTY_TYPE_ANY,
+                         0,     // offset
+                         256)); // length
+  }
+  for (size_t i = 0; i < job.types.size(); ++i) {
+    xcb_get_property_reply_t* reply =
+        xcb_get_property_reply(conn_, cookies[i], NULL);
+    if (!XWindow::ParseProperty(job.id, job.types[i], reply, &result->props,
+                                &result->transient_for_id)) {
+      result->success = false;
+    }
+    if (job.types[i] == WindowProperties::TRANSIENT_CHANGE)
+      fetched_transient_for = true;
+    free(reply);
+  }
+  if (fetched_transient_for) result->got_transient_for = true;
+
+  if (result->success && !fetched_transient_for) {
+    job.classifier->ClassifyWindow(result->props, &result->configs);
+    result->classified = true;
+  }
+  return result;
+}
+
+
+void PropertyWorker::SendJob(
+    Window* window, const vector<WindowProperties::ChangeType>& types) {
+  CHECK(window);
+  Pending& pending = pending_[window->id()];
+  pending.classifier = WindowClassifier::GetRef();
+  PushJob(window->id(), types, window->props());
+}
+
+
+void PropertyWorker::PushJob(
+    ::Window id,
+    const vector<WindowProperties::ChangeType>& types,
+    const WindowProperties& props) {
+  map< ::Window, Pending>::iterator it = pending_.find(id);
+  CHECK(it != pending_.end());
+
+  Job* job = new Job;
+  job->id = id;
+  job->types = types;
+  job->props = props;
+  job->transient_for_id =
+      props.transient_for ? props.transient_for->id() : None;
+  job->classifier = it->second.classifier.get();
+
+  pthread_mutex_lock(&mutex_);
+  jobs_.push_back(job);
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+void PropertyWorker::Wake() {
+  uint64_t count = 1;
+  if (write(event_fd_, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    ERROR << "Unable to write to eventfd: " << strerror(errno);
+}
+
+
+void PropertyWorker::Stop() {
+  if (!thread_started_) return;
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&mutex_);
+  pthread_join(thread_, NULL);
+  thread_started_ = false;
+}
+
+}  // namespace wham
@@ -0,0 +1,229 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __PROPERTY_WORKER_H__
+#define __PROPERTY_WORKER_H__
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <pthread.h>
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <xcb/xcb.h>
+}
+
+#include "util.h"
+#include "window-classifier.h"
+#include "window-properties.h"
+
+using namespace std;
+
+class PropertyWorkerTestSuite;  // from property-worker_test.h
+
+namespace wham {
+
+class Window;
+
+// Fetches windows' changed properties and reclassifies the windows on a
+// separate thread, so that the main thread never waits for property
+// replies or evaluates WindowCriteria regexps when a property changes.
+//
+// The thread has its own XCB connection, so its round trips don't hold
+// up (or get held up by) the main connection.  Each request carries a
+// copy of the window's current properties; the thread updates the copy
+// from the replies, classifies it into a new WindowConfigSet, and hands
+// both back in a Result.  An eventfd becomes readable when results are
+// waiting.  Nothing that the thread touches is shared with the main
+// thread except for the WindowClassifier, which is only read and is
+// kept alive until the result has been handled.
+//
+// Only one request per window is in flight at a time, so results can't
+// be applied out of order.  Changes that arrive while a window's request
+// is in flight are saved and sent together by FinishUpdate().
+//
+// WM_TRANSIENT_FOR names another window, which only the main thread can
+// look up, so requests that include it are fetched but not classified.
+// The main thread looks it up and passes the result to ClassifyResult(),
+// which sends the properties back to be classified without fetching
+// anything.  New windows are classified the same way, via
+// RequestClassification().
+class PropertyWorker {
+ public:
+  // The outcome of a request.
+  struct Result {
+    Result()
+        : id(None),
+          num_changes(0),
+          success(true),
+          transient_for_id(None),
+          got_transient_for(false),
+          classified(false),
+          superseded(false) {
+    }
+
+    // Window whose properties were fetched.
+    ::Window id;
+
+    // Number of RequestUpdate() calls that this result covers.  0 for
+    // results that were only classified.
+    size_t num_changes;
+
+    // The window's properties, updated from the replies.  If
+    // 'got_transient_for' is set, 'props.transient_for' may be stale and
+    // must be looked up from 'transient_for_id'.
+    WindowProperties props;
+
+    // False if any of the properties couldn't be read.
+    bool success;
+
+    // Set if WM_TRANSIENT_FOR was fetched (in which case 'props' wasn't
+    // classified) or if 'props' was only classified (in which case the
+    // transient-for window may have been destroyed since the job was
+    // sent).
+    ::Window transient_for_id;
+    bool got_transient_for;
+
+    // Was 'props' classified into 'configs'?  If the classification
+    // failed, 'configs' is empty.
+    bool classified;
+    WindowConfigSet configs;
+
+    // Set by PopResult() if the window was destroyed and a new Window
+    // object for the same X window asked to be classified while this
+    // result was in flight.  The result shouldn't be applied to it.
+    bool superseded;
+
+   private:
+    DISALLOW_EVIL_CONSTRUCTORS(Result);
+  };
+
+  PropertyWorker();
+
+  // Stops and joins the thread.
+  ~PropertyWorker();
+
+  // Connect to 'display_name' and start the thread.  Returns false on
+  // failure.
+  bool Start(const char* display_name);
+
+  // File descriptor that becomes readable when results are available.
+  int fd() const { return event_fd_; }
+
+  // Fetch the property of type 'type' for 'window' and reclassify it.
+  // Must be called from the main thread.
+  void RequestUpdate(Window* window, WindowProperties::ChangeType type);
+
+  // Classify 'window' using its current properties.  Must be called from
+  // the main thread.
+  void RequestClassification(Window* window);
+
+  // Send the properties from 'result', whose 'transient_for' has been
+  // looked up, back to the thread to be classified.  The window's request
+  // stays in flight, so FinishUpdate() shouldn't be called for 'result';
+  // it'll be called for the new result instead.
+  void ClassifyResult(const Result& result);
+
+  // Make fd() unreadable until more results are available.  Should be
+  // called by the main thread before it pops results.
+  void ClearWakeup();
+
+  // Get the oldest result, or NULL if there aren't any.  The caller takes
+  // ownership of the result and must pass it to FinishUpdate() after
+  // handling it.
+  Result* PopResult();
+
+  // Called by the main thread after it handles 'result'.  Sends any
+  // changes for the result's window that arrived in the meantime, or just
+  // forgets about them if 'window' (the window that the result was for)
+  // is NULL because it's gone.
+  void FinishUpdate(const Result& result, Window* window);
+
+ private:
+  friend class ::PropertyWorkerTestSuite;
+
+  // A request for the thread.
+  struct Job {
+    ::Window id;
+
+    // Properties to fetch.  If empty, 'props' is just classified.
+    vector<WindowProperties::ChangeType> types;
+    WindowProperties props;
+
+    // 'props.transient_for' can't be dereferenced by the thread, so its
+    // ID is looked up before the job is sent.
+    ::Window transient_for_id;
+
+    // Not owned; see Pending.
+    const WindowClassifier* classifier;
+  };
+
+  // Main-thread state for a window with a job in flight.
+  struct Pending {
+    Pending() : classification_queued(false) {}
+
+    // Changes that arrived after the job was sent.
+    vector<WindowProperties::ChangeType> queued_types;
+
+    // Was RequestClassification() called after the job was sent?
+    bool classification_queued;
+
+    // Keeps the job's classifier alive if a new one is loaded.
+    ref_ptr<WindowClassifier> classifier;
+  };
+
+  static void* RunThread(void* arg);
+
+  // Handle jobs until Stop() is called.
+  void Run();
+
+  // Fetch and classify the properties for 'job'.  Runs on the thread.
+  Result* RunJob(const Job& job);
+
+  // Send a job for 'types' on 'window'.  If 'types' is empty, the
+  // window's properties are just classified.
+  void SendJob(Window* window,
+               const vector<WindowProperties::ChangeType>& types);
+
+  // Send a job for 'types' on window 'id', starting from 'props'.
+  void PushJob(::Window id,
+               const vector<WindowProperties::ChangeType>& types,
+               const WindowProperties& props);
+
+  // Make fd() readable.
+  void Wake();
+
+  // Tell the thread to exit and wait for it.
+  void Stop();
+
+  xcb_connection_t* conn_;
+
+  int event_fd_;
+
+  pthread_t thread_;
+  bool thread_started_;
+
+  // Protects 'jobs_', 'results_', and 'quit_'.
+  pthread_mutex_t mutex_;
+
+  // Signalled when a job is added or 'quit_' is set.
+  pthread_cond_t cond_;
+
+  // Jobs for the thread and results for the main thread, oldest first.
+  // They're owned by whichever queue they're in.
+  deque<Job*> jobs_;
+  deque<Result*> results_;
+
+  bool quit_;
+
+  // Only used by the main thread.
+  map< ::Window, Pending> pending_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(PropertyWorker);
+};
+
+}  // namespace wham
+
+#endif
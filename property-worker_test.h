@@ -0,0 +1,128 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "property-worker.h"
+
+#include "mock-x-window.h"
+#include "window-properties.h"
+#include "window.h"
+#include "x-server.h"
+#include "x-window.h"
+
+using namespace wham;
+
+class PropertyWorkerTestSuite : public CxxTest::TestSuite {
+ public:
+  void setUp() {
+    XServer::SetupTesting();
+    MockXWindow::ClearCannedData();
+  }
+
+  void testQueueChangesWhileInFlight() {
+    // The thread isn't started, so jobs just pile up in the queue.
+    PropertyWorker worker;
+    XWindow* xwin = XWindow::Create(0, 0, 10, 10);
+    wham::Window win(xwin);
+
+    worker.RequestUpdate(&win, WindowProperties::WINDOW_NAME_CHANGE);
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 1U);
+    TS_ASSERT_EQUALS(worker.jobs_.back()->id, xwin->id());
+    TS_ASSERT_EQUALS(worker.jobs_.back()->types.size(), 1U);
+
+    // Later changes should wait for the first job's result.
+    worker.RequestUpdate(&win, WindowProperties::CLASS_CHANGE);
+    worker.RequestUpdate(&win, WindowProperties::WINDOW_NAME_CHANGE);
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 1U);
+
+    // Once it's handled, they should be sent together.
+    PropertyWorker::Result result;
+    result.id = xwin->id();
+    worker.FinishUpdate(result, &win);
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 2U);
+    const PropertyWorker::Job* job = worker.jobs_.back();
+    TS_ASSERT_EQUALS(job->types.size(), 2U);
+    TS_ASSERT_EQUALS(job->types[0], WindowProperties::CLASS_CHANGE);
+    TS_ASSERT_EQUALS(job->types[1], WindowProperties::WINDOW_NAME_CHANGE);
+    TS_ASSERT(job->classifier != NULL);
+
+    // Nothing else is waiting.
+    worker.FinishUpdate(result, &win);
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 2U);
+    TS_ASSERT(worker.pending_.empty());
+  }
+
+  void testWindowGone() {
+    PropertyWorker worker;
+    XWindow* xwin = XWindow::Create(0, 0, 10, 10);
+    wham::Window win(xwin);
+
+    // Changes queued for a window that's gone should be dropped.
+    worker.RequestUpdate(&win, WindowProperties::WINDOW_NAME_CHANGE);
+    worker.RequestUpdate(&win, WindowProperties::ICON_NAME_CHANGE);
+    PropertyWorker::Result result;
+    result.id = xwin->id();
+    worker.FinishUpdate(result, NULL);
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 1U);
+    TS_ASSERT(worker.pending_.empty());
+  }
+
+  void testClassification() {
+    PropertyWorker worker;
+    XWindow* xwin = XWindow::Create(0, 0, 10, 10);
+    wham::Window win(xwin);
+
+    // Classification jobs shouldn't fetch anything.
+    worker.RequestClassification(&win);
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 1U);
+    TS_ASSERT(worker.jobs_.back()->types.empty());
+
+    // A result with a newly-fetched WM_TRANSIENT_FOR gets sent back to be
+    // classified, keeping the window's request in flight.
+    PropertyWorker::Result result;
+    result.id = xwin->id();
+    result.num_changes = 1;
+    result.got_transient_for = true;
+    worker.ClassifyResult(result);
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 2U);
+    TS_ASSERT(worker.jobs_.back()->types.empty());
+    TS_ASSERT_EQUALS(worker.pending_.size(), 1U);
+  }
+
+  void testClassificationWhileInFlight() {
+    PropertyWorker worker;
+    XWindow* xwin = XWindow::Create(0, 0, 10, 10);
+    wham::Window win(xwin);
+
+    // If a new Window object asks to be classified while a request for an
+    // old one is in flight, the old request's result shouldn't be applied,
+    // and the classification should be sent along with any queued changes
+    // once it's been handled.
+    worker.RequestUpdate(&win, WindowProperties::WINDOW_NAME_CHANGE);
+    worker.RequestClassification(&win);
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 1U);
+
+    PropertyWorker::Result* result = new PropertyWorker::Result;
+    result->id = xwin->id();
+    worker.results_.push_back(result);
+    result = worker.PopResult();
+    TS_ASSERT(result->superseded);
+    worker.FinishUpdate(*result, &win);
+    delete result;
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 2U);
+    TS_ASSERT(worker.jobs_.back()->types.empty());
+
+    worker.RequestUpdate(&win, WindowProperties::CLASS_CHANGE);
+    worker.RequestClassification(&win);
+    result = new PropertyWorker::Result;
+    result->id = xwin->id();
+    worker.results_.push_back(result);
+    result = worker.PopResult();
+    TS_ASSERT(result->superseded);
+    worker.FinishUpdate(*result, &win);
+    delete result;
+    TS_ASSERT_EQUALS(worker.jobs_.size(), 3U);
+    TS_ASSERT_EQUALS(worker.jobs_.back()->types.size(), 1U);
+  }
+};
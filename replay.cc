@@ -0,0 +1,122 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include <getopt.h>
+
+#include "config.h"
+#include "event-trace.h"
+#include "util.h"
+#include "window-manager.h"
+#include "x-server.h"
+
+using namespace wham;
+
+static const char* kUsage =
+    "Usage: wham-replay [options] TRACE\n"
+    "\n"
+    "Replays a trace recorded by \"wham --record\" without an X server.\n"
+    "\n"
+    "Options:\n"
+    "  -c FILE, --config=FILE   Config file to load\n"
+    "  -h, --help               Display this message and exit\n"
+    "  -p, --paced              Replay events with their recorded spacing\n"
+    "                           instead of as fast as possible\n";
+
+// Number of calls to operator new, so that we can report how many
+// allocations the handlers make per event.
+static unsigned long long num_allocations = 0;
+
+// Dynamic exception specifications are gone in C++17, but the deallocation
+// functions still need to be declared as non-throwing.
+#if __cplusplus >= 201103L
+#define NOEXCEPT noexcept
+#else
+#define NOEXCEPT throw()
+#endif
+
+void* operator new(size_t size) {
+  num_allocations++;
+  void* ptr = malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) NOEXCEPT {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) NOEXCEPT {
+  free(ptr);
+}
+
+int main(int argc, char** argv) {
+  string config_file = "config";
+  bool paced = false;
+
+  struct option long_opts[] = {
+    { "config", true,  NULL, 'c' },
+    { "help",   false, NULL, 'h' },
+    { "paced",  false, NULL, 'p' },
+    { NULL,     false, NULL, 0 },
+  };
+  int opt = 0;
+  while ((opt = getopt_long(argc, argv, "c:hp", long_opts, NULL)) != -1) {
+    switch (opt) {
+      case 'c':
+        config_file = string(optarg);
+        break;
+      case 'p':
+        paced = true;
+        break;
+      case 'h':
+        // fallthrough
+      default:
+        std::cerr << kUsage;
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (optind != argc - 1) {
+    std::cerr << kUsage;
+    exit(EXIT_FAILURE);
+  }
+
+  EventTraceReader reader;
+  if (!reader.Open(argv[optind])) exit(EXIT_FAILURE);
+
+  XServer::SetupTesting();
+  EventReplayer replayer(&reader);
+  replayer.ApplyStartupRecords();
+
+  WindowManager window_manager;
+  window_manager.SetupDefaultCrap();
+  CHECK(window_manager.LoadConfig(config_file));
+
+  unsigned long long start_allocations = num_allocations;
+  double start_time = GetMonotonicTime();
+  replayer.Replay(&window_manager, paced);
+  double elapsed = GetMonotonicTime() - start_time;
+  unsigned long long allocations = num_allocations - start_allocations;
+
+  int num_events = replayer.num_events();
+  printf("Replayed %d events in %.3f sec\n", num_events, elapsed);
+  if (num_events > 0) {
+    printf("Handler time: %.3f sec (%.0f events/sec, %.2f us/event)\n",
+           replayer.handler_time(),
+           replayer.handler_time() > 0 ?
+             num_events / replayer.handler_time() : 0.0,
+           1e6 * replayer.handler_time() / num_events);
+    printf("Allocations: %llu (%.2f/event)\n",
+           allocations, static_cast<double>(allocations) / num_events);
+  }
+  printf("\n%s", XServer::Get()->event_stats().DebugString().c_str());
+  return 0;
+}
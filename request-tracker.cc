@@ -0,0 +1,65 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "request-tracker.h"
+
+using namespace std;
+
+namespace wham {
+
+RequestTracker::RequestTracker() {
+}
+
+
+void RequestTracker::Track(uint32_t sequence,
+                           const char* name,
+                           ErrorFunction* func) {
+  CHECK(name);
+  CHECK(entries_.empty() ||
+        SequenceIsOlder(entries_.back().sequence, sequence));
+  if (entries_.size() >= kMaxEntries) {
+    ERROR << "Request tracker is full; dropping oldest request";
+    entries_.pop_front();
+  }
+  entries_.push_back(Entry());
+  Entry& entry = entries_.back();
+  entry.sequence = sequence;
+  entry.name = name;
+  entry.func.reset(func);
+}
+
+
+void RequestTracker::Expire(uint32_t sequence) {
+  while (!entries_.empty() &&
+         SequenceIsOlder(entries_.front().sequence, sequence)) {
+    entries_.pop_front();
+  }
+}
+
+
+void RequestTracker::HandleError(const xcb_generic_error_t& error) {
+  for (deque<Entry>::iterator it = entries_.begin();
+       it != entries_.end(); ++it) {
+    if (SequenceIsOlder(error.full_sequence, it->sequence)) break;
+    if (it->sequence != error.full_sequence) continue;
+
+    ERROR << "Got X error " << static_cast<int>(error.error_code)
+          << " for " << it->name << " request (sequence "
+          << error.full_sequence << ", resource 0x" << hex
+          << error.resource_id << ")";
+    // Take the entry out before running the function, in case it tracks
+    // more requests.
+    ref_ptr<ErrorFunction> func = it->func;
+    entries_.erase(it);
+    if (func.get()) (*func)(error);
+    return;
+  }
+
+  ERROR << "Got X error " << static_cast<int>(error.error_code)
+        << " for request " << static_cast<int>(error.major_code)
+        << "." << static_cast<int>(error.minor_code)
+        << " (sequence " << error.full_sequence << ", resource 0x" << hex
+        << error.resource_id << ")";
+}
+
+}  // namespace wham
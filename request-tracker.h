@@ -0,0 +1,78 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __REQUEST_TRACKER_H__
+#define __REQUEST_TRACKER_H__
+
+#include <deque>
+
+#include <stdint.h>
+
+extern "C" {
+#include <xcb/xcb.h>
+}
+
+#include "util.h"
+
+using namespace std;
+
+class RequestTrackerTestSuite;  // from request-tracker_test.h
+
+namespace wham {
+
+// Finds out whether requests that we care about succeeded without
+// waiting for them.  Errors for requests that don't have replies show up
+// in the event stream along with the request's sequence number, and the
+// server handles requests in order, so once we've seen anything with a
+// later sequence number, we know that the request worked.  This is what
+// we use instead of syncing with the server after each request.
+class RequestTracker {
+ public:
+  // Run when a tracked request fails.
+  class ErrorFunction {
+   public:
+    virtual ~ErrorFunction() {}
+    virtual void operator()(const xcb_generic_error_t& error) = 0;
+  };
+
+  RequestTracker();
+
+  // Watch for an error from the request with sequence number 'sequence'.
+  // 'name' describes the request in log messages.  If 'func' is non-NULL,
+  // we take ownership of it and run it if the request fails; it's deleted
+  // once we know how the request turned out.  Requests must be tracked in
+  // the order in which they were sent.
+  void Track(uint32_t sequence, const char* name, ErrorFunction* func);
+
+  // Forget about requests older than 'sequence', which must have
+  // succeeded.
+  void Expire(uint32_t sequence);
+
+  // Log 'error' and run the function for the request that caused it, if
+  // we're tracking it.
+  void HandleError(const xcb_generic_error_t& error);
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  friend class ::RequestTrackerTestSuite;
+
+  // Keeps the tracker from growing without bound if the server stops
+  // sending us anything.
+  static const size_t kMaxEntries = 4096;
+
+  struct Entry {
+    uint32_t sequence;
+    const char* name;
+    ref_ptr<ErrorFunction> func;
+  };
+
+  // Tracked requests, oldest first.
+  deque<Entry> entries_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(RequestTracker);
+};
+
+}  // namespace wham
+
+#endif
@@ -0,0 +1,81 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include <cstring>
+
+#include "request-tracker.h"
+
+using namespace wham;
+
+class RequestTrackerTestSuite : public CxxTest::TestSuite {
+ public:
+  void testErrors() {
+    RequestTracker tracker;
+    int num_errors = 0, num_deleted = 0;
+    tracker.Track(10, "Foo", new CountingFunction(&num_errors, &num_deleted));
+    tracker.Track(11, "Bar", NULL);
+    tracker.Track(12, "Baz", new CountingFunction(&num_errors, &num_deleted));
+
+    // An error for a request that we're not tracking should just be
+    // logged.
+    tracker.HandleError(MakeError(9));
+    TS_ASSERT_EQUALS(num_errors, 0);
+    TS_ASSERT_EQUALS(tracker.size(), 3U);
+
+    // Requests without functions should still be forgotten when they fail.
+    tracker.HandleError(MakeError(11));
+    TS_ASSERT_EQUALS(num_errors, 0);
+    TS_ASSERT_EQUALS(tracker.size(), 2U);
+
+    tracker.HandleError(MakeError(12));
+    TS_ASSERT_EQUALS(num_errors, 1);
+    TS_ASSERT_EQUALS(num_deleted, 1);
+    TS_ASSERT_EQUALS(tracker.size(), 1U);
+
+    // Once we've heard about a later request, the earlier one must have
+    // succeeded.
+    tracker.Expire(10);
+    TS_ASSERT_EQUALS(tracker.size(), 1U);
+    tracker.Expire(11);
+    TS_ASSERT_EQUALS(tracker.size(), 0U);
+    TS_ASSERT_EQUALS(num_errors, 1);
+    TS_ASSERT_EQUALS(num_deleted, 2);
+  }
+
+  void testWraparound() {
+    RequestTracker tracker;
+    int num_errors = 0, num_deleted = 0;
+    tracker.Track(0xffffffff, "Foo", NULL);
+    tracker.Track(2, "Bar", new CountingFunction(&num_errors, &num_deleted));
+    tracker.Expire(1);
+    TS_ASSERT_EQUALS(tracker.size(), 1U);
+    tracker.HandleError(MakeError(2));
+    TS_ASSERT_EQUALS(num_errors, 1);
+  }
+
+ private:
+  class CountingFunction : public RequestTracker::ErrorFunction {
+   public:
+    CountingFunction(int* num_errors, int* num_deleted)
+        : num_errors_(num_errors),
+          num_deleted_(num_deleted) {
+    }
+    ~CountingFunction() { (*num_deleted_)++; }
+    void operator()(const xcb_generic_error_t& error) { (*num_errors_)++; }
+
+   private:
+    int* num_errors_;
+    int* num_deleted_;
+  };
+
+  static xcb_generic_error_t MakeError(uint32_t sequence) {
+    xcb_generic_error_t error;
+    memset(&error, 0, sizeof(error));
+    error.error_code = XCB_WINDOW;
+    error.sequence = sequence & 0xffff;
+    error.full_sequence = sequence;
+    return error;
+  }
+};
@@ -0,0 +1,94 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __RING_BUFFER_H__
+#define __RING_BUFFER_H__
+
+#include <vector>
+
+#include "util.h"
+
+using namespace std;
+
+class RingBufferTestSuite;  // from ring-buffer_test.h
+
+namespace wham {
+
+// Fixed-size queue for handing items from one thread to another without
+// locking.  Exactly one thread may call Push() and exactly one thread may
+// call Pop().  Each index is only written by one side and is published
+// with a release store, so the other side sees an item's contents before
+// it sees the index that covers it.
+template<class T>
+class RingBuffer {
+ public:
+  // 'capacity' is rounded up to a power of two.
+  explicit RingBuffer(size_t capacity)
+      : mask_(RoundUpToPowerOfTwo(capacity) - 1),
+        items_(mask_ + 1),
+        head_(0),
+        tail_(0) {
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // Number of items in the buffer.  This is only a snapshot when called
+  // while the other thread is using the buffer.
+  size_t size() const {
+    return __atomic_load_n(&tail_, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&head_, __ATOMIC_ACQUIRE);
+  }
+  bool empty() const { return size() == 0; }
+
+  // Add an item.  Called by the producer.  Returns false if the buffer is
+  // full.
+  bool Push(const T& item) {
+    size_t tail = tail_;
+    if (tail - __atomic_load_n(&head_, __ATOMIC_ACQUIRE) > mask_)
+      return false;
+    items_[tail & mask_] = item;
+    __atomic_store_n(&tail_, tail + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // Remove the oldest item.  Called by the consumer.  Returns false if the
+  // buffer is empty.
+  bool Pop(T* item) {
+    CHECK(item);
+    size_t head = head_;
+    if (head == __atomic_load_n(&tail_, __ATOMIC_ACQUIRE)) return false;
+    *item = items_[head & mask_];
+    __atomic_store_n(&head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+ private:
+  friend class ::RingBufferTestSuite;
+
+  static size_t RoundUpToPowerOfTwo(size_t num) {
+    size_t result = 1;
+    while (result < num) result <<= 1;
+    return result;
+  }
+
+  // Size of a cache line, used to keep the indexes (which are written by
+  // different threads) from sharing one.
+  static const size_t kCacheLineSize = 64;
+
+  const size_t mask_;
+  vector<T> items_;
+
+  // Total number of items popped, written only by the consumer.
+  size_t head_;
+  char padding_[kCacheLineSize];
+
+  // Total number of items pushed, written only by the producer.  The
+  // indexes wrap around together, so their difference is still the size.
+  size_t tail_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(RingBuffer);
+};
+
+}  // namespace wham
+
+#endif
@@ -0,0 +1,83 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include <pthread.h>
+
+#include "ring-buffer.h"
+#include "util.h"
+
+using namespace wham;
+
+class RingBufferTestSuite : public CxxTest::TestSuite {
+ public:
+  void testPushAndPop() {
+    // The capacity should be rounded up to a power of two.
+    RingBuffer<int> ring(3);
+    TS_ASSERT_EQUALS(ring.capacity(), 4U);
+    TS_ASSERT(ring.empty());
+
+    int item = 0;
+    TS_ASSERT(!ring.Pop(&item));
+    for (int i = 1; i <= 4; ++i) TS_ASSERT(ring.Push(i));
+    TS_ASSERT(!ring.Push(5));
+    TS_ASSERT_EQUALS(ring.size(), 4U);
+
+    TS_ASSERT(ring.Pop(&item));
+    TS_ASSERT_EQUALS(item, 1);
+    TS_ASSERT(ring.Push(5));
+
+    // The items should come back out in order after wrapping around.
+    for (int i = 2; i <= 5; ++i) {
+      TS_ASSERT(ring.Pop(&item));
+      TS_ASSERT_EQUALS(item, i);
+    }
+    TS_ASSERT(!ring.Pop(&item));
+    TS_ASSERT(ring.empty());
+  }
+
+  void testIndexWraparound() {
+    // The indexes only ever grow, so check that things still work when
+    // they overflow.
+    RingBuffer<int> ring(2);
+    ring.head_ = ring.tail_ = static_cast<size_t>(-1);
+    TS_ASSERT(ring.Push(1));
+    TS_ASSERT(ring.Push(2));
+    TS_ASSERT(!ring.Push(3));
+    int item = 0;
+    TS_ASSERT(ring.Pop(&item));
+    TS_ASSERT_EQUALS(item, 1);
+    TS_ASSERT(ring.Pop(&item));
+    TS_ASSERT_EQUALS(item, 2);
+    TS_ASSERT(ring.empty());
+  }
+
+  void testThreads() {
+    // Push a bunch of items from another thread through a small buffer
+    // and check that they all arrive in order.
+    RingBuffer<int> ring(16);
+    pthread_t thread;
+    TS_ASSERT_EQUALS(pthread_create(&thread, NULL, PushItems, &ring), 0);
+    int expected = 0;
+    while (expected < kNumThreadItems) {
+      int item = 0;
+      if (!ring.Pop(&item)) continue;
+      if (item != expected) break;
+      expected++;
+    }
+    TS_ASSERT_EQUALS(expected, kNumThreadItems);
+    TS_ASSERT_EQUALS(pthread_join(thread, NULL), 0);
+  }
+
+ private:
+  static const int kNumThreadItems = 100000;
+
+  static void* PushItems(void* arg) {
+    RingBuffer<int>* ring = static_cast<RingBuffer<int>*>(arg);
+    for (int i = 0; i < kNumThreadItems; ++i) {
+      while (!ring->Push(i)) {}
+    }
+    return NULL;
+  }
+};
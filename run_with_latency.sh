@@ -0,0 +1,11 @@
+#!/bin/sh
+# Runs wham against an Xvfb server through wham-latency-proxy, which adds
+# RTT_MS (default 40) milliseconds to every round trip.  Send wham SIGUSR1
+# to log the RTTs that it's measured.
+RTT_MS=${1:-40}
+Xvfb :1 -ac -screen 0 1000x720x24 &
+sleep 3
+./wham-latency-proxy --rtt=$RTT_MS :2 :1 &
+sleep 1
+export DISPLAY=:2
+./wham
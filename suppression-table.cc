@@ -0,0 +1,57 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "suppression-table.h"
+
+using namespace std;
+
+namespace wham {
+
+SuppressionTable::SuppressionTable() {
+}
+
+
+void SuppressionTable::Add(uint32_t sequence, ::Window window, uint types) {
+  CHECK(entries_.empty() ||
+        !SequenceIsOlder(sequence, entries_.back().sequence));
+  if (entries_.size() >= kMaxEntries) {
+    ERROR << "Suppression table is full; dropping oldest entry";
+    entries_.pop_front();
+  }
+  Entry entry;
+  entry.sequence = sequence;
+  entry.window = window;
+  entry.types = types;
+  entries_.push_back(entry);
+}
+
+
+void SuppressionTable::Expire(uint32_t sequence) {
+  while (!entries_.empty() &&
+         SequenceIsOlder(entries_.front().sequence, sequence)) {
+    entries_.pop_front();
+  }
+}
+
+
+bool SuppressionTable::ShouldSuppress(const Event& event) const {
+  uint type = 0;
+  if (event.type == Event::UNMAP_NOTIFY) type = UNMAP_NOTIFY;
+  else if (event.type == Event::ENTER_NOTIFY) type = ENTER_NOTIFY;
+  else return false;
+
+  // There are only ever a few entries, and the matching ones are usually
+  // at the front.
+  for (deque<Entry>::const_iterator it = entries_.begin();
+       it != entries_.end(); ++it) {
+    if (SequenceIsOlder(event.sequence, it->sequence)) break;
+    if (it->sequence == event.sequence &&
+        (it->types & type) &&
+        (it->window == None || it->window == event.window)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace wham
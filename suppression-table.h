@@ -0,0 +1,81 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __SUPPRESSION_TABLE_H__
+#define __SUPPRESSION_TABLE_H__
+
+#include <deque>
+
+#include <stdint.h>
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+#include "event.h"
+#include "util.h"
+
+using namespace std;
+
+class SuppressionTableTestSuite;  // from suppression-table_test.h
+
+namespace wham {
+
+// Keeps track of requests that we've made whose side effects we don't
+// want to hear about, so that the events that they generate can be
+// dropped.  Every event carries the sequence number of the last request
+// that the server had processed when it was generated, so an UnmapNotify
+// or EnterNotify with the same sequence number as one of our requests
+// was caused by that request.  This lets us ignore our own unmaps and the
+// pointer crossings caused by mapping, unmapping and restacking windows
+// without grabbing the server or changing event masks.
+class SuppressionTable {
+ public:
+  // Types of events that can be suppressed.
+  enum {
+    UNMAP_NOTIFY = 1 << 0,
+    ENTER_NOTIFY = 1 << 1,
+  };
+
+  SuppressionTable();
+
+  // Drop events matching 'types' (a bitfield of the above values) that
+  // are generated by the request with sequence number 'sequence'.  If
+  // 'window' isn't None, only events for that window are dropped.
+  // Requests must be added in the order in which they were sent.
+  void Add(uint32_t sequence, ::Window window, uint types);
+
+  // Forget about requests older than 'sequence'.  The server handles
+  // requests in order, so once we've seen an event (or reply or error)
+  // with a newer sequence number, the older requests can't generate any
+  // more events.
+  void Expire(uint32_t sequence);
+
+  // Should 'event' be dropped?
+  bool ShouldSuppress(const Event& event) const;
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  friend class ::SuppressionTableTestSuite;
+
+  // We'll never have anywhere near this many requests in flight; this
+  // just keeps the table from growing without bound if the server stops
+  // sending us events.
+  static const size_t kMaxEntries = 4096;
+
+  struct Entry {
+    uint32_t sequence;
+    ::Window window;
+    uint types;
+  };
+
+  // Entries, oldest first.
+  deque<Entry> entries_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(SuppressionTable);
+};
+
+}  // namespace wham
+
+#endif
@@ -0,0 +1,70 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "suppression-table.h"
+
+#include "event.h"
+
+using namespace wham;
+
+class SuppressionTableTestSuite : public CxxTest::TestSuite {
+ public:
+  void testSuppress() {
+    SuppressionTable table;
+    table.Add(10, 0x100, SuppressionTable::UNMAP_NOTIFY);
+    table.Add(10, None, SuppressionTable::ENTER_NOTIFY);
+    table.Add(12, None, SuppressionTable::ENTER_NOTIFY);
+
+    // The unmap should only be suppressed for the window that we
+    // unmapped, but crossing events should be suppressed for any window.
+    TS_ASSERT(table.ShouldSuppress(MakeEvent(Event::UNMAP_NOTIFY, 0x100, 10)));
+    TS_ASSERT(!table.ShouldSuppress(MakeEvent(Event::UNMAP_NOTIFY, 0x200, 10)));
+    TS_ASSERT(table.ShouldSuppress(MakeEvent(Event::ENTER_NOTIFY, 0x200, 10)));
+    TS_ASSERT(table.ShouldSuppress(MakeEvent(Event::ENTER_NOTIFY, 0x300, 12)));
+
+    // Events generated by other requests shouldn't be suppressed.
+    TS_ASSERT(!table.ShouldSuppress(MakeEvent(Event::UNMAP_NOTIFY, 0x100, 9)));
+    TS_ASSERT(!table.ShouldSuppress(MakeEvent(Event::ENTER_NOTIFY, 0x200, 11)));
+
+    // Neither should other types of events.
+    TS_ASSERT(!table.ShouldSuppress(MakeEvent(Event::EXPOSE, 0x100, 10)));
+  }
+
+  void testExpire() {
+    SuppressionTable table;
+    table.Add(10, None, SuppressionTable::ENTER_NOTIFY);
+    table.Add(12, None, SuppressionTable::ENTER_NOTIFY);
+
+    // Seeing an event for request 10 shouldn't expire its entry, since
+    // it may have generated more events.
+    table.Expire(10);
+    TS_ASSERT_EQUALS(table.size(), 2U);
+    table.Expire(11);
+    TS_ASSERT_EQUALS(table.size(), 1U);
+    TS_ASSERT(!table.ShouldSuppress(MakeEvent(Event::ENTER_NOTIFY, 0x1, 10)));
+    table.Expire(20);
+    TS_ASSERT_EQUALS(table.size(), 0U);
+  }
+
+  void testWraparound() {
+    SuppressionTable table;
+    table.Add(0xfffffffe, None, SuppressionTable::ENTER_NOTIFY);
+    table.Add(1, None, SuppressionTable::ENTER_NOTIFY);
+
+    // Sequence numbers after the wraparound are newer.
+    table.Expire(0xffffffff);
+    TS_ASSERT_EQUALS(table.size(), 1U);
+    TS_ASSERT(table.ShouldSuppress(MakeEvent(Event::ENTER_NOTIFY, 0x1, 1)));
+    table.Expire(2);
+    TS_ASSERT_EQUALS(table.size(), 0U);
+  }
+
+ private:
+  static Event MakeEvent(Event::Type type, ::Window window, uint32_t sequence) {
+    Event event(type, window);
+    event.sequence = sequence;
+    return event;
+  }
+};
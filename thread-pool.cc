@@ -0,0 +1,245 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "thread-pool.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace wham {
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_started_(0),
+      event_fd_(-1),
+      num_queued_(0),
+      quit_(false),
+      next_worker_(0),
+      next_id_(1) {
+  CHECK(num_threads > 0);
+  for (int i = 0; i < num_threads; ++i) {
+    Worker* worker = new Worker;
+    worker->pool = this;
+    worker->index = i;
+    pthread_mutex_init(&worker->mutex, NULL);
+    workers_.push_back(worker);
+  }
+  event_fd_ = eventfd(0, EFD_NONBLOCK);
+  CHECK(event_fd_ != -1);
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&cond_, NULL);
+}
+
+
+ThreadPool::~ThreadPool() {
+  Stop();
+
+  // Every entry that's still queued, running, or waiting for
+  // RunCompletions() is in 'pending_'.
+  for (map<PoolTaskId, Entry*>::iterator it = pending_.begin();
+       it != pending_.end(); ++it) {
+    Entry* entry = it->second;
+    if (entry->group) entry->group->ids_.erase(entry->id);
+    delete entry->task;
+    delete entry;
+  }
+  pending_.clear();
+  completions_.clear();
+
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    pthread_mutex_destroy(&workers_[i]->mutex);
+    delete workers_[i];
+  }
+  workers_.clear();
+
+  close(event_fd_);
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+
+bool ThreadPool::Start() {
+  CHECK(num_started_ == 0);
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    int error =
+        pthread_create(&workers_[i]->thread, NULL, RunThread, workers_[i]);
+    if (error) {
+      ERROR << "Unable to start thread pool thread: " << strerror(error);
+      Stop();
+      return false;
+    }
+    num_started_++;
+  }
+  return true;
+}
+
+
+PoolTaskId ThreadPool::Post(PoolTask* task, PoolTaskGroup* group) {
+  CHECK(task);
+  PoolTaskId id = next_id_++;
+  Entry* entry = new Entry(id, task, group);
+  pending_[id] = entry;
+  if (group) group->ids_.insert(id);
+
+  Worker* worker = workers_[next_worker_];
+  next_worker_ = (next_worker_ + 1) % workers_.size();
+  pthread_mutex_lock(&worker->mutex);
+  worker->entries.push_back(entry);
+  pthread_mutex_unlock(&worker->mutex);
+
+  pthread_mutex_lock(&mutex_);
+  num_queued_++;
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&mutex_);
+  return id;
+}
+
+
+bool ThreadPool::Cancel(PoolTaskId id) {
+  map<PoolTaskId, Entry*>::iterator it = pending_.find(id);
+  if (it == pending_.end()) return false;
+  Entry* entry = it->second;
+  if (__atomic_load_n(&entry->cancelled, __ATOMIC_ACQUIRE)) return false;
+
+  // The entry stays in 'pending_' until a thread is done with it.
+  __atomic_store_n(&entry->cancelled, 1, __ATOMIC_RELEASE);
+  if (entry->group) {
+    entry->group->ids_.erase(id);
+    entry->group = NULL;
+  }
+  return true;
+}
+
+
+int ThreadPool::RunCompletions() {
+  uint64_t count = 0;
+  if (read(event_fd_, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    ERROR << "Unable to read from eventfd: " << strerror(errno);
+
+  deque<Entry*> completions;
+  pthread_mutex_lock(&mutex_);
+  completions.swap(completions_);
+  pthread_mutex_unlock(&mutex_);
+
+  // Finish() may cancel tasks (including ones later in 'completions'),
+  // so each entry is only looked at once we get to it.
+  int num_finished = 0;
+  for (deque<Entry*>::iterator it = completions.begin();
+       it != completions.end(); ++it) {
+    Entry* entry = *it;
+    pending_.erase(entry->id);
+    if (entry->group) {
+      entry->group->ids_.erase(entry->id);
+      entry->group = NULL;
+    }
+    if (!__atomic_load_n(&entry->cancelled, __ATOMIC_ACQUIRE)) {
+      entry->task->Finish();
+      num_finished++;
+    }
+    delete entry->task;
+    delete entry;
+  }
+  return num_finished;
+}
+
+
+void* ThreadPool::RunThread(void* arg) {
+  Worker* worker = static_cast<Worker*>(arg);
+  worker->pool->Run(worker);
+  return NULL;
+}
+
+
+void ThreadPool::Run(Worker* worker) {
+  while (true) {
+    Entry* entry = TakeEntry(worker);
+    if (!entry) {
+      pthread_mutex_lock(&mutex_);
+      while (num_queued_ <= 0 && !quit_) pthread_cond_wait(&cond_, &mutex_);
+      bool quit = quit_;
+      pthread_mutex_unlock(&mutex_);
+      if (quit) break;
+      continue;
+    }
+
+    pthread_mutex_lock(&mutex_);
+    num_queued_--;
+    bool quit = quit_;
+    pthread_mutex_unlock(&mutex_);
+
+    if (!quit && !__atomic_load_n(&entry->cancelled, __ATOMIC_ACQUIRE))
+      entry->task->Run();
+
+    pthread_mutex_lock(&mutex_);
+    completions_.push_back(entry);
+    pthread_mutex_unlock(&mutex_);
+
+    uint64_t count = 1;
+    if (write(event_fd_, &count, sizeof(count)) == -1 && errno != EAGAIN)
+      ERROR << "Unable to write to eventfd: " << strerror(errno);
+    if (quit) break;
+  }
+}
+
+
+ThreadPool::Entry* ThreadPool::TakeEntry(Worker* worker) {
+  Entry* entry = NULL;
+  pthread_mutex_lock(&worker->mutex);
+  if (!worker->entries.empty()) {
+    entry = worker->entries.front();
+    worker->entries.pop_front();
+  }
+  pthread_mutex_unlock(&worker->mutex);
+  if (entry) return entry;
+
+  for (size_t i = 1; i < workers_.size() && !entry; ++i) {
+    Worker* victim = workers_[(worker->index + i) % workers_.size()];
+    pthread_mutex_lock(&victim->mutex);
+    if (!victim->entries.empty()) {
+      entry = victim->entries.back();
+      victim->entries.pop_back();
+    }
+    pthread_mutex_unlock(&victim->mutex);
+  }
+  return entry;
+}
+
+
+void ThreadPool::Stop() {
+  if (num_started_ == 0) return;
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&mutex_);
+  for (size_t i = 0; i < num_started_; ++i)
+    pthread_join(workers_[i]->thread, NULL);
+  num_started_ = 0;
+}
+
+
+PoolTaskGroup::PoolTaskGroup(ThreadPool* pool)
+    : pool_(pool) {
+  CHECK(pool_);
+}
+
+
+PoolTaskGroup::~PoolTaskGroup() {
+  CancelAll();
+}
+
+
+void PoolTaskGroup::CancelAll() {
+  // Cancel() removes IDs from 'ids_', so work from a copy.
+  set<PoolTaskId> ids;
+  ids.swap(ids_);
+  for (set<PoolTaskId>::const_iterator it = ids.begin();
+       it != ids.end(); ++it) {
+    pool_->Cancel(*it);
+  }
+}
+
+}  // namespace wham
@@ -0,0 +1,198 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "util.h"
+
+using namespace std;
+
+class ThreadPoolTestSuite;  // from thread-pool_test.h
+
+namespace wham {
+
+class PoolTaskGroup;
+
+// Interface for CPU-heavy work (scaling images, compiling regexps,
+// serializing state) that shouldn't hold up the event loop.  Run() does
+// the work on one of the pool's threads and must only touch the task's
+// own data; Finish() then hands the result over on the main thread.
+class PoolTask {
+ public:
+  virtual ~PoolTask() {}
+
+  // Do the work.  Called on a pool thread.
+  virtual void Run() = 0;
+
+  // Use the result.  Called on the main thread after Run() returns,
+  // unless the task was cancelled.
+  virtual void Finish() = 0;
+};
+
+
+// Handle for a task posted to a ThreadPool.  0 is never a valid handle.
+typedef uint64_t PoolTaskId;
+
+
+// Runs PoolTasks on a fixed set of threads.  Posted tasks are spread
+// across the threads' queues.  Each thread takes tasks from the front of
+// its own queue, and a thread whose queue is empty steals from the back
+// of the others', so one long task doesn't hold up the tasks queued
+// behind it.  An eventfd becomes readable when tasks have finished, and
+// RunCompletions() calls their Finish() methods.
+//
+// Everything except the tasks' Run() methods happens on the main thread.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+
+  // Stops and joins the threads.  Tasks that haven't finished are
+  // deleted without having Finish() called.
+  ~ThreadPool();
+
+  // Start the threads.  Returns false on failure.
+  bool Start();
+
+  // File descriptor that becomes readable when tasks have finished.
+  int fd() const { return event_fd_; }
+
+  // Run 'task', taking ownership of it.  If 'group' is non-NULL, the task
+  // is cancelled when the group is destroyed.
+  PoolTaskId Post(PoolTask* task, PoolTaskGroup* group);
+
+  // Cancel a task.  If it hasn't started running, it won't; either way,
+  // its Finish() method won't be called.  Returns false if it already
+  // finished or was cancelled.
+  bool Cancel(PoolTaskId id);
+
+  // Call Finish() for all of the tasks that have finished running and
+  // delete them.  Returns the number of Finish() calls.
+  int RunCompletions();
+
+  // Number of tasks that RunCompletions() hasn't handled yet, including
+  // cancelled ones that are still running.
+  size_t num_pending() const { return pending_.size(); }
+
+ private:
+  friend class ::ThreadPoolTestSuite;
+
+  struct Entry {
+    Entry(PoolTaskId id, PoolTask* task, PoolTaskGroup* group)
+        : id(id),
+          task(task),
+          group(group),
+          cancelled(0) {
+    }
+
+    PoolTaskId id;
+    PoolTask* task;
+
+    // Only used by the main thread.  Cleared when the task is cancelled.
+    PoolTaskGroup* group;
+
+    // Set by the main thread and read by the pool threads, so it's only
+    // accessed atomically.
+    int cancelled;
+  };
+
+  // A pool thread and its queue.
+  struct Worker {
+    ThreadPool* pool;
+    int index;
+    pthread_t thread;
+
+    // Protects 'entries'.
+    pthread_mutex_t mutex;
+    deque<Entry*> entries;
+  };
+
+  static void* RunThread(void* arg);
+
+  // Run tasks on 'worker' until Stop() is called.
+  void Run(Worker* worker);
+
+  // Take the oldest entry from 'worker''s queue or, if it's empty, the
+  // newest one from another thread's queue.  Returns NULL if all of the
+  // queues are empty.
+  Entry* TakeEntry(Worker* worker);
+
+  // Tell the threads to exit and wait for them.
+  void Stop();
+
+  vector<Worker*> workers_;
+
+  // Number of workers whose threads are running.
+  size_t num_started_;
+
+  int event_fd_;
+
+  // Protects 'num_queued_', 'quit_', and 'completions_'.
+  pthread_mutex_t mutex_;
+
+  // Signalled when a task is queued or 'quit_' is set.
+  pthread_cond_t cond_;
+
+  // Number of entries in the workers' queues.  This can briefly drop
+  // below zero when a thread takes an entry before Post() has counted it.
+  int num_queued_;
+
+  bool quit_;
+
+  // Entries that have been run (or skipped because they were cancelled),
+  // oldest first.
+  deque<Entry*> completions_;
+
+  // Entries that haven't been handled by RunCompletions() yet, keyed by
+  // ID.  Only used by the main thread.
+  map<PoolTaskId, Entry*> pending_;
+
+  // Worker that the next posted task goes to.
+  size_t next_worker_;
+
+  PoolTaskId next_id_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(ThreadPool);
+};
+
+
+// Cancels all of the tasks posted with it when it's destroyed.  Objects
+// that post tasks to a ThreadPool whose Finish() methods refer back to
+// them (a Window that's scaling its icon, say) should own one of these,
+// so the results are dropped when the object goes away.  Groups must be
+// destroyed before their pool.
+class PoolTaskGroup {
+ public:
+  explicit PoolTaskGroup(ThreadPool* pool);
+  ~PoolTaskGroup();
+
+  // Post 'task' to the pool as part of this group.
+  PoolTaskId Post(PoolTask* task) { return pool_->Post(task, this); }
+
+  // Cancel all of the group's tasks.
+  void CancelAll();
+
+  size_t size() const { return ids_.size(); }
+
+ private:
+  friend class ThreadPool;
+
+  ThreadPool* pool_;  // not owned
+
+  // Tasks that haven't finished or been cancelled.
+  set<PoolTaskId> ids_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(PoolTaskGroup);
+};
+
+}  // namespace wham
+
+#endif
@@ -0,0 +1,188 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "thread-pool.h"
+
+using namespace wham;
+
+// Adds up a range of numbers.
+class SumTask : public PoolTask {
+ public:
+  SumTask(int start, int end, int* result, int* num_runs)
+      : start_(start),
+        end_(end),
+        sum_(0),
+        result_(result),
+        num_runs_(num_runs),
+        finish_thread_(0) {
+  }
+
+  void Run() {
+    for (int i = start_; i < end_; ++i) sum_ += i;
+    __atomic_add_fetch(num_runs_, 1, __ATOMIC_SEQ_CST);
+  }
+
+  void Finish() {
+    *result_ += sum_;
+    finish_thread_ = pthread_self();
+    CHECK(pthread_equal(finish_thread_, main_thread_));
+  }
+
+  static pthread_t main_thread_;
+
+ private:
+  int start_;
+  int end_;
+  int sum_;
+  int* result_;
+  int* num_runs_;
+  pthread_t finish_thread_;
+};
+
+pthread_t SumTask::main_thread_;
+
+
+// Blocks its thread until Open() is called.
+class GateTask : public PoolTask {
+ public:
+  GateTask() : open_(0), running_(0) {}
+
+  void Run() {
+    __atomic_store_n(&running_, 1, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(&open_, __ATOMIC_ACQUIRE)) usleep(1000);
+  }
+  void Finish() {}
+
+  void Open() { __atomic_store_n(&open_, 1, __ATOMIC_RELEASE); }
+
+  void WaitUntilRunning() {
+    while (!__atomic_load_n(&running_, __ATOMIC_ACQUIRE)) usleep(1000);
+  }
+
+ private:
+  int open_;
+  int running_;
+};
+
+
+class ThreadPoolTestSuite : public CxxTest::TestSuite {
+ public:
+  void setUp() {
+    SumTask::main_thread_ = pthread_self();
+  }
+
+  void testRunAndFinish() {
+    ThreadPool pool(3);
+    TS_ASSERT(pool.Start());
+
+    int result = 0, num_runs = 0;
+    for (int i = 0; i < 10; ++i)
+      pool.Post(new SumTask(i * 100, (i + 1) * 100, &result, &num_runs), NULL);
+    TS_ASSERT_EQUALS(WaitForCompletions(&pool, 10), 10);
+    TS_ASSERT_EQUALS(result, 999 * 1000 / 2);
+    TS_ASSERT_EQUALS(pool.num_pending(), 0U);
+  }
+
+  void testCancel() {
+    ThreadPool pool(1);
+    TS_ASSERT(pool.Start());
+
+    // Keep the thread busy while we cancel the task queued behind it.
+    GateTask* gate = new GateTask;
+    PoolTaskId gate_id = pool.Post(gate, NULL);
+    gate->WaitUntilRunning();
+    int result = 0, num_runs = 0;
+    PoolTaskId id = pool.Post(new SumTask(0, 10, &result, &num_runs), NULL);
+    TS_ASSERT(pool.Cancel(id));
+    TS_ASSERT(!pool.Cancel(id));
+
+    // The running task can be cancelled too, but it still runs to
+    // completion.
+    TS_ASSERT(pool.Cancel(gate_id));
+    gate->Open();
+    TS_ASSERT_EQUALS(WaitForCompletions(&pool, 0), 0);
+    TS_ASSERT_EQUALS(num_runs, 0);
+    TS_ASSERT_EQUALS(result, 0);
+  }
+
+  void testGroup() {
+    ThreadPool pool(1);
+    TS_ASSERT(pool.Start());
+    GateTask* gate = new GateTask;
+    pool.Post(gate, NULL);
+    gate->WaitUntilRunning();
+
+    // Destroying the group should cancel its tasks but not others.
+    int result = 0, num_runs = 0;
+    {
+      PoolTaskGroup group(&pool);
+      group.Post(new SumTask(0, 10, &result, &num_runs));
+      group.Post(new SumTask(10, 20, &result, &num_runs));
+      TS_ASSERT_EQUALS(group.size(), 2U);
+    }
+    pool.Post(new SumTask(0, 5, &result, &num_runs), NULL);
+    gate->Open();
+    TS_ASSERT_EQUALS(WaitForCompletions(&pool, 2), 2);
+    TS_ASSERT_EQUALS(result, 10);
+    TS_ASSERT_EQUALS(num_runs, 1);
+
+    // Finished tasks should be removed from their groups.
+    PoolTaskGroup group(&pool);
+    group.Post(new SumTask(0, 5, &result, &num_runs));
+    TS_ASSERT_EQUALS(WaitForCompletions(&pool, 1), 1);
+    TS_ASSERT_EQUALS(group.size(), 0U);
+  }
+
+  void testSteal() {
+    ThreadPool pool(2);
+    TS_ASSERT(pool.Start());
+
+    // Posted tasks alternate between the threads' queues, so half of
+    // these land behind the gate and have to be stolen by the other
+    // thread.
+    GateTask* gate = new GateTask;
+    pool.Post(gate, NULL);
+    gate->WaitUntilRunning();
+    int result = 0, num_runs = 0;
+    for (int i = 0; i < 4; ++i)
+      pool.Post(new SumTask(0, 10, &result, &num_runs), NULL);
+    TS_ASSERT_EQUALS(WaitForCompletions(&pool, 4), 4);
+    TS_ASSERT_EQUALS(result, 4 * 45);
+    gate->Open();
+  }
+
+  void testDeleteWithPendingTasks() {
+    // Tasks that haven't finished should just be deleted.
+    ThreadPool pool(1);
+    int result = 0, num_runs = 0;
+    pool.Post(new SumTask(0, 10, &result, &num_runs), NULL);
+    TS_ASSERT_EQUALS(pool.num_pending(), 1U);
+  }
+
+ private:
+  // Run completions until 'num_tasks' tasks have been finished or there
+  // are no more pending tasks, giving up after a few seconds.  Returns
+  // the number of finished tasks.
+  static int WaitForCompletions(ThreadPool* pool, int num_tasks) {
+    int num_finished = 0;
+    for (int i = 0; i < 50; ++i) {
+      if (pool->num_pending() == 0 ||
+          (num_tasks > 0 && num_finished >= num_tasks)) {
+        break;
+      }
+      struct pollfd pfd;
+      pfd.fd = pool->fd();
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      poll(&pfd, 1, 100);
+      num_finished += pool->RunCompletions();
+    }
+    return num_finished;
+  }
+};
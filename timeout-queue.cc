@@ -0,0 +1,124 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "timeout-queue.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace wham {
+
+const uint32_t TimeoutQueue::kFree = static_cast<uint32_t>(-1);
+
+
+TimeoutQueue::TimeoutQueue() {
+}
+
+
+TimeoutId TimeoutQueue::Add(TimeoutFunction* func, double time) {
+  CHECK(func);
+
+  uint32_t slot_index;
+  if (!free_slots_.empty()) {
+    slot_index = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    slot_index = slots_.size();
+    slots_.push_back(Slot());
+  }
+  Slot& slot = slots_[slot_index];
+  slot.func = func;
+
+  heap_.push_back(HeapEntry(time, slot_index));
+  slot.heap_index = heap_.size() - 1;
+  SiftUp(heap_.size() - 1);
+
+  return (static_cast<TimeoutId>(slot.generation) << 32) | slot_index;
+}
+
+
+bool TimeoutQueue::Cancel(TimeoutId id) {
+  Slot* slot = GetSlot(id);
+  if (!slot) return false;
+  RemoveAt(slot->heap_index);
+  return true;
+}
+
+
+TimeoutFunction* TimeoutQueue::Pop() {
+  CHECK(!heap_.empty());
+  TimeoutFunction* func = slots_[heap_[0].slot].func;
+  RemoveAt(0);
+  return func;
+}
+
+
+TimeoutQueue::Slot* TimeoutQueue::GetSlot(TimeoutId id) {
+  uint32_t slot_index = static_cast<uint32_t>(id);
+  uint32_t generation = static_cast<uint32_t>(id >> 32);
+  if (slot_index >= slots_.size()) return NULL;
+  Slot* slot = &slots_[slot_index];
+  if (slot->generation != generation || slot->heap_index == kFree)
+    return NULL;
+  return slot;
+}
+
+
+void TimeoutQueue::RemoveAt(size_t index) {
+  CHECK(index < heap_.size());
+  uint32_t slot_index = heap_[index].slot;
+  Slot& slot = slots_[slot_index];
+  slot.heap_index = kFree;
+  slot.func = NULL;
+  // Skip 0 when the generation wraps so that handles are never 0.
+  if (++slot.generation == 0) slot.generation = 1;
+  free_slots_.push_back(slot_index);
+
+  // Fill the hole with the last entry and restore the heap property.
+  size_t last = heap_.size() - 1;
+  if (index != last) {
+    SetEntry(index, heap_[last]);
+    heap_.pop_back();
+    if (index > 0 && heap_[index].time < heap_[(index - 1) / kArity].time) {
+      SiftUp(index);
+    } else {
+      SiftDown(index);
+    }
+  } else {
+    heap_.pop_back();
+  }
+}
+
+
+void TimeoutQueue::SiftUp(size_t index) {
+  HeapEntry entry = heap_[index];
+  while (index > 0) {
+    size_t parent = (index - 1) / kArity;
+    if (!(entry.time < heap_[parent].time)) break;
+    SetEntry(index, heap_[parent]);
+    index = parent;
+  }
+  SetEntry(index, entry);
+}
+
+
+void TimeoutQueue::SiftDown(size_t index) {
+  HeapEntry entry = heap_[index];
+  size_t size = heap_.size();
+  while (true) {
+    size_t first_child = kArity * index + 1;
+    if (first_child >= size) break;
+    size_t last_child = min(first_child + kArity, size);
+    size_t min_child = first_child;
+    for (size_t child = first_child + 1; child < last_child; ++child) {
+      if (heap_[child].time < heap_[min_child].time) min_child = child;
+    }
+    if (!(heap_[min_child].time < entry.time)) break;
+    SetEntry(index, heap_[min_child]);
+    index = min_child;
+  }
+  SetEntry(index, entry);
+}
+
+}  // namespace wham
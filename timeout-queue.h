@@ -0,0 +1,120 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __TIMEOUT_QUEUE_H__
+#define __TIMEOUT_QUEUE_H__
+
+#include <vector>
+
+#include <stdint.h>
+
+#include "util.h"
+
+using namespace std;
+
+class TimeoutQueueTestSuite;  // from timeout-queue_test.h
+
+namespace wham {
+
+// Interface for code that should be run when a timeout expires.
+class TimeoutFunction {
+ public:
+  virtual ~TimeoutFunction() {}
+
+  virtual void operator()() = 0;
+};
+
+
+// Handle for a timeout in a TimeoutQueue.  The low 32 bits hold the index
+// of the timeout's slot and the high 32 bits hold the slot's generation,
+// which is incremented whenever the slot is freed, so a stale handle will
+// never match a timeout that later reuses the same slot.  0 is never a
+// valid handle.
+typedef uint64_t TimeoutId;
+
+
+// Priority queue of timeouts ordered by deadline.  This is an indexed
+// 4-ary min-heap: each timeout lives in a slot that records its position
+// in the heap, so Add() and Cancel() are both O(log n), and a 4-ary heap
+// is shallower and more cache-friendly than a binary one.
+class TimeoutQueue {
+ public:
+  TimeoutQueue();
+
+  bool empty() const { return heap_.empty(); }
+  size_t size() const { return heap_.size(); }
+
+  // Deadline of the earliest timeout.  The queue must be non-empty.
+  double next_time() const {
+    CHECK(!heap_.empty());
+    return heap_[0].time;
+  }
+
+  // Add a timeout that should run 'func' at 'time'.  Ownership of 'func'
+  // remains with the caller.
+  TimeoutId Add(TimeoutFunction* func, double time);
+
+  // Remove a timeout.  Returns false if it already ran or was cancelled.
+  bool Cancel(TimeoutId id);
+
+  // Remove the earliest timeout and return its function.  The queue must
+  // be non-empty.
+  TimeoutFunction* Pop();
+
+ private:
+  friend class ::TimeoutQueueTestSuite;
+
+  // A heap entry.  The deadline is copied here so that sifting doesn't
+  // need to look at the slots.
+  struct HeapEntry {
+    HeapEntry(double time, uint32_t slot) : time(time), slot(slot) {}
+    double time;
+    uint32_t slot;
+  };
+
+  struct Slot {
+    Slot() : generation(1), heap_index(kFree), func(NULL) {}
+
+    uint32_t generation;
+
+    // Position of this slot's timeout in 'heap_', or kFree if the slot
+    // isn't in use.
+    uint32_t heap_index;
+
+    TimeoutFunction* func;
+  };
+
+  static const uint32_t kFree;
+
+  static const int kArity = 4;
+
+  // Get the slot for 'id', or NULL if it doesn't refer to a pending
+  // timeout.
+  Slot* GetSlot(TimeoutId id);
+
+  // Remove the entry at 'index' from the heap and free its slot.
+  void RemoveAt(size_t index);
+
+  // Store 'entry' at 'index' and update its slot.
+  void SetEntry(size_t index, const HeapEntry& entry) {
+    heap_[index] = entry;
+    slots_[entry.slot].heap_index = index;
+  }
+
+  // Move the entry at 'index' towards the root or the leaves until the
+  // heap property holds.
+  void SiftUp(size_t index);
+  void SiftDown(size_t index);
+
+  vector<HeapEntry> heap_;
+  vector<Slot> slots_;
+
+  // Indexes of unused entries in 'slots_'.
+  vector<uint32_t> free_slots_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TimeoutQueue);
+};
+
+}  // namespace wham
+
+#endif
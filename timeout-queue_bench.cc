@@ -0,0 +1,156 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+//
+// Registers and then cancels 100,000 timeouts (in random order) using
+// TimeoutQueue and using the heap that EventLoop used previously, where
+// cancelling a timeout meant scanning the whole heap for its ID and then
+// rebuilding the heap with make_heap().  A second pass simulates anchor
+// animations: a fixed number of pending timeouts, each repeatedly
+// cancelled and re-registered.
+//
+// Cancelling is quadratic with the old heap, so the first pass takes close
+// to a minute.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "timeout-queue.h"
+#include "util.h"
+
+using namespace std;
+using namespace wham;
+
+// Number of timeouts registered and cancelled in the first pass.
+static const int kNumTimeouts = 100000;
+
+// Number of pending timeouts and cancel/register operations in the
+// second pass.
+static const int kNumChurnTimeouts = 1000;
+static const int kNumChurnOps = 100000;
+
+
+// The old heap.
+class OldHeap {
+ public:
+  OldHeap() : next_id_(1) {}
+
+  uint Add(TimeoutFunction* func, double time) {
+    uint id = next_id_++;
+    heap_.push_back(Timeout(id, func, time));
+    push_heap(heap_.begin(), heap_.end());
+    return id;
+  }
+
+  bool Cancel(uint id) {
+    for (vector<Timeout>::iterator it = heap_.begin();
+         it != heap_.end(); ++it) {
+      if (it->id == id) {
+        heap_.erase(it);
+        make_heap(heap_.begin(), heap_.end());
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t size() const { return heap_.size(); }
+
+ private:
+  struct Timeout {
+    Timeout(uint id, TimeoutFunction* func, double time)
+        : id(id), func(func), time(time) {}
+    bool operator<(const Timeout& o) const { return time > o.time; }
+    uint id;
+    TimeoutFunction* func;
+    double time;
+  };
+
+  uint next_id_;
+  vector<Timeout> heap_;
+};
+
+
+class NullTimeoutFunction : public TimeoutFunction {
+ public:
+  void operator()() {}
+};
+
+
+// Add 'num' timeouts with random deadlines to 'queue' and then cancel
+// them in random order, returning the elapsed time.
+template<class Queue, class Id>
+static double RunRegisterCancel(Queue* queue, int num) {
+  NullTimeoutFunction func;
+  srand(1);
+  vector<Id> ids;
+  ids.reserve(num);
+  double start = GetMonotonicTime();
+  for (int i = 0; i < num; ++i)
+    ids.push_back(queue->Add(&func, rand() / (RAND_MAX + 1.0)));
+  random_shuffle(ids.begin(), ids.end());
+  for (int i = 0; i < num; ++i) CHECK(queue->Cancel(ids[i]));
+  double elapsed = GetMonotonicTime() - start;
+  CHECK_EQ(queue->size(), 0U);
+  return elapsed;
+}
+
+
+// Keep 'num_pending' timeouts in 'queue', repeatedly cancelling a random
+// one and registering a replacement with a later deadline.
+template<class Queue, class Id>
+static double RunChurn(Queue* queue, int num_pending, int num_ops) {
+  NullTimeoutFunction func;
+  srand(1);
+  vector<Id> ids;
+  double now = 0;
+  for (int i = 0; i < num_pending; ++i)
+    ids.push_back(queue->Add(&func, now + rand() / (RAND_MAX + 1.0)));
+  double start = GetMonotonicTime();
+  for (int i = 0; i < num_ops; ++i) {
+    int index = rand() % num_pending;
+    CHECK(queue->Cancel(ids[index]));
+    now += 0.0001;
+    ids[index] = queue->Add(&func, now + 0.0333);
+  }
+  return GetMonotonicTime() - start;
+}
+
+
+static void PrintResult(const char* name, int num_ops, double elapsed) {
+  printf("  %-6s total=%.3fs per-op=%.1fns\n",
+         name, elapsed, 1e9 * elapsed / num_ops);
+}
+
+
+int main(int argc, char** argv) {
+  printf("register and cancel %d timeouts:\n", kNumTimeouts);
+  {
+    OldHeap old_heap;
+    PrintResult("old", 2 * kNumTimeouts,
+                RunRegisterCancel<OldHeap, uint>(&old_heap, kNumTimeouts));
+  }
+  {
+    TimeoutQueue queue;
+    PrintResult("queue", 2 * kNumTimeouts,
+                RunRegisterCancel<TimeoutQueue, TimeoutId>(
+                    &queue, kNumTimeouts));
+  }
+
+  printf("cancel and re-register %d times with %d pending:\n",
+         kNumChurnOps, kNumChurnTimeouts);
+  {
+    OldHeap old_heap;
+    PrintResult("old", 2 * kNumChurnOps,
+                RunChurn<OldHeap, uint>(
+                    &old_heap, kNumChurnTimeouts, kNumChurnOps));
+  }
+  {
+    TimeoutQueue queue;
+    PrintResult("queue", 2 * kNumChurnOps,
+                RunChurn<TimeoutQueue, TimeoutId>(
+                    &queue, kNumChurnTimeouts, kNumChurnOps));
+  }
+  return 0;
+}
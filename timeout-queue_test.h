@@ -0,0 +1,125 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "timeout-queue.h"
+#include "util.h"
+
+using namespace wham;
+
+class TimeoutQueueTestSuite : public CxxTest::TestSuite {
+ public:
+  // Records the order in which functions are run.
+  class RecordingTimeoutFunction : public TimeoutFunction {
+   public:
+    RecordingTimeoutFunction(int num, vector<int>* order)
+        : num_(num),
+          order_(order) {}
+
+    void operator()() { order_->push_back(num_); }
+
+   private:
+    int num_;
+    vector<int>* order_;
+  };
+
+  // Check that each heap entry's deadline is no earlier than its parent's
+  // and that every slot points at the right heap entry.
+  static bool QueueIsConsistent(const TimeoutQueue& queue) {
+    for (size_t i = 0; i < queue.heap_.size(); ++i) {
+      if (i > 0 &&
+          queue.heap_[i].time <
+          queue.heap_[(i - 1) / TimeoutQueue::kArity].time) {
+        return false;
+      }
+      if (queue.slots_[queue.heap_[i].slot].heap_index != i) return false;
+    }
+    return true;
+  }
+
+  void testOrdering() {
+    TimeoutQueue queue;
+    vector<int> order;
+    vector<RecordingTimeoutFunction*> funcs;
+    int times[] = { 5, 3, 9, 1, 7, 2, 8, 6, 4, 0 };
+    for (int i = 0; i < 10; ++i) {
+      funcs.push_back(new RecordingTimeoutFunction(times[i], &order));
+      queue.Add(funcs.back(), times[i]);
+    }
+    TS_ASSERT_EQUALS(queue.size(), 10U);
+    TS_ASSERT(QueueIsConsistent(queue));
+
+    while (!queue.empty()) (*(queue.Pop()))();
+    TS_ASSERT_EQUALS(order.size(), 10U);
+    for (int i = 0; i < static_cast<int>(order.size()); ++i)
+      TS_ASSERT_EQUALS(order[i], i);
+
+    for (size_t i = 0; i < funcs.size(); ++i) delete funcs[i];
+  }
+
+  void testCancel() {
+    TimeoutQueue queue;
+    vector<int> order;
+    RecordingTimeoutFunction first(1, &order);
+    RecordingTimeoutFunction second(2, &order);
+    RecordingTimeoutFunction third(3, &order);
+
+    queue.Add(&first, 1.0);
+    TimeoutId id = queue.Add(&second, 2.0);
+    queue.Add(&third, 3.0);
+    TS_ASSERT(id != 0);
+    TS_ASSERT(queue.Cancel(id));
+    TS_ASSERT(QueueIsConsistent(queue));
+
+    // Cancelling again should fail, as should cancelling a bogus ID.
+    TS_ASSERT(!queue.Cancel(id));
+    TS_ASSERT(!queue.Cancel(0));
+    TS_ASSERT(!queue.Cancel(12345));
+
+    // The slot should be reused, but the old ID shouldn't match the new
+    // timeout.
+    TimeoutId new_id = queue.Add(&second, 4.0);
+    TS_ASSERT_EQUALS(static_cast<uint32_t>(new_id),
+                     static_cast<uint32_t>(id));
+    TS_ASSERT(new_id != id);
+    TS_ASSERT(!queue.Cancel(id));
+
+    while (!queue.empty()) (*(queue.Pop()))();
+    TS_ASSERT_EQUALS(order.size(), 3U);
+    TS_ASSERT_EQUALS(order[0], 1);
+    TS_ASSERT_EQUALS(order[1], 3);
+    TS_ASSERT_EQUALS(order[2], 2);
+
+    // Timeouts that have already been popped can't be cancelled.
+    TS_ASSERT(!queue.Cancel(new_id));
+  }
+
+  void testRandomCancels() {
+    TimeoutQueue queue;
+    vector<int> order;
+    RecordingTimeoutFunction func(0, &order);
+
+    srand(1);
+    vector<TimeoutId> ids;
+    for (int i = 0; i < 1000; ++i)
+      ids.push_back(queue.Add(&func, rand() % 100));
+    random_shuffle(ids.begin(), ids.end());
+    for (int i = 0; i < 500; ++i) {
+      TS_ASSERT(queue.Cancel(ids[i]));
+    }
+    TS_ASSERT_EQUALS(queue.size(), 500U);
+    TS_ASSERT(QueueIsConsistent(queue));
+
+    double last_time = -1;
+    while (!queue.empty()) {
+      double time = queue.next_time();
+      TS_ASSERT(time >= last_time);
+      last_time = time;
+      queue.Pop();
+    }
+  }
+};
@@ -0,0 +1,494 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "titlebar-renderer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace wham {
+
+// A string that hopefully measures the full ascent and descent for a given
+// font.
+static const string kFullHeightString = "X[yj|";
+
+// ImageText8 requests can't hold longer strings than this.
+static const size_t kMaxTextLength = 255;
+
+
+bool TitlebarRender::operator==(const TitlebarRender& o) const {
+  return titlebar == o.titlebar &&
+         font == o.font &&
+         border == o.border &&
+         padding == o.padding &&
+         spacing == o.spacing &&
+         active_title_border == o.active_title_border &&
+         active_title_padding == o.active_title_padding &&
+         inactive_title_border == o.inactive_title_border &&
+         inactive_title_padding == o.inactive_title_padding &&
+         colors == o.colors &&
+         active_title_colors == o.active_title_colors &&
+         inactive_title_colors == o.inactive_title_colors &&
+         min_width == o.min_width &&
+         max_width == o.max_width &&
+         anchor_name == o.anchor_name &&
+         titles == o.titles;
+}
+
+
+void LayOutTitlebar(const TitlebarRender& render,
+                    TextMeasurer* measurer,
+                    TitlebarLayout* layout) {
+  CHECK(measurer);
+  CHECK(layout);
+  layout->boxes.clear();
+  layout->texts.clear();
+
+  const TitlebarRender& r = render;
+  int ascent = 0, descent = 0;
+  measurer->GetTextSize(r.font, kFullHeightString, NULL, &ascent, &descent);
+  uint height = ascent + descent + 2 * r.padding + 2 * r.border +
+      2 * max(r.active_title_border, r.inactive_title_border) +
+      2 * max(r.active_title_padding, r.inactive_title_padding);
+
+  // Include the outer border and padding in the total width.
+  uint width = 2 * (r.border + r.padding);
+  if (r.titles.empty()) {
+    int name_width = 0;
+    measurer->GetTextSize(r.font, r.anchor_name, &name_width, NULL, NULL);
+    width += name_width +
+        2 * (r.inactive_title_padding + r.inactive_title_border);
+  } else {
+    int max_title_width = 0;
+    for (vector<TitlebarRender::Title>::const_iterator title =
+           r.titles.begin(); title != r.titles.end(); ++title) {
+      int title_width = 0;
+      measurer->GetTextSize(r.font, title->title, &title_width, NULL, NULL);
+      max_title_width = max(max_title_width, title_width);
+    }
+    width += max_title_width +
+        2 * (r.active_title_padding + r.active_title_border) +
+        (r.titles.size() - 1) *
+        (max_title_width + r.inactive_title_border +
+         r.inactive_title_padding + r.spacing);
+  }
+  width = min(max(width, r.min_width), r.max_width);
+  layout->width = width;
+  layout->height = height;
+
+  layout->boxes.push_back(
+      TitlebarLayout::Box(0, 0, width, height, &r.colors, r.border));
+
+  uint edge = r.border + r.padding;
+  if (r.titles.empty()) {
+    layout->boxes.push_back(
+        TitlebarLayout::Box(edge, edge, width - 2 * edge, height - 2 * edge,
+                            &r.inactive_title_colors,
+                            r.inactive_title_border));
+    uint gap = r.inactive_title_border + r.inactive_title_padding;
+    layout->texts.push_back(
+        TitlebarLayout::Text(edge + gap, edge + gap + ascent, r.anchor_name,
+                             &r.inactive_title_colors));
+    return;
+  }
+
+  uint width_for_titles =
+      width - 2 * edge - (r.titles.size() - 1) * r.spacing;
+  float title_width = static_cast<float>(width_for_titles) / r.titles.size();
+  for (size_t i = 0; i < r.titles.size(); ++i) {
+    const TitlebarRender::Title& title = r.titles[i];
+    int x = edge + static_cast<int>(roundf(i * (title_width + r.spacing)));
+    int y = edge;
+    int this_width = edge +
+        static_cast<int>(roundf(i * (title_width + r.spacing) + title_width)) -
+        x;
+    int this_height = height - 2 * edge;
+    const DrawingColors* colors =
+        title.active ? &r.active_title_colors : &r.inactive_title_colors;
+    uint border =
+        title.active ? r.active_title_border : r.inactive_title_border;
+    layout->boxes.push_back(
+        TitlebarLayout::Box(x, y, this_width, this_height, colors, border));
+
+    uint gap = border +
+        (title.active ? r.active_title_padding : r.inactive_title_padding);
+    string text = title.tags.empty() ? "" : "[" + title.tags + "] ";
+    text += title.title;
+    layout->texts.push_back(
+        TitlebarLayout::Text(x + gap, y + gap + ascent, text, colors));
+  }
+}
+
+
+TitlebarRenderer::TitlebarRenderer()
+    : conn_(NULL),
+      screen_(NULL),
+      gc_(XCB_NONE),
+      event_fd_(-1),
+      thread_started_(false),
+      quit_(false) {
+  event_fd_ = eventfd(0, EFD_NONBLOCK);
+  CHECK(event_fd_ != -1);
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&cond_, NULL);
+}
+
+
+TitlebarRenderer::~TitlebarRenderer() {
+  Stop();
+  for (deque<TitlebarRender*>::iterator it = queue_.begin();
+       it != queue_.end(); ++it) {
+    delete *it;
+  }
+  fonts_.reset();
+  if (conn_) xcb_disconnect(conn_);
+  close(event_fd_);
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+
+bool TitlebarRenderer::Start(const char* display_name) {
+  CHECK(!thread_started_);
+  int screen_num = 0;
+  conn_ = xcb_connect(display_name, &screen_num);
+  if (xcb_connection_has_error(conn_)) {
+    ERROR << "Unable to open titlebar renderer's connection to "
+          << (display_name ? display_name : "default display");
+    xcb_disconnect(conn_);
+    conn_ = NULL;
+    return false;
+  }
+  xcb_screen_iterator_t screen_iter =
+      xcb_setup_roots_iterator(xcb_get_setup(conn_));
+  for (int i = 0; i < screen_num; ++i) xcb_screen_next(&screen_iter);
+  screen_ = screen_iter.data;
+
+  gc_ = xcb_generate_id(conn_);
+  uint32_t graphics_exposures = 0;
+  xcb_create_gc(conn_, gc_, screen_->root, XCB_GC_GRAPHICS_EXPOSURES,
+                &graphics_exposures);
+  fonts_.reset(new FontCache(conn_));
+
+  // The thread has no use for signals, so start it with all of them
+  // blocked; otherwise, one that the main thread reads from a signalfd
+  // could be delivered to it instead.
+  sigset_t all_mask, old_mask;
+  sigfillset(&all_mask);
+  pthread_sigmask(SIG_SETMASK, &all_mask, &old_mask);
+  int error = pthread_create(&thread_, NULL, RunThread, this);
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+  if (error) {
+    ERROR << "Unable to start titlebar renderer thread: " << strerror(error);
+    return false;
+  }
+  thread_started_ = true;
+  return true;
+}
+
+
+void TitlebarRenderer::Enqueue(TitlebarRender* render) {
+  CHECK(render);
+  pthread_mutex_lock(&mutex_);
+  bool replaced = false;
+  for (deque<TitlebarRender*>::iterator it = queue_.begin();
+       it != queue_.end(); ++it) {
+    if ((*it)->titlebar == render->titlebar) {
+      delete *it;
+      *it = render;
+      replaced = true;
+      break;
+    }
+  }
+  if (!replaced) queue_.push_back(render);
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+void TitlebarRenderer::Cancel(::Window titlebar) {
+  pthread_mutex_lock(&mutex_);
+  for (deque<TitlebarRender*>::iterator it = queue_.begin();
+       it != queue_.end(); ++it) {
+    if ((*it)->titlebar == titlebar) {
+      delete *it;
+      queue_.erase(it);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+
+void TitlebarRenderer::ClearWakeup() {
+  uint64_t count = 0;
+  if (read(event_fd_, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    ERROR << "Unable to read from eventfd: " << strerror(errno);
+}
+
+
+bool TitlebarRenderer::PopResult(Result* result) {
+  CHECK(result);
+  bool found = false;
+  pthread_mutex_lock(&mutex_);
+  if (!results_.empty()) {
+    *result = results_.front();
+    results_.pop_front();
+    found = true;
+  }
+  pthread_mutex_unlock(&mutex_);
+  return found;
+}
+
+
+void* TitlebarRenderer::RunThread(void* arg) {
+  static_cast<TitlebarRenderer*>(arg)->Run();
+  return NULL;
+}
+
+
+void TitlebarRenderer::Run() {
+  while (true) {
+    pthread_mutex_lock(&mutex_);
+    while (queue_.empty() && !quit_) pthread_cond_wait(&cond_, &mutex_);
+    if (quit_) {
+      pthread_mutex_unlock(&mutex_);
+      break;
+    }
+    TitlebarRender* render = queue_.front();
+    queue_.pop_front();
+    pthread_mutex_unlock(&mutex_);
+
+    Result result;
+    Render(*render, &result);
+    delete render;
+
+    pthread_mutex_lock(&mutex_);
+    results_.push_back(result);
+    pthread_mutex_unlock(&mutex_);
+    Wake();
+
+    // We don't select any events, so anything that shows up is an error
+    // (usually because the titlebar was destroyed before we drew it).
+    xcb_generic_event_t* event = NULL;
+    while ((event = xcb_poll_for_event(conn_))) {
+      if (event->response_type == 0) {
+        DEBUG << "Got X error "
+              << static_cast<int>(
+                     reinterpret_cast<xcb_generic_error_t*>(event)->error_code)
+              << " while drawing titlebar";
+      }
+      free(event);
+    }
+  }
+}
+
+
+void TitlebarRenderer::Render(const TitlebarRender& render, Result* result) {
+  CHECK(result);
+  TitlebarLayout layout;
+  LayOutTitlebar(render, fonts_.get(), &layout);
+  result->titlebar = render.titlebar;
+  result->width = layout.width;
+  result->height = layout.height;
+  if (!layout.width || !layout.height) return;
+
+  xcb_pixmap_t pixmap = xcb_generate_id(conn_);
+  xcb_create_pixmap(conn_, screen_->root_depth, pixmap, screen_->root,
+                    layout.width, layout.height);
+
+  for (vector<TitlebarLayout::Box>::const_iterator box =
+         layout.boxes.begin(); box != layout.boxes.end(); ++box) {
+    const DrawingColors& colors = *(box->colors);
+    uint border = box->border_width;
+    FillRectangle(pixmap, box->x, box->y, box->width, box->height,
+                  colors.bg);
+    if (!border) continue;
+    FillRectangle(pixmap, box->x, box->y, box->width, border, colors.top);
+    FillRectangle(pixmap, box->x, box->y + border,
+                  border, box->height - border, colors.left);
+    FillRectangle(pixmap, box->x + border, box->y + box->height - border,
+                  box->width - border, border, colors.bottom);
+    FillRectangle(pixmap, box->x + box->width - border, box->y + border,
+                  border, box->height - 2 * border, colors.right);
+  }
+
+  xcb_font_t font = fonts_->GetFontId(render.font);
+  if (font != XCB_NONE) {
+    for (vector<TitlebarLayout::Text>::const_iterator text =
+           layout.texts.begin(); text != layout.texts.end(); ++text) {
+      uint32_t values[] = {
+        GetPixel(text->colors->fg), GetPixel(text->colors->bg), font };
+      xcb_change_gc(conn_, gc_,
+                    XCB_GC_FOREGROUND | XCB_GC_BACKGROUND | XCB_GC_FONT,
+                    values);
+      xcb_image_text_8(conn_, min(text->text.size(), kMaxTextLength),
+                       pixmap, gc_, text->x, text->y, text->text.c_str());
+    }
+  }
+
+  // The server keeps the pixmap around for as long as it's the window's
+  // background, and repaints from it on exposures and resizes.
+  xcb_change_window_attributes(conn_, render.titlebar, XCB_CW_BACK_PIXMAP,
+                               &pixmap);
+  xcb_clear_area(conn_, 0, render.titlebar, 0, 0, 0, 0);
+  xcb_free_pixmap(conn_, pixmap);
+  xcb_flush(conn_);
+}
+
+
+void TitlebarRenderer::FillRectangle(xcb_drawable_t drawable,
+                                     int x, int y,
+                                     uint width, uint height,
+                                     const string& color) {
+  uint32_t pixel = GetPixel(color);
+  xcb_change_gc(conn_, gc_, XCB_GC_FOREGROUND, &pixel);
+  xcb_rectangle_t rect;
+  rect.x = x;
+  rect.y = y;
+  rect.width = width;
+  rect.height = height;
+  xcb_poly_fill_rectangle(conn_, drawable, gc_, 1, &rect);
+}
+
+
+uint32_t TitlebarRenderer::GetPixel(const string& color) {
+  map<string, uint32_t>::const_iterator it = pixels_.find(color);
+  if (it != pixels_.end()) return it->second;
+
+  // FIXME: Is it safe to leave this at 0 if we fail to load the color?
+  uint32_t pixel = 0;
+  xcb_alloc_named_color_reply_t* reply = xcb_alloc_named_color_reply(
+      conn_,
+      xcb_alloc_named_color(conn_, screen_->default_colormap,
+                            color.size(), color.c_str()),
+      NULL);
+  if (!reply) {
+    ERROR << "Unable to allocate color " << color;
+  } else {
+    pixel = reply->pixel;
+    free(reply);
+  }
+  pixels_.insert(make_pair(color, pixel));
+  return pixel;
+}
+
+
+void TitlebarRenderer::Wake() {
+  uint64_t count = 1;
+  if (write(event_fd_, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    ERROR << "Unable to write to eventfd: " << strerror(errno);
+}
+
+
+void TitlebarRenderer::Stop() {
+  if (!thread_started_) return;
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&mutex_);
+  pthread_join(thread_, NULL);
+  thread_started_ = false;
+}
+
+
+TitlebarRenderer::FontCache::~FontCache() {
+  for (map<string, Font>::iterator it = fonts_.begin();
+       it != fonts_.end(); ++it) {
+    free(it->second.info);
+  }
+}
+
+
+void TitlebarRenderer::FontCache::GetTextSize(const string& font,
+                                              const string& text,
+                                              int* width,
+                                              int* ascent,
+                                              int* descent) {
+  int total_width = 0, max_ascent = 0, max_descent = 0;
+  const Font& info = LoadFont(font);
+  if (info.info) {
+    for (size_t i = 0; i < text.size(); ++i) {
+      const xcb_charinfo_t* ch =
+          GetCharInfo(info, static_cast<unsigned char>(text[i]));
+      if (!ch) continue;
+      total_width += ch->character_width;
+      max_ascent = max(max_ascent, static_cast<int>(ch->ascent));
+      max_descent = max(max_descent, static_cast<int>(ch->descent));
+    }
+  }
+  if (width) *width = total_width;
+  if (ascent) *ascent = max_ascent;
+  if (descent) *descent = max_descent;
+}
+
+
+xcb_font_t TitlebarRenderer::FontCache::GetFontId(const string& font) {
+  return LoadFont(font).id;
+}
+
+
+const xcb_charinfo_t* TitlebarRenderer::FontCache::GetCharInfo(
+    const Font& font, unsigned char ch) {
+  const xcb_query_font_reply_t* info = font.info;
+  CHECK(info);
+
+  // Fonts whose characters all have the same metrics don't list them.
+  int num_chars = xcb_query_font_char_infos_length(info);
+  if (num_chars == 0) return &info->max_bounds;
+
+  // Only single-row fonts are handled; characters that the font doesn't
+  // have are drawn as its default character.
+  const xcb_charinfo_t* chars = xcb_query_font_char_infos(info);
+  uint indexes[] = { ch, info->default_char };
+  for (int i = 0; i < 2; ++i) {
+    uint index = indexes[i];
+    if (info->min_byte1 != 0 ||
+        index < info->min_char_or_byte2 ||
+        index > info->max_char_or_byte2) {
+      continue;
+    }
+    index -= info->min_char_or_byte2;
+    if (static_cast<int>(index) >= num_chars) continue;
+    const xcb_charinfo_t& ci = chars[index];
+    if (ci.character_width == 0 && ci.ascent == 0 && ci.descent == 0 &&
+        ci.left_side_bearing == 0 && ci.right_side_bearing == 0) {
+      continue;
+    }
+    return &ci;
+  }
+  return NULL;
+}
+
+
+const TitlebarRenderer::FontCache::Font&
+TitlebarRenderer::FontCache::LoadFont(const string& name) {
+  map<string, Font>::const_iterator it = fonts_.find(name);
+  if (it != fonts_.end()) return it->second;
+
+  Font font;
+  font.id = xcb_generate_id(conn_);
+  font.info = NULL;
+  xcb_generic_error_t* error = xcb_request_check(
+      conn_, xcb_open_font_checked(conn_, font.id, name.size(), name.c_str()));
+  if (error) {
+    ERROR << "Unable to load font " << name;
+    free(error);
+    font.id = XCB_NONE;
+  } else {
+    font.info =
+        xcb_query_font_reply(conn_, xcb_query_font(conn_, font.id), NULL);
+  }
+  return fonts_.insert(make_pair(name, font)).first->second;
+}
+
+}  // namespace wham
@@ -0,0 +1,301 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __TITLEBAR_RENDERER_H__
+#define __TITLEBAR_RENDERER_H__
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+extern "C" {
+#include <X11/Xlib.h>
+#include <xcb/xcb.h>
+}
+
+#include "util.h"
+
+using namespace std;
+
+class TitlebarRendererTestSuite;  // from titlebar-renderer_test.h
+
+namespace wham {
+
+// A background color, a foreground (text) color, and the colors of the
+// four borders around something that gets drawn.
+struct DrawingColors {
+  DrawingColors() {}
+  DrawingColors(const string& bg,
+                const string& fg,
+                const string& top,
+                const string& left,
+                const string& bottom,
+                const string& right)
+      : bg(bg),
+        fg(fg),
+        top(top),
+        left(left),
+        bottom(bottom),
+        right(right) {}
+
+  bool operator==(const DrawingColors& o) const {
+    return bg == o.bg && fg == o.fg && top == o.top && left == o.left &&
+           bottom == o.bottom && right == o.right;
+  }
+
+  string bg;
+  string fg;
+  string top;
+  string left;
+  string bottom;
+  string right;
+};
+
+
+// Everything needed to draw an anchor's titlebar.  It's a copy of the
+// anchor's state and of the relevant parts of the drawing engine's style,
+// so it can be drawn without looking at either of them.
+struct TitlebarRender {
+  TitlebarRender()
+      : titlebar(None),
+        border(0),
+        padding(0),
+        spacing(0),
+        active_title_border(0),
+        active_title_padding(0),
+        inactive_title_border(0),
+        inactive_title_padding(0),
+        min_width(0),
+        max_width(0) {
+  }
+
+  struct Title {
+    Title(const string& title, const string& tags, bool active)
+        : title(title),
+          tags(tags),
+          active(active) {}
+
+    bool operator==(const Title& o) const {
+      return title == o.title && tags == o.tags && active == o.active;
+    }
+
+    string title;
+    string tags;
+    bool active;
+  };
+
+  // Would this titlebar look the same as 'o'?
+  bool operator==(const TitlebarRender& o) const;
+
+  ::Window titlebar;
+
+  string font;
+  uint border;
+  uint padding;
+  uint spacing;
+  uint active_title_border;
+  uint active_title_padding;
+  uint inactive_title_border;
+  uint inactive_title_padding;
+  DrawingColors colors;
+  DrawingColors active_title_colors;
+  DrawingColors inactive_title_colors;
+  uint min_width;
+  uint max_width;
+
+  // Drawn instead of the titles if there aren't any windows.
+  string anchor_name;
+
+  vector<Title> titles;
+};
+
+
+// Interface for measuring text.
+class TextMeasurer {
+ public:
+  virtual ~TextMeasurer() {}
+
+  // Get the size of 'text' when written in 'font'.  The text's width,
+  // ascent, and descent are stored at the passed-in pointers if non-NULL.
+  virtual void GetTextSize(const string& font, const string& text,
+                           int* width, int* ascent, int* descent) = 0;
+};
+
+
+// The boxes and strings that make up a titlebar.
+struct TitlebarLayout {
+  TitlebarLayout() : width(0), height(0) {}
+
+  // A filled rectangle with borders.
+  struct Box {
+    Box(int x, int y, uint width, uint height,
+        const DrawingColors* colors, uint border_width)
+        : x(x), y(y), width(width), height(height),
+          colors(colors), border_width(border_width) {}
+    int x, y;
+    uint width, height;
+    const DrawingColors* colors;  // points into the TitlebarRender
+    uint border_width;
+  };
+
+  // A string, drawn with its baseline at 'y'.
+  struct Text {
+    Text(int x, int y, const string& text, const DrawingColors* colors)
+        : x(x), y(y), text(text), colors(colors) {}
+    int x, y;
+    string text;
+    const DrawingColors* colors;  // points into the TitlebarRender
+  };
+
+  uint width;
+  uint height;
+
+  // Boxes are drawn first, in order, and then the strings.
+  vector<Box> boxes;
+  vector<Text> texts;
+};
+
+// Lay out the titlebar described by 'render', measuring text with
+// 'measurer'.
+void LayOutTitlebar(const TitlebarRender& render,
+                    TextMeasurer* measurer,
+                    TitlebarLayout* layout);
+
+
+// Draws titlebars on a separate thread, so that the main thread just has
+// to describe each titlebar in a TitlebarRender and queue it.
+//
+// The thread has its own XCB connection.  It measures and draws each
+// titlebar into a pixmap, installs the pixmap as the titlebar window's
+// background, and reports the titlebar's new size back through a queue;
+// an eventfd becomes readable when sizes are waiting, and the main thread
+// is responsible for resizing the window.  If a titlebar is queued again
+// before the thread gets to it, the newer render replaces the older one.
+class TitlebarRenderer {
+ public:
+  // A titlebar that's been drawn.
+  struct Result {
+    ::Window titlebar;
+    uint width;
+    uint height;
+  };
+
+  TitlebarRenderer();
+
+  // Stops and joins the thread.
+  ~TitlebarRenderer();
+
+  // Connect to 'display_name' and start the thread.  Returns false on
+  // failure.
+  bool Start(const char* display_name);
+
+  // File descriptor that becomes readable when results are available.
+  int fd() const { return event_fd_; }
+
+  // Draw 'render', taking ownership of it.
+  void Enqueue(TitlebarRender* render);
+
+  // Drop any queued render for 'titlebar' (e.g. because it's about to be
+  // destroyed).
+  void Cancel(::Window titlebar);
+
+  // Make fd() unreadable until more results are available.  Should be
+  // called by the main thread before it pops results.
+  void ClearWakeup();
+
+  // Copy the oldest result into 'result'.  Returns false if there aren't
+  // any.
+  bool PopResult(Result* result);
+
+ private:
+  friend class ::TitlebarRendererTestSuite;
+
+  // Measures text using fonts loaded on our connection.
+  class FontCache : public TextMeasurer {
+   public:
+    explicit FontCache(xcb_connection_t* conn) : conn_(conn) {}
+    ~FontCache();
+
+    void GetTextSize(const string& font, const string& text,
+                     int* width, int* ascent, int* descent);
+
+    // Get the ID of 'font', or XCB_NONE if it couldn't be loaded.
+    xcb_font_t GetFontId(const string& font);
+
+   private:
+    struct Font {
+      xcb_font_t id;
+      xcb_query_font_reply_t* info;  // owned; NULL if loading failed
+    };
+
+    // Get the metrics for 'ch' in 'font'.
+    static const xcb_charinfo_t* GetCharInfo(const Font& font,
+                                             unsigned char ch);
+
+    const Font& LoadFont(const string& name);
+
+    xcb_connection_t* conn_;  // not owned
+    map<string, Font> fonts_;
+
+    DISALLOW_EVIL_CONSTRUCTORS(FontCache);
+  };
+
+  static void* RunThread(void* arg);
+
+  // Draw titlebars until Stop() is called.
+  void Run();
+
+  // Draw 'render' and return its size in 'result'.  Runs on the thread.
+  void Render(const TitlebarRender& render, Result* result);
+
+  // Fill a rectangle in 'drawable'.  Runs on the thread.
+  void FillRectangle(xcb_drawable_t drawable, int x, int y,
+                     uint width, uint height, const string& color);
+
+  // Get the pixel value for a named color.  Runs on the thread.
+  uint32_t GetPixel(const string& color);
+
+  // Make fd() readable.
+  void Wake();
+
+  // Tell the thread to exit and wait for it.
+  void Stop();
+
+  xcb_connection_t* conn_;
+  const xcb_screen_t* screen_;  // not owned
+
+  // GC used for drawing.  Only used by the thread.
+  xcb_gcontext_t gc_;
+
+  // Only used by the thread.
+  ref_ptr<FontCache> fonts_;
+  map<string, uint32_t> pixels_;
+
+  int event_fd_;
+
+  pthread_t thread_;
+  bool thread_started_;
+
+  // Protects 'queue_', 'results_', and 'quit_'.
+  pthread_mutex_t mutex_;
+
+  // Signalled when a render is queued or 'quit_' is set.
+  pthread_cond_t cond_;
+
+  // Titlebars waiting to be drawn, oldest first.  There's at most one
+  // render per titlebar.
+  deque<TitlebarRender*> queue_;
+
+  deque<Result> results_;
+
+  bool quit_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(TitlebarRenderer);
+};
+
+}  // namespace wham
+
+#endif
@@ -0,0 +1,124 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "titlebar-renderer.h"
+
+using namespace wham;
+
+// Measures every character as 6 pixels wide, 10 pixels above the
+// baseline, and 3 below it.
+class FakeTextMeasurer : public TextMeasurer {
+ public:
+  void GetTextSize(const string& font, const string& text,
+                   int* width, int* ascent, int* descent) {
+    if (width) *width = 6 * text.size();
+    if (ascent) *ascent = 10;
+    if (descent) *descent = 3;
+  }
+};
+
+
+class TitlebarRendererTestSuite : public CxxTest::TestSuite {
+ public:
+  void testLayOutTitles() {
+    TitlebarRender render;
+    InitRender(&render);
+    render.titles.push_back(TitlebarRender::Title("abc", "a", true));
+    render.titles.push_back(TitlebarRender::Title("defgh", "", false));
+
+    FakeTextMeasurer measurer;
+    TitlebarLayout layout;
+    LayOutTitlebar(render, &measurer, &layout);
+
+    // The titles are each given the width of the longest one, plus their
+    // borders and padding and the spacing between them.
+    TS_ASSERT_EQUALS(layout.width, 77U);
+    TS_ASSERT_EQUALS(layout.height, 25U);
+
+    TS_ASSERT_EQUALS(layout.boxes.size(), 3U);
+    AssertBox(layout.boxes[0], 0, 0, 77, 25, &render.colors);
+    AssertBox(layout.boxes[1], 3, 3, 35, 19, &render.active_title_colors);
+    AssertBox(layout.boxes[2], 40, 3, 34, 19, &render.inactive_title_colors);
+
+    // Tags are only drawn, not measured.
+    TS_ASSERT_EQUALS(layout.texts.size(), 2U);
+    TS_ASSERT_EQUALS(layout.texts[0].text, "[a] abc");
+    TS_ASSERT_EQUALS(layout.texts[0].x, 6);
+    TS_ASSERT_EQUALS(layout.texts[0].y, 16);
+    TS_ASSERT_EQUALS(layout.texts[1].text, "defgh");
+    TS_ASSERT_EQUALS(layout.texts[1].x, 43);
+    TS_ASSERT(layout.texts[1].colors == &render.inactive_title_colors);
+
+    // The width should be capped.
+    render.max_width = 50;
+    LayOutTitlebar(render, &measurer, &layout);
+    TS_ASSERT_EQUALS(layout.width, 50U);
+    TS_ASSERT_EQUALS(layout.boxes.size(), 3U);
+  }
+
+  void testLayOutEmptyAnchor() {
+    TitlebarRender render;
+    InitRender(&render);
+    render.anchor_name = "[test]";
+
+    FakeTextMeasurer measurer;
+    TitlebarLayout layout;
+    LayOutTitlebar(render, &measurer, &layout);
+    TS_ASSERT_EQUALS(layout.width, 6U + 36U + 6U);
+    TS_ASSERT_EQUALS(layout.boxes.size(), 2U);
+    AssertBox(layout.boxes[1], 3, 3, 42, 19, &render.inactive_title_colors);
+    TS_ASSERT_EQUALS(layout.texts.size(), 1U);
+    TS_ASSERT_EQUALS(layout.texts[0].text, "[test]");
+  }
+
+  void testSupersede() {
+    // The thread isn't started, so renders just sit in the queue.
+    TitlebarRenderer renderer;
+    renderer.Enqueue(CreateRender(0x1));
+    renderer.Enqueue(CreateRender(0x2));
+    TitlebarRender* newer = CreateRender(0x1);
+    renderer.Enqueue(newer);
+
+    // The newer render for the first titlebar should replace the older
+    // one without losing its place in line.
+    TS_ASSERT_EQUALS(renderer.queue_.size(), 2U);
+    TS_ASSERT(renderer.queue_[0] == newer);
+    TS_ASSERT_EQUALS(renderer.queue_[1]->titlebar, 0x2U);
+
+    renderer.Cancel(0x2);
+    TS_ASSERT_EQUALS(renderer.queue_.size(), 1U);
+    renderer.Cancel(0x3);
+    TS_ASSERT_EQUALS(renderer.queue_.size(), 1U);
+  }
+
+ private:
+  static void InitRender(TitlebarRender* render) {
+    render->border = 1;
+    render->padding = 2;
+    render->spacing = 2;
+    render->active_title_border = 1;
+    render->active_title_padding = 2;
+    render->inactive_title_border = 1;
+    render->inactive_title_padding = 2;
+    render->min_width = 10;
+    render->max_width = 1000;
+  }
+
+  static TitlebarRender* CreateRender(::Window titlebar) {
+    TitlebarRender* render = new TitlebarRender;
+    render->titlebar = titlebar;
+    return render;
+  }
+
+  static void AssertBox(const TitlebarLayout::Box& box,
+                        int x, int y, uint width, uint height,
+                        const DrawingColors* colors) {
+    TS_ASSERT_EQUALS(box.x, x);
+    TS_ASSERT_EQUALS(box.y, y);
+    TS_ASSERT_EQUALS(box.width, width);
+    TS_ASSERT_EQUALS(box.height, height);
+    TS_ASSERT(box.colors == colors);
+  }
+};
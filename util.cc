@@ -62,6 +62,13 @@ double GetCurrentTime() {
 }
 
 
+double GetMonotonicTime() {
+  struct timespec ts;
+  CHECK_EQ(clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+  return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+
 void FillTimeval(double time, struct timeval* tv) {
   CHECK(tv);
   tv->tv_sec = static_cast<__time_t>(time);
@@ -8,6 +8,7 @@
 #include <iostream>
 #include <map>
 #include <pcrecpp.h>
+#include <stdint.h>
 #include <string>
 #include <sys/time.h>
 #include <vector>
@@ -205,6 +206,18 @@ V FindWithDefault(const map<K, V>& the_map, const K& key, const V& def) {
 double GetCurrentTime();
 
 
+// Get the number of seconds on the monotonic clock.  This is unaffected by
+// changes to the system time, so it should be used for timeouts.
+double GetMonotonicTime();
+
+
+// Is X request sequence number 'a' older than 'b', taking wraparound into
+// account?
+inline bool SequenceIsOlder(uint32_t a, uint32_t b) {
+  return static_cast<int32_t>(a - b) < 0;
+}
+
+
 // Fill 'tv' with the time from 'time'.
 void FillTimeval(double time, struct timeval* tv);
 
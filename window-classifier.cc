@@ -105,7 +105,9 @@ bool WindowCriteria::Matches(const WindowProperties& props) const {
   for (RegexpCriteria::const_iterator it = regexp_criteria_.begin();
        it != regexp_criteria_.end(); ++it) {
     CriterionType type = it->first;
-    ref_ptr<pcrecpp::RE> re = it->second;
+    // Don't copy the ref_ptr; its count isn't safe to update from
+    // multiple threads.
+    const pcrecpp::RE* re = it->second.get();
     if (!re->PartialMatch(GetPropertyForCriterionType(props, type))) {
       return false;
     }
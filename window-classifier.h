@@ -4,6 +4,7 @@
 #ifndef __WINDOW_CLASSIFIER_H__
 #define __WINDOW_CLASSIFIER_H__
 
+#include <algorithm>
 #include <pcrecpp.h>
 #include <string>
 #include <vector>
@@ -107,6 +108,13 @@ class WindowConfigSet {
   // Returns true if successful and false otherwise.
   bool SetActiveConfigByName(const string& name);
 
+  // Exchange this set's configs with those in 'other'.
+  void Swap(WindowConfigSet* other) {
+    CHECK(other);
+    configs_.swap(other->configs_);
+    swap(active_, other->active_);
+  }
+
  private:
   friend class ::WindowClassifierTestSuite;
 
@@ -186,6 +194,13 @@ class WindowClassifier {
     return singleton_.get();
   }
 
+  // Get a reference to the current classifier.  This keeps it alive
+  // even if a new one is installed while it's in use.
+  static ref_ptr<WindowClassifier> GetRef() {
+    CHECK(singleton_.get());
+    return singleton_;
+  }
+
   // Install a new classifier.
   static void Swap(ref_ptr<WindowClassifier> new_classifier) {
     singleton_.swap(new_classifier);
@@ -197,7 +212,9 @@ class WindowClassifier {
   void AddConfig(ref_ptr<WindowCriteriaVector> criteria,
                  ref_ptr<WindowConfigVector> configs);
 
-  // Classify a WindowProperties object into list of configs.
+  // Classify a WindowProperties object into list of configs.  This only
+  // reads the classifier, so it can be called from multiple threads at
+  // once.
   bool ClassifyWindow(const WindowProperties& props,
                       WindowConfigSet* configs) const;
 
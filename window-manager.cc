@@ -3,6 +3,7 @@
 
 #include <cerrno>
 #include <cstdlib>
+#include <csignal>
 #include <cstring>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -63,8 +64,7 @@ bool WindowManager::LoadConfig(const string& filename) {
 void WindowManager::HandleButtonPress(
     XWindow* xwin, int x, int y, uint button) {
   if (button == Config::Get()->mouse_primary_button) {
-    CHECK(active_desktop_);
-    Anchor* anchor = active_desktop_->GetAnchorByTitlebar(xwin);
+    Anchor* anchor = GetVisibleAnchorByTitlebar(xwin);
     if (anchor == NULL) return;  // FIXME: handle button presses on borders
 
     // Make this the active anchor.
@@ -136,7 +136,7 @@ void WindowManager::HandleButtonRelease(
     if (dragging_) {
       dragging_ = false;
     } else {
-      Anchor* anchor = active_desktop_->GetAnchorByTitlebar(xwin);
+      Anchor* anchor = GetVisibleAnchorByTitlebar(xwin);
       // Maybe this is a window border and not a titlebar.
       if (anchor) {
         int index = anchor->GetWindowIndexAtTitlebarPoint(x);
@@ -151,16 +151,11 @@ void WindowManager::HandleEnterWindow(XWindow* xwin) {
   // We don't want to update the focus if the user is already dragging.
   if (mouse_down_) return;
 
-  CHECK(active_desktop_);
   Anchor* anchor = NULL;
-  if (IsAnchorWindow(xwin)) {
-    // anchor titlebar
-    anchor = active_desktop_->GetAnchorByTitlebar(xwin);
-  } else {
-    // client window
-    Window* window =
-        FindWithDefault(windows_, xwin, ref_ptr<Window>()).get();
-    if (window) anchor = window->anchor();
+  if (xwin->role() == XWindow::ROLE_TITLEBAR) {
+    anchor = GetVisibleAnchorByTitlebar(xwin);
+  } else if (xwin->role() == XWindow::ROLE_CLIENT) {
+    anchor = xwin->client_window()->anchor();
     // FIXME: handle window borders
   }
   // In either case, we want to make this anchor active (which will also
@@ -170,19 +165,11 @@ void WindowManager::HandleEnterWindow(XWindow* xwin) {
 
 
 void WindowManager::HandleExposeWindow(XWindow* xwin) {
-  CHECK(active_desktop_);
-  Anchor* anchor = active_desktop_->GetAnchorByTitlebar(xwin);
-  if (anchor) {
-    anchor->DrawTitlebar();
-    return;
-  }
-
-  Window* window = FindWithDefault(frames_,
-                                   static_cast<const XWindow*>(xwin),
-                                   static_cast<Window*>(NULL));
-  if (window) {
-    window->DrawFrame();
-    return;
+  if (xwin->role() == XWindow::ROLE_TITLEBAR) {
+    Anchor* anchor = GetVisibleAnchorByTitlebar(xwin);
+    if (anchor) anchor->DrawTitlebar();
+  } else if (xwin->role() == XWindow::ROLE_FRAME) {
+    xwin->frame_window()->DrawFrame();
   }
 }
 
@@ -194,13 +181,12 @@ void WindowManager::HandleMapRequest(XWindow* xwin) {
     return;
   }
 
-  if (windows_.find(xwin) != windows_.end()) return;
+  if (xwin->role() != XWindow::ROLE_NONE) return;
 
   xwin->SetBorder(0);
   xwin->SelectClientEvents();
   ref_ptr<Window> window(new Window(xwin));
   windows_.insert(make_pair(xwin, window));
-  frames_.insert(make_pair(window->frame(), window.get()));
   Window* transient_for = GetTransientFor(window.get());
   if (transient_for == NULL) {
     CHECK(active_desktop_);
@@ -231,26 +217,19 @@ void WindowManager::HandleMotion(XWindow* xwin, int x, int y) {
 
 void WindowManager::HandlePropertyChange(
     XWindow* xwin, WindowProperties::ChangeType type) {
-  if (IsAnchorWindow(xwin)) return;
-
-  Window* window = FindWithDefault(windows_, xwin, ref_ptr<Window>()).get();
-  CHECK(window);
+  Window* window = xwin->client_window();
+  if (!window) return;
 
   if (type == WindowProperties::TRANSIENT_CHANGE) {
     // FIXME: handle this?
   } else {
-    bool changed = false;
-    window->HandlePropertyChange(type, &changed);
-    if (changed) {
-      window->anchor()->DrawTitlebar();
-    }
+    window->HandlePropertyChange(type);
   }
 }
 
 
 void WindowManager::HandleUnmapWindow(XWindow* xwin) {
-  // FIXME: create a little method that does this
-  Window* window = FindWithDefault(windows_, xwin, ref_ptr<Window>()).get();
+  Window* window = xwin->client_window();
   if (!window) return;
 
   DEBUG << "Stopping management of 0x" << hex << xwin->id();
@@ -259,15 +238,10 @@ void WindowManager::HandleUnmapWindow(XWindow* xwin) {
     RemoveWindowFromDesktop(window, *desktop);
   }
   window_desktops_.erase(window);
-  frames_.erase(window->frame());
   windows_.erase(xwin);
 }
 
 
-void WindowManager::HandleWindowDamage(XWindow* xwin) {
-}
-
-
 void WindowManager::HandleCommand(const Command &cmd) {
   CHECK(active_desktop_);
 
@@ -291,6 +265,8 @@ void WindowManager::HandleCommand(const Command &cmd) {
   } else if (cmd.type() == Command::CYCLE_WINDOW_CONFIG) {
     Anchor* anchor = active_desktop_->active_anchor();
     if (anchor) anchor->CycleActiveWindowConfig(cmd.GetBoolArg());
+  } else if (cmd.type() == Command::DISPLAY_STATS) {
+    LOG << XServer::Get()->event_stats().DebugString();
   } else if (cmd.type() == Command::DISPLAY_WINDOW_PROPS) {
     Window* window = GetActiveWindow();
     if (window) LOG << window->props().DebugString();
@@ -423,19 +399,29 @@ void WindowManager::SetActiveAnchor(Anchor* anchor) {
 
 
 bool WindowManager::IsAnchorWindow(XWindow* xwin) const {
-  for (DesktopVector::const_iterator desktop = desktops_.begin();
-       desktop != desktops_.end(); ++desktop) {
-    if ((*desktop)->IsTitlebarWindow(xwin)) return true;
-  }
-  return false;
+  return xwin->role() == XWindow::ROLE_TITLEBAR;
+}
+
+
+Anchor* WindowManager::GetVisibleAnchorByTitlebar(XWindow* xwin) const {
+  CHECK(active_desktop_);
+  Anchor* anchor = xwin->titlebar_anchor();
+  return (anchor && anchor->desktop() == active_desktop_) ? anchor : NULL;
 }
 
 
 bool WindowManager::Exec(const string& command) const {
   DEBUG << "Executing " << command;
+  // Don't actually run anything when we're replaying a trace or testing.
+  if (XServer::Testing()) return true;
   const char* shell = "/bin/sh";
   if (fork() == 0) {
     if (fork() == 0) {
+      // Our signal mask (see XServer::Init()) would otherwise be
+      // inherited by the command.
+      sigset_t empty_mask;
+      sigemptyset(&empty_mask);
+      sigprocmask(SIG_SETMASK, &empty_mask, NULL);
       execl(shell, shell, "-c", command.c_str(), static_cast<char*>(NULL));
       ERROR << "execve() failed: " << strerror(errno);
     }
@@ -449,7 +435,7 @@ bool WindowManager::Exec(const string& command) const {
 Window* WindowManager::GetTransientFor(Window* transient) const {
   CHECK(transient);
   XWindow* xwin = transient->transient_for();
-  return FindWithDefault(windows_, xwin, ref_ptr<Window>()).get();
+  return xwin ? xwin->client_window() : NULL;
 }
 
 
@@ -479,11 +465,7 @@ Window* WindowManager::GetActiveWindow() const {
 
 
 Window* WindowManager::GetWindowByFrame(XWindow* xwin) const {
-  for (WindowMap::const_iterator win = windows_.begin();
-       win != windows_.end(); ++win) {
-    if (win->second->frame() == xwin) return win->second.get();
-  }
-  return NULL;
+  return xwin->frame_window();
 }
 
 
@@ -39,7 +39,6 @@ class WindowManager {
   void HandlePropertyChange(XWindow* xwin,
                             WindowProperties::ChangeType type);
   void HandleUnmapWindow(XWindow* xwin);
-  void HandleWindowDamage(XWindow* xwin);
   void HandleCommand(const Command& cmd);
 
  private:
@@ -68,6 +67,10 @@ class WindowManager {
   // Check if the passed-in X window is an anchor titlebar or not.
   bool IsAnchorWindow(XWindow* xwin) const;
 
+  // Get the anchor whose titlebar is 'xwin', or NULL if 'xwin' isn't a
+  // titlebar or the anchor isn't on the active desktop.
+  Anchor* GetVisibleAnchorByTitlebar(XWindow* xwin) const;
+
   // Execute the passed-in command.
   bool Exec(const string& command) const;
 
@@ -100,14 +103,12 @@ class WindowManager {
   // Should a window currently be mapped onscreen?
   bool WindowShouldBeMapped(Window* window) const;
 
-  // Map from client windows to Window objects.
+  // Map from client windows to Window objects.  This just holds
+  // ownership; use XWindow::client_window() and friends to get from an X
+  // window to the object that's using it.
   typedef map<XWindow*, ref_ptr<Window> > WindowMap;
   WindowMap windows_;
 
-  // Map from each window frame to the window owning it.
-  typedef map<const XWindow*, Window*> FrameMap;
-  FrameMap frames_;
-
   // Map from a window to all desktops where it's present.
   map<Window*, set<Desktop*> > window_desktops_;
 
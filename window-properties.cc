@@ -16,6 +16,8 @@ string WindowProperties::ChangeTypeToStr(WindowProperties::ChangeType type) {
   if (type == CLASS_CHANGE) return "class";
   if (type == WM_HINTS_CHANGE) return "wm hints";
   if (type == TRANSIENT_CHANGE) return "transient";
+  if (type == INPUT_HINT_CHANGE) return "input hint";
+  if (type == PROTOCOLS_CHANGE) return "protocols";
   else return StringPrintf("other (%d)", type);
 }
 
@@ -42,20 +44,16 @@ string WindowProperties::DebugString() const {
       << "base_width=" << base_width << "\n"
       << "base_height=" << base_height << "\n"
       << "transient_for=0x" << hex
-      << (transient_for ? transient_for->id() : 0) << "\n";
+      << (transient_for ? transient_for->id() : 0) << "\n" << dec
+      << "accepts_input=" << accepts_input << "\n"
+      << "supports_take_focus=" << supports_take_focus << "\n";
   return out.str();
 }
 
 
 bool WindowProperties::UpdateAll(XWindow* win) {
   CHECK(win);
-  // FIXME: send these all at once
-  win->UpdateProperties(this, WINDOW_NAME_CHANGE);
-  win->UpdateProperties(this, ICON_NAME_CHANGE);
-  win->UpdateProperties(this, COMMAND_CHANGE);
-  win->UpdateProperties(this, CLASS_CHANGE);
-  win->UpdateProperties(this, WM_HINTS_CHANGE);
-  win->UpdateProperties(this, TRANSIENT_CHANGE);
+  win->UpdateAllProperties(this);
   // FIXME: do something with errors?
   return true;
 }
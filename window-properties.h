@@ -26,6 +26,8 @@ struct WindowProperties {
     CLASS_CHANGE,
     WM_HINTS_CHANGE,
     TRANSIENT_CHANGE,
+    INPUT_HINT_CHANGE,
+    PROTOCOLS_CHANGE,
     OTHER_CHANGE,
   };
 
@@ -51,7 +53,9 @@ struct WindowProperties {
         max_aspect(0),
         base_width(0),
         base_height(0),
-        transient_for(NULL) {}
+        transient_for(NULL),
+        accepts_input(true),
+        supports_take_focus(false) {}
 
   string DebugString() const;
 
@@ -76,7 +80,9 @@ struct WindowProperties {
            max_aspect == o.max_aspect &&
            base_width == o.base_width &&
            base_height == o.base_height &&
-           transient_for == o.transient_for;
+           transient_for == o.transient_for &&
+           accepts_input == o.accepts_input &&
+           supports_take_focus == o.supports_take_focus;
   }
 
   bool operator!=(const WindowProperties& o) {
@@ -110,6 +116,13 @@ struct WindowProperties {
   // TODO: add win_gravity?
 
   XWindow* transient_for;
+
+  // Does the window want us to give it the focus?  This is the input
+  // field from WM_HINTS, which we assume to be true if it isn't set.
+  bool accepts_input;
+
+  // Does the window want WM_TAKE_FOCUS messages (from WM_PROTOCOLS)?
+  bool supports_take_focus;
 };
 
 }  // namespace wham
@@ -8,6 +8,7 @@
 #include "anchor.h"
 #include "config.h"
 #include "drawing-engine.h"
+#include "property-worker.h"
 #include "x-server.h"
 #include "x-window.h"
 
@@ -19,24 +20,39 @@ Window::Window(XWindow* xwin)
       anchor_(NULL),
       props_(),
       configs_(),
-      tagged_(false) {
+      tagged_(false),
+      awaiting_classification_(false),
+      map_when_classified_(false),
+      focus_when_classified_(false) {
   CHECK(xwin_);
+  xwin_->SetClientRole(this);
   props_.UpdateAll(xwin_);
 
   uint border = Config::Get()->window_border;
   frame_ = XWindow::Create(
       xwin->x() - border, xwin->y() - border,
       xwin->width() + 2 * border, xwin->height() + 2 * border);
+  frame_->SetFrameRole(this);
 
   // Map the client window but not the frame.
   xwin->Reparent(frame_, border, border);
   xwin->Map();
 
-  Classify();
+  // Evaluating the criteria's regexps can be slow, so let the worker do it
+  // if we have one.
+  PropertyWorker* worker = XServer::Get()->property_worker();
+  if (worker) {
+    awaiting_classification_ = true;
+    worker->RequestClassification(this);
+  } else {
+    Classify();
+  }
 }
 
 
 Window::~Window() {
+  xwin_->ClearRole();
+  frame_->ClearRole();
   frame_->Destroy();
   xwin_ = NULL;
   frame_ = NULL;
@@ -44,6 +60,7 @@ Window::~Window() {
 
 
 void Window::CycleConfig(bool forward) {
+  if (!configs_.GetActiveConfig()) return;
   configs_.CycleActiveConfig(forward);
   ApplyActiveConfig();
 }
@@ -64,19 +81,29 @@ void Window::Resize(uint width, uint height) {
 
 
 void Window::Map() {
+  if (awaiting_classification_) {
+    map_when_classified_ = true;
+    return;
+  }
   DrawFrame();
   frame_->Map();
 }
 
 
 void Window::Unmap() {
+  map_when_classified_ = false;
+  focus_when_classified_ = false;
   frame_->Unmap();
 }
 
 
 void Window::TakeFocus() {
+  if (awaiting_classification_) {
+    focus_when_classified_ = true;
+    return;
+  }
   DEBUG << "TakeFocus: 0x" << hex << xwin_->id();
-  xwin_->TakeFocus();
+  XServer::Get()->focus_manager()->RequestFocus(xwin_);
 }
 
 
@@ -90,14 +117,45 @@ void Window::MakeSibling(const XWindow& leader) {
 }
 
 
-void Window::HandlePropertyChange(
-    WindowProperties::ChangeType type, bool* changed) {
-  CHECK(changed);
-  UpdateProperties(type, changed);
-  if (*changed) {
-    DEBUG << "Properties changed for 0x" << hex << xwin_->id()
-          << "; reclassifying";
-    Classify();
+void Window::HandlePropertyChange(WindowProperties::ChangeType type) {
+  xwin_->RequestPropertyUpdate(type);
+}
+
+
+void Window::HandleUpdatedProperties(const WindowProperties& props,
+                                     bool success) {
+  if (!success || props_ == props) return;
+  props_ = props;
+  DEBUG << "Properties changed for 0x" << hex << xwin_->id()
+        << "; reclassifying";
+  Classify();
+  if (anchor_) anchor_->DrawTitlebar();
+}
+
+
+void Window::HandleClassifiedProperties(const WindowProperties& props,
+                                        bool success,
+                                        WindowConfigSet* configs) {
+  CHECK(configs);
+  if (!success || (props_ == props && !awaiting_classification_)) return;
+  props_ = props;
+  DEBUG << "Applying new classification to 0x" << hex << xwin_->id();
+
+  const WindowConfig* prev_config = configs_.GetActiveConfig();
+  if (prev_config) configs->SetActiveConfigByName(prev_config->name);
+  configs_.Swap(configs);
+  if (configs_.GetActiveConfig())
+    ApplyActiveConfig();
+  else
+    ERROR << "Unable to classify window 0x" << hex << xwin_->id();
+  if (anchor_) anchor_->DrawTitlebar();
+
+  if (awaiting_classification_) {
+    awaiting_classification_ = false;
+    if (map_when_classified_) Map();
+    if (focus_when_classified_) TakeFocus();
+    map_when_classified_ = false;
+    focus_when_classified_ = false;
   }
 }
 
@@ -200,15 +258,4 @@ void Window::ApplyConfig(const WindowConfig& config) {
   Resize(width, height);
 }
 
-
-bool Window::UpdateProperties(WindowProperties::ChangeType type,
-                              bool* changed) {
-  CHECK(changed);
-  WindowProperties new_props(props_);
-  if (!xwin_->UpdateProperties(&new_props, type)) return false;
-  *changed = (new_props != props_);
-  props_ = new_props;
-  return true;
-}
-
 }  // namespace wham
@@ -33,15 +33,33 @@ class Window {
   // larger, depending on the configured border width.
   void Resize(uint width, uint height);
 
+  // If the window is still waiting to be classified (see
+  // 'awaiting_classification_'), Map() and TakeFocus() are deferred until
+  // it has been.
   void Map();
   void Unmap();
   void TakeFocus();
   void Raise();
   void MakeSibling(const XWindow& leader);
 
-  // Handle a property change event on this window, reclassifying the
-  // window if necessary.
-  void HandlePropertyChange(WindowProperties::ChangeType type, bool* changed);
+  // Handle a property change event on this window.  The property is
+  // fetched asynchronously and passed to HandleUpdatedProperties().
+  void HandlePropertyChange(WindowProperties::ChangeType type);
+
+  // Handle updated properties for this window, reclassifying the window
+  // and redrawing its anchor's titlebar if they changed.  Nothing is done
+  // if 'success' is false.
+  void HandleUpdatedProperties(const WindowProperties& props, bool success);
+
+  // Like HandleUpdatedProperties(), but for properties that have already
+  // been classified into 'configs' (by PropertyWorker).  The configs are
+  // swapped into the window, keeping the current active config if the new
+  // set has it.  If the window was waiting for its first classification,
+  // the configs are applied even if the properties are unchanged, and any
+  // deferred Map() or TakeFocus() calls are performed.
+  void HandleClassifiedProperties(const WindowProperties& props,
+                                  bool success,
+                                  WindowConfigSet* configs);
 
   // Instruct the drawing engine to draw the window frame.
   void DrawFrame();
@@ -76,7 +94,7 @@ class Window {
       // TODO: We want to resize vertically-maximized windows to take the
       // anchor's titlebar into account, but is this the best place to do
       // it?
-      Classify();
+      if (configs_.GetActiveConfig()) ApplyActiveConfig();
     }
   }
 
@@ -98,9 +116,6 @@ class Window {
   // Apply a config.
   void ApplyConfig(const WindowConfig& config);
 
-  // Update 'props_' with this window's properties.
-  bool UpdateProperties(WindowProperties::ChangeType type, bool* changed);
-
   // A pointer to information about the X window; used for interacting with
   // the X server.
   XWindow* xwin_;   // not owned
@@ -117,6 +132,16 @@ class Window {
 
   bool tagged_;
 
+  // Has the window been sent to PropertyWorker to be classified without
+  // getting a result yet?  It isn't mapped until then, so it never shows
+  // up at the wrong size.
+  bool awaiting_classification_;
+
+  // Were Map() or TakeFocus() called while 'awaiting_classification_' was
+  // set?
+  bool map_when_classified_;
+  bool focus_when_classified_;
+
   DISALLOW_EVIL_CONSTRUCTORS(Window);
 };
 
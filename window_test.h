@@ -95,6 +95,81 @@ class WindowTestSuite : public CxxTest::TestSuite {
     TS_ASSERT(!frame->mapped());
   }
 
+  void testMapWhenClassified() {
+    XWindow* xwin = XWindow::Create(50, 60, 640, 480);
+    wham::Window win(xwin);
+    MockXWindow* frame = dynamic_cast<MockXWindow*>(win.frame());
+    CHECK(frame);
+
+    // Pretend that the window was sent to PropertyWorker.  Mapping it
+    // should wait for the result.
+    win.awaiting_classification_ = true;
+    win.Map();
+    TS_ASSERT(!frame->mapped());
+
+    // The result should be applied even though the properties didn't
+    // change, and then the window should be mapped.
+    WindowConfigSet configs;
+    configs.MergeConfig(WindowConfig("default", 300, 200));
+    win.HandleClassifiedProperties(win.props(), true, &configs);
+    TS_ASSERT(frame->mapped());
+    TS_ASSERT_EQUALS(xwin->width(), 300U);
+    TS_ASSERT_EQUALS(xwin->height(), 200U);
+
+    // If it's unmapped before the result arrives, it should stay that way.
+    win.Unmap();
+    win.awaiting_classification_ = true;
+    win.Map();
+    win.Unmap();
+    configs.MergeConfig(WindowConfig("default", 300, 200));
+    win.HandleClassifiedProperties(win.props(), true, &configs);
+    TS_ASSERT(!frame->mapped());
+  }
+
+  void testRoles() {
+    XWindow* xwin = XWindow::Create(50, 60, 640, 480);
+    XWindow* frame = NULL;
+    {
+      wham::Window win(xwin);
+      frame = win.frame();
+
+      // The client window and frame should both point back at us.
+      TS_ASSERT_EQUALS(xwin->role(), XWindow::ROLE_CLIENT);
+      TS_ASSERT_EQUALS(xwin->client_window(), &win);
+      TS_ASSERT(xwin->frame_window() == NULL);
+      TS_ASSERT_EQUALS(frame->role(), XWindow::ROLE_FRAME);
+      TS_ASSERT_EQUALS(frame->frame_window(), &win);
+      TS_ASSERT(frame->client_window() == NULL);
+      TS_ASSERT(frame->titlebar_anchor() == NULL);
+    }
+
+    // The roles should be cleared when the Window goes away.
+    TS_ASSERT_EQUALS(xwin->role(), XWindow::ROLE_NONE);
+    TS_ASSERT(xwin->client_window() == NULL);
+    TS_ASSERT_EQUALS(frame->role(), XWindow::ROLE_NONE);
+  }
+
+  void testPropertyUpdate() {
+    MockXWindow::ClearCannedData();
+    XWindow* xwin = XWindow::Create(50, 60, 640, 480);
+    wham::Window win(xwin);
+    TS_ASSERT_EQUALS(win.title(), "");
+
+    // Nothing should change until the reply arrives.
+    win.HandlePropertyChange(WindowProperties::WINDOW_NAME_CHANGE);
+    TS_ASSERT_EQUALS(win.title(), "");
+    WindowProperties props;
+    props.window_name = "foo";
+    MockXWindow::AddCannedProperties(xwin->id(), props, None, true);
+    TS_ASSERT_EQUALS(win.title(), "foo");
+
+    // Properties that couldn't be read should be ignored.
+    props.window_name = "bar";
+    MockXWindow::AddCannedProperties(xwin->id(), props, None, false);
+    win.HandlePropertyChange(WindowProperties::WINDOW_NAME_CHANGE);
+    TS_ASSERT_EQUALS(win.title(), "foo");
+  }
+
   void testApplyConfig() {
     // At first, the window should be left at its initial size.
     uint initial_width = 200, initial_height = 100;
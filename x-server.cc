@@ -4,24 +4,29 @@
 #include "x-server.h"
 
 #include <algorithm>
-#include <ctime>
+#include <cerrno>
+#include <csignal>
 
-#include <sys/select.h>
-#include <sys/time.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
 
 extern "C" {
 #include <X11/Xatom.h>
 #include <X11/Xlib-xcb.h>
 #include <X11/cursorfont.h>
 #include <X11/extensions/Xdamage.h>
+#include <xcb/xcbext.h>
 }
 
 #include "config.h"
+#include "drawing-engine.h"
+#include "event.h"
 #include "key-bindings.h"
 #include "mock-x-window.h"
 #include "util.h"
 #include "window-manager.h"
 #include "window-properties.h"
+#include "window.h"
 
 using namespace std;
 
@@ -32,6 +37,47 @@ ref_ptr<XServer> XServer::singleton_(new XServer);
 bool XServer::testing_ = false;
 
 
+// Get the name of the method that handles events of type 'type', for
+// stats and logging.
+static const char* GetHandlerName(Event::Type type) {
+  switch (type) {
+    case Event::BUTTON_PRESS: return "WindowManager::HandleButtonPress";
+    case Event::BUTTON_RELEASE: return "WindowManager::HandleButtonRelease";
+    case Event::CONFIGURE_NOTIFY: return "XWindow::HandleConfigureNotify";
+    case Event::CREATE_NOTIFY: return "PropertyPrefetcher::HandleCreate";
+    case Event::DAMAGE_NOTIFY: return "XWindow::HandleDamage";
+    case Event::DESTROY_NOTIFY: return "XServer::DeleteWindow";
+    case Event::ENTER_NOTIFY: return "WindowManager::HandleEnterWindow";
+    case Event::EXPOSE: return "WindowManager::HandleExposeWindow";
+    case Event::FOCUS_IN: return "FocusManager::HandleFocusIn";
+    case Event::FOCUS_OUT: return "FocusManager::HandleFocusOut";
+    case Event::KEY_PRESS: return "XServer::HandleKeyPress";
+    case Event::MAP_REQUEST: return "WindowManager::HandleMapRequest";
+    case Event::MOTION_NOTIFY: return "WindowManager::HandleMotion";
+    case Event::PROPERTY_NOTIFY: return "WindowManager::HandlePropertyChange";
+    case Event::UNMAP_NOTIFY: return "WindowManager::HandleUnmapWindow";
+    default: return "none";
+  }
+}
+
+
+// Logs a key binding that we couldn't grab (usually because another
+// client already has it).
+class KeyGrabErrorFunction : public RequestTracker::ErrorFunction {
+ public:
+  explicit KeyGrabErrorFunction(KeySym keysym) : keysym_(keysym) {}
+
+  void operator()(const xcb_generic_error_t& error) {
+    const char* name = XKeysymToString(keysym_);
+    ERROR << "Unable to grab key " << (name ? name : "(unknown)")
+          << "; is another client using it?";
+  }
+
+ private:
+  KeySym keysym_;
+};
+
+
 static const char* XEventTypeToName(int type) {
   switch (type) {
     case ButtonPress: return "ButtonPress";
@@ -77,13 +123,23 @@ XServer::XServer()
       xcb_screen_(NULL),
       display_(NULL),
       screen_num_(-1),
+      root_(None),
       damage_event_base_(0),
       damage_error_base_(0),
       width_(0),
       height_(0),
       initialized_(false),
+      wm_protocols_atom_(XCB_NONE),
+      wm_take_focus_atom_(XCB_NONE),
       in_progress_binding_(NULL),
-      next_timeout_id_(1) {
+      request_batch_depth_(0),
+      first_unflushed_request_(0),
+      num_request_batches_(0),
+      latency_ping_func_(this),
+      deferred_properties_task_(this),
+      deferred_properties_task_id_(0),
+      event_ingester_(NULL),
+      event_loop_(new EventLoop) {
 }
 
 
@@ -102,6 +158,14 @@ bool XServer::Init() {
     width_ = 1024;
     height_ = 768;
   } else {
+    // SIGUSR1 is read from a signalfd by RunEventLoop().  Block it before
+    // any other threads are started so that they inherit the mask;
+    // otherwise, the signal could be delivered to one of them and kill us.
+    sigset_t sigusr1_mask;
+    sigemptyset(&sigusr1_mask);
+    sigaddset(&sigusr1_mask, SIGUSR1);
+    CHECK(sigprocmask(SIG_BLOCK, &sigusr1_mask, NULL) == 0);
+
     display_ = XOpenDisplay(NULL);
     if (display_ == NULL) {
       ERROR << "Can't open display " << XDisplayName(NULL);
@@ -115,12 +179,31 @@ bool XServer::Init() {
       ERROR << "Couldn't get XCB connection from Xlib display";
       return false;
     }
+    // Read events through XCB instead of Xlib; Xlib is still used for
+    // some requests, but it never sees any events.
+    XSetEventQueueOwner(display_, XCBOwnsEventQueue);
 
     const xcb_setup_t* xcb_setup = xcb_get_setup(xcb_conn_);
     xcb_screen_iterator_t xcb_screen_iter = xcb_setup_roots_iterator(xcb_setup);
     for (int i = 0; i < screen_num_; ++i) xcb_screen_next(&xcb_screen_iter);
     xcb_screen_ = xcb_screen_iter.data;
 
+    // Send both requests before waiting for either reply.
+    static const char kWmProtocols[] = "WM_PROTOCOLS";
+    static const char kWmTakeFocus[] = "WM_TAKE_FOCUS";
+    xcb_intern_atom_cookie_t protocols_cookie = xcb_intern_atom(
+        xcb_conn_, 0, sizeof(kWmProtocols) - 1, kWmProtocols);
+    xcb_intern_atom_cookie_t take_focus_cookie = xcb_intern_atom(
+        xcb_conn_, 0, sizeof(kWmTakeFocus) - 1, kWmTakeFocus);
+    ref_ptr<xcb_intern_atom_reply_t> protocols_reply(
+        xcb_intern_atom_reply(xcb_conn_, protocols_cookie, NULL));
+    ref_ptr<xcb_intern_atom_reply_t> take_focus_reply(
+        xcb_intern_atom_reply(xcb_conn_, take_focus_cookie, NULL));
+    CHECK(protocols_reply.get());
+    CHECK(take_focus_reply.get());
+    wm_protocols_atom_ = protocols_reply->atom;
+    wm_take_focus_atom_ = take_focus_reply->atom;
+
     // FIXME: XCB from Jaunty doesn't appear to expose this. :-(
     CHECK(XDamageQueryExtension(display_,
                                 &damage_event_base_,
@@ -130,16 +213,16 @@ bool XServer::Init() {
     cursor_ = XCreateFontCursor(display_, XC_left_ptr);
     XDefineCursor(display_, root_, cursor_);
 
-    //XSynchronize(display_, True);
-
-    ::Window root_ret;
-    int x, y;
-    uint border_width, depth;
-    XGetGeometry(display_, root_, &root_ret, &x, &y,
-                 &width_, &height_, &border_width, &depth);
+    // The connection setup data already has the root window's size.
+    width_ = xcb_screen_->width_in_pixels;
+    height_ = xcb_screen_->height_in_pixels;
 
+    // SubstructureNotify tells us when top-level windows are created, so
+    // that we can start fetching their properties.
     XSelectInput(display_, root_,
-                 SubstructureRedirectMask | StructureNotifyMask);
+                 SubstructureRedirectMask | SubstructureNotifyMask |
+                 StructureNotifyMask);
+    first_unflushed_request_ = NextRequest(display_);
   }
 
   initialized_ = true;
@@ -151,194 +234,833 @@ void XServer::RunEventLoop(WindowManager* window_manager) {
   CHECK(window_manager);
   CHECK(initialized_);
 
-  int x11_fd = XConnectionNumber(display_);
-  DEBUG << "X11 connection is on fd " << x11_fd;
-  // FIXME: need to also use XAddConnectionWatch()?
-
-  while (true) {
-    while (XPending(display_)) {
-      ProcessEvent(window_manager);
-    }
-
-    double now = GetCurrentTime();
-    while (!timeout_heap_.empty() &&
-           timeout_heap_[0].time <= now) {
-      DEBUG << "Running timeout for " << fixed << timeout_heap_[0].time;
-      (*(timeout_heap_[0].func))();
-      pop_heap(timeout_heap_.begin(), timeout_heap_.end());
-      timeout_heap_.pop_back();
+  // If events are being read by another thread, we hear about them (and
+  // about replies) from it instead of watching the connection ourselves.
+  XEventsFunction x_events_func(this, window_manager);
+  if (Config::Get()->use_event_ingestion_thread) {
+    event_ingester_ = new EventIngester(xcb_conn_);
+    if (!event_ingester_->Start()) {
+      delete event_ingester_;
+      event_ingester_ = NULL;
     }
-
-    struct timeval tv;
-    struct timeval* timeout_tv = NULL;
-    if (!timeout_heap_.empty()) {
-      FillTimeval(timeout_heap_[0].time - now, &tv);
-      timeout_tv = &tv;
+  }
+  if (event_ingester_) {
+    LOG << "Reading events on a separate thread";
+    event_loop_->WatchFd(event_ingester_->fd(), &x_events_func);
+  } else {
+    int x11_fd = xcb_get_file_descriptor(xcb_conn_);
+    DEBUG << "X11 connection is on fd " << x11_fd;
+    event_loop_->WatchFd(x11_fd, &x_events_func);
+  }
+  event_loop_->set_timer_slack(Config::Get()->timer_slack_ms / 1000.0);
+  event_stats_.set_budget(Config::Get()->event_budget_ms / 1000.0);
+
+  // Dump our stats when we get SIGUSR1.  The signal was blocked by
+  // Init() and is read from a signalfd so that it's handled by the event
+  // loop instead of interrupting whatever we're in the middle of.
+  sigset_t sigusr1_mask;
+  sigemptyset(&sigusr1_mask);
+  sigaddset(&sigusr1_mask, SIGUSR1);
+  int signal_fd = signalfd(-1, &sigusr1_mask, SFD_NONBLOCK);
+  CHECK(signal_fd != -1);
+  StatsSignalFunction stats_signal_func(this);
+  event_loop_->WatchFd(signal_fd, &stats_signal_func);
+
+  PropertyResultsFunction property_results_func(this);
+  if (Config::Get()->use_property_worker) {
+    property_worker_.reset(new PropertyWorker);
+    if (property_worker_->Start(DisplayString(display_))) {
+      LOG << "Fetching changed properties on a separate thread";
+      event_loop_->WatchFd(property_worker_->fd(), &property_results_func);
+    } else {
+      property_worker_.reset();
     }
-
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(x11_fd, &fds);
-    CHECK(select(x11_fd + 1, &fds, NULL, NULL, timeout_tv) != -1);
   }
-}
 
+  PoolCompletionsFunction pool_completions_func(this);
+  if (Config::Get()->num_pool_threads > 0) {
+    thread_pool_.reset(new ThreadPool(Config::Get()->num_pool_threads));
+    if (thread_pool_->Start())
+      event_loop_->WatchFd(thread_pool_->fd(), &pool_completions_func);
+    else
+      thread_pool_.reset();
+  }
 
-uint XServer::RegisterTimeout(TimeoutFunction* func, double timeout_sec) {
-  CHECK(func);
-  CHECK(timeout_sec >= 0);
+  latency_monitor_.SetThresholds(
+      Config::Get()->high_latency_threshold_ms / 1000.0,
+      Config::Get()->low_latency_threshold_ms / 1000.0);
+  if (Config::Get()->latency_ping_interval_ms > 0) SendLatencyPing();
 
-  uint id = next_timeout_id_;
-  Timeout timeout(id, func, GetCurrentTime() + timeout_sec);
-  DEBUG << "Registering timeout for " << fixed << timeout.time;
-  timeout_heap_.push_back(timeout);
-  push_heap(timeout_heap_.begin(), timeout_heap_.end());
+  AdoptExistingWindows(window_manager);
 
-  // FIXME: If we have long timeouts and create lots of them, we could end
-  // up recycling IDs here.  Use 64 bits?  Probably not necessary.
-  next_timeout_id_++;
-  return id;
+  while (true) {
+    // XCB may have already read events into its queue while waiting for
+    // a reply, in which case the fd won't become readable for them, so
+    // drain the queue (or have the ingestion thread drain it) before
+    // blocking.  This also flushes the requests made by any timeouts that
+    // just ran.
+    ProcessPendingEvents(window_manager);
+    if (RunIdleTasks()) continue;
+    if (event_ingester_) event_ingester_->Kick();
+    event_loop_->RunOnce(true);
+  }
 }
 
 
-void XServer::CancelTimeout(uint id) {
-  for (vector<Timeout>::iterator it = timeout_heap_.begin();
-       it != timeout_heap_.end(); ++it) {
-    if (it->id == id) {
-      timeout_heap_.erase(it);
-      // TODO: I suspect that I can just call make_heap(it, ...) here, but
-      // I'm not sure about it.
-      make_heap(timeout_heap_.begin(), timeout_heap_.end());
-      return;
-    }
-  }
-  ERROR << "Got request to cancel nonexistent timeout with ID " << id;
+bool XServer::RunIdleTasks() {
+  if (idle_tasks_.empty()) return false;
+
+  // Anything that's ready to run takes precedence; we'll get back here
+  // on the next pass through the loop.
+  if (event_loop_->RunOnce(false) > 0) return true;
+
+  RequestBatch request_batch(this);
+  idle_tasks_.RunSlice(Config::Get()->idle_task_slice_ms / 1000.0);
+  focus_manager_.Commit();
+  return true;
 }
 
 
 void XServer::RegisterKeyBindings(const KeyBindings& bindings) {
   // Ungrab old bindings, update our map, and grab all of the top-level
   // bindings.
-  XUngrabKey(display_, AnyKey, AnyModifier, root_);
+  if (!testing_)
+    xcb_ungrab_key(xcb_conn_, XCB_GRAB_ANY, root_, XCB_MOD_MASK_ANY);
   UpdateKeyBindingMap(bindings, &bindings_);
+  if (testing_) return;
   for (XKeyBindingMap::const_iterator it = bindings_.begin();
        it != bindings_.end(); ++it) {
     KeyCode keycode = XKeysymToKeycode(display_, it->second->keysym);
-    XGrabKey(display_, keycode, it->second->required_mods,
-             root_, False, GrabModeAsync, GrabModeAsync);
+    xcb_void_cookie_t cookie =
+        xcb_grab_key(xcb_conn_, 0, root_, it->second->required_mods, keycode,
+                     XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+    TrackRequest(cookie, "GrabKey",
+                 new KeyGrabErrorFunction(it->second->keysym));
   }
 }
 
 
+bool XServer::StartRecording(const string& filename) {
+  ref_ptr<EventTraceWriter> writer(new EventTraceWriter);
+  if (!writer->Open(filename)) return false;
+  trace_writer_.swap(writer);
+  LOG << "Recording events to " << filename;
+  return true;
+}
+
+
 XWindow* XServer::GetWindow(::Window id, bool create) {
-  XWindowMap::iterator it = windows_.find(id);
-  if (it != windows_.end()) return it->second.get();
-  if (!create) return NULL;
+  XWindow* xwin = windows_.Find(id);
+  if (xwin || !create) return xwin;
+  xwin = CreateWindowObject(id);
+  // Mock windows get their geometry from canned data instead.
+  if (!testing_) xwin->FetchGeometry();
+  return xwin;
+}
+
+
+XWindow* XServer::CreateWindowObject(::Window id) {
+  CHECK(!windows_.Find(id));
   ref_ptr<XWindow> window(testing_ ? new MockXWindow(id) : new XWindow(id));
-  windows_.insert(make_pair(id, window));
+  windows_.Insert(id, window);
   return window.get();
 }
 
 
 void XServer::DeleteWindow(::Window id) {
-  windows_.erase(id);
+  windows_.Erase(id);
+}
+
+
+void XServer::ProcessPendingEvents(WindowManager* window_manager) {
+  RequestBatch request_batch(this);
+
+  // Drain everything that's pending into a batch so that we can drop
+  // events that are made redundant by later ones before handling any of
+  // them.
+  event_batch_.clear();
+  bool got_events = ReadPendingEvents(&event_batch_);
+
+  // Replies arrive in the same stream as events, so reading the events
+  // also reads any replies that we're waiting for.
+  RunReplyFunctions();
+
+  if (!got_events) {
+    // Timeouts may have asked for the focus to be changed.
+    focus_manager_.Commit();
+    return;
+  }
+
+  // Input and structural changes are handled before redrawing and
+  // property updates, so that a busy client can't delay the response to
+  // a keypress.  While we work through the deferred events, we
+  // occasionally check for new ones; anything urgent that has arrived is
+  // handled first, and the deferred events are then resumed.  Each check
+  // is made only after at least one deferred event has been handled, and
+  // there's a limit on the number of checks per call, so deferred events
+  // always make progress and we always get back to the event loop.
+  const double slice_sec =
+      (high_latency() ?
+       Config::Get()->high_latency_deferred_event_slice_ms :
+       Config::Get()->deferred_event_slice_ms) / 1000.0;
+  int num_checks = 0;
+  deferred_events_.clear();
+  while (true) {
+    size_t num_decoded = event_batch_.size();
+    CoalesceEvents(&event_batch_);
+    if (event_batch_.size() != num_decoded) {
+      DEBUG << "Coalesced " << num_decoded << " events into "
+            << event_batch_.size();
+    }
+    SplitDeferrableEvents(&event_batch_, &deferred_events_);
+
+    // Get all of the property requests for newly-mapped windows in
+    // flight before handling anything.
+    if (!testing_) PrefetchProperties(event_batch_);
+
+    for (vector<Event>::const_iterator event = event_batch_.begin();
+         event != event_batch_.end(); ++event) {
+      HandleEvent(*event, window_manager);
+    }
+    event_batch_.clear();
+
+    bool got_new_events = false;
+    double slice_start = GetMonotonicTime();
+    for (size_t i = 0; i < deferred_events_.size(); ++i) {
+      HandleEvent(deferred_events_[i], window_manager);
+      if (i + 1 == deferred_events_.size() ||
+          num_checks >= kMaxDeferredEventChecks ||
+          GetMonotonicTime() - slice_start < slice_sec)
+        continue;
+
+      // Put the remaining deferred events in front of the new ones, so
+      // that they can be coalesced together and so that a new urgent
+      // event pulls any earlier events for its window along with it.
+      num_checks++;
+      event_batch_.assign(deferred_events_.begin() + i + 1,
+                          deferred_events_.end());
+      if (ReadPendingEvents(&event_batch_)) {
+        got_new_events = true;
+        break;
+      }
+      event_batch_.clear();
+      slice_start = GetMonotonicTime();
+    }
+    deferred_events_.clear();
+    if (!got_new_events) break;
+  }
+  DiscardPrefetchedProperties();
+
+  // Only the last focus change made while handling the batch matters.
+  // The requests that we made while handling the batch are sent when
+  // 'request_batch' goes out of scope.
+  focus_manager_.Commit();
+
+  // Push the batch out to the trace so that it's usable even if we get
+  // killed.
+  if (trace_writer_.get()) trace_writer_->Flush();
+}
+
+
+bool XServer::ReadPendingEvents(vector<Event>* events) {
+  CHECK(events);
+  size_t num_events = events->size();
+
+  if (event_ingester_) {
+    // Clear the wakeup first so that we'll hear about any events that
+    // are pushed while we're draining the ring.
+    event_ingester_->ClearWakeup();
+    xcb_generic_event_t xcb_event;
+    while (event_ingester_->Pop(&xcb_event)) ReadEvent(xcb_event, events);
+  } else {
+    // xcb_poll_for_event() reads everything that's available from the
+    // connection into XCB's queue, so after the first event, the rest can
+    // be taken from the queue without any more reads.
+    xcb_generic_event_t* xcb_event = xcb_poll_for_event(xcb_conn_);
+    while (xcb_event) {
+      ReadEvent(*xcb_event, events);
+      free(xcb_event);
+      xcb_event = xcb_poll_for_queued_event(xcb_conn_);
+    }
+  }
+  if (xcb_connection_has_error(xcb_conn_)) {
+    ERROR << "Lost connection to X server";
+    exit(EXIT_FAILURE);
+  }
+  return events->size() != num_events;
+}
+
+
+void XServer::ReadEvent(const xcb_generic_event_t& xcb_event,
+                        vector<Event>* events) {
+  suppression_table_.Expire(xcb_event.full_sequence);
+  request_tracker_.Expire(xcb_event.full_sequence);
+  Event event;
+  if (!DecodeEvent(xcb_event, &event)) return;
+  event_stats_.RecordReceived(event.type);
+  if (suppression_table_.ShouldSuppress(event)) {
+    DEBUG << "Suppressing " << event.DebugString();
+    return;
+  }
+  events->push_back(event);
+}
+
+
+void XServer::AwaitReply(unsigned int sequence, ReplyFunction* func) {
+  CHECK(func);
+  awaited_replies_.push_back(AwaitedReply());
+  awaited_replies_.back().sequence = sequence;
+  awaited_replies_.back().func.reset(func);
+}
+
+
+void XServer::RunReplyFunctions() {
+  // The server replies to requests in order, so once we get to a request
+  // that hasn't been answered yet, none of the later ones have been
+  // either.
+  while (!awaited_replies_.empty()) {
+    void* reply = NULL;
+    xcb_generic_error_t* error = NULL;
+    if (!xcb_poll_for_reply(xcb_conn_, awaited_replies_.front().sequence,
+                            &reply, &error)) {
+      break;
+    }
+    // Pop the entry before running the function, which may await more
+    // replies.
+    ref_ptr<ReplyFunction> func = awaited_replies_.front().func;
+    awaited_replies_.pop_front();
+    if (error) {
+      DEBUG << "Got X error " << static_cast<int>(error->error_code)
+            << " for request with sequence " << error->full_sequence;
+      free(error);
+    }
+    (*func)(reply);
+    free(reply);
+  }
+}
+
+
+void XServer::SendLatencyPing() {
+  // GetInputFocus is the cheapest request that has a reply; it's what
+  // XSync() uses.  The reply is noticed the next time that we read from
+  // the connection, so the RTT includes any time that we spend busy.
+  double now = GetMonotonicTime();
+  if (latency_monitor_.ping_in_flight()) {
+    if (latency_monitor_.CheckPingInFlight(now)) HandleLatencyModeChange();
+  } else {
+    xcb_get_input_focus_cookie_t cookie = xcb_get_input_focus(xcb_conn_);
+    latency_monitor_.RecordPingSent(now);
+    AwaitReply(cookie.sequence, new LatencyPingReplyFunction(this));
+  }
+  RegisterTimeout(&latency_ping_func_,
+                  Config::Get()->latency_ping_interval_ms / 1000.0);
+}
+
+
+void XServer::HandleLatencyModeChange() {
+  bool high_latency = latency_monitor_.high_latency();
+  LOG << "Switching to " << (high_latency ? "high" : "normal")
+      << "-latency mode (smoothed RTT "
+      << 1000 * latency_monitor_.smoothed_rtt() << " ms)";
+  event_loop_->set_timer_slack(
+      (high_latency ?
+       Config::Get()->high_latency_timer_slack_ms :
+       Config::Get()->timer_slack_ms) / 1000.0);
+  DrawingEngine::Get()->HandleLatencyModeChange();
+}
+
+
+void XServer::DeferPropertyUpdate(::Window id,
+                                  WindowProperties::ChangeType type) {
+  pair< ::Window, WindowProperties::ChangeType> entry(id, type);
+  if (find(deferred_properties_.begin(), deferred_properties_.end(), entry) !=
+      deferred_properties_.end()) {
+    return;
+  }
+  deferred_properties_.push_back(entry);
+  if (!deferred_properties_task_id_)
+    deferred_properties_task_id_ = AddIdleTask(&deferred_properties_task_);
+}
+
+
+bool XServer::FetchDeferredProperty() {
+  if (!deferred_properties_.empty()) {
+    pair< ::Window, WindowProperties::ChangeType> entry =
+        deferred_properties_.front();
+    deferred_properties_.pop_front();
+    // The window may have been destroyed in the meantime.
+    XWindow* xwin = GetWindow(entry.first, false);
+    if (xwin) xwin->FetchProperty(entry.second);
+  }
+  if (!deferred_properties_.empty()) return true;
+  deferred_properties_task_id_ = 0;
+  return false;
+}
+
+
+void XServer::HandlePropertyWorkerResults() {
+  CHECK(property_worker_.get());
+  property_worker_->ClearWakeup();
+
+  RequestBatch request_batch(this);
+  while (true) {
+    ref_ptr<PropertyWorker::Result> result(property_worker_->PopResult());
+    if (!result.get()) break;
+
+    // The worker can't look up windows, so it left 'transient_for' alone.
+    XWindow* xwin = GetWindow(result->id, false);
+    Window* window = xwin ? xwin->client_window() : NULL;
+    if (!window) {
+      result->props.transient_for = NULL;
+    } else if (result->got_transient_for) {
+      result->props.transient_for =
+          xwin->FindTransientForWindow(result->transient_for_id);
+    } else {
+      result->props.transient_for = window->props().transient_for;
+    }
+
+    // Replays fetch each change separately, so they expect a record for
+    // each one.
+    if (trace_writer_.get()) {
+      for (size_t i = 0; i < result->num_changes; ++i) {
+        trace_writer_->WriteProperties(
+            result->id, result->props, result->success);
+      }
+    }
+
+    if (window && !result->superseded) {
+      if (result->classified) {
+        window->HandleClassifiedProperties(
+            result->props, result->success, &result->configs);
+      } else if (result->success && result->got_transient_for) {
+        // Now that 'transient_for' is known, the thread can classify it.
+        property_worker_->ClassifyResult(*result);
+        continue;
+      } else {
+        window->HandleUpdatedProperties(result->props, result->success);
+      }
+    }
+    property_worker_->FinishUpdate(*result, window);
+  }
+  focus_manager_.Commit();
+}
+
+
+bool XServer::TakePrefetchedProperties(::Window id,
+                                       XWindow::PropertyCookies* cookies) {
+  CHECK(cookies);
+  if (property_prefetcher_.TakeProperties(id, cookies)) return true;
+  for (size_t i = 0; i < prefetched_properties_.size(); ++i) {
+    if (prefetched_properties_[i].first == id) {
+      *cookies = prefetched_properties_[i].second;
+      prefetched_properties_[i] = prefetched_properties_.back();
+      prefetched_properties_.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void XServer::PrefetchProperties(const vector<Event>& events) {
+  for (vector<Event>::const_iterator event = events.begin();
+       event != events.end(); ++event) {
+    if (event->type != Event::MAP_REQUEST) continue;
+
+    // Windows that already have a role are either ours or already
+    // managed, so HandleMapRequest() won't look at their properties.
+    XWindow* xwin = GetWindow(event->window, false);
+    if (xwin && xwin->role() != XWindow::ROLE_NONE) continue;
+
+    // We may have started fetching everything when the window was
+    // created.
+    if (property_prefetcher_.HasWindow(event->window)) continue;
+
+    bool already_requested = false;
+    for (size_t i = 0; i < prefetched_properties_.size(); ++i) {
+      if (prefetched_properties_[i].first == event->window) {
+        already_requested = true;
+        break;
+      }
+    }
+    if (already_requested) continue;
+
+    XWindow::PropertyCookies cookies;
+    XWindow::RequestAllProperties(event->window, &cookies);
+    prefetched_properties_.push_back(make_pair(event->window, cookies));
+    if (!xwin) {
+      prefetched_geometry_.push_back(
+          make_pair(event->window, xcb_get_geometry(xcb_conn_, event->window)));
+    }
+  }
+  // This is the one place where we flush before the batch ends, so that
+  // the server can work on the replies while we handle earlier events.
+  if (!prefetched_properties_.empty()) xcb_flush(xcb_conn_);
+}
+
+
+bool XServer::ShouldPrefetchOnCreate(::Window id) {
+  // Windows that we created ourselves are already known.
+  if (GetWindow(id, false)) return false;
+  for (size_t i = 0; i < prefetched_properties_.size(); ++i)
+    if (prefetched_properties_[i].first == id) return false;
+  return true;
+}
+
+
+bool XServer::TakePrefetchedGeometry(::Window id,
+                                     xcb_get_geometry_cookie_t* cookie) {
+  CHECK(cookie);
+  for (size_t i = 0; i < prefetched_geometry_.size(); ++i) {
+    if (prefetched_geometry_[i].first == id) {
+      *cookie = prefetched_geometry_[i].second;
+      prefetched_geometry_[i] = prefetched_geometry_.back();
+      prefetched_geometry_.pop_back();
+      return true;
+    }
+  }
+  return false;
 }
 
 
-void XServer::ProcessEvent(WindowManager* window_manager) {
-  XEvent event;
-  XNextEvent(display_, &event);
+void XServer::DiscardPrefetchedProperties() {
+  for (size_t i = 0; i < prefetched_properties_.size(); ++i)
+    XWindow::DiscardPropertyCookies(prefetched_properties_[i].second);
+  prefetched_properties_.clear();
+  for (size_t i = 0; i < prefetched_geometry_.size(); ++i)
+    xcb_discard_reply(xcb_conn_, prefetched_geometry_[i].second.sequence);
+  prefetched_geometry_.clear();
+}
+
+
+void XServer::AdoptExistingWindows(WindowManager* window_manager) {
+  CHECK(window_manager);
+  RequestBatch request_batch(this);
+
+  ref_ptr<xcb_query_tree_reply_t> tree(
+      xcb_query_tree_reply(xcb_conn_, xcb_query_tree(xcb_conn_, root_), NULL));
+  if (!tree.get()) {
+    ERROR << "Unable to query root window's children";
+    return;
+  }
+  const xcb_window_t* children = xcb_query_tree_children(tree.get());
+  int num_children = xcb_query_tree_children_length(tree.get());
+
+  // Send all of the requests for all of the windows before reading any
+  // replies, so that the whole thing takes a single round trip no matter
+  // how many windows there are.  We'll throw away the geometry and
+  // properties of the windows that we don't end up managing.
+  vector<xcb_get_window_attributes_cookie_t> attr_cookies(num_children);
+  vector<xcb_get_geometry_cookie_t> geometry_cookies(num_children);
+  vector<XWindow::PropertyCookies> property_cookies(num_children);
+  for (int i = 0; i < num_children; ++i) {
+    attr_cookies[i] = xcb_get_window_attributes(xcb_conn_, children[i]);
+    geometry_cookies[i] = xcb_get_geometry(xcb_conn_, children[i]);
+    XWindow::RequestAllProperties(children[i], &property_cookies[i]);
+  }
+
+  vector< ::Window> adopted_windows;
+  for (int i = 0; i < num_children; ++i) {
+    ref_ptr<xcb_get_window_attributes_reply_t> attr(
+        xcb_get_window_attributes_reply(xcb_conn_, attr_cookies[i], NULL));
+    // Skip windows that have been destroyed since we queried the tree,
+    // windows that don't want to be managed, windows that aren't mapped,
+    // and windows (like anchor titlebars) that we created ourselves.
+    if (!attr.get() ||
+        attr->override_redirect ||
+        attr->map_state != XCB_MAP_STATE_VIEWABLE ||
+        GetWindow(children[i], false)) {
+      xcb_discard_reply(xcb_conn_, geometry_cookies[i].sequence);
+      XWindow::DiscardPropertyCookies(property_cookies[i]);
+      continue;
+    }
+    prefetched_geometry_.push_back(
+        make_pair(children[i], geometry_cookies[i]));
+    prefetched_properties_.push_back(
+        make_pair(children[i], property_cookies[i]));
+    adopted_windows.push_back(children[i]);
+  }
+  LOG << "Adopting " << adopted_windows.size() << " existing window(s)";
+
+  for (vector< ::Window>::const_iterator it = adopted_windows.begin();
+       it != adopted_windows.end(); ++it) {
+    HandleEvent(Event(Event::MAP_REQUEST, *it), window_manager);
+  }
+  DiscardPrefetchedProperties();
+  focus_manager_.Commit();
+}
+
+
+void XServer::QueueConfigure(::Window id, bool move_to_back) {
+  if (move_to_back) {
+    queued_configures_.erase(
+        remove(queued_configures_.begin(), queued_configures_.end(), id),
+        queued_configures_.end());
+  }
+  queued_configures_.push_back(id);
+}
+
 
-  if (event.type == ButtonPress) {
-    XButtonEvent& e = event.xbutton;
-    DEBUG << "ButtonPress: xwin=0x" << hex << e.window << dec
-          << " x=" << e.x_root << " y=" << e.y_root << " button=" << e.button;
-    XWindow* xwin = GetWindow(e.window, false);
+void XServer::CommitPendingConfigures() {
+  for (size_t i = 0; i < queued_configures_.size(); ++i) {
+    // Windows may have been destroyed since they were queued.
+    XWindow* xwin = GetWindow(queued_configures_[i], false);
+    if (xwin) xwin->CommitConfigure();
+  }
+  queued_configures_.clear();
+}
+
+
+void XServer::EndRequestBatch() {
+  CHECK(request_batch_depth_ > 0);
+  if (--request_batch_depth_ > 0) return;
+  CommitPendingConfigures();
+  num_request_batches_++;
+  if (testing_) return;
+
+  // XFlush() pushes out anything buffered by Xlib as well as by XCB.
+  // Xlib only learns about the requests that were made directly through
+  // XCB when it takes the connection back, so the next request's
+  // sequence number isn't accurate until after the flush.
+  XFlush(display_);
+  unsigned long next_request = NextRequest(display_);
+  uint num_requests =
+      static_cast<uint>(next_request - first_unflushed_request_);
+  first_unflushed_request_ = next_request;
+  if (num_requests) event_stats_.RecordRequestBatch(num_requests);
+}
+
+
+void XServer::HandleEvent(const Event& event,
+                          WindowManager* window_manager) {
+  double start = GetMonotonicTime();
+  if (trace_writer_.get()) trace_writer_->WriteEvent(event, start);
+  if (event.time != CurrentTime) focus_manager_.RecordEventTime(event.time);
+  ProcessEvent(event, window_manager);
+  event_stats_.RecordHandled(event, GetHandlerName(event.type),
+                             GetMonotonicTime() - start);
+}
+
+
+bool XServer::DecodeEvent(const xcb_generic_event_t& xcb_event,
+                          Event* event) {
+  CHECK(event);
+  *event = Event();
+
+  // The high bit is set for events that were sent by other clients.
+  int type = xcb_event.response_type & ~0x80;
+  event->sequence = xcb_event.full_sequence;
+
+  if (type == 0) {
+    request_tracker_.HandleError(
+        reinterpret_cast<const xcb_generic_error_t&>(xcb_event));
+    return false;
+  } else if (type == XCB_BUTTON_PRESS || type == XCB_BUTTON_RELEASE) {
+    const xcb_button_press_event_t& e =
+        reinterpret_cast<const xcb_button_press_event_t&>(xcb_event);
+    event->type = (type == XCB_BUTTON_PRESS) ?
+        Event::BUTTON_PRESS : Event::BUTTON_RELEASE;
+    event->window = e.event;
+    event->x = e.root_x;
+    event->y = e.root_y;
+    event->detail = e.detail;
+    event->time = e.time;
+  } else if (type == damage_event_base_ + XDamageNotify) {
+    const DamageNotifyEvent& e =
+        reinterpret_cast<const DamageNotifyEvent&>(xcb_event);
+    event->type = Event::DAMAGE_NOTIFY;
+    event->window = e.drawable;
+    event->detail = e.damage;
+  } else if (type == XCB_DESTROY_NOTIFY) {
+    const xcb_destroy_notify_event_t& e =
+        reinterpret_cast<const xcb_destroy_notify_event_t&>(xcb_event);
+    event->type = Event::DESTROY_NOTIFY;
+    event->window = e.window;
+  } else if (type == XCB_ENTER_NOTIFY) {
+    const xcb_enter_notify_event_t& e =
+        reinterpret_cast<const xcb_enter_notify_event_t&>(xcb_event);
+    event->type = Event::ENTER_NOTIFY;
+    event->window = e.event;
+    event->time = e.time;
+  } else if (type == XCB_EXPOSE) {
+    const xcb_expose_event_t& e =
+        reinterpret_cast<const xcb_expose_event_t&>(xcb_event);
+    event->type = Event::EXPOSE;
+    event->window = e.window;
+  } else if (type == XCB_FOCUS_IN || type == XCB_FOCUS_OUT) {
+    const xcb_focus_in_event_t& e =
+        reinterpret_cast<const xcb_focus_in_event_t&>(xcb_event);
+    event->type = (type == XCB_FOCUS_IN) ?
+        Event::FOCUS_IN : Event::FOCUS_OUT;
+    event->window = e.event;
+    event->detail = e.detail;
+    event->state = e.mode;
+  } else if (type == XCB_KEY_PRESS || type == XCB_KEY_RELEASE) {
+    const xcb_key_press_event_t& e =
+        reinterpret_cast<const xcb_key_press_event_t&>(xcb_event);
+    event->type = (type == XCB_KEY_PRESS) ?
+        Event::KEY_PRESS : Event::KEY_RELEASE;
+    event->window = e.event;
+    // Xlib still owns the keyboard mapping, so let it do the lookup.
+    XKeyEvent xevent;
+    memset(&xevent, 0, sizeof(xevent));
+    xevent.display = display_;
+    xevent.keycode = e.detail;
+    event->detail = XLookupKeysym(&xevent, 0);
+    event->state = e.state;
+    event->time = e.time;
+  } else if (type == XCB_MAPPING_NOTIFY) {
+    // Update Xlib's copy of the keyboard mapping right away, since we
+    // look up keysyms for later key events in the batch while decoding
+    // them.
+    const xcb_mapping_notify_event_t& e =
+        reinterpret_cast<const xcb_mapping_notify_event_t&>(xcb_event);
+    DEBUG << "MappingNotify";
+    XMappingEvent xevent;
+    memset(&xevent, 0, sizeof(xevent));
+    xevent.type = MappingNotify;
+    xevent.serial = e.sequence;
+    xevent.display = display_;
+    xevent.request = e.request;
+    xevent.first_keycode = e.first_keycode;
+    xevent.count = e.count;
+    XRefreshKeyboardMapping(&xevent);
+    return false;
+  } else if (type == XCB_MAP_REQUEST) {
+    const xcb_map_request_event_t& e =
+        reinterpret_cast<const xcb_map_request_event_t&>(xcb_event);
+    event->type = Event::MAP_REQUEST;
+    event->window = e.window;
+  } else if (type == XCB_MOTION_NOTIFY) {
+    const xcb_motion_notify_event_t& e =
+        reinterpret_cast<const xcb_motion_notify_event_t&>(xcb_event);
+    event->type = Event::MOTION_NOTIFY;
+    event->window = e.event;
+    event->x = e.root_x;
+    event->y = e.root_y;
+    event->time = e.time;
+  } else if (type == XCB_PROPERTY_NOTIFY) {
+    const xcb_property_notify_event_t& e =
+        reinterpret_cast<const xcb_property_notify_event_t&>(xcb_event);
+    event->type = Event::PROPERTY_NOTIFY;
+    event->window = e.window;
+    event->detail = e.atom;
+    event->state = e.state;
+  } else if (type == XCB_UNMAP_NOTIFY) {
+    const xcb_unmap_notify_event_t& e =
+        reinterpret_cast<const xcb_unmap_notify_event_t&>(xcb_event);
+    // We only care about unmaps of client windows, which we hear about
+    // directly; ignore the copies reported to the root window.
+    if (e.event != e.window) return false;
+    event->type = Event::UNMAP_NOTIFY;
+    event->window = e.window;
+  } else if (type == XCB_CONFIGURE_NOTIFY) {
+    // Synthetic ConfigureNotify events use root coordinates and don't
+    // necessarily describe the window's real geometry.
+    if (xcb_event.response_type & 0x80) return false;
+    const xcb_configure_notify_event_t& e =
+        reinterpret_cast<const xcb_configure_notify_event_t&>(xcb_event);
+    event->type = Event::CONFIGURE_NOTIFY;
+    event->window = e.window;
+    event->x = e.x;
+    event->y = e.y;
+    event->detail = e.width;
+    event->state = e.height;
+  } else if (type == XCB_CREATE_NOTIFY) {
+    const xcb_create_notify_event_t& e =
+        reinterpret_cast<const xcb_create_notify_event_t&>(xcb_event);
+    // Override-redirect windows will never ask to be mapped.
+    if (e.parent != root_ || e.override_redirect) return false;
+    event->type = Event::CREATE_NOTIFY;
+    event->window = e.window;
+    event->x = e.x;
+    event->y = e.y;
+    event->detail = e.width;
+    event->state = e.height;
+  } else {
+    DEBUG << XEventTypeToName(type);
+    return false;
+  }
+  return true;
+}
+
+
+void XServer::ProcessEvent(const Event& event,
+                           WindowManager* window_manager) {
+  if (event.type != Event::MOTION_NOTIFY) DEBUG << event.DebugString();
+
+  if (event.type == Event::BUTTON_PRESS) {
+    XWindow* xwin = GetWindow(event.window, false);
     if (xwin) {
-      window_manager->HandleButtonPress(xwin, e.x_root, e.y_root, e.button);
+      window_manager->HandleButtonPress(
+          xwin, event.x, event.y, event.detail);
     }
-  } else if (event.type == ButtonRelease) {
-    XButtonEvent& e = event.xbutton;
-    DEBUG << "ButtonRelease: xwin=0x" << hex << e.window << dec
-          << " x=" << e.x_root << " y=" << e.y_root << " button=" << e.button;
-    XWindow* xwin = GetWindow(e.window, false);
+  } else if (event.type == Event::BUTTON_RELEASE) {
+    XWindow* xwin = GetWindow(event.window, false);
     if (xwin) {
-      window_manager->HandleButtonRelease(xwin, e.x_root, e.y_root, e.button);
-    }
-  } else if (event.type == ConfigureNotify) {
-    // We don't care about these.
-  } else if (event.type == damage_event_base_ + XDamageNotify) {
-    const XDamageNotifyEvent& e =
-        *(reinterpret_cast<XDamageNotifyEvent*>(&event));
-    DEBUG << "DamageNotify: xwin=0x" << hex << e.drawable
-          << " damage=" << dec << e.damage;
-    XWindow* xwin = GetWindow(e.drawable, false);
+      window_manager->HandleButtonRelease(
+          xwin, event.x, event.y, event.detail);
+    }
+  } else if (event.type == Event::CONFIGURE_NOTIFY) {
+    XWindow* xwin = GetWindow(event.window, false);
     if (xwin) {
-      CHECK_EQ(e.damage, xwin->damage());
-      // FIXME: Pass the damaged region as well, so that the whole window
-      // doesn't need to be repaired?
-      window_manager->HandleWindowDamage(xwin);
-      XDamageSubtract(display_, xwin->damage(), None, None);
-    }
-  } else if (event.type == DestroyNotify) {
-    XDestroyWindowEvent& e = event.xdestroywindow;
-    DEBUG << "DestroyNotify: xwin=0x" << hex << e.window;
-    XWindow* xwin = GetWindow(e.window, false);
-    if (xwin) DeleteWindow(e.window);
-  } else if (event.type == EnterNotify) {
-    XCrossingEvent& e = event.xcrossing;
-    DEBUG << "Enter: xwin=0x" << hex << e.window;
-    XWindow* xwin = GetWindow(e.window, false);
+      xwin->HandleConfigureNotify(
+          event.x, event.y, event.detail, event.state, event.sequence);
+    } else if (!testing_) {
+      property_prefetcher_.HandleConfigure(
+          event.window, event.x, event.y, event.detail, event.state);
+    }
+  } else if (event.type == Event::CREATE_NOTIFY) {
+    if (!testing_ && ShouldPrefetchOnCreate(event.window)) {
+      property_prefetcher_.HandleCreate(
+          event.window, event.x, event.y, event.detail, event.state);
+    }
+  } else if (event.type == Event::DAMAGE_NOTIFY) {
+    XWindow* xwin = GetWindow(event.window, false);
+    // FIXME: Pass the damaged region as well, so that the whole window
+    // doesn't need to be repaired?
+    if (xwin) xwin->HandleDamage(static_cast< ::Damage>(event.detail));
+  } else if (event.type == Event::DESTROY_NOTIFY) {
+    // Top-level windows' destruction is reported both to the window and
+    // to the root, but handling it twice is harmless.
+    if (!testing_) property_prefetcher_.HandleDestroy(event.window);
+    XWindow* xwin = GetWindow(event.window, false);
+    if (xwin) {
+      // We should've already seen an UnmapNotify for a managed client,
+      // but make sure that nothing's left pointing at the window before
+      // we delete it.
+      if (xwin->role() == XWindow::ROLE_CLIENT) {
+        window_manager->HandleUnmapWindow(xwin);
+      }
+      focus_manager_.HandleWindowDestroyed(event.window);
+      DeleteWindow(event.window);
+    }
+  } else if (event.type == Event::ENTER_NOTIFY) {
+    XWindow* xwin = GetWindow(event.window, false);
     // This could for a border window that we just deleted.
     if (xwin) window_manager->HandleEnterWindow(xwin);
-  } else if (event.type == Expose) {
-    // Coalesce expose events for the same window to avoid redrawing the
-    // same one more than necessary.
-    // TODO: Is this needed?  Doesn't appear to have much of an effect on
-    // my computer, but maybe with a slower machine or slower drawing
-    // code it could help.
-    set<XWindow*> exposed_windows;
-    do {
-      XExposeEvent& e = event.xexpose;
-      DEBUG << "Expose: xwin=0x" << hex << e.window;
-      XWindow* xwin = GetWindow(e.window, false);
-      // This could be for a border window that we just deleted.
-      if (xwin == NULL) continue;
-      exposed_windows.insert(xwin);
-    } while (XCheckMaskEvent(display_, ExposureMask, &event) == True);
-    for (set<XWindow*>::iterator win = exposed_windows.begin();
-         win != exposed_windows.end(); ++win) {
-      window_manager->HandleExposeWindow(*win);
-    }
-  } else if (event.type == KeyPress) {
-    XKeyEvent& e = event.xkey;
-    DEBUG << "KeyPress: xwin=0x" << hex << e.window << dec
-          << " keycode=" << e.keycode << " state=" << e.state;
-    HandleKeyPress(XLookupKeysym(&e, 0), e.state, window_manager);
-  } else if (event.type == KeyRelease) {
-    XKeyEvent& e = event.xkey;
-    DEBUG << "KeyRelease: xwin=0x" << hex << e.window << dec
-          << " keycode=" << e.keycode << " state=" << e.state;
-  } else if (event.type == MappingNotify) {
-    XMappingEvent& e = event.xmapping;
-    DEBUG << "MappingNotify";
-    XRefreshKeyboardMapping(&e);
-  } else if (event.type == MapRequest) {
-    XMapRequestEvent& e = event.xmaprequest;
-    DEBUG << "MapRequest: xwin=0x" << hex << e.window;
-    XWindow* xwin = GetWindow(e.window, true);
+  } else if (event.type == Event::EXPOSE) {
+    XWindow* xwin = GetWindow(event.window, false);
+    // This could be for a border window that we just deleted.
+    if (xwin) window_manager->HandleExposeWindow(xwin);
+  } else if (event.type == Event::FOCUS_IN) {
+    focus_manager_.HandleFocusIn(event.window, event.detail, event.state);
+  } else if (event.type == Event::FOCUS_OUT) {
+    focus_manager_.HandleFocusOut(event.window, event.detail, event.state);
+  } else if (event.type == Event::KEY_PRESS) {
+    HandleKeyPress(event.detail, event.state, window_manager);
+  } else if (event.type == Event::KEY_RELEASE) {
+    // Nothing to do.
+  } else if (event.type == Event::MAP_REQUEST) {
+    XWindow* xwin = GetWindow(event.window, true);
     window_manager->HandleMapRequest(xwin);
-  } else if (event.type == MotionNotify) {
-    XMotionEvent& e = event.xmotion;
-    //DEBUG << "MotionNotify: xwin=0x" << hex << e.window << dec
-    //      << " x=" << e.x_root << " y=" << e.y_root;
-    XWindow* xwin = GetWindow(e.window, false);
-    if (xwin) window_manager->HandleMotion(xwin, e.x_root, e.y_root);
-  } else if (event.type == PropertyNotify) {
-    XPropertyEvent& e = event.xproperty;
-    XWindow* xwin = GetWindow(e.window, false);
+  } else if (event.type == Event::MOTION_NOTIFY) {
+    XWindow* xwin = GetWindow(event.window, false);
+    if (xwin) window_manager->HandleMotion(xwin, event.x, event.y);
+  } else if (event.type == Event::PROPERTY_NOTIFY) {
+    XWindow* xwin = GetWindow(event.window, false);
     WindowProperties::ChangeType type = WindowProperties::OTHER_CHANGE;
-    switch (e.atom) {
+    switch (event.detail) {
       case XA_WM_NAME: type = WindowProperties::WINDOW_NAME_CHANGE; break;
       case XA_WM_ICON_NAME: type = WindowProperties::ICON_NAME_CHANGE; break;
       case XA_WM_COMMAND: type = WindowProperties::COMMAND_CHANGE; break;
@@ -347,27 +1069,73 @@ void XServer::ProcessEvent(WindowManager* window_manager) {
            type = WindowProperties::WM_HINTS_CHANGE; break;
       case XA_WM_TRANSIENT_FOR:
            type = WindowProperties::TRANSIENT_CHANGE; break;
+      case XA_WM_HINTS: type = WindowProperties::INPUT_HINT_CHANGE; break;
       default: type = WindowProperties::OTHER_CHANGE;
     }
-    DEBUG << "PropertyNotify: xwin=0x" << hex << e.window << dec
-          << " atom=" << e.atom
-          << " type=" << WindowProperties::ChangeTypeToStr(type)
-          << " state=" << (e.state == PropertyNewValue ?
+    if (wm_protocols_atom_ != XCB_NONE && event.detail == wm_protocols_atom_)
+      type = WindowProperties::PROTOCOLS_CHANGE;
+    DEBUG << "PropertyNotify: type="
+          << WindowProperties::ChangeTypeToStr(type)
+          << " state=" << (event.state == PropertyNewValue ?
                            "PropertyNewValue" : "PropertyDeleted");
-    if (type != WindowProperties::OTHER_CHANGE) {
+    if (xwin && type != WindowProperties::OTHER_CHANGE) {
       window_manager->HandlePropertyChange(xwin, type);
+    } else if (!xwin && !testing_) {
+      property_prefetcher_.HandlePropertyChange(
+          event.window, event.detail, event.sequence);
     }
-  } else if (event.type == UnmapNotify) {
-    XUnmapEvent& e = event.xunmap;
-    DEBUG << "UnmapNotify: xwin=0x" << hex << e.window;
-    XWindow* xwin = GetWindow(e.window, false);
+  } else if (event.type == Event::UNMAP_NOTIFY) {
+    XWindow* xwin = GetWindow(event.window, false);
     if (xwin) window_manager->HandleUnmapWindow(xwin);
-  } else {
-    DEBUG << XEventTypeToName(event.type);
   }
 }
 
 
+void XServer::XEventsFunction::operator()(int fd) {
+  x_server_->ProcessPendingEvents(window_manager_);
+}
+
+
+void XServer::PropertyResultsFunction::operator()(int fd) {
+  x_server_->HandlePropertyWorkerResults();
+}
+
+
+void XServer::PoolCompletionsFunction::operator()(int fd) {
+  RequestBatch request_batch(x_server_);
+  x_server_->thread_pool_->RunCompletions();
+  x_server_->focus_manager_.Commit();
+}
+
+
+void XServer::StatsSignalFunction::operator()(int fd) {
+  struct signalfd_siginfo info;
+  while (read(fd, &info, sizeof(info)) == sizeof(info)) {}
+  if (errno != EAGAIN) {
+    ERROR << "Unable to read from signalfd: " << strerror(errno);
+  }
+  LOG << x_server_->event_stats_.DebugString();
+  LOG << x_server_->latency_monitor_.DebugString();
+}
+
+
+void XServer::LatencyPingFunction::operator()() {
+  x_server_->SendLatencyPing();
+}
+
+
+void XServer::LatencyPingReplyFunction::operator()(void* reply) {
+  // Even an error means that the request made the round trip.
+  if (x_server_->latency_monitor_.RecordPingReply(GetMonotonicTime()))
+    x_server_->HandleLatencyModeChange();
+}
+
+
+bool XServer::DeferredPropertiesTask::operator()() {
+  return x_server_->FetchDeferredProperty();
+}
+
+
 bool XServer::GetModifiers(const vector<string>& mods, uint* mod_bits) {
   CHECK(mod_bits);
   *mod_bits = 0U;
@@ -521,7 +1289,7 @@ void XServer::HandleKeyPress(KeySym keysym,
         XStringToKeysym(Config::Get()->keybinding_abort_key.c_str()));
     if (keysym == abort_key) {
       DEBUG << "Key binding aborted; ungrabbing keyboard";
-      XUngrabKeyboard(display_, CurrentTime);
+      UngrabKeyboard();
       in_progress_binding_ = NULL;
       return;
     }
@@ -546,7 +1314,7 @@ void XServer::HandleKeyPress(KeySym keysym,
             << hex << keysym << " mods=0x" << mods;
     } else {
       DEBUG << "Key binding aborted; ungrabbing keyboard";
-      XUngrabKeyboard(display_, CurrentTime);
+      UngrabKeyboard();
       in_progress_binding_ = NULL;
     }
     return;
@@ -555,8 +1323,7 @@ void XServer::HandleKeyPress(KeySym keysym,
   if (!binding->children.empty()) {
     if (!in_progress_binding_) {
       DEBUG << "Grabbing keyboard";
-      XGrabKeyboard(display_, root_, False, GrabModeAsync, GrabModeAsync,
-                    CurrentTime);
+      GrabKeyboard();
       // FIXME: Also grab the pointer and change the cursor?  It'd probably
       // make sense for a mouse click to also abort the keyboard grab.
     }
@@ -566,7 +1333,7 @@ void XServer::HandleKeyPress(KeySym keysym,
   } else {
     if (in_progress_binding_) {
       DEBUG << "Ungrabbing keyboard";
-      XUngrabKeyboard(display_, CurrentTime);
+      UngrabKeyboard();
       in_progress_binding_ = NULL;
     }
   }
@@ -576,4 +1343,16 @@ void XServer::HandleKeyPress(KeySym keysym,
   }
 }
 
+void XServer::GrabKeyboard() {
+  if (testing_) return;
+  XGrabKeyboard(display_, root_, False, GrabModeAsync, GrabModeAsync,
+                CurrentTime);
+}
+
+
+void XServer::UngrabKeyboard() {
+  if (testing_) return;
+  XUngrabKeyboard(display_, CurrentTime);
+}
+
 }  // namespace wham
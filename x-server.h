@@ -4,6 +4,7 @@
 #ifndef __X_SERVER_H__
 #define __X_SERVER_H__
 
+#include <deque>
 #include <map>
 #include <string>
 
@@ -14,7 +15,21 @@ extern "C" {
 }
 
 #include "command.h"
+#include "event-ingester.h"
+#include "event-loop.h"
+#include "event-stats.h"
+#include "event-trace.h"
+#include "event.h"
+#include "focus-manager.h"
+#include "idle-task-queue.h"
+#include "latency-monitor.h"
+#include "property-prefetcher.h"
+#include "property-worker.h"
+#include "request-tracker.h"
+#include "suppression-table.h"
+#include "thread-pool.h"
 #include "util.h"
+#include "x-window-index.h"
 #include "x-window.h"
 
 using namespace std;
@@ -75,20 +90,38 @@ class XServer {
   // Start reading events from the X server and handling them.
   void RunEventLoop(WindowManager* window_manager);
 
-  class TimeoutFunction {
-   public:
-    virtual ~TimeoutFunction() {}
-
-    virtual void operator()() = 0;
-  };
+  typedef EventLoop::TimeoutFunction TimeoutFunction;
+  typedef EventLoop::FdFunction FdFunction;
 
   // Run 'func' in 'timeout_sec', returning an ID that can be used to
   // cancel the timeout before it's executed.  Ownership of 'func' remains
   // with the caller.
-  uint RegisterTimeout(TimeoutFunction *func, double timeout_sec);
+  TimeoutId RegisterTimeout(TimeoutFunction *func, double timeout_sec) {
+    return event_loop_->RegisterTimeout(func, timeout_sec);
+  }
+
+  // Cancel a timeout.  Returns false if it's already run or been
+  // cancelled.
+  bool CancelTimeout(TimeoutId id) { return event_loop_->CancelTimeout(id); }
+
+  // Run 'func' from the event loop whenever 'fd' is readable.  This lets
+  // other subsystems (control sockets, inotify, signalfd, etc.) share the
+  // loop with the X connection.  Ownership of 'func' remains with the
+  // caller.
+  void WatchFd(int fd, FdFunction* func) { event_loop_->WatchFd(fd, func); }
+
+  // Stop watching a file descriptor previously passed to WatchFd().
+  void UnwatchFd(int fd) { event_loop_->UnwatchFd(fd); }
 
-  // Cancel a timeout.
-  void CancelTimeout(uint id);
+  // Run 'task' repeatedly whenever we have nothing else to do, until it
+  // says that it's done or is cancelled.  Idle work is done in slices of
+  // Config::idle_task_slice_ms, after which we check for events again.
+  // Ownership of 'task' remains with the caller.
+  IdleTaskId AddIdleTask(IdleTask* task) { return idle_tasks_.Add(task); }
+
+  // Cancel an idle task.  Returns false if it's already finished or been
+  // cancelled.
+  bool CancelIdleTask(IdleTaskId id) { return idle_tasks_.Cancel(id); }
 
   xcb_connection_t* xcb_conn() { return xcb_conn_; }
   const xcb_screen_t* xcb_screen() { return xcb_screen_; }
@@ -100,20 +133,354 @@ class XServer {
 
   void RegisterKeyBindings(const KeyBindings& bindings);
 
+  // Counts and handler latencies for the events that we've received.
+  const EventStats& event_stats() const { return event_stats_; }
+
+  // Round-trip times to the server, measured every
+  // Config::latency_ping_interval_ms.
+  const LatencyMonitor& latency_monitor() const { return latency_monitor_; }
+
+  // Are round trips to the server slow enough that we should avoid
+  // unnecessary requests?  See Config::high_latency_threshold_ms.
+  bool high_latency() const { return latency_monitor_.high_latency(); }
+
+  // Drop events of 'types' (a bitfield of SuppressionTable values)
+  // generated by the request that returned 'cookie'.  If 'window' isn't
+  // None, only events for that window are dropped.
+  void SuppressEvents(xcb_void_cookie_t cookie, ::Window window, uint types) {
+    suppression_table_.Add(cookie.sequence, window, types);
+  }
+
+  // Log an error if the request that returned 'cookie' fails, and run
+  // 'func' (if non-NULL) if it does.  Ownership of 'func' passes to us.
+  // See RequestTracker.
+  void TrackRequest(xcb_void_cookie_t cookie,
+                    const char* name,
+                    RequestTracker::ErrorFunction* func) {
+    request_tracker_.Track(cookie.sequence, name, func);
+  }
+
+  // Interface for code that should be run when the reply to a request
+  // arrives.
+  class ReplyFunction {
+   public:
+    virtual ~ReplyFunction() {}
+
+    // 'reply' is the request's reply (e.g. an xcb_get_property_reply_t),
+    // or NULL if the request failed.  It's freed after the call returns.
+    virtual void operator()(void* reply) = 0;
+  };
+
+  // Run 'func' once the reply to the request with sequence number
+  // 'sequence' arrives, instead of blocking until it does.  Replies are
+  // checked for at the start of each event batch and functions are run in
+  // the order in which their requests were sent.  The functions shouldn't
+  // hold on to pointers to windows, which may be gone by then.  Ownership
+  // of 'func' passes to us.
+  void AwaitReply(unsigned int sequence, ReplyFunction* func);
+
+  // Tracks and changes the input focus.
+  FocusManager* focus_manager() { return &focus_manager_; }
+
+  // Scope during which the requests that we make are buffered instead of
+  // being written to the server.  Every event batch and replayed event is
+  // handled inside of one.  Batches can be nested; when the outermost one
+  // ends, everything that's been requested since the last batch ended is
+  // flushed in a single write and counted in our stats.
+  class RequestBatch {
+   public:
+    explicit RequestBatch(XServer* x_server) : x_server_(x_server) {
+      CHECK(x_server_);
+      x_server_->BeginRequestBatch();
+    }
+    ~RequestBatch() { x_server_->EndRequestBatch(); }
+
+   private:
+    XServer* x_server_;
+
+    DISALLOW_EVIL_CONSTRUCTORS(RequestBatch);
+  };
+
+  // Are we currently inside of a RequestBatch?
+  bool in_request_batch() const { return request_batch_depth_ > 0; }
+
+  // Ask for the window with ID 'id' to have its pending geometry and
+  // stacking changes sent when the current request batch ends.  Windows
+  // are committed in the order in which they're queued; if 'move_to_back'
+  // is true and the window's already queued, it's moved to the back so
+  // that its restacking happens after that of the windows queued before.
+  void QueueConfigure(::Window id, bool move_to_back);
+
+  // Send the changes for all of the windows passed to QueueConfigure().
+  void CommitPendingConfigures();
+
+  // Atoms used for WM_TAKE_FOCUS messages.  These are None in testing
+  // mode.
+  xcb_atom_t wm_protocols_atom() const { return wm_protocols_atom_; }
+  xcb_atom_t wm_take_focus_atom() const { return wm_take_focus_atom_; }
+
+  // Start writing every event that we handle, along with the window
+  // geometry and properties that we fetch, to a trace at 'filename' that
+  // can be replayed later by EventReplayer.  Returns false on failure.
+  bool StartRecording(const string& filename);
+
+  // The writer for the trace that we're recording, or NULL.
+  EventTraceWriter* trace_writer() { return trace_writer_.get(); }
+
+  // The worker that fetches changed properties if
+  // Config::use_property_worker is set, or NULL.
+  PropertyWorker* property_worker() { return property_worker_.get(); }
+
+  // The pool for CPU-heavy work, or NULL if Config::num_pool_threads is
+  // 0.  Tasks' Finish() methods are run from the event loop.
+  ThreadPool* thread_pool() { return thread_pool_.get(); }
+
+  // Fetch the property described by 'type' for the window with ID 'id'
+  // the next time that we're idle, instead of right away.  Used in
+  // high-latency mode for properties that we don't display.  Requests
+  // that are already waiting are ignored.
+  void DeferPropertyUpdate(::Window id, WindowProperties::ChangeType type);
+
+  // If PrefetchProperties() requested the properties of the window with
+  // ID 'id', copy the cookies into 'cookies', forget about them, and
+  // return true.
+  bool TakePrefetchedProperties(::Window id,
+                                XWindow::PropertyCookies* cookies);
+
+  // Like TakePrefetchedProperties(), but for the geometry requests sent
+  // by PrefetchProperties() and AdoptExistingWindows().
+  bool TakePrefetchedGeometry(::Window id, xcb_get_geometry_cookie_t* cookie);
+
+  // If we already know the geometry of the window with ID 'id' from the
+  // events that we've seen since it was created, copy it into the
+  // out-params and return true.
+  bool TakeCreatedGeometry(::Window id,
+                           int* x,
+                           int* y,
+                           uint* width,
+                           uint* height) {
+    return property_prefetcher_.TakeGeometry(id, x, y, width, height);
+  }
+
+  // Get the object representing the window with ID 'id'.  If we don't
+  // know about the window yet, one is created (with its geometry fetched
+  // from the server) if 'create' is true; otherwise, NULL is returned.
+  XWindow* GetWindow(::Window id, bool create);
+
   // FIXME: clean this up
   static void SetTesting(bool testing) { testing_ = testing; }
   static bool Testing() { return testing_; }
 
  private:
   friend class ::XServerTestSuite;
+  friend class EventReplayer;
   friend class XWindow;
+  friend class XEventsFunction;
+  friend class StatsSignalFunction;
+  friend class PropertyResultsFunction;
+  friend class PoolCompletionsFunction;
+  friend class LatencyPingFunction;
+  friend class LatencyPingReplyFunction;
+  friend class DeferredPropertiesTask;
+  friend class RequestBatch;
+
+  // Maximum number of times that ProcessPendingEvents() checks for new
+  // events while it's handling deferred ones.
+  static const int kMaxDeferredEventChecks = 8;
+
+  // Reads and handles all pending events when the X connection is
+  // readable.
+  class XEventsFunction : public FdFunction {
+   public:
+    XEventsFunction(XServer* x_server, WindowManager* window_manager)
+        : x_server_(x_server),
+          window_manager_(window_manager) {
+      CHECK(x_server_);
+      CHECK(window_manager_);
+    }
+
+    void operator()(int fd);
+
+   private:
+    XServer* x_server_;
+    WindowManager* window_manager_;
+  };
+
+  // Logs our event stats when we receive SIGUSR1.
+  class StatsSignalFunction : public FdFunction {
+   public:
+    StatsSignalFunction(XServer* x_server) : x_server_(x_server) {
+      CHECK(x_server_);
+    }
+
+    void operator()(int fd);
+
+   private:
+    XServer* x_server_;
+  };
+
+  // Handles results from 'property_worker_' when they're available.
+  class PropertyResultsFunction : public FdFunction {
+   public:
+    PropertyResultsFunction(XServer* x_server) : x_server_(x_server) {
+      CHECK(x_server_);
+    }
+
+    void operator()(int fd);
+
+   private:
+    XServer* x_server_;
+  };
+
+  // Pass all of the results from 'property_worker_' to their windows.
+  void HandlePropertyWorkerResults();
+
+  // Finishes tasks from 'thread_pool_' when they're done.
+  class PoolCompletionsFunction : public FdFunction {
+   public:
+    PoolCompletionsFunction(XServer* x_server) : x_server_(x_server) {
+      CHECK(x_server_);
+    }
+
+    void operator()(int fd);
+
+   private:
+    XServer* x_server_;
+  };
+
+  // Pings the server every Config::latency_ping_interval_ms.
+  class LatencyPingFunction : public TimeoutFunction {
+   public:
+    LatencyPingFunction(XServer* x_server) : x_server_(x_server) {
+      CHECK(x_server_);
+    }
+
+    void operator()();
+
+   private:
+    XServer* x_server_;
+  };
+
+  // Handles the reply to a ping sent by SendLatencyPing().
+  class LatencyPingReplyFunction : public ReplyFunction {
+   public:
+    LatencyPingReplyFunction(XServer* x_server) : x_server_(x_server) {
+      CHECK(x_server_);
+    }
+
+    void operator()(void* reply);
+
+   private:
+    XServer* x_server_;
+  };
+
+  // Send a ping if the last one has been answered (or see how long it's
+  // been waiting if it hasn't), and schedule the next one.
+  void SendLatencyPing();
+
+  // Log a switch to or from high-latency mode and adjust our timers.
+  void HandleLatencyModeChange();
+
+  // Fetches the properties passed to DeferPropertyUpdate() when we're
+  // idle.
+  class DeferredPropertiesTask : public IdleTask {
+   public:
+    DeferredPropertiesTask(XServer* x_server) : x_server_(x_server) {
+      CHECK(x_server_);
+    }
+
+    bool operator()();
+
+   private:
+    XServer* x_server_;
+  };
+
+  // Fetch the oldest property from 'deferred_properties_'.  Returns true
+  // if there are more to fetch.
+  bool FetchDeferredProperty();
+
+  // Create and index an object for the window with ID 'id', which we
+  // must not already know about.  Its geometry isn't initialized.
+  XWindow* CreateWindowObject(::Window id);
 
-  XWindow* GetWindow(::Window id, bool create);
   void DeleteWindow(::Window id);
 
-  // Read the next event (or possibly more than one, in the case of expose
-  // events) and handle it.
-  void ProcessEvent(WindowManager* window_manager);
+  // Read all pending events into a batch, coalesce redundant events
+  // within it, and pass the remaining ones to ProcessEvent(), handling
+  // input and structural changes before deferrable events.
+  void ProcessPendingEvents(WindowManager* window_manager);
+
+  // Read all events that are available without blocking, decode them, and
+  // append the ones that we want to handle to 'events'.  Returns true if
+  // any events were appended.
+  bool ReadPendingEvents(vector<Event>* events);
+
+  // Expire old suppressions and tracked requests using 'xcb_event''s
+  // sequence number, decode it, and append it to 'events' unless it's
+  // uninteresting or suppressed.
+  void ReadEvent(const xcb_generic_event_t& xcb_event, vector<Event>* events);
+
+  // Send requests for the properties of all of the windows that are
+  // asking to be mapped in 'events' that we aren't managing yet (and for
+  // the geometry of those that we haven't seen before), so that the
+  // replies for all of them can arrive in a single round trip.
+  void PrefetchProperties(const vector<Event>& events);
+
+  // Should PropertyPrefetcher start fetching the properties of the window
+  // with ID 'id', which was just created?  We skip windows that we
+  // already know about and ones whose MapRequest came in the same batch,
+  // since PrefetchProperties() has already requested their properties.
+  bool ShouldPrefetchOnCreate(::Window id);
+
+  // Discard any prefetched properties (and geometry) that weren't used.
+  void DiscardPrefetchedProperties();
+
+  // Start managing the windows that were already mapped when we started.
+  // The attributes, geometry and properties of all of the root window's
+  // children are requested at once, and the viewable ones are then
+  // handled as if they had just sent us MapRequest events.
+  void AdoptExistingWindows(WindowManager* window_manager);
+
+  // Run the functions passed to AwaitReply() for all of the replies that
+  // have arrived.
+  void RunReplyFunctions();
+
+  // Run a slice of idle tasks if nothing else is ready.  Returns false if
+  // there were no idle tasks to run.
+  bool RunIdleTasks();
+
+  // Called by RequestBatch.  Ending the outermost batch flushes our
+  // requests.
+  void BeginRequestBatch() { request_batch_depth_++; }
+  void EndRequestBatch();
+
+  // Wire format of the DAMAGE extension's DamageNotify event.  This
+  // mirrors xcb_damage_notify_event_t, but libxcb-damage is broken on some
+  // of the systems that we run on, so we don't use it.
+  struct DamageNotifyEvent {
+    uint8_t response_type;
+    uint8_t level;
+    uint16_t sequence;
+    uint32_t drawable;
+    uint32_t damage;
+    uint32_t timestamp;
+    int16_t area_x, area_y;
+    uint16_t area_width, area_height;
+    int16_t geometry_x, geometry_y;
+    uint16_t geometry_width, geometry_height;
+  };
+
+  // Decode an event (or error) read from XCB into 'event'.  Returns false
+  // for events that we don't care about and for errors, which are passed
+  // to 'request_tracker_'.
+  bool DecodeEvent(const xcb_generic_event_t& xcb_event, Event* event);
+
+  // Pass a decoded event to ProcessEvent(), recording it in our stats
+  // and in the trace (if we're recording one).
+  void HandleEvent(const Event& event, WindowManager* window_manager);
+
+  // Handle a single decoded event.
+  void ProcessEvent(const Event& event, WindowManager* window_manager);
 
   // Convert a vector containing string representations of modifiers keys
   // into a bitmap consisting of the corresponding X modifier masks.
@@ -130,6 +497,11 @@ class XServer {
 
   void HandleKeyPress(KeySym keysym, uint mods, WindowManager* window_manager);
 
+  // Grab or ungrab the keyboard while a multi-key binding is in progress.
+  // These do nothing in testing mode.
+  void GrabKeyboard();
+  void UngrabKeyboard();
+
   xcb_connection_t* xcb_conn_;
   xcb_screen_t* xcb_screen_;
 
@@ -148,8 +520,22 @@ class XServer {
 
   bool initialized_;
 
-  typedef map< ::Window, ref_ptr<XWindow> > XWindowMap;
-  XWindowMap windows_;
+  XWindowIndex windows_;
+
+  FocusManager focus_manager_;
+
+  // Events caused by our own requests that should be dropped.
+  SuppressionTable suppression_table_;
+
+  // Requests whose errors we want to hear about.
+  RequestTracker request_tracker_;
+
+  // Fetches the properties of new top-level windows before they're
+  // mapped.
+  PropertyPrefetcher property_prefetcher_;
+
+  xcb_atom_t wm_protocols_atom_;
+  xcb_atom_t wm_take_focus_atom_;
 
   XKeyBindingMap bindings_;
   XKeyBinding* in_progress_binding_;
@@ -159,34 +545,75 @@ class XServer {
 
   static bool testing_;
 
-  // Simple struct representing a timeout.  Doesn't take ownership of
-  // 'func'.
-  struct Timeout {
-    Timeout(int id, TimeoutFunction* func, double time)
-        : id(id),
-          func(func),
-          time(time) {
-    }
+  // Events read by the current call to ProcessPendingEvents().  This is a
+  // member so that its storage is reused from batch to batch.
+  vector<Event> event_batch_;
 
-    ~Timeout() {
-      func = NULL;
-    }
+  // Deferrable events from the current batch (see
+  // SplitDeferrableEvents()), handled after the rest of the batch.
+  vector<Event> deferred_events_;
 
-    // Used for ordering objects in a heap, so we say that this timeout is
-    // less than 'o' if the time at which is should be executed is *after*
-    // that of 'o'.
-    bool operator<(const Timeout& o) const {
-      return time > o.time;
-    }
+  // Property requests sent by PrefetchProperties() for the current batch,
+  // keyed by window ID.  There are only ever a few of these, so a vector
+  // is cheaper than a map.
+  vector<pair< ::Window, XWindow::PropertyCookies> > prefetched_properties_;
 
-    uint id;
-    TimeoutFunction* func;
-    double time;
+  // Geometry requests sent by PrefetchProperties() and
+  // AdoptExistingWindows(), keyed by window ID.
+  vector<pair< ::Window, xcb_get_geometry_cookie_t> > prefetched_geometry_;
+
+  // Functions passed to AwaitReply() that are waiting for their replies,
+  // oldest first.
+  struct AwaitedReply {
+    unsigned int sequence;
+    ref_ptr<ReplyFunction> func;
   };
+  deque<AwaitedReply> awaited_replies_;
+
+  // Number of RequestBatch objects that currently exist.
+  int request_batch_depth_;
+
+  // IDs of windows with changes that will be sent when the current
+  // request batch ends, in the order in which they should be sent.
+  vector< ::Window> queued_configures_;
+
+  // Sequence number that the first request after the last flush got (or
+  // will get), used to count the requests in each batch.
+  unsigned long first_unflushed_request_;
+
+  // Number of times that the outermost RequestBatch has ended.
+  uint64_t num_request_batches_;
+
+  EventStats event_stats_;
+
+  LatencyMonitor latency_monitor_;
+  LatencyPingFunction latency_ping_func_;
+
+  // Properties passed to DeferPropertyUpdate() that haven't been fetched
+  // yet, oldest first, and the ID of the idle task that fetches them (0
+  // if it isn't queued).
+  deque<pair< ::Window, WindowProperties::ChangeType> > deferred_properties_;
+  DeferredPropertiesTask deferred_properties_task_;
+  IdleTaskId deferred_properties_task_id_;
+
+  // Set while we're recording a trace.
+  ref_ptr<EventTraceWriter> trace_writer_;
+
+  // Reads events on another thread if Config::use_event_ingestion_thread
+  // is set.  This is never deleted; see EventIngester.
+  EventIngester* event_ingester_;
+
+  // Fetches changed properties on another thread if
+  // Config::use_property_worker is set.
+  ref_ptr<PropertyWorker> property_worker_;
+
+  // Runs CPU-heavy work if Config::num_pool_threads is non-zero.
+  ref_ptr<ThreadPool> thread_pool_;
 
-  uint next_timeout_id_;
+  // Loop that we use to wait for X events and timeouts.
+  ref_ptr<EventLoop> event_loop_;
 
-  vector<Timeout> timeout_heap_;
+  IdleTaskQueue idle_tasks_;
 
   DISALLOW_EVIL_CONSTRUCTORS(XServer);
 };
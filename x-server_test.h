@@ -3,8 +3,14 @@
 
 #include <cxxtest/TestSuite.h>
 
+extern "C" {
+#include <X11/Xatom.h>
+#include <X11/extensions/Xdamage.h>
+}
+
 #include "command.h"
 #include "key-bindings.h"
+#include "event.h"
 #include "util.h"
 #include "x-server.h"
 
@@ -86,6 +92,169 @@ class XServerTestSuite : public CxxTest::TestSuite {
     }
   }
 
+  void testDecodeEvent() {
+    XServer x_server;
+    x_server.damage_event_base_ = 90;
+    x_server.root_ = 0x1;
+    Event event;
+
+    xcb_button_press_event_t button;
+    memset(&button, 0, sizeof(button));
+    button.response_type = XCB_BUTTON_PRESS;
+    button.event = 0x10;
+    button.root_x = 100;
+    button.root_y = 200;
+    button.detail = 3;
+    TS_ASSERT(x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(button), &event));
+    TS_ASSERT_EQUALS(event.type, Event::BUTTON_PRESS);
+    TS_ASSERT_EQUALS(event.window, 0x10U);
+    TS_ASSERT_EQUALS(event.x, 100);
+    TS_ASSERT_EQUALS(event.y, 200);
+    TS_ASSERT_EQUALS(event.detail, 3U);
+
+    // Events sent by other clients have the high bit set.
+    xcb_property_notify_event_t property;
+    memset(&property, 0, sizeof(property));
+    property.response_type = XCB_PROPERTY_NOTIFY | 0x80;
+    property.window = 0x20;
+    property.atom = XA_WM_NAME;
+    property.state = XCB_PROPERTY_NEW_VALUE;
+    TS_ASSERT(x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(property), &event));
+    TS_ASSERT_EQUALS(event.type, Event::PROPERTY_NOTIFY);
+    TS_ASSERT_EQUALS(event.window, 0x20U);
+    TS_ASSERT_EQUALS(event.detail, static_cast<uint>(XA_WM_NAME));
+    TS_ASSERT_EQUALS(event.state, static_cast<uint>(PropertyNewValue));
+
+    XServer::DamageNotifyEvent damage;
+    memset(&damage, 0, sizeof(damage));
+    TS_ASSERT_EQUALS(sizeof(damage), 32U);
+    damage.response_type = 90 + XDamageNotify;
+    damage.drawable = 0x30;
+    damage.damage = 0x31;
+    TS_ASSERT(x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(damage), &event));
+    TS_ASSERT_EQUALS(event.type, Event::DAMAGE_NOTIFY);
+    TS_ASSERT_EQUALS(event.window, 0x30U);
+    TS_ASSERT_EQUALS(event.detail, 0x31U);
+
+    // Errors and events that we don't care about should be dropped.
+    xcb_generic_error_t error;
+    memset(&error, 0, sizeof(error));
+    error.response_type = 0;
+    error.error_code = XCB_WINDOW;
+    TS_ASSERT(!x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(error), &event));
+
+    xcb_reparent_notify_event_t reparent;
+    memset(&reparent, 0, sizeof(reparent));
+    reparent.response_type = XCB_REPARENT_NOTIFY;
+    TS_ASSERT(!x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(reparent), &event));
+
+    // ConfigureNotify events carry the window's new geometry, unless
+    // they were sent by another client.
+    xcb_configure_notify_event_t configure;
+    memset(&configure, 0, sizeof(configure));
+    configure.response_type = XCB_CONFIGURE_NOTIFY;
+    configure.window = 0x40;
+    configure.x = -5;
+    configure.y = 10;
+    configure.width = 300;
+    configure.height = 200;
+    TS_ASSERT(x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(configure), &event));
+    TS_ASSERT_EQUALS(event.type, Event::CONFIGURE_NOTIFY);
+    TS_ASSERT_EQUALS(event.window, 0x40U);
+    TS_ASSERT_EQUALS(event.x, -5);
+    TS_ASSERT_EQUALS(event.y, 10);
+    TS_ASSERT_EQUALS(event.detail, 300U);
+    TS_ASSERT_EQUALS(event.state, 200U);
+    configure.response_type |= 0x80;
+    TS_ASSERT(!x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(configure), &event));
+
+    // CreateNotify is only interesting for top-level windows that will
+    // ask to be mapped.
+    xcb_create_notify_event_t create;
+    memset(&create, 0, sizeof(create));
+    create.response_type = XCB_CREATE_NOTIFY;
+    create.parent = x_server.root();
+    create.window = 0x50;
+    create.width = 80;
+    create.height = 60;
+    TS_ASSERT(x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(create), &event));
+    TS_ASSERT_EQUALS(event.type, Event::CREATE_NOTIFY);
+    TS_ASSERT_EQUALS(event.window, 0x50U);
+    TS_ASSERT_EQUALS(event.detail, 80U);
+    TS_ASSERT_EQUALS(event.state, 60U);
+    create.override_redirect = 1;
+    TS_ASSERT(!x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(create), &event));
+    create.override_redirect = 0;
+    create.parent = 0x51;
+    TS_ASSERT(!x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(create), &event));
+
+    // Unmaps reported to the parent should be ignored, since we hear
+    // about client windows' unmaps directly.
+    xcb_unmap_notify_event_t unmap;
+    memset(&unmap, 0, sizeof(unmap));
+    unmap.response_type = XCB_UNMAP_NOTIFY;
+    unmap.event = 0x60;
+    unmap.window = 0x60;
+    TS_ASSERT(x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(unmap), &event));
+    TS_ASSERT_EQUALS(event.type, Event::UNMAP_NOTIFY);
+    unmap.event = 0x61;
+    TS_ASSERT(!x_server.DecodeEvent(
+        reinterpret_cast<const xcb_generic_event_t&>(unmap), &event));
+  }
+
+  void testRequestBatch() {
+    XServer::SetupTesting();
+    XServer* x_server = XServer::Get();
+    uint64_t num_batches = x_server->num_request_batches_;
+    TS_ASSERT(!x_server->in_request_batch());
+
+    // Only the outermost batch should be counted (and flushed).
+    {
+      XServer::RequestBatch outer(x_server);
+      {
+        XServer::RequestBatch inner(x_server);
+        TS_ASSERT(x_server->in_request_batch());
+      }
+      TS_ASSERT(x_server->in_request_batch());
+      TS_ASSERT_EQUALS(x_server->num_request_batches_, num_batches);
+    }
+    TS_ASSERT(!x_server->in_request_batch());
+    TS_ASSERT_EQUALS(x_server->num_request_batches_, num_batches + 1);
+  }
+
+  void testCreateAndMapInSameBatch() {
+    XServer::SetupTesting();
+    XServer* x_server = XServer::Get();
+    const ::Window kId = 0x1234;
+    TS_ASSERT(x_server->ShouldPrefetchOnCreate(kId));
+
+    // If the window's MapRequest is in the same batch as its
+    // CreateNotify, PrefetchProperties() will have already requested its
+    // properties, so we shouldn't ask for them again...
+    XWindow::PropertyCookies cookies;
+    cookies.name.sequence = 10;
+    x_server->prefetched_properties_.push_back(make_pair(kId, cookies));
+    TS_ASSERT(!x_server->ShouldPrefetchOnCreate(kId));
+    TS_ASSERT(x_server->ShouldPrefetchOnCreate(kId + 1));
+
+    // ...and the MapRequest handler should get the original requests.
+    XWindow::PropertyCookies taken;
+    TS_ASSERT(x_server->TakePrefetchedProperties(kId, &taken));
+    TS_ASSERT_EQUALS(taken.name.sequence, 10U);
+    TS_ASSERT(x_server->prefetched_properties_.empty());
+  }
+
   static const XKeyBinding* GetBinding(
       const XServer::XKeyBindingMap& binding_map, KeySym keysym, uint mods) {
     XServer::XKeyCombo combo = make_pair(keysym, mods);
@@ -0,0 +1,102 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include "x-window-index.h"
+
+#include "x-window.h"
+
+namespace wham {
+
+const size_t XWindowIndex::kMinSlots = 16;
+
+
+XWindowIndex::XWindowIndex()
+    : slots_(),
+      mask_(0),
+      shift_(32),
+      num_windows_(0) {
+}
+
+
+XWindowIndex::~XWindowIndex() {
+  Clear();
+}
+
+
+void XWindowIndex::Insert(::Window id, ref_ptr<XWindow> window) {
+  CHECK(id != None);
+  CHECK(window.get());
+
+  // Keep the table at most half full so that probe sequences stay short.
+  if (2 * (num_windows_ + 1) > slots_.size()) {
+    Resize(slots_.empty() ? kMinSlots : 2 * slots_.size());
+  }
+
+  size_t i = GetHomeSlot(id);
+  while (slots_[i].id != None) {
+    CHECK(slots_[i].id != id);
+    i = (i + 1) & mask_;
+  }
+  slots_[i].id = id;
+  slots_[i].window = window;
+  num_windows_++;
+}
+
+
+bool XWindowIndex::Erase(::Window id) {
+  if (slots_.empty()) return false;
+
+  size_t i = GetHomeSlot(id);
+  while (slots_[i].id != id) {
+    if (slots_[i].id == None) return false;
+    i = (i + 1) & mask_;
+  }
+
+  // Shift later entries in the same cluster back into the hole, so that
+  // we don't need tombstones.  An entry can fill the hole only if the
+  // hole lies between its home slot and its current slot.
+  for (size_t j = (i + 1) & mask_; slots_[j].id != None; j = (j + 1) & mask_) {
+    size_t home = GetHomeSlot(slots_[j].id);
+    if (((j - home) & mask_) >= ((j - i) & mask_)) {
+      slots_[i].id = slots_[j].id;
+      slots_[i].window = slots_[j].window;
+      i = j;
+    }
+  }
+  slots_[i].id = None;
+  slots_[i].window.reset();
+  num_windows_--;
+  return true;
+}
+
+
+void XWindowIndex::Clear() {
+  slots_.clear();
+  mask_ = 0;
+  shift_ = 32;
+  num_windows_ = 0;
+}
+
+
+void XWindowIndex::Resize(size_t num_slots) {
+  CHECK(num_slots >= kMinSlots);
+  CHECK_EQ(num_slots & (num_slots - 1), 0U);
+  CHECK(num_slots > num_windows_);
+
+  vector<Slot> old_slots(num_slots);
+  old_slots.swap(slots_);
+  mask_ = num_slots - 1;
+  shift_ = 32;
+  for (size_t n = num_slots; n > 1; n >>= 1) shift_--;
+
+  for (vector<Slot>::const_iterator it = old_slots.begin();
+       it != old_slots.end(); ++it) {
+    if (it->id == None) continue;
+    size_t i = GetHomeSlot(it->id);
+    while (slots_[i].id != None) i = (i + 1) & mask_;
+    slots_[i].id = it->id;
+    slots_[i].window = it->window;
+  }
+}
+
+}  // namespace wham
@@ -0,0 +1,101 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#ifndef __X_WINDOW_INDEX_H__
+#define __X_WINDOW_INDEX_H__
+
+#include <vector>
+
+extern "C" {
+#include <X11/Xlib.h>
+}
+
+#include "util.h"
+
+using namespace std;
+
+class XWindowIndexTestSuite;  // from x-window-index_test.h
+
+namespace wham {
+
+class XWindow;
+
+// Maps X window IDs to the XWindow objects that represent them.  Every
+// event that we receive needs to be resolved to an XWindow, so this is an
+// open-addressing hash table (linear probing with backward-shift deletion
+// and a power-of-two capacity) rather than a std::map: a lookup usually
+// touches a single slot of a flat array.  Combined with the role that's
+// stored in each XWindow, this lets us figure out whether an event is for
+// a client window, a frame, or an anchor titlebar with one probe.
+class XWindowIndex {
+ public:
+  XWindowIndex();
+  ~XWindowIndex();
+
+  // Number of windows in the index.
+  size_t size() const { return num_windows_; }
+  bool empty() const { return num_windows_ == 0; }
+
+  // Get the window with ID 'id', or NULL if it isn't present.
+  XWindow* Find(::Window id) const {
+    if (slots_.empty()) return NULL;
+    for (size_t i = GetHomeSlot(id); ; i = (i + 1) & mask_) {
+      const Slot& slot = slots_[i];
+      if (slot.id == id) return slot.window.get();
+      if (slot.id == None) return NULL;
+    }
+  }
+
+  // Add 'window' under 'id', which must not already be present.
+  void Insert(::Window id, ref_ptr<XWindow> window);
+
+  // Remove the window with ID 'id', dropping our reference to it.
+  // Returns false if it wasn't present.
+  bool Erase(::Window id);
+
+  // Remove all windows.
+  void Clear();
+
+ private:
+  friend class ::XWindowIndexTestSuite;
+
+  struct Slot {
+    Slot() : id(None), window() {}
+
+    // None for empty slots.
+    ::Window id;
+    ref_ptr<XWindow> window;
+  };
+
+  // Smallest number of slots that we'll allocate.
+  static const size_t kMinSlots;
+
+  // Get the slot where a search for 'id' should start.  Window IDs are
+  // allocated sequentially within each client's ID range, so we use
+  // Fibonacci hashing to spread them out instead of just masking off the
+  // low bits.
+  size_t GetHomeSlot(::Window id) const {
+    return (static_cast<uint>(id) * 2654435769U) >> shift_;
+  }
+
+  // Reallocate the table with 'num_slots' slots (a power of two) and
+  // reinsert all of the existing windows.
+  void Resize(size_t num_slots);
+
+  vector<Slot> slots_;
+
+  // slots_.size() - 1.
+  size_t mask_;
+
+  // Number of bits to shift the 32-bit product in GetHomeSlot() right by
+  // so that log2(slots_.size()) bits remain.
+  int shift_;
+
+  size_t num_windows_;
+
+  DISALLOW_EVIL_CONSTRUCTORS(XWindowIndex);
+};
+
+}  // namespace wham
+
+#endif
@@ -0,0 +1,164 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+//
+// Compares the cost of resolving an event's window ID to the object that
+// should handle it using XWindowIndex and window roles against the lookups
+// that XServer and WindowManager did previously: a std::map from IDs to
+// XWindows, a scan over every desktop to see if the window is an anchor
+// titlebar, and then a lookup in the client or frame map.  The workload
+// has 10,000 managed windows spread across 50 desktops.
+//
+// Creating the windows logs a lot, so run this with stderr redirected:
+//
+//   ./x-window-index_bench 2>/dev/null
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "anchor.h"
+#include "desktop.h"
+#include "util.h"
+#include "window.h"
+#include "x-server.h"
+#include "x-window.h"
+
+using namespace std;
+using namespace wham;
+
+static const int kNumDesktops = 50;
+static const int kAnchorsPerDesktop = 4;
+static const int kNumWindows = 10000;
+
+// Number of events to resolve in each run.
+static const int kNumEvents = 2000000;
+
+
+// The containers that were previously used to resolve events.
+struct OldMaps {
+  map< ::Window, XWindow*> xwindows;
+  map<XWindow*, wham::Window*> windows;
+  map<const XWindow*, wham::Window*> frames;
+};
+
+
+// Look up 'id' the way that XServer::ProcessEvent() and
+// WindowManager::HandleEnterWindow() / HandleExposeWindow() used to,
+// returning a value that depends on what was found.
+static long ResolveOld(::Window id,
+                       const OldMaps& maps,
+                       const vector<Desktop*>& desktops,
+                       Desktop* active_desktop) {
+  XWindow* xwin = FindWithDefault(
+      maps.xwindows, id, static_cast<XWindow*>(NULL));
+  if (!xwin) return 0;
+
+  bool is_titlebar = false;
+  for (vector<Desktop*>::const_iterator desktop = desktops.begin();
+       desktop != desktops.end(); ++desktop) {
+    if ((*desktop)->IsTitlebarWindow(xwin)) {
+      is_titlebar = true;
+      break;
+    }
+  }
+  if (is_titlebar) {
+    return reinterpret_cast<long>(active_desktop->GetAnchorByTitlebar(xwin));
+  }
+
+  wham::Window* window =
+      FindWithDefault(maps.windows, xwin, static_cast<wham::Window*>(NULL));
+  if (window) return reinterpret_cast<long>(window);
+  window = FindWithDefault(maps.frames, static_cast<const XWindow*>(xwin),
+                           static_cast<wham::Window*>(NULL));
+  return reinterpret_cast<long>(window);
+}
+
+
+// Look up 'id' using the index and the window's role.
+static long ResolveNew(::Window id, Desktop* active_desktop) {
+  XWindow* xwin = XServer::Get()->GetWindow(id, false);
+  if (!xwin) return 0;
+
+  switch (xwin->role()) {
+    case XWindow::ROLE_TITLEBAR: {
+      Anchor* anchor = xwin->titlebar_anchor();
+      return anchor->desktop() == active_desktop ?
+             reinterpret_cast<long>(anchor) : 0;
+    }
+    case XWindow::ROLE_CLIENT:
+      return reinterpret_cast<long>(xwin->client_window());
+    case XWindow::ROLE_FRAME:
+      return reinterpret_cast<long>(xwin->frame_window());
+    default:
+      return 0;
+  }
+}
+
+
+int main(int argc, char** argv) {
+  XServer::SetupTesting();
+
+  vector<ref_ptr<Desktop> > desktops;
+  vector<Desktop*> desktop_ptrs;
+  vector< ::Window> ids;
+  OldMaps maps;
+
+  for (int i = 0; i < kNumDesktops; ++i) {
+    ref_ptr<Desktop> desktop(new Desktop);
+    for (int j = 0; j < kAnchorsPerDesktop; ++j) {
+      Anchor* anchor = desktop->CreateAnchor("bench", 100 * j, 100 * j);
+      XWindow* titlebar = anchor->titlebar();
+      maps.xwindows[titlebar->id()] = titlebar;
+      ids.push_back(titlebar->id());
+    }
+    desktops.push_back(desktop);
+    desktop_ptrs.push_back(desktop.get());
+  }
+
+  vector<ref_ptr<wham::Window> > windows;
+  for (int i = 0; i < kNumWindows; ++i) {
+    XWindow* xwin = XWindow::Create(0, 0, 640, 480);
+    ref_ptr<wham::Window> window(new wham::Window(xwin));
+    desktops[i % kNumDesktops]->AddWindow(window.get());
+    windows.push_back(window);
+
+    maps.xwindows[xwin->id()] = xwin;
+    maps.windows[xwin] = window.get();
+    maps.xwindows[window->frame()->id()] = window->frame();
+    maps.frames[window->frame()] = window.get();
+    ids.push_back(xwin->id());
+    ids.push_back(window->frame()->id());
+  }
+
+  Desktop* active_desktop = desktops[0].get();
+
+  // Pick the windows that events will be for ahead of time so that both
+  // runs see the same sequence.
+  srand(1);
+  vector< ::Window> event_ids(kNumEvents);
+  for (int i = 0; i < kNumEvents; ++i)
+    event_ids[i] = ids[rand() % ids.size()];
+
+  double start = GetMonotonicTime();
+  long old_sum = 0;
+  for (int i = 0; i < kNumEvents; ++i)
+    old_sum += ResolveOld(event_ids[i], maps, desktop_ptrs, active_desktop);
+  double old_elapsed = GetMonotonicTime() - start;
+
+  start = GetMonotonicTime();
+  long new_sum = 0;
+  for (int i = 0; i < kNumEvents; ++i)
+    new_sum += ResolveNew(event_ids[i], active_desktop);
+  double new_elapsed = GetMonotonicTime() - start;
+
+  CHECK_EQ(old_sum, new_sum);
+
+  printf("windows=%d desktops=%d events=%d\n",
+         kNumWindows, kNumDesktops, kNumEvents);
+  printf("old   total=%.3fs per-event=%.1fns\n",
+         old_elapsed, 1e9 * old_elapsed / kNumEvents);
+  printf("index total=%.3fs per-event=%.1fns\n",
+         new_elapsed, 1e9 * new_elapsed / kNumEvents);
+  return 0;
+}
@@ -0,0 +1,126 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "x-window-index.h"
+
+#include "mock-x-window.h"
+#include "util.h"
+#include "x-server.h"
+
+using namespace wham;
+
+class XWindowIndexTestSuite : public CxxTest::TestSuite {
+ public:
+  // Keeps track of how many instances are alive.
+  class CountedXWindow : public MockXWindow {
+   public:
+    CountedXWindow(::Window id) : MockXWindow(id) { num_instances++; }
+    ~CountedXWindow() { num_instances--; }
+    static int num_instances;
+  };
+
+  void setUp() {
+    XServer::SetupTesting();
+    CountedXWindow::num_instances = 0;
+  }
+
+  static ref_ptr<XWindow> MakeWindow(::Window id) {
+    return ref_ptr<XWindow>(new CountedXWindow(id));
+  }
+
+  // Check that every occupied slot can be reached by probing from its
+  // home slot without crossing an empty slot.
+  static bool ProbeSequencesIntact(const XWindowIndex& index) {
+    for (size_t i = 0; i < index.slots_.size(); ++i) {
+      ::Window id = index.slots_[i].id;
+      if (id == None) continue;
+      for (size_t j = index.GetHomeSlot(id); j != i;
+           j = (j + 1) & index.mask_) {
+        if (index.slots_[j].id == None) return false;
+      }
+    }
+    return true;
+  }
+
+  void testBasic() {
+    XWindowIndex index;
+    TS_ASSERT(index.empty());
+    TS_ASSERT(index.Find(1) == NULL);
+    TS_ASSERT(!index.Erase(1));
+
+    ref_ptr<XWindow> win1 = MakeWindow(1);
+    ref_ptr<XWindow> win2 = MakeWindow(0x400001);
+    index.Insert(win1->id(), win1);
+    index.Insert(win2->id(), win2);
+    TS_ASSERT_EQUALS(index.size(), 2U);
+    TS_ASSERT_EQUALS(index.Find(1), win1.get());
+    TS_ASSERT_EQUALS(index.Find(0x400001), win2.get());
+    TS_ASSERT(index.Find(2) == NULL);
+
+    TS_ASSERT(index.Erase(1));
+    TS_ASSERT(index.Find(1) == NULL);
+    TS_ASSERT_EQUALS(index.Find(0x400001), win2.get());
+    TS_ASSERT_EQUALS(index.size(), 1U);
+  }
+
+  void testManyWindows() {
+    XWindowIndex index;
+
+    // Use IDs from a few different clients' ranges, like we'd see from a
+    // real server.
+    vector< ::Window> ids;
+    for (::Window client = 1; client <= 8; ++client) {
+      for (::Window i = 1; i <= 500; ++i) ids.push_back((client << 21) | i);
+    }
+    for (size_t i = 0; i < ids.size(); ++i)
+      index.Insert(ids[i], MakeWindow(ids[i]));
+    TS_ASSERT_EQUALS(index.size(), ids.size());
+    TS_ASSERT_EQUALS(CountedXWindow::num_instances,
+                     static_cast<int>(ids.size()));
+    TS_ASSERT(ProbeSequencesIntact(index));
+
+    // Erase every third window and check that the rest are still
+    // reachable.
+    for (size_t i = 0; i < ids.size(); i += 3) TS_ASSERT(index.Erase(ids[i]));
+    TS_ASSERT(ProbeSequencesIntact(index));
+    for (size_t i = 0; i < ids.size(); ++i) {
+      XWindow* xwin = index.Find(ids[i]);
+      if (i % 3 == 0) {
+        TS_ASSERT(xwin == NULL);
+      } else {
+        TS_ASSERT(xwin != NULL);
+        if (xwin) TS_ASSERT_EQUALS(xwin->id(), ids[i]);
+      }
+    }
+
+    // Dropping the windows from the index should've deleted them.
+    int num_left = static_cast<int>(index.size());
+    TS_ASSERT_EQUALS(CountedXWindow::num_instances, num_left);
+    index.Clear();
+    TS_ASSERT_EQUALS(CountedXWindow::num_instances, 0);
+  }
+
+  void testReinsert() {
+    // Repeatedly add and remove windows so that clusters get shifted
+    // around.
+    XWindowIndex index;
+    for (::Window id = 1; id <= 200; ++id) index.Insert(id, MakeWindow(id));
+    for (int round = 0; round < 5; ++round) {
+      for (::Window id = 1; id <= 200; id += 2) TS_ASSERT(index.Erase(id));
+      for (::Window id = 1; id <= 200; id += 2)
+        index.Insert(id, MakeWindow(id));
+      TS_ASSERT(ProbeSequencesIntact(index));
+    }
+    for (::Window id = 1; id <= 200; ++id) {
+      XWindow* xwin = index.Find(id);
+      TS_ASSERT(xwin != NULL);
+      if (xwin) TS_ASSERT_EQUALS(xwin->id(), id);
+    }
+    TS_ASSERT_EQUALS(index.size(), 200U);
+    TS_ASSERT_EQUALS(CountedXWindow::num_instances, 200);
+  }
+};
+
+int XWindowIndexTestSuite::CountedXWindow::num_instances = 0;
@@ -3,13 +3,18 @@
 
 #include "x-window.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <X11/Xatom.h>
 #include <xcb/xcb_atom.h>
 #include <xcb/xcb_icccm.h>
 
+#include "event-trace.h"
 #include "mock-x-window.h"
+#include "property-worker.h"
 #include "util.h"
+#include "window.h"
 #include "x-server.h"
 
 using namespace std;
@@ -18,7 +23,8 @@ namespace wham {
 
 // X input mask for client windows that we're managing.
 static const uint kClientInputMask =
-    EnterWindowMask | PropertyChangeMask | StructureNotifyMask;
+    EnterWindowMask | FocusChangeMask | PropertyChangeMask |
+    StructureNotifyMask;
 
 // X input mask for windows that are created via the Create() method.
 static const uint kCreateInputMask =
@@ -26,44 +32,135 @@ static const uint kCreateInputMask =
     ExposureMask | PointerMotionMask;
 
 
+// Tells the FocusManager when we fail to focus a window (usually because
+// it was unmapped before the request reached the server).
+class FocusErrorFunction : public RequestTracker::ErrorFunction {
+ public:
+  explicit FocusErrorFunction(::Window id) : id_(id) {}
+
+  void operator()(const xcb_generic_error_t& error) {
+    XServer::Get()->focus_manager()->HandleFocusFailed(id_);
+  }
+
+ private:
+  ::Window id_;
+};
+
+
+// Passes the reply to a request sent by XWindow::RequestPropertyUpdate()
+// to the window, if it still exists.
+class PropertyReplyFunction : public XServer::ReplyFunction {
+ public:
+  PropertyReplyFunction(::Window id, WindowProperties::ChangeType type)
+      : id_(id),
+        type_(type) {}
+
+  void operator()(void* reply) {
+    XWindow* xwin = XServer::Get()->GetWindow(id_, false);
+    if (!xwin) return;
+    xwin->HandlePropertyReply(
+        type_, static_cast<const xcb_get_property_reply_t*>(reply));
+  }
+
+ private:
+  ::Window id_;
+  WindowProperties::ChangeType type_;
+};
+
+
+PendingConfigure::PendingConfigure()
+    : mask_(0),
+      x_(0),
+      y_(0),
+      width_(0),
+      height_(0),
+      border_width_(0),
+      sibling_(None),
+      stack_mode_(XCB_STACK_MODE_ABOVE) {
+}
+
+
+void PendingConfigure::SetPosition(int x, int y) {
+  x_ = x;
+  y_ = y;
+  mask_ |= XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y;
+}
+
+
+void PendingConfigure::SetSize(uint width, uint height) {
+  width_ = width;
+  height_ = height;
+  mask_ |= XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT;
+}
+
+
+void PendingConfigure::SetBorderWidth(uint border_width) {
+  border_width_ = border_width;
+  mask_ |= XCB_CONFIG_WINDOW_BORDER_WIDTH;
+}
+
+
+void PendingConfigure::SetStacking(::Window sibling, uint stack_mode) {
+  sibling_ = sibling;
+  stack_mode_ = stack_mode;
+  mask_ |= XCB_CONFIG_WINDOW_STACK_MODE;
+  if (sibling != None) {
+    mask_ |= XCB_CONFIG_WINDOW_SIBLING;
+  } else {
+    mask_ &= ~XCB_CONFIG_WINDOW_SIBLING;
+  }
+}
+
+
+int PendingConfigure::GetValues(uint32_t* values) const {
+  CHECK(values);
+  int num_values = 0;
+  if (mask_ & XCB_CONFIG_WINDOW_X) values[num_values++] = x_;
+  if (mask_ & XCB_CONFIG_WINDOW_Y) values[num_values++] = y_;
+  if (mask_ & XCB_CONFIG_WINDOW_WIDTH) values[num_values++] = width_;
+  if (mask_ & XCB_CONFIG_WINDOW_HEIGHT) values[num_values++] = height_;
+  if (mask_ & XCB_CONFIG_WINDOW_BORDER_WIDTH)
+    values[num_values++] = border_width_;
+  if (mask_ & XCB_CONFIG_WINDOW_SIBLING) values[num_values++] = sibling_;
+  if (mask_ & XCB_CONFIG_WINDOW_STACK_MODE) values[num_values++] = stack_mode_;
+  return num_values;
+}
+
+
 XWindow::XWindow(::Window id)
-    : parent_(NULL),
+    : x_(0),
+      y_(0),
+      width_(0),
+      height_(0),
+      initial_x_(0),
+      initial_y_(0),
+      initial_width_(0),
+      initial_height_(0),
+      parent_(NULL),
       id_(id),
+      role_(ROLE_NONE),
       damage_(None),
-      input_mask_(0) {
-  if (!XServer::Testing()) {
-    GetGeometry(&x_, &y_, &width_, &height_, NULL);
-    initial_x_ = x_;
-    initial_y_ = y_;
-    initial_width_ = width_;
-    initial_height_ = height_;
-
-    // FIXME: libxcb-damage0 1.1.93-0ubuntu appears to be broken in Ubuntu
-    // -- I get no events when I use XCB instead of Xlib.
-    damage_ = XDamageCreate(dpy(), id_, XDamageReportNonEmpty);
-    XDamageSubtract(dpy(), damage_, None, None);
-  }
+      damage_level_(XDamageReportNonEmpty),
+      input_mask_(0),
+      configure_queued_(false),
+      last_configure_sequence_(0),
+      sent_configure_(false) {
+  owner_.window = NULL;
 }
 
 
 XWindow::~XWindow() {
-  if (!XServer::Testing()) {
-    CHECK(damage_ != XCB_NONE);
-    // FIXME: Destroying the damage object here triggers a crash.  I'm
-    // guessing that the server is deleting it for us already, although I
-    // don't see anything explicitly saying that this is the case in the
-    // spec.
-    //xcb_damage_destroy(xcb_conn(), damage_);
-    damage_ = XCB_NONE;
-  }
+  // Destroying the damage object here triggers a crash, since the server
+  // has already deleted it along with the window, so we just forget
+  // about it.
+  damage_ = None;
 }
 
 
 XWindow* XWindow::Create(int x, int y, uint width, uint height) {
   xcb_window_t id;
   if (XServer::Testing()) {
-    static int win_id = 1;
-    id = win_id++;
+    id = MockXWindow::GetNextId();
   } else {
     id = xcb_generate_id(xcb_conn());
     xcb_create_window(xcb_conn(),
@@ -76,102 +173,129 @@ XWindow* XWindow::Create(int x, int y, uint width, uint height) {
                       XCB_WINDOW_CLASS_INPUT_OUTPUT,
                       xcb_screen()->root_visual,
                       0, NULL);
+    EventTraceWriter* trace_writer = XServer::Get()->trace_writer();
+    if (trace_writer) trace_writer->WriteCreateWindow(id);
   }
   DEBUG << "Created window 0x" << hex << id;
-  XWindow* win = XServer::Get()->GetWindow(id, true);
-  if (XServer::Testing()) {
-    // FIXME: This is super-ugly; change it.
-    win->x_ = win->initial_x_ = x;
-    win->y_ = win->initial_y_ = y;
-    win->width_ = win->initial_width_ = width;
-    win->height_ = win->initial_height_ = height;
-  } else {
-    win->SelectInput(kCreateInputMask);
-  }
+  XWindow* win = XServer::Get()->CreateWindowObject(id);
+  win->InitGeometry(x, y, width, height);
+  if (!XServer::Testing()) win->SelectInput(kCreateInputMask);
   return win;
 }
 
 
-bool XWindow::UpdateProperties(WindowProperties* props,
-                               WindowProperties::ChangeType type) {
+void XWindow::RequestPropertyUpdate(WindowProperties::ChangeType type) {
+  if (XServer::Get()->high_latency() && IsDeferrableProperty(type)) {
+    XServer::Get()->DeferPropertyUpdate(id_, type);
+    return;
+  }
+  FetchProperty(type);
+}
+
+
+void XWindow::FetchProperty(WindowProperties::ChangeType type) {
+  xcb_atom_t atom = GetPropertyAtom(type);
+  if (atom == XCB_NONE) return;
+
+  PropertyWorker* worker = XServer::Get()->property_worker();
+  Window* window = client_window();
+  if (worker && window) {
+    worker->RequestUpdate(window, type);
+    return;
+  }
+
+  xcb_get_property_cookie_t cookie = RequestProperty(atom);
+  XServer::Get()->AwaitReply(cookie.sequence,
+                             new PropertyReplyFunction(id_, type));
+}
+
+
+void XWindow::HandlePropertyReply(WindowProperties::ChangeType type,
+                                  const xcb_get_property_reply_t* reply) {
+  // The trace gets a record even if we've stopped managing the window, so
+  // that replays stay in sync.
+  Window* window = client_window();
+  WindowProperties props;
+  if (window) props = window->props();
+  bool success = ParseProperty(type, reply, &props);
+  EventTraceWriter* trace_writer = XServer::Get()->trace_writer();
+  if (trace_writer) trace_writer->WriteProperties(id_, props, success);
+  if (window) window->HandleUpdatedProperties(props, success);
+}
+
+
+xcb_atom_t XWindow::GetPropertyAtom(WindowProperties::ChangeType type) {
+  switch (type) {
+    case WindowProperties::WINDOW_NAME_CHANGE: return WM_NAME;
+    case WindowProperties::ICON_NAME_CHANGE: return WM_ICON_NAME;
+    case WindowProperties::COMMAND_CHANGE: return WM_COMMAND;
+    case WindowProperties::CLASS_CHANGE: return WM_CLASS;
+    case WindowProperties::WM_HINTS_CHANGE: return WM_NORMAL_HINTS;
+    case WindowProperties::TRANSIENT_CHANGE: return WM_TRANSIENT_FOR;
+    case WindowProperties::INPUT_HINT_CHANGE: return WM_HINTS;
+    case WindowProperties::PROTOCOLS_CHANGE:
+      return XServer::Get()->wm_protocols_atom();
+    default:
+      ERROR << "Unable to handle property change of type "
+            << WindowProperties::ChangeTypeToStr(type);
+      return XCB_NONE;
+  }
+}
+
+
+bool XWindow::ParseProperty(WindowProperties::ChangeType type,
+                            const xcb_get_property_reply_t* reply,
+                            WindowProperties* props) {
   CHECK(props);
+  ::Window transient_for_id = None;
+  if (!ParseProperty(id_, type, reply, props, &transient_for_id))
+    return false;
+  if (type == WindowProperties::TRANSIENT_CHANGE)
+    props->transient_for = FindTransientForWindow(transient_for_id);
+  return true;
+}
+
+
+bool XWindow::ParseProperty(::Window id,
+                            WindowProperties::ChangeType type,
+                            const xcb_get_property_reply_t* reply,
+                            WindowProperties* props,
+                            ::Window* transient_for_id) {
+  CHECK(props);
+  CHECK(transient_for_id);
 
   if (type == WindowProperties::WINDOW_NAME_CHANGE) {
-    if (!GetStringPropertySync(WM_NAME, &props->window_name)) {
-      ERROR << "Unable to get WM_NAME property for  0x" << hex << id_;
+    if (!ParseStringProperty(reply, &props->window_name)) {
+      ERROR << "Unable to get WM_NAME property for  0x" << hex << id;
       return false;
     }
   } else if (type == WindowProperties::ICON_NAME_CHANGE) {
-    if (!GetStringPropertySync(WM_ICON_NAME, &props->icon_name)) {
-      ERROR << "Unable to get WM_ICON_NAME property for  0x" << hex << id_;
+    if (!ParseStringProperty(reply, &props->icon_name)) {
+      ERROR << "Unable to get WM_ICON_NAME property for  0x" << hex << id;
       return false;
     }
   } else if (type == WindowProperties::COMMAND_CHANGE) {
-    // FIXME: Ubuntu's xcb library is hella old; no way to get this. :-(
-    char **argv = NULL;
-    int argc = 0;
-    if (!XGetCommand(dpy(), id_, &argv, &argc)) {
-      ERROR << "XGetCommand() failed for 0x" << hex << id_;
+    if (!ParseCommandProperty(reply, &props->command)) {
+      ERROR << "Unable to get WM_COMMAND property for 0x" << hex << id;
       return false;
     }
-    // FIXME: update command
-    XFreeStringList(argv);
   } else if (type == WindowProperties::CLASS_CHANGE) {
-    // FIXME: Ubuntu's xcb library is hella old; no way to get this. :-(
-    XClassHint class_hint;
-    if (!XGetClassHint(dpy(), id_, &class_hint)) {
-      ERROR << "XGetClassHint() failed for 0x" << hex << id_;
+    if (!ParseClassProperty(reply, props)) {
+      ERROR << "Unable to get WM_CLASS property for 0x" << hex << id;
       return false;
     }
-    props->app_name = class_hint.res_name ? class_hint.res_name : "";
-    props->app_class = class_hint.res_class ? class_hint.res_class : "";
-    if (class_hint.res_name) XFree(class_hint.res_name);
-    if (class_hint.res_class) XFree(class_hint.res_class);
   } else if (type == WindowProperties::WM_HINTS_CHANGE) {
-    XSizeHints* size_hints = XAllocSizeHints();
-    CHECK(size_hints);
-    long supplied_hints = 0;
-    if (!XGetWMNormalHints(dpy(), id_, size_hints, &supplied_hints)) {
-      ERROR << "XGetWMNormalHints() failed for 0x" << hex << id_;
-      XFree(size_hints);
+    if (!ParseSizeHintsProperty(reply, props)) {
+      ERROR << "Unable to get WM_NORMAL_HINTS property for 0x" << hex << id;
       return false;
     }
-    if (size_hints->flags & USPosition || size_hints->flags & PPosition) {
-      props->x = size_hints->x;
-      props->y = size_hints->y;
-    }
-    if (size_hints->flags & USSize || size_hints->flags & PSize) {
-      props->width = static_cast<uint>(size_hints->width);
-      props->height = static_cast<uint>(size_hints->height);
-    }
-    if (size_hints->flags & PMinSize) {
-      props->min_width = static_cast<uint>(size_hints->min_width);
-      props->min_height = static_cast<uint>(size_hints->min_height);
-    }
-    if (size_hints->flags & PMaxSize) {
-      props->max_width = static_cast<uint>(size_hints->max_width);
-      props->max_height = static_cast<uint>(size_hints->max_height);
-    }
-    if (size_hints->flags & PResizeInc) {
-      props->width_inc = static_cast<uint>(size_hints->width_inc);
-      props->height_inc = static_cast<uint>(size_hints->height_inc);
-    }
-    if (size_hints->flags & PAspect) {
-      props->min_aspect = static_cast<float>(size_hints->min_aspect.x) /
-                          size_hints->min_aspect.y;
-      props->max_aspect = static_cast<float>(size_hints->max_aspect.x) /
-                          size_hints->max_aspect.y;
-    }
-    if (size_hints->flags & PBaseSize) {
-      props->base_width = static_cast<uint>(size_hints->base_width);
-      props->base_height = static_cast<uint>(size_hints->base_height);
-    }
-    XFree(size_hints);
   } else if (type == WindowProperties::TRANSIENT_CHANGE) {
-    props->transient_for = GetTransientFor();
+    ParseTransientForProperty(reply, transient_for_id);
+  } else if (type == WindowProperties::INPUT_HINT_CHANGE) {
+    ParseInputHintProperty(reply, &props->accepts_input);
+  } else if (type == WindowProperties::PROTOCOLS_CHANGE) {
+    ParseProtocolsProperty(reply, props);
   } else {
-    ERROR << "Unable to handle property change of type "
-          << WindowProperties::ChangeTypeToStr(type);
     CHECK(false);
   }
 
@@ -179,14 +303,112 @@ bool XWindow::UpdateProperties(WindowProperties* props,
 }
 
 
+void XWindow::RequestAllProperties(::Window id, PropertyCookies* cookies) {
+  CHECK(cookies);
+  cookies->name = RequestProperty(id, WM_NAME);
+  cookies->icon_name = RequestProperty(id, WM_ICON_NAME);
+  cookies->command = RequestProperty(id, WM_COMMAND);
+  cookies->wm_class = RequestProperty(id, WM_CLASS);
+  cookies->normal_hints = RequestProperty(id, WM_NORMAL_HINTS);
+  cookies->transient_for = RequestProperty(id, WM_TRANSIENT_FOR);
+  cookies->hints = RequestProperty(id, WM_HINTS);
+  cookies->protocols =
+      RequestProperty(id, XServer::Get()->wm_protocols_atom());
+}
+
+
+void XWindow::DiscardPropertyCookies(const PropertyCookies& cookies) {
+  xcb_discard_reply(xcb_conn(), cookies.name.sequence);
+  xcb_discard_reply(xcb_conn(), cookies.icon_name.sequence);
+  xcb_discard_reply(xcb_conn(), cookies.command.sequence);
+  xcb_discard_reply(xcb_conn(), cookies.wm_class.sequence);
+  xcb_discard_reply(xcb_conn(), cookies.normal_hints.sequence);
+  xcb_discard_reply(xcb_conn(), cookies.transient_for.sequence);
+  xcb_discard_reply(xcb_conn(), cookies.hints.sequence);
+  xcb_discard_reply(xcb_conn(), cookies.protocols.sequence);
+}
+
+
+void XWindow::RefreshPropertyCookie(::Window id,
+                                    xcb_atom_t atom,
+                                    uint32_t sequence,
+                                    PropertyCookies* cookies) {
+  CHECK(cookies);
+  xcb_get_property_cookie_t* cookie = NULL;
+  if (atom == WM_NAME) cookie = &cookies->name;
+  else if (atom == WM_ICON_NAME) cookie = &cookies->icon_name;
+  else if (atom == WM_COMMAND) cookie = &cookies->command;
+  else if (atom == WM_CLASS) cookie = &cookies->wm_class;
+  else if (atom == WM_NORMAL_HINTS) cookie = &cookies->normal_hints;
+  else if (atom == WM_TRANSIENT_FOR) cookie = &cookies->transient_for;
+  else if (atom == WM_HINTS) cookie = &cookies->hints;
+  else if (atom == XServer::Get()->wm_protocols_atom())
+    cookie = &cookies->protocols;
+  else return;
+
+  // The reply already reflects changes that the server made before it
+  // handled our request.
+  if (SequenceIsOlder(sequence, cookie->sequence)) return;
+  xcb_discard_reply(xcb_conn(), cookie->sequence);
+  *cookie = RequestProperty(id, atom);
+}
+
+
+bool XWindow::UpdateAllProperties(WindowProperties* props) {
+  CHECK(props);
+  PropertyCookies cookies;
+  if (!XServer::Get()->TakePrefetchedProperties(id_, &cookies))
+    RequestAllProperties(id_, &cookies);
+  bool success = GetRequestedProperties(cookies, props);
+  EventTraceWriter* trace_writer = XServer::Get()->trace_writer();
+  if (trace_writer) trace_writer->WriteProperties(id_, *props, success);
+  return success;
+}
+
+
+bool XWindow::GetRequestedProperties(const PropertyCookies& cookies,
+                                     WindowProperties* props) {
+  CHECK(props);
+
+  // Read every reply, even after a failure, so that none of them are
+  // left sitting in XCB's queue.  Only the name and icon name are
+  // reported as errors; lots of clients don't bother setting the others.
+  bool success = true;
+  if (!ParseStringProperty(GetPropertyReply(cookies.name).get(),
+                           &props->window_name)) {
+    ERROR << "Unable to get WM_NAME property for  0x" << hex << id_;
+    success = false;
+  }
+  if (!ParseStringProperty(GetPropertyReply(cookies.icon_name).get(),
+                           &props->icon_name)) {
+    ERROR << "Unable to get WM_ICON_NAME property for  0x" << hex << id_;
+    success = false;
+  }
+  if (!ParseCommandProperty(GetPropertyReply(cookies.command).get(),
+                            &props->command))
+    success = false;
+  if (!ParseClassProperty(GetPropertyReply(cookies.wm_class).get(), props))
+    success = false;
+  if (!ParseSizeHintsProperty(GetPropertyReply(cookies.normal_hints).get(),
+                              props))
+    success = false;
+  ::Window transient_for_id = None;
+  ParseTransientForProperty(GetPropertyReply(cookies.transient_for).get(),
+                            &transient_for_id);
+  props->transient_for = FindTransientForWindow(transient_for_id);
+  ParseInputHintProperty(GetPropertyReply(cookies.hints).get(),
+                         &props->accepts_input);
+  ParseProtocolsProperty(GetPropertyReply(cookies.protocols).get(), props);
+  return success;
+}
+
+
 void XWindow::Move(int x, int y) {
   if (x == x_ && y == y_) return;
   x_ = x;
   y_ = y;
-  const uint32_t values[] = { x, y };
-  xcb_configure_window(xcb_conn(), id_,
-                       XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y,
-                       values);
+  pending_configure_.SetPosition(x, y);
+  QueueConfigure(false);
 }
 
 
@@ -194,27 +416,24 @@ void XWindow::Resize(uint width, uint height) {
   if (width == width_ && height == height_) return;
   width_ = width;
   height_ = height;
-  const uint32_t values[] = { width, height };
-  xcb_configure_window(xcb_conn(), id_,
-                       XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
-                       values);
+  pending_configure_.SetSize(width, height);
+  QueueConfigure(false);
 }
 
 
 void XWindow::Unmap() {
-  // Cribbed from blackbox.  When we unmap a window ourselves, we don't
-  // want to get notification about it, so grab the server and unselect
-  // structure events.
-  XGrabServer(dpy());
-  XSelectInput(dpy(), id_, input_mask_ & ~StructureNotifyMask);
-  XUnmapWindow(dpy(), id_);
-  XSelectInput(dpy(), id_, input_mask_);
-  XUngrabServer(dpy());
+  // When we unmap a window ourselves, we don't want to hear about it
+  // (otherwise we'd think that a client window had been withdrawn).
+  xcb_void_cookie_t cookie = xcb_unmap_window(xcb_conn(), id_);
+  XServer::Get()->SuppressEvents(cookie, id_, SuppressionTable::UNMAP_NOTIFY);
+  SuppressCrossingEvents(cookie);
 }
 
 
 void XWindow::Map() {
-  xcb_map_window(xcb_conn(), id_);
+  // Make sure that the window shows up in the right place.
+  CommitQueuedConfigures();
+  SuppressCrossingEvents(xcb_map_window(xcb_conn(), id_));
 }
 
 
@@ -223,39 +442,80 @@ void XWindow::SelectClientEvents() {
 }
 
 
-void XWindow::TakeFocus() {
-  XSetInputFocus(dpy(), id_, RevertToPointerRoot, CurrentTime);
-  // FIXME: debugging
-  XSync(dpy(), False);
+void XWindow::TakeFocus(bool set_input_focus,
+                        bool send_take_focus,
+                        Time time) {
+  if (set_input_focus) {
+    xcb_void_cookie_t cookie =
+        xcb_set_input_focus(xcb_conn(), XCB_INPUT_FOCUS_POINTER_ROOT, id_,
+                            XCB_CURRENT_TIME);
+    XServer::Get()->TrackRequest(
+        cookie, "SetInputFocus", new FocusErrorFunction(id_));
+  }
+  if (send_take_focus) {
+    xcb_client_message_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.response_type = XCB_CLIENT_MESSAGE;
+    event.format = 32;
+    event.window = id_;
+    event.type = XServer::Get()->wm_protocols_atom();
+    event.data.data32[0] = XServer::Get()->wm_take_focus_atom();
+    event.data.data32[1] = time;
+    xcb_send_event(xcb_conn(), 0, id_, XCB_EVENT_MASK_NO_EVENT,
+                   reinterpret_cast<const char*>(&event));
+  }
 }
 
 
 void XWindow::SetBorder(uint size) {
-  const uint32_t values[] = { size };
-  xcb_configure_window(xcb_conn(), id_, XCB_CONFIG_WINDOW_BORDER_WIDTH, values);
+  pending_configure_.SetBorderWidth(size);
+  QueueConfigure(false);
 }
 
 
 void XWindow::Raise() {
-  static const uint32_t values[] = { XCB_STACK_MODE_ABOVE };
-  xcb_configure_window(xcb_conn(), id_, XCB_CONFIG_WINDOW_STACK_MODE, values);
+  // Restacking is relative to the other windows, so if this window has
+  // already been restacked, the earlier changes need to go out first.
+  if (pending_configure_.restacks())
+    XServer::Get()->CommitPendingConfigures();
+  pending_configure_.SetStacking(None, XCB_STACK_MODE_ABOVE);
+  QueueConfigure(true);
 }
 
 
 void XWindow::MakeSibling(const XWindow& leader) {
-  const uint32_t values[] = { leader.id(), XCB_STACK_MODE_BELOW };
-  xcb_configure_window(xcb_conn(), id_,
-                       XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE,
-                       values);
+  if (pending_configure_.restacks())
+    XServer::Get()->CommitPendingConfigures();
+  pending_configure_.SetStacking(leader.id(), XCB_STACK_MODE_BELOW);
+  QueueConfigure(true);
 }
 
 
 void XWindow::Reparent(XWindow* parent, int x, int y) {
   DEBUG << "Reparent: xwin=0x" << hex << id_ << " parent=0x" << parent->id();
-  xcb_reparent_window(xcb_conn(), id_,
-                      parent ? parent->id() : xcb_screen()->root,
-                      x, y);
+  CommitQueuedConfigures();
+  // Reparenting a window that's already mapped (e.g. one that existed
+  // before we started) unmaps and remaps it, and we don't want to mistake
+  // the unmap for the client withdrawing the window.
+  xcb_void_cookie_t cookie =
+      xcb_reparent_window(xcb_conn(), id_,
+                          parent ? parent->id() : xcb_screen()->root,
+                          x, y);
+  XServer::Get()->SuppressEvents(cookie, id_, SuppressionTable::UNMAP_NOTIFY);
+  XServer::Get()->TrackRequest(cookie, "ReparentWindow", NULL);
+  HandleReparentSent(parent, x, y, cookie.sequence);
+}
+
+
+void XWindow::HandleReparentSent(XWindow* parent,
+                                 int x,
+                                 int y,
+                                 uint32_t sequence) {
   parent_ = parent;
+  x_ = x;
+  y_ = y;
+  last_configure_sequence_ = sequence;
+  sent_configure_ = true;
 }
 
 
@@ -273,26 +533,198 @@ void XWindow::WarpPointer(int x, int y) {
 }
 
 
-void XWindow::GetGeometry(int* x,
-                          int* y,
-                          uint* width,
-                          uint* height,
-                          uint* border_width) {
-  xcb_get_geometry_cookie_t cookie = xcb_get_geometry(xcb_conn(), id_);
-  ref_ptr<xcb_get_geometry_reply_t> geometry(
-      xcb_get_geometry_reply(xcb_conn(), cookie, NULL));
-  if (x) *x = geometry->x;
-  if (y) *y = geometry->y;
-  if (width) *width = geometry->width;
-  if (height) *height = geometry->height;
-  if (border_width) *border_width = geometry->border_width;
+void XWindow::InitGeometry(int x, int y, uint width, uint height) {
+  x_ = initial_x_ = x;
+  y_ = initial_y_ = y;
+  width_ = initial_width_ = width;
+  height_ = initial_height_ = height;
+}
+
+
+void XWindow::FetchGeometry() {
+  int x = 0, y = 0;
+  uint width = 0, height = 0;
+  if (!XServer::Get()->TakeCreatedGeometry(id_, &x, &y, &width, &height)) {
+    // We only get here for MapRequest events (including the ones faked by
+    // AdoptExistingWindows()), and the geometry of their windows is always
+    // requested ahead of time.  Rather than blocking on a request of our
+    // own if it was somehow missed, start out empty and let a later
+    // ConfigureNotify correct it.
+    xcb_get_geometry_cookie_t cookie;
+    if (!XServer::Get()->TakePrefetchedGeometry(id_, &cookie)) {
+      ERROR << "Geometry for 0x" << hex << id_ << " wasn't prefetched";
+    } else {
+      ref_ptr<xcb_get_geometry_reply_t> geometry(
+          xcb_get_geometry_reply(xcb_conn(), cookie, NULL));
+      if (!geometry.get()) {
+        // The window was probably destroyed before we got to it.
+        ERROR << "Unable to get geometry for 0x" << hex << id_;
+        return;
+      }
+      x = geometry->x;
+      y = geometry->y;
+      width = geometry->width;
+      height = geometry->height;
+    }
+  }
+  InitGeometry(x, y, width, height);
+  EventTraceWriter* trace_writer = XServer::Get()->trace_writer();
+  if (trace_writer) trace_writer->WriteGeometry(id_, x_, y_, width_, height_);
+}
+
+
+void XWindow::HandleConfigureNotify(int x,
+                                    int y,
+                                    uint width,
+                                    uint height,
+                                    uint32_t sequence) {
+  if (sent_configure_ && SequenceIsOlder(sequence, last_configure_sequence_))
+    return;
+  uint16_t pending_mask = pending_configure_.mask();
+  if (!(pending_mask & XCB_CONFIG_WINDOW_X)) x_ = x;
+  if (!(pending_mask & XCB_CONFIG_WINDOW_Y)) y_ = y;
+  if (!(pending_mask & XCB_CONFIG_WINDOW_WIDTH)) width_ = width;
+  if (!(pending_mask & XCB_CONFIG_WINDOW_HEIGHT)) height_ = height;
 }
 
 
 void XWindow::Destroy() {
   DEBUG << "Destroy: xwin=0x" << hex << id_;
-  XServer::Get()->DeleteWindow(id_);
+  // The XServer will skip our ID when it sees that we're gone.
+  pending_configure_.Clear();
   xcb_destroy_window(xcb_conn(), id_);
+  // This deletes us, so it needs to come last.
+  XServer::Get()->DeleteWindow(id_);
+}
+
+
+void XWindow::CommitConfigure() {
+  configure_queued_ = false;
+  if (pending_configure_.empty()) return;
+  uint32_t values[PendingConfigure::kMaxValues];
+  pending_configure_.GetValues(values);
+  xcb_void_cookie_t cookie = xcb_configure_window(
+      xcb_conn(), id_, pending_configure_.mask(), values);
+  last_configure_sequence_ = cookie.sequence;
+  sent_configure_ = true;
+  if (pending_configure_.restacks()) SuppressCrossingEvents(cookie);
+  pending_configure_.Clear();
+}
+
+
+void XWindow::QueueConfigure(bool restacked) {
+  XServer* x_server = XServer::Get();
+  if (!x_server->in_request_batch()) {
+    CommitConfigure();
+    return;
+  }
+  if (!configure_queued_ || restacked) {
+    x_server->QueueConfigure(id_, restacked);
+    configure_queued_ = true;
+  }
+}
+
+
+void XWindow::CommitQueuedConfigures() {
+  if (configure_queued_) XServer::Get()->CommitPendingConfigures();
+}
+
+
+void XWindow::AddDamageObserver(DamageObserver* observer, int level) {
+  CHECK(observer);
+  CHECK(damage_observers_.insert(make_pair(observer, level)).second);
+  // Lower report levels are more detailed.
+  if (damage_observers_.size() == 1 || level < damage_level_)
+    CreateDamage(level);
+}
+
+
+void XWindow::RemoveDamageObserver(DamageObserver* observer) {
+  CHECK(damage_observers_.erase(observer));
+  if (damage_observers_.empty()) {
+    DestroyDamage();
+    return;
+  }
+
+  // If the observer that we removed was the only one that needed the
+  // current level, switch to a less detailed one.
+  int level = XDamageReportNonEmpty;
+  for (map<DamageObserver*, int>::const_iterator it =
+         damage_observers_.begin();
+       it != damage_observers_.end(); ++it) {
+    level = min(level, it->second);
+  }
+  if (level != damage_level_) CreateDamage(level);
+}
+
+
+void XWindow::HandleDamage(::Damage damage) {
+  if (!XServer::Testing()) {
+    // The event may be for a damage object that we've since replaced.
+    if (damage != damage_ || damage_ == None) return;
+    // Reset the damaged region so that we'll hear about the next change.
+    XDamageSubtract(dpy(), damage_, None, None);
+  }
+
+  // Copy the observers, since they may remove themselves.
+  vector<DamageObserver*> observers;
+  for (map<DamageObserver*, int>::const_iterator it =
+         damage_observers_.begin();
+       it != damage_observers_.end(); ++it) {
+    observers.push_back(it->first);
+  }
+  for (vector<DamageObserver*>::iterator it = observers.begin();
+       it != observers.end(); ++it) {
+    if (damage_observers_.count(*it)) (*it)->HandleDamage(this);
+  }
+}
+
+
+void XWindow::CreateDamage(int level) {
+  damage_level_ = level;
+  if (XServer::Testing()) return;
+  DestroyDamage();
+  // FIXME: libxcb-damage0 1.1.93-0ubuntu appears to be broken in Ubuntu
+  // -- I get no events when I use XCB instead of Xlib.
+  damage_ = XDamageCreate(dpy(), id_, level);
+  XDamageSubtract(dpy(), damage_, None, None);
+}
+
+
+void XWindow::DestroyDamage() {
+  if (damage_ == None) return;
+  XDamageDestroy(dpy(), damage_);
+  damage_ = None;
+}
+
+
+void XWindow::SetClientRole(Window* window) {
+  CHECK(window);
+  CHECK_EQ(role_, ROLE_NONE);
+  role_ = ROLE_CLIENT;
+  owner_.window = window;
+}
+
+
+void XWindow::SetFrameRole(Window* window) {
+  CHECK(window);
+  CHECK_EQ(role_, ROLE_NONE);
+  role_ = ROLE_FRAME;
+  owner_.window = window;
+}
+
+
+void XWindow::SetTitlebarRole(Anchor* anchor) {
+  CHECK(anchor);
+  CHECK_EQ(role_, ROLE_NONE);
+  role_ = ROLE_TITLEBAR;
+  owner_.anchor = anchor;
+}
+
+
+void XWindow::ClearRole() {
+  role_ = ROLE_NONE;
+  owner_.window = NULL;
 }
 
 
@@ -313,10 +745,11 @@ int XWindow::scr() { return XServer::Get()->screen_num(); }
 ::Window XWindow::root() { return XServer::Get()->root(); }
 
 
-xcb_get_property_cookie_t XWindow::RequestProperty(xcb_atom_t property) {
+xcb_get_property_cookie_t XWindow::RequestProperty(::Window id,
+                                                   xcb_atom_t property) {
   return xcb_get_property(xcb_conn(),
                           0,     // delete
-                          id_,
+                          id,
                           property,
                           XCB_GET_PROPERTY_TYPE_ANY,
                           0,     // offset
@@ -324,34 +757,178 @@ xcb_get_property_cookie_t XWindow::RequestProperty(xcb_atom_t property) {
 }
 
 
-bool XWindow::GetRequestedStringProperty(xcb_get_property_cookie_t cookie,
-                                         string* out) {
-  CHECK(out);
-
-  ref_ptr<xcb_get_property_reply_t> reply(
+ref_ptr<xcb_get_property_reply_t> XWindow::GetPropertyReply(
+    xcb_get_property_cookie_t cookie) {
+  return ref_ptr<xcb_get_property_reply_t>(
       xcb_get_property_reply(xcb_conn(), cookie, 0));
-  if (!reply.get()) return false;
+}
+
+
+bool XWindow::ParseStringProperty(const xcb_get_property_reply_t* reply,
+                                  string* out) {
+  CHECK(out);
+  if (!reply) return false;
   // FIXME: Think I need to be safer here -- check type, etc.
-  const void* value = xcb_get_property_value(reply.get());
-  int length = xcb_get_property_value_length(reply.get());
+  const void* value = xcb_get_property_value(reply);
+  int length = xcb_get_property_value_length(reply);
   *out = string(static_cast<const char*>(value), length);
   DEBUG << "Got property \"" << *out << "\" of type " << reply->type;
   return true;
 }
 
 
-XWindow* XWindow::GetTransientFor() {
-  ::Window win_id;
-  if (!XGetTransientForHint(dpy(), id_, &win_id)) {
-    ERROR << "XGetTransientForHint() failed for 0x" << hex << id_;
-    return NULL;
+bool XWindow::ParseCommandProperty(const xcb_get_property_reply_t* reply,
+                                   string* out) {
+  CHECK(out);
+  string value;
+  if (!ParseStringProperty(reply, &value) || value.empty())
+    return false;
+
+  // WM_COMMAND holds NUL-terminated arguments; join them with spaces.
+  if (value[value.size() - 1] == '\0') value.resize(value.size() - 1);
+  replace(value.begin(), value.end(), '\0', ' ');
+  *out = value;
+  return true;
+}
+
+
+bool XWindow::ParseClassProperty(const xcb_get_property_reply_t* reply,
+                                 WindowProperties* props) {
+  CHECK(props);
+  string value;
+  if (!ParseStringProperty(reply, &value) || value.empty())
+    return false;
+
+  // WM_CLASS holds the NUL-terminated instance name followed by the
+  // NUL-terminated class name.
+  size_t name_end = value.find('\0');
+  props->app_name = value.substr(0, name_end);
+  if (name_end == string::npos) {
+    props->app_class = "";
+  } else {
+    size_t class_end = value.find('\0', name_end + 1);
+    props->app_class = value.substr(
+        name_end + 1,
+        class_end == string::npos ? string::npos : class_end - name_end - 1);
+  }
+  return true;
+}
+
+
+bool XWindow::ParseSizeHintsProperty(const xcb_get_property_reply_t* reply,
+                                     WindowProperties* props) {
+  CHECK(props);
+  if (!reply || reply->format != 32) return false;
+
+  // This is the ICCCM's WM_SIZE_HINTS layout.  Clients following older
+  // versions of the ICCCM leave off the base size and gravity.
+  enum {
+    FLAGS = 0, X, Y, WIDTH, HEIGHT, MIN_WIDTH, MIN_HEIGHT,
+    MAX_WIDTH, MAX_HEIGHT, WIDTH_INC, HEIGHT_INC,
+    MIN_ASPECT_NUM, MIN_ASPECT_DEN, MAX_ASPECT_NUM, MAX_ASPECT_DEN,
+    BASE_WIDTH, BASE_HEIGHT, NUM_OLD_FIELDS = BASE_WIDTH,
+  };
+  int num_fields = xcb_get_property_value_length(reply) / 4;
+  if (num_fields < NUM_OLD_FIELDS) return false;
+  const uint32_t* hints =
+      static_cast<const uint32_t*>(xcb_get_property_value(reply));
+  uint32_t flags = hints[FLAGS];
+
+  if (flags & USPosition || flags & PPosition) {
+    props->x = static_cast<int32_t>(hints[X]);
+    props->y = static_cast<int32_t>(hints[Y]);
+  }
+  if (flags & USSize || flags & PSize) {
+    props->width = hints[WIDTH];
+    props->height = hints[HEIGHT];
+  }
+  if (flags & PMinSize) {
+    props->min_width = hints[MIN_WIDTH];
+    props->min_height = hints[MIN_HEIGHT];
   }
-  XWindow* win = XServer::Get()->GetWindow(win_id, false);
-  if (win == NULL) {
+  if (flags & PMaxSize) {
+    props->max_width = hints[MAX_WIDTH];
+    props->max_height = hints[MAX_HEIGHT];
+  }
+  if (flags & PResizeInc) {
+    props->width_inc = hints[WIDTH_INC];
+    props->height_inc = hints[HEIGHT_INC];
+  }
+  if (flags & PAspect &&
+      hints[MIN_ASPECT_DEN] != 0 && hints[MAX_ASPECT_DEN] != 0) {
+    props->min_aspect = static_cast<float>(hints[MIN_ASPECT_NUM]) /
+                        hints[MIN_ASPECT_DEN];
+    props->max_aspect = static_cast<float>(hints[MAX_ASPECT_NUM]) /
+                        hints[MAX_ASPECT_DEN];
+  }
+  if (flags & PBaseSize && num_fields > BASE_HEIGHT) {
+    props->base_width = hints[BASE_WIDTH];
+    props->base_height = hints[BASE_HEIGHT];
+  }
+  return true;
+}
+
+
+bool XWindow::ParseTransientForProperty(const xcb_get_property_reply_t* reply,
+                                        ::Window* out) {
+  CHECK(out);
+  *out = None;
+  if (!reply || reply->format != 32 ||
+      xcb_get_property_value_length(reply) < 4) {
+    return false;
+  }
+  *out = *static_cast<const uint32_t*>(xcb_get_property_value(reply));
+  return true;
+}
+
+
+XWindow* XWindow::FindTransientForWindow(::Window id) const {
+  if (id == None) return NULL;
+  XWindow* xwin = XServer::Get()->GetWindow(id, false);
+  if (!xwin) {
     ERROR << hex << "0x" << id_ << " claims to be a transient for 0x"
-          << win_id << ", which isn't registered";
+          << id << ", which isn't registered";
   }
-  return win;
+  return xwin;
+}
+
+
+bool XWindow::ParseInputHintProperty(const xcb_get_property_reply_t* reply,
+                                     bool* out) {
+  CHECK(out);
+  *out = true;
+  if (!reply || reply->format != 32 ||
+      xcb_get_property_value_length(reply) < 8) {
+    return false;
+  }
+
+  // WM_HINTS starts with a flags field followed by the input field.
+  const uint32_t* hints =
+      static_cast<const uint32_t*>(xcb_get_property_value(reply));
+  if (hints[0] & InputHint) *out = (hints[1] != 0);
+  return true;
+}
+
+
+bool XWindow::ParseProtocolsProperty(const xcb_get_property_reply_t* reply,
+                                     WindowProperties* props) {
+  CHECK(props);
+  props->supports_take_focus = false;
+  if (!reply || reply->format != 32) return false;
+
+  const xcb_atom_t* atoms =
+      static_cast<const xcb_atom_t*>(xcb_get_property_value(reply));
+  int num_atoms = xcb_get_property_value_length(reply) / 4;
+  xcb_atom_t take_focus_atom = XServer::Get()->wm_take_focus_atom();
+  for (int i = 0; i < num_atoms; ++i) {
+    if (atoms[i] == take_focus_atom) props->supports_take_focus = true;
+  }
+  return true;
+}
+
+
+void XWindow::SuppressCrossingEvents(xcb_void_cookie_t cookie) {
+  XServer::Get()->SuppressEvents(cookie, None, SuppressionTable::ENTER_NOTIFY);
 }
 
 
@@ -11,15 +11,76 @@ extern "C" {
 #include <xcb/xcb.h>
 }
 
+#include <map>
+
 #include "util.h"
 #include "window-properties.h"
 
 using namespace std;
 
+class XWindowTestSuite;  // from x-window_test.h
+
 namespace wham {
 
+class Anchor;
+class Window;
 class WindowProperties;
 class XServer;
+class XWindow;
+
+// Interface for things that want to hear about changes to a window's
+// contents.  See XWindow::AddDamageObserver().
+class DamageObserver {
+ public:
+  virtual ~DamageObserver() {}
+
+  // Called when 'xwin' has been drawn to.
+  virtual void HandleDamage(XWindow* xwin) = 0;
+};
+
+// Changes to a window's geometry and stacking that haven't been sent to
+// the server yet.  Later changes replace earlier ones, so however many
+// times a window is moved, resized and restacked, only a single
+// ConfigureWindow request needs to be sent.
+class PendingConfigure {
+ public:
+  PendingConfigure();
+
+  // Maximum number of values that GetValues() can return.
+  static const int kMaxValues = 7;
+
+  // Bitfield of XCB_CONFIG_WINDOW_* values that have been changed.
+  uint16_t mask() const { return mask_; }
+  bool empty() const { return mask_ == 0; }
+
+  // Has the window's stacking order been changed?
+  bool restacks() const { return mask_ & XCB_CONFIG_WINDOW_STACK_MODE; }
+
+  void SetPosition(int x, int y);
+  void SetSize(uint width, uint height);
+  void SetBorderWidth(uint border_width);
+
+  // Stack the window using 'stack_mode' relative to 'sibling', or
+  // relative to all of its siblings if 'sibling' is None.
+  void SetStacking(::Window sibling, uint stack_mode);
+
+  // Copy the values for the fields in mask() into 'values', which must
+  // have room for kMaxValues entries, in the order that the protocol
+  // wants them.  Returns the number of values.
+  int GetValues(uint32_t* values) const;
+
+  void Clear() { mask_ = 0; }
+
+ private:
+  uint16_t mask_;
+  int x_;
+  int y_;
+  uint width_;
+  uint height_;
+  uint border_width_;
+  ::Window sibling_;
+  uint stack_mode_;
+};
 
 class XWindow {
  public:
@@ -30,29 +91,159 @@ class XWindow {
 
   ::Window id() const { return id_; }
 
-  // Update 'props' with this window's current properties of type 'type'.
-  virtual bool UpdateProperties(WindowProperties* props,
-                                WindowProperties::ChangeType type);
+  // What the window manager is using a window for.
+  enum Role {
+    ROLE_NONE = 0,
+    ROLE_CLIENT,
+    ROLE_FRAME,
+    ROLE_TITLEBAR,
+  };
+  Role role() const { return role_; }
+
+  // Record that this window is a managed client window, the frame
+  // surrounding a client window, or an anchor's titlebar.  The owner is
+  // not owned by us; ClearRole() must be called before it's destroyed.
+  void SetClientRole(Window* window);
+  void SetFrameRole(Window* window);
+  void SetTitlebarRole(Anchor* anchor);
+  void ClearRole();
+
+  // Get the object that owns this window in the given role, or NULL if
+  // the window has a different role.
+  Window* client_window() const {
+    return role_ == ROLE_CLIENT ? owner_.window : NULL;
+  }
+  Window* frame_window() const {
+    return role_ == ROLE_FRAME ? owner_.window : NULL;
+  }
+  Anchor* titlebar_anchor() const {
+    return role_ == ROLE_TITLEBAR ? owner_.anchor : NULL;
+  }
+
+  // Request this window's current property of type 'type' without
+  // waiting for the reply.  When it arrives, it's passed to our client
+  // window's Window::HandleUpdatedProperties(), as long as we still have
+  // one.  If the XServer has a PropertyWorker, the property is fetched
+  // and the window is reclassified on the worker's thread instead.  In
+  // high-latency mode, properties that we don't display are passed to
+  // XServer::DeferPropertyUpdate() to be fetched later.
+  virtual void RequestPropertyUpdate(WindowProperties::ChangeType type);
+
+  // Like RequestPropertyUpdate(), but never deferred.
+  void FetchProperty(WindowProperties::ChangeType type);
+
+  // Can fetching properties of type 'type' wait until we're idle when
+  // round trips are expensive?
+  static bool IsDeferrableProperty(WindowProperties::ChangeType type) {
+    return type == WindowProperties::ICON_NAME_CHANGE ||
+           type == WindowProperties::COMMAND_CHANGE;
+  }
+
+  // Handle the reply (NULL on failure) to a request made by
+  // RequestPropertyUpdate().
+  void HandlePropertyReply(WindowProperties::ChangeType type,
+                           const xcb_get_property_reply_t* reply);
+
+  // Get the atom holding the property that changes of type 'type' are
+  // about, or XCB_NONE if we don't track it.
+  static xcb_atom_t GetPropertyAtom(WindowProperties::ChangeType type);
+
+  // Copy the property of type 'type' for the window with ID 'id' from
+  // 'reply' (which may be NULL) into 'props'.  Returns false if it
+  // couldn't be read.  This doesn't look at any XWindow objects, so it's
+  // safe to call from other threads; the ID from WM_TRANSIENT_FOR is
+  // stored in 'transient_for_id' instead of being resolved in 'props'.
+  static bool ParseProperty(::Window id,
+                            WindowProperties::ChangeType type,
+                            const xcb_get_property_reply_t* reply,
+                            WindowProperties* props,
+                            ::Window* transient_for_id);
+
+  // Get the window with ID 'id' that this window claims to be a
+  // transient for, or NULL if 'id' is None or we don't know about it.
+  XWindow* FindTransientForWindow(::Window id) const;
+
+  // Cookies for in-flight requests for all of the properties that
+  // WindowProperties tracks.
+  struct PropertyCookies {
+    xcb_get_property_cookie_t name;
+    xcb_get_property_cookie_t icon_name;
+    xcb_get_property_cookie_t command;
+    xcb_get_property_cookie_t wm_class;
+    xcb_get_property_cookie_t normal_hints;
+    xcb_get_property_cookie_t transient_for;
+    xcb_get_property_cookie_t hints;
+    xcb_get_property_cookie_t protocols;
+  };
+
+  // Send requests for all of the properties of the window with ID 'id'
+  // without waiting for the replies.  Requesting the properties of
+  // several windows before collecting any replies lets them all arrive in
+  // a single round trip.
+  static void RequestAllProperties(::Window id, PropertyCookies* cookies);
+
+  // Throw away the replies to requests sent by RequestAllProperties().
+  static void DiscardPropertyCookies(const PropertyCookies& cookies);
+
+  // Handle a change to 'atom' on the window with ID 'id', reported in an
+  // event with sequence number 'sequence'.  If the change happened after
+  // the request for the property in 'cookies' was handled, the old reply
+  // is discarded and the property is requested again.
+  static void RefreshPropertyCookie(::Window id,
+                                    xcb_atom_t atom,
+                                    uint32_t sequence,
+                                    PropertyCookies* cookies);
+
+  // Update 'props' with all of this window's current properties.  If the
+  // XServer already requested them (see XServer::PrefetchProperties()),
+  // those replies are used; otherwise, all of the requests are sent
+  // before any of the replies are read.
+  virtual bool UpdateAllProperties(WindowProperties* props);
 
   virtual void Move(int x, int y);
   virtual void Resize(uint width, uint height);
   virtual void Unmap();
   virtual void Map();
   virtual void SelectClientEvents();
-  virtual void TakeFocus();
+  // Give the focus to this window.  If 'set_input_focus' is true, the
+  // input focus is assigned directly; if 'send_take_focus' is true, the
+  // window is sent a WM_TAKE_FOCUS message with timestamp 'time'.
+  // Callers should usually go through FocusManager instead.
+  virtual void TakeFocus(bool set_input_focus,
+                         bool send_take_focus,
+                         Time time);
   virtual void SetBorder(uint size);
   virtual void Raise();
   virtual void MakeSibling(const XWindow& leader);
   virtual void Reparent(XWindow* parent, int x, int y);
   virtual void WarpPointer(int x, int y);
-  // FIXME: change this to UpdateGeometry() and just update in-object vals
-  virtual void GetGeometry(int* x,
-                           int* y,
-                           uint* width,
-                           uint* height,
-                           uint* border_width);
   virtual void Destroy();
 
+  // Our cached copy of the window's geometry is authoritative; we never
+  // ask the server for it after the window is first seen.  These set its
+  // initial value, either to something that we already know (e.g. for
+  // windows that we create ourselves or saw a CreateNotify for) or by
+  // reading the reply to a geometry request that was sent along with the
+  // requests for the window's properties (see
+  // XServer::PrefetchProperties()).  FetchGeometry() never makes a
+  // request of its own.
+  void InitGeometry(int x, int y, uint width, uint height);
+  void FetchGeometry();
+
+  // Update the cached geometry from a ConfigureNotify event with sequence
+  // number 'sequence'.  Fields that we've changed ourselves since then
+  // are left alone, since our requests will override them.
+  void HandleConfigureNotify(int x,
+                             int y,
+                             uint width,
+                             uint height,
+                             uint32_t sequence);
+
+  // Send the geometry and stacking changes that have been made since the
+  // last call in a single request.  Changes made inside of an
+  // XServer::RequestBatch are held until the batch ends.
+  void CommitConfigure();
+
   virtual bool operator<(const XWindow& o) const {
     return id_ < o.id_;
   }
@@ -74,6 +265,23 @@ class XWindow {
   uint initial_width() const { return initial_width_; }
   uint initial_height() const { return initial_height_; }
 
+  // Start telling 'observer' about changes to this window's contents.
+  // 'level' is the XDamageReportLevel that the observer needs.  The
+  // window's damage object is only created when the first observer is
+  // added (and is recreated if a later observer needs a more detailed
+  // level), so windows that nobody is watching don't cost the server
+  // anything or generate any events.
+  void AddDamageObserver(DamageObserver* observer, int level);
+
+  // Stop telling 'observer' about damage.  The damage object is destroyed
+  // when the last observer is removed, and recreated with a less detailed
+  // level if none of the remaining observers need the current one.
+  void RemoveDamageObserver(DamageObserver* observer);
+
+  // Handle a DamageNotify event from 'damage' by passing it on to our
+  // observers.
+  void HandleDamage(::Damage damage);
+
   ::Damage damage() const { return damage_; }
 
  protected:
@@ -90,6 +298,8 @@ class XWindow {
   XWindow* parent_;
 
  private:
+  friend class ::XWindowTestSuite;
+
   // Convenience methods.
   static xcb_connection_t* xcb_conn();
   static const xcb_screen_t* xcb_screen();
@@ -97,31 +307,116 @@ class XWindow {
   static int scr();
   static ::Window root();
 
-  // Request a property from this window.
-  xcb_get_property_cookie_t RequestProperty(xcb_atom_t property);
+  // Copy the property of type 'type' from 'reply' (which may be NULL)
+  // into 'props'.  Returns false if it couldn't be read.
+  bool ParseProperty(WindowProperties::ChangeType type,
+                     const xcb_get_property_reply_t* reply,
+                     WindowProperties* props);
 
-  // Get a string property previously requested by RequestProperty().
-  // On failure, returns false and leaves 'out' untouched.
-  bool GetRequestedStringProperty(xcb_get_property_cookie_t cookie,
-                                  string* out);
+  // Read the replies for all of the requests in 'cookies' into 'props'.
+  // Returns false if any of the properties couldn't be read.
+  bool GetRequestedProperties(const PropertyCookies& cookies,
+                              WindowProperties* props);
 
-  // Convenience wrapper to synchronously get a string property.
-  bool GetStringPropertySync(xcb_atom_t property, string* out) {
-    return GetRequestedStringProperty(RequestProperty(property), out);
+  // Request a property from the window with ID 'id'.
+  static xcb_get_property_cookie_t RequestProperty(::Window id,
+                                                   xcb_atom_t property);
+
+  // Request a property from this window.
+  xcb_get_property_cookie_t RequestProperty(xcb_atom_t property) {
+    return RequestProperty(id_, property);
   }
 
-  // Get the window for which this window is a transient.
-  // Returns NULL if no such window exists.
-  virtual XWindow* GetTransientFor();
+  // Wait for the reply to a request made by RequestProperty().  The
+  // returned reply is NULL if the request failed.
+  static ref_ptr<xcb_get_property_reply_t> GetPropertyReply(
+      xcb_get_property_cookie_t cookie);
+
+  // Get a string property from a reply to RequestProperty().  On failure
+  // (including when 'reply' is NULL), returns false and leaves 'out'
+  // untouched.
+  static bool ParseStringProperty(const xcb_get_property_reply_t* reply,
+                                  string* out);
+
+  // Helper methods for reading the replies to property requests.  They
+  // return false if the property isn't set or is malformed.  For
+  // WM_TRANSIENT_FOR, 'out' is set to None if the window isn't a
+  // transient.
+  static bool ParseCommandProperty(const xcb_get_property_reply_t* reply,
+                                   string* out);
+  static bool ParseClassProperty(const xcb_get_property_reply_t* reply,
+                                 WindowProperties* props);
+  static bool ParseSizeHintsProperty(const xcb_get_property_reply_t* reply,
+                                     WindowProperties* props);
+  static bool ParseTransientForProperty(const xcb_get_property_reply_t* reply,
+                                        ::Window* out);
+  static bool ParseInputHintProperty(const xcb_get_property_reply_t* reply,
+                                     bool* out);
+  static bool ParseProtocolsProperty(const xcb_get_property_reply_t* reply,
+                                     WindowProperties* props);
+
+  // Ignore EnterNotify events caused by the pointer ending up in a
+  // different window after the request that returned 'cookie' (e.g. when
+  // we map, unmap or restack a window).  Otherwise, changing desktops or
+  // rearranging windows would move the focus to whatever was under the
+  // pointer.
+  static void SuppressCrossingEvents(xcb_void_cookie_t cookie);
 
   void SelectInput(uint mask);
 
+  // Arrange for 'pending_configure_' to be sent, either now or (if we're
+  // in a request batch) when the batch ends.  'restacked' should be true
+  // if the window's stacking order was just changed.
+  void QueueConfigure(bool restacked);
+
+  // Update our cached parent and position after sending a ReparentWindow
+  // request with sequence number 'sequence'.  ConfigureNotify events from
+  // before the request are ignored afterwards, like ones from before a
+  // ConfigureWindow request.
+  void HandleReparentSent(XWindow* parent, int x, int y, uint32_t sequence);
+
+  // If this window has changes waiting to be sent, send them, along with
+  // those of every other window that was changed before it.  Used before
+  // requests that depend on the window's geometry, like mapping it.
+  void CommitQueuedConfigures();
+
   ::Window id_;
 
+  Role role_;
+  union {
+    Window* window;
+    Anchor* anchor;
+  } owner_;
+
+  // Create 'damage_' with report level 'level', replacing the existing
+  // damage object if there is one.  Does nothing in testing mode.
+  void CreateDamage(int level);
+
+  // Destroy 'damage_' if it exists.
+  void DestroyDamage();
+
   ::Damage damage_;
 
+  // Report level used for 'damage_'.
+  int damage_level_;
+
+  // Observers that want to hear about damage, along with the report
+  // levels that they asked for.
+  map<DamageObserver*, int> damage_observers_;
+
   uint input_mask_;
 
+  // Changes that haven't been sent to the server yet, and whether the
+  // XServer is holding onto our ID so that it can send them at the end of
+  // the current request batch.
+  PendingConfigure pending_configure_;
+  bool configure_queued_;
+
+  // Sequence number of the last ConfigureWindow or ReparentWindow request
+  // that we sent.  ConfigureNotify events from before then are stale.
+  uint32_t last_configure_sequence_;
+  bool sent_configure_;
+
   DISALLOW_EVIL_CONSTRUCTORS(XWindow);
 };
 
@@ -0,0 +1,156 @@
+// Copyright 2008 Daniel Erat <dan@erat.org>
+// All rights reserved.
+
+#include <cxxtest/TestSuite.h>
+
+#include "x-window.h"
+
+#include "mock-x-window.h"
+#include "x-server.h"
+
+using namespace wham;
+
+class XWindowTestSuite : public CxxTest::TestSuite {
+ public:
+  void testPendingConfigure() {
+    PendingConfigure configure;
+    TS_ASSERT(configure.empty());
+    uint32_t values[PendingConfigure::kMaxValues];
+
+    // Later changes should replace earlier ones.
+    configure.SetPosition(10, 20);
+    configure.SetSize(100, 200);
+    configure.SetPosition(30, 40);
+    TS_ASSERT_EQUALS(configure.mask(),
+                     XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+                     XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT);
+    TS_ASSERT(!configure.restacks());
+    TS_ASSERT_EQUALS(configure.GetValues(values), 4);
+    TS_ASSERT_EQUALS(values[0], 30U);
+    TS_ASSERT_EQUALS(values[1], 40U);
+    TS_ASSERT_EQUALS(values[2], 100U);
+    TS_ASSERT_EQUALS(values[3], 200U);
+
+    // The values should be in the order in which the protocol lists them,
+    // regardless of the order in which they were set.
+    configure.SetStacking(0x123, XCB_STACK_MODE_BELOW);
+    configure.SetBorderWidth(2);
+    TS_ASSERT(configure.restacks());
+    TS_ASSERT_EQUALS(configure.GetValues(values), 7);
+    TS_ASSERT_EQUALS(values[4], 2U);
+    TS_ASSERT_EQUALS(values[5], 0x123U);
+    TS_ASSERT_EQUALS(values[6], static_cast<uint32_t>(XCB_STACK_MODE_BELOW));
+
+    // Raising the window afterwards shouldn't leave the sibling behind.
+    configure.SetStacking(None, XCB_STACK_MODE_ABOVE);
+    TS_ASSERT(!(configure.mask() & XCB_CONFIG_WINDOW_SIBLING));
+    TS_ASSERT_EQUALS(configure.GetValues(values), 6);
+    TS_ASSERT_EQUALS(values[5], static_cast<uint32_t>(XCB_STACK_MODE_ABOVE));
+
+    configure.Clear();
+    TS_ASSERT(configure.empty());
+    TS_ASSERT_EQUALS(configure.GetValues(values), 0);
+  }
+
+  void testConfigureNotify() {
+    XServer::SetupTesting();
+    XWindow* xwin = XWindow::Create(10, 20, 30, 40);
+    TS_ASSERT_EQUALS(xwin->x(), 10);
+    TS_ASSERT_EQUALS(xwin->initial_width(), 30U);
+
+    // The cached geometry should follow the server's notifications.
+    xwin->HandleConfigureNotify(1, 2, 3, 4, 5);
+    TS_ASSERT_EQUALS(xwin->x(), 1);
+    TS_ASSERT_EQUALS(xwin->y(), 2);
+    TS_ASSERT_EQUALS(xwin->width(), 3U);
+    TS_ASSERT_EQUALS(xwin->height(), 4U);
+    TS_ASSERT_EQUALS(xwin->initial_width(), 30U);
+
+    // Notifications from before our last configure request, and fields
+    // that we've changed but haven't sent yet, should be ignored.
+    xwin->last_configure_sequence_ = 10;
+    xwin->sent_configure_ = true;
+    xwin->HandleConfigureNotify(7, 7, 7, 7, 9);
+    TS_ASSERT_EQUALS(xwin->x(), 1);
+    xwin->pending_configure_.SetSize(50, 60);
+    xwin->HandleConfigureNotify(8, 8, 8, 8, 10);
+    TS_ASSERT_EQUALS(xwin->x(), 8);
+    TS_ASSERT_EQUALS(xwin->y(), 8);
+    TS_ASSERT_EQUALS(xwin->width(), 3U);
+    TS_ASSERT_EQUALS(xwin->height(), 4U);
+    xwin->pending_configure_.Clear();
+  }
+
+  void testConfigureNotifyAfterReparent() {
+    XServer::SetupTesting();
+    XWindow* parent = XWindow::Create(0, 0, 100, 100);
+    XWindow* xwin = XWindow::Create(10, 20, 30, 40);
+
+    // A notification that was generated before we reparented the window
+    // has coordinates relative to the old parent and should be ignored.
+    xwin->HandleReparentSent(parent, 5, 6, 20);
+    xwin->HandleConfigureNotify(10, 20, 30, 40, 19);
+    TS_ASSERT_EQUALS(xwin->x(), 5);
+    TS_ASSERT_EQUALS(xwin->y(), 6);
+
+    // Later ones should still be used.
+    xwin->HandleConfigureNotify(7, 8, 30, 40, 20);
+    TS_ASSERT_EQUALS(xwin->x(), 7);
+    TS_ASSERT_EQUALS(xwin->y(), 8);
+  }
+
+  void testDamageObservers() {
+    XServer::SetupTesting();
+    XWindow* xwin = XWindow::Create(0, 0, 10, 10);
+    TestDamageObserver observer1, observer2;
+
+    xwin->AddDamageObserver(&observer1, XDamageReportNonEmpty);
+    TS_ASSERT_EQUALS(xwin->damage_level_, XDamageReportNonEmpty);
+    xwin->HandleDamage(None);
+    TS_ASSERT_EQUALS(observer1.num_calls, 1);
+
+    // The more detailed of the requested levels should be used.
+    xwin->AddDamageObserver(&observer2, XDamageReportBoundingBox);
+    TS_ASSERT_EQUALS(xwin->damage_level_, XDamageReportBoundingBox);
+    xwin->HandleDamage(None);
+    TS_ASSERT_EQUALS(observer1.num_calls, 2);
+    TS_ASSERT_EQUALS(observer2.num_calls, 1);
+
+    // Removed observers shouldn't hear about any more damage.
+    xwin->RemoveDamageObserver(&observer1);
+    xwin->HandleDamage(None);
+    TS_ASSERT_EQUALS(observer1.num_calls, 2);
+    TS_ASSERT_EQUALS(observer2.num_calls, 2);
+    xwin->RemoveDamageObserver(&observer2);
+    xwin->HandleDamage(None);
+    TS_ASSERT_EQUALS(observer2.num_calls, 2);
+  }
+
+  void testDamageLevelDowngrade() {
+    XServer::SetupTesting();
+    XWindow* xwin = XWindow::Create(0, 0, 10, 10);
+    TestDamageObserver observer1, observer2, observer3;
+    xwin->AddDamageObserver(&observer1, XDamageReportNonEmpty);
+    xwin->AddDamageObserver(&observer2, XDamageReportBoundingBox);
+    xwin->AddDamageObserver(&observer3, XDamageReportDeltaRectangles);
+    TS_ASSERT_EQUALS(xwin->damage_level_, XDamageReportDeltaRectangles);
+
+    // Once the observer that needed the most detailed level is gone, the
+    // next most detailed one should be used.
+    xwin->RemoveDamageObserver(&observer3);
+    TS_ASSERT_EQUALS(xwin->damage_level_, XDamageReportBoundingBox);
+    xwin->RemoveDamageObserver(&observer1);
+    TS_ASSERT_EQUALS(xwin->damage_level_, XDamageReportBoundingBox);
+    xwin->RemoveDamageObserver(&observer2);
+    xwin->HandleDamage(None);
+    TS_ASSERT_EQUALS(observer2.num_calls, 0);
+  }
+
+ private:
+  class TestDamageObserver : public DamageObserver {
+   public:
+    TestDamageObserver() : num_calls(0) {}
+    void HandleDamage(XWindow* xwin) { num_calls++; }
+    int num_calls;
+  };
+};